@@ -0,0 +1,805 @@
+#include "Aggregator.h"
+#include "DBsystem.h"
+#include "JsonLines.h"
+#include "RecordMapper.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const size_t BATCH = 256;           // Rows whose group ids are resolved together
+    const int MAX_PARTITION_BITS = 16;
+
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    const double INF = std::numeric_limits<double>::infinity();
+
+    // splitmix64 finalizer; a bijection, so distinct keys never share a hash
+    inline uint64_t mix64(uint64_t k)
+    {
+        k ^= k >> 30;
+        k *= 0xbf58476d1ce4e5b9ull;
+        k ^= k >> 27;
+        k *= 0x94d049bb133111ebull;
+        k ^= k >> 31;
+        return k;
+    }
+
+    struct Accumulator
+    {
+        long long count;    // Non-null values
+        double sum;
+        double sumsq;
+        double min;
+        double max;
+        double first;
+        double last;
+    };
+
+    const Accumulator EMPTY_ACCUMULATOR = {0, 0.0, 0.0, INF, -INF, NaN, NaN};
+
+    // Folds v[0..n) into acc, skipping NaN (null). Two doubles per step with
+    // SSE2; nulls are masked to 0 for the sums and to +/-inf for min/max.
+    void reduceRun(const double *v, size_t n, Accumulator &acc)
+    {
+        size_t i = 0;
+#ifdef __SSE2__
+        if (n >= 4)
+        {
+            const __m128d one = _mm_set1_pd(1.0);
+            const __m128d inf = _mm_set1_pd(INF);
+            const __m128d ninf = _mm_set1_pd(-INF);
+            __m128d sum = _mm_setzero_pd();
+            __m128d sumsq = _mm_setzero_pd();
+            __m128d count = _mm_setzero_pd();
+            __m128d lo = inf;
+            __m128d hi = ninf;
+            for (; i + 2 <= n; i += 2)
+            {
+                __m128d x = _mm_loadu_pd(v + i);
+                __m128d ok = _mm_cmpord_pd(x, x);
+                __m128d xz = _mm_and_pd(ok, x);
+                sum = _mm_add_pd(sum, xz);
+                sumsq = _mm_add_pd(sumsq, _mm_mul_pd(xz, xz));
+                count = _mm_add_pd(count, _mm_and_pd(ok, one));
+                lo = _mm_min_pd(lo, _mm_or_pd(xz, _mm_andnot_pd(ok, inf)));
+                hi = _mm_max_pd(hi, _mm_or_pd(xz, _mm_andnot_pd(ok, ninf)));
+            }
+            double s[2], q[2], c[2], l[2], h[2];
+            _mm_storeu_pd(s, sum);
+            _mm_storeu_pd(q, sumsq);
+            _mm_storeu_pd(c, count);
+            _mm_storeu_pd(l, lo);
+            _mm_storeu_pd(h, hi);
+            acc.sum += s[0] + s[1];
+            acc.sumsq += q[0] + q[1];
+            acc.count += (long long)(c[0] + c[1]);
+            acc.min = std::min(acc.min, std::min(l[0], l[1]));
+            acc.max = std::max(acc.max, std::max(h[0], h[1]));
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            double x = v[i];
+            if (x == x)
+            {
+                acc.sum += x;
+                acc.sumsq += x * x;
+                ++acc.count;
+                acc.min = std::min(acc.min, x);
+                acc.max = std::max(acc.max, x);
+            }
+        }
+    }
+
+    // Fixed-size open-addressing map from composite key to group number.
+    // Holds at most half its slots so probe runs stay short; a full table
+    // sends the caller to the partitioned path instead of growing.
+    class GroupTable
+    {
+    public:
+        explicit GroupTable(int bits)
+            : m_keys(size_t(1) << bits), m_groups(size_t(1) << bits, -1), m_mask((uint64_t(1) << bits) - 1),
+              m_limit(size_t(1) << (bits - 1)), m_size(0)
+        {
+        }
+
+        void reset()
+        {
+            std::fill(m_groups.begin(), m_groups.end(), -1);
+            m_size = 0;
+        }
+
+        size_t limit() const { return m_limit; }
+
+        // @return The key's group, @p next if it was added, -1 if full
+        int32_t find(uint64_t key, uint64_t hash, int32_t next)
+        {
+            for (uint64_t s = hash & m_mask;; s = (s + 1) & m_mask)
+            {
+                if (m_groups[s] < 0)
+                {
+                    if (m_size == m_limit)
+                    {
+                        return -1;
+                    }
+                    ++m_size;
+                    m_keys[s] = key;
+                    m_groups[s] = next;
+                    return next;
+                }
+                if (m_keys[s] == key)
+                {
+                    return m_groups[s];
+                }
+            }
+        }
+
+    private:
+        std::vector<uint64_t> m_keys;
+        std::vector<int32_t> m_groups;
+        uint64_t m_mask;
+        size_t m_limit;
+        size_t m_size;
+    };
+
+    struct AggState
+    {
+        const uint64_t *keys;                       // Composite group key per row
+        std::vector<AggFunction> functions;         // Per metric
+        std::vector<const double *> numbers;        // Per metric, numeric functions
+        std::vector<const uint32_t *> codes;        // Per metric, count_distinct
+
+        std::vector<uint64_t> groupKey;             // Per group
+        std::vector<uint32_t> firstRow;
+        std::vector<long long> groupRows;
+        std::vector<Accumulator> acc;               // group * metrics + metric
+        std::vector<std::vector<uint64_t> > distinct;   // Per metric: group << 32 | code
+    };
+
+    // Drops the groups (and distinct pairs) a failed aggregateRows added
+    void rollback(AggState &st, size_t groups, const std::vector<size_t> &distinct)
+    {
+        st.groupKey.resize(groups);
+        st.firstRow.resize(groups);
+        st.groupRows.resize(groups);
+        st.acc.resize(groups * st.functions.size());
+        for (size_t m = 0; m < distinct.size(); ++m)
+        {
+            st.distinct[m].resize(distinct[m]);
+        }
+    }
+
+    // Aggregates rows[0..n) (or begin..begin+n when rows is NULL) with an
+    // empty table. @return False if the table filled up
+    bool aggregateRows(AggState &st, GroupTable &table, const uint32_t *rows, size_t begin, size_t n)
+    {
+        size_t metrics = st.functions.size();
+        int32_t gid[BATCH];
+        uint32_t rowId[BATCH];
+        double vals[BATCH];
+
+        for (size_t at = 0; at < n; at += BATCH)
+        {
+            size_t count = std::min(BATCH, n - at);
+            for (size_t j = 0; j < count; ++j)
+            {
+                uint32_t r = rows ? rows[at + j] : uint32_t(begin + at + j);
+                uint64_t key = st.keys[r];
+                int32_t next = int32_t(st.groupKey.size());
+                int32_t g = table.find(key, mix64(key), next);
+                if (g < 0)
+                {
+                    return false;
+                }
+                if (g == next)
+                {
+                    st.groupKey.push_back(key);
+                    st.firstRow.push_back(r);
+                    st.groupRows.push_back(0);
+                    st.acc.insert(st.acc.end(), metrics, EMPTY_ACCUMULATOR);
+                }
+                ++st.groupRows[size_t(g)];
+                gid[j] = g;
+                rowId[j] = r;
+            }
+
+            for (size_t m = 0; m < metrics; ++m)
+            {
+                switch (st.functions[m])
+                {
+                case AGG_COUNT:
+                    break;
+                case AGG_COUNT_DISTINCT:
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        uint32_t code = st.codes[m][rowId[j]];
+                        if (code != AggTable::NULL_CODE)
+                        {
+                            st.distinct[m].push_back(uint64_t(gid[j]) << 32 | code);
+                        }
+                    }
+                    break;
+                case AGG_FIRST:
+                case AGG_LAST:
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        double x = st.numbers[m][rowId[j]];
+                        if (x == x)
+                        {
+                            Accumulator &a = st.acc[size_t(gid[j]) * metrics + m];
+                            if (a.count++ == 0)
+                            {
+                                a.first = x;
+                            }
+                            a.last = x;
+                        }
+                    }
+                    break;
+                default:
+                {
+                    // Gather, then fold each run of rows that share a group
+                    const double *column = st.numbers[m];
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        vals[j] = column[rowId[j]];
+                    }
+                    size_t j0 = 0;
+                    while (j0 < count)
+                    {
+                        size_t j1 = j0 + 1;
+                        while (j1 < count && gid[j1] == gid[j0])
+                        {
+                            ++j1;
+                        }
+                        reduceRun(vals + j0, j1 - j0, st.acc[size_t(gid[j0]) * metrics + m]);
+                        j0 = j1;
+                    }
+                    break;
+                }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Two-phase mode. Phase 1 scatters the rows into 2^bits partitions by
+    // the hash bits below the usedBits already spent (keeping row order);
+    // phase 2 aggregates each partition on its own. Every group lives in
+    // exactly one partition, so the results just concatenate. A partition
+    // that still overflows the table is split again.
+    void aggregatePartitioned(AggState &st, GroupTable &table, const uint32_t *rows, size_t n, int usedBits,
+                              int bits, int &partitions)
+    {
+        bits = std::min(bits, 64 - usedBits);
+        size_t parts = size_t(1) << bits;
+        int shift = 64 - usedBits - bits;
+        uint64_t mask = parts - 1;
+
+        std::vector<size_t> bounds(parts + 1, 0);
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint32_t r = rows ? rows[i] : uint32_t(i);
+            ++bounds[((mix64(st.keys[r]) >> shift) & mask) + 1];
+        }
+        for (size_t p = 0; p < parts; ++p)
+        {
+            bounds[p + 1] += bounds[p];
+        }
+        std::vector<size_t> cursor(bounds.begin(), bounds.end() - 1);
+        std::vector<uint32_t> scattered(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint32_t r = rows ? rows[i] : uint32_t(i);
+            scattered[cursor[(mix64(st.keys[r]) >> shift) & mask]++] = r;
+        }
+
+        std::vector<size_t> distinct(st.distinct.size());
+        for (size_t p = 0; p < parts; ++p)
+        {
+            size_t len = bounds[p + 1] - bounds[p];
+            if (len == 0)
+            {
+                continue;
+            }
+            size_t groups = st.groupKey.size();
+            for (size_t m = 0; m < distinct.size(); ++m)
+            {
+                distinct[m] = st.distinct[m].size();
+            }
+            table.reset();
+            if (aggregateRows(st, table, &scattered[bounds[p]], 0, len))
+            {
+                ++partitions;
+                continue;
+            }
+            rollback(st, groups, distinct);
+            aggregatePartitioned(st, table, &scattered[bounds[p]], len, usedBits + bits, 4, partitions);
+        }
+    }
+
+    bool metricFunction(const std::string &name, AggFunction &function)
+    {
+        static const char *names[] = {"count", "sum", "avg", "min", "max", "count_distinct", "first", "last", "std"};
+        for (int f = 0; f <= AGG_STD; ++f)
+        {
+            if (name == names[f])
+            {
+                function = AggFunction(f);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void appendNumber(std::string &out, double value)
+    {
+        char digits[32];
+        std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+        out.assign(digits, size_t(r.ptr - digits));
+    }
+
+    // A DBsystem record presented as named fields, for AggTable::appendRow
+    struct FieldSource
+    {
+        const char *names[8];
+        std::string values[8];
+        int count;
+
+        const std::string *find(const std::string &key) const
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (key == names[i])
+                {
+                    return &values[i];
+                }
+            }
+            return NULL;
+        }
+    };
+
+    struct StudentRows
+    {
+        AggTable &table;
+        FieldSource src;
+        void operator()(const Student &s)
+        {
+            appendNumber(src.values[0], s.getID());
+            src.values[1] = s.getName();
+            src.values[2] = s.getLevel();
+            src.values[3] = s.getMajor();
+            appendNumber(src.values[4], s.getGPA());
+            appendNumber(src.values[5], s.getAdvisor());
+            table.appendRow(src);
+        }
+    };
+
+    struct FacultyRows
+    {
+        AggTable &table;
+        FieldSource src;
+        void operator()(const Faculty &f)
+        {
+            appendNumber(src.values[0], f.getID());
+            src.values[1] = f.getName();
+            src.values[2] = f.getLevel();
+            src.values[3] = f.getDepartment();
+            appendNumber(src.values[4], f.getAdviseeCount());
+            table.appendRow(src);
+        }
+    };
+
+    struct CourseRows
+    {
+        AggTable &table;
+        FieldSource src;
+        void operator()(const Course &c)
+        {
+            appendNumber(src.values[0], c.getID());
+            src.values[1] = c.getCode();
+            src.values[2] = c.getTitle();
+            appendNumber(src.values[3], c.getCredits());
+            src.values[4] = c.getDepartment();
+            appendNumber(src.values[5], c.getInstructor());
+            table.appendRow(src);
+        }
+    };
+
+    struct EnrollmentRows
+    {
+        AggTable &table;
+        FieldSource src;
+        void operator()(const Enrollment &e)
+        {
+            appendNumber(src.values[0], e.getID());
+            appendNumber(src.values[1], e.getStudent());
+            appendNumber(src.values[2], e.getCourse());
+            src.values[3] = e.getStatus();
+            src.values[4] = e.getGrade();
+            if (e.getGrade().empty())
+                src.values[5].clear();          // grade_points is null until graded
+            else
+                appendNumber(src.values[5], e.getGradePoints());
+            table.appendRow(src);
+        }
+    };
+}
+
+// ---------------------------------------------------------------------------
+// Query parsing
+// ---------------------------------------------------------------------------
+
+bool parseAggMetric(const std::string &spec, AggMetric &metric)
+{
+    size_t eq = spec.find('=');
+    std::string call = eq == std::string::npos ? spec : spec.substr(eq + 1);
+    std::string function = call;
+    metric.column.clear();
+
+    size_t open = call.find('(');
+    if (open != std::string::npos)
+    {
+        if (call.size() < open + 2 || call[call.size() - 1] != ')')
+        {
+            return false;
+        }
+        function = call.substr(0, open);
+        metric.column = call.substr(open + 1, call.size() - open - 2);
+        if (metric.column == "*")
+        {
+            metric.column.clear();
+        }
+    }
+    if (!metricFunction(function, metric.function) || (metric.column.empty() && metric.function != AGG_COUNT))
+    {
+        return false;
+    }
+
+    if (eq != std::string::npos)
+        metric.name = spec.substr(0, eq);
+    else
+        metric.name = metric.column.empty() ? function : function + "_" + metric.column;
+    return !metric.name.empty();
+}
+
+bool parseHaving(const std::string &spec, HavingClause &clause)
+{
+    static const struct { const char *text; HavingOp op; } OPS[] = {
+        {">=", HAVING_GTE}, {"<=", HAVING_LTE}, {"!=", HAVING_NE}, {"==", HAVING_EQ},
+        {">", HAVING_GT}, {"<", HAVING_LT}, {"=", HAVING_EQ}};
+
+    for (size_t i = 0; i < sizeof(OPS) / sizeof(OPS[0]); ++i)
+    {
+        size_t at = spec.find(OPS[i].text);
+        if (at == std::string::npos || at == 0)
+        {
+            continue;
+        }
+        clause.metric = spec.substr(0, at);
+        clause.op = OPS[i].op;
+        return RecordMapper::parseDouble(spec.substr(at + std::char_traits<char>::length(OPS[i].text)), clause.value);
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// AggTable
+// ---------------------------------------------------------------------------
+
+const uint32_t AggTable::NULL_CODE;
+
+AggTable::AggTable(const AggQuery &query) : m_rows(0)
+{
+    for (size_t i = 0; i < query.groupBy.size(); ++i)
+    {
+        addColumn(query.groupBy[i], true, false);
+    }
+    for (size_t i = 0; i < query.metrics.size(); ++i)
+    {
+        const AggMetric &m = query.metrics[i];
+        if (m.function != AGG_COUNT)
+        {
+            addColumn(m.column, m.function == AGG_COUNT_DISTINCT, m.function != AGG_COUNT_DISTINCT);
+        }
+    }
+}
+
+void AggTable::addColumn(const std::string &name, bool coded, bool numeric)
+{
+    for (size_t c = 0; c < m_columns.size(); ++c)
+    {
+        if (m_columns[c].name == name)
+        {
+            m_columns[c].coded = m_columns[c].coded || coded;
+            m_columns[c].numeric = m_columns[c].numeric || numeric;
+            return;
+        }
+    }
+    m_columns.push_back(Column());
+    m_columns.back().name = name;
+    m_columns.back().coded = coded;
+    m_columns.back().numeric = numeric;
+}
+
+void AggTable::append(size_t c, const std::string *text)
+{
+    Column &col = m_columns[c];
+    if (col.numeric)
+    {
+        double value;
+        col.numbers.push_back(text != NULL && RecordMapper::parseDouble(*text, value) ? value : NaN);
+    }
+    if (col.coded)
+    {
+        if (text == NULL)
+        {
+            col.codes.push_back(NULL_CODE);
+            return;
+        }
+        std::unordered_map<std::string, uint32_t>::iterator it = col.index.find(*text);
+        if (it == col.index.end())
+        {
+            it = col.index.insert(std::make_pair(*text, uint32_t(col.dictionary.size()))).first;
+            col.dictionary.push_back(*text);
+        }
+        col.codes.push_back(it->second);
+    }
+}
+
+long long AggTable::loadJson(std::FILE *in)
+{
+    JsonLinesReader reader(in);
+    JsonObject obj;
+    long long added = 0;
+    while (reader.next(obj))
+    {
+        appendRow(obj);
+        ++added;
+    }
+    return added;
+}
+
+bool AggTable::loadTable(DBsystem &db, const std::string &table, std::string &error)
+{
+    if (table == "students")
+    {
+        StudentRows rows = {*this, FieldSource()};
+        rows.src.count = RecordMapper::STUDENT_FIELDS;
+        for (int f = 0; f < rows.src.count; ++f)
+            rows.src.names[f] = RecordMapper::studentFieldName(RecordMapper::StudentField(f));
+        db.forEachStudent(rows);
+    }
+    else if (table == "faculty")
+    {
+        FacultyRows rows = {*this, FieldSource()};
+        rows.src.count = RecordMapper::FACULTY_FIELDS;
+        for (int f = 0; f < rows.src.count; ++f)
+            rows.src.names[f] = RecordMapper::facultyFieldName(RecordMapper::FacultyField(f));
+        db.forEachFaculty(rows);
+    }
+    else if (table == "courses")
+    {
+        CourseRows rows = {*this, FieldSource()};
+        rows.src.count = RecordMapper::COURSE_FIELDS;
+        for (int f = 0; f < rows.src.count; ++f)
+            rows.src.names[f] = RecordMapper::courseFieldName(RecordMapper::CourseField(f));
+        db.forEachCourse(rows);
+    }
+    else if (table == "enrollments")
+    {
+        EnrollmentRows rows = {*this, FieldSource()};
+        rows.src.count = RecordMapper::ENROLLMENT_FIELDS;
+        for (int f = 0; f < rows.src.count; ++f)
+            rows.src.names[f] = RecordMapper::enrollmentFieldName(RecordMapper::EnrollmentField(f));
+        db.forEachEnrollment(rows);
+    }
+    else
+    {
+        error = "unknown table " + table;
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// aggregate
+// ---------------------------------------------------------------------------
+
+bool aggregate(const AggTable &table, const AggQuery &query, const AggOptions &options, AggResult &result,
+               AggStats *stats, std::string &error)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    size_t rows = table.m_rows;
+    size_t metrics = query.metrics.size();
+
+    std::vector<const AggTable::Column *> keyColumns;
+    AggState st;
+    for (size_t k = 0; k < query.groupBy.size(); ++k)
+    {
+        for (size_t c = 0; c < table.m_columns.size(); ++c)
+        {
+            if (table.m_columns[c].name == query.groupBy[k])
+                keyColumns.push_back(&table.m_columns[c]);
+        }
+    }
+    for (size_t m = 0; m < metrics; ++m)
+    {
+        const AggMetric &metric = query.metrics[m];
+        st.functions.push_back(metric.function);
+        st.numbers.push_back(NULL);
+        st.codes.push_back(NULL);
+        for (size_t c = 0; c < table.m_columns.size() && metric.function != AGG_COUNT; ++c)
+        {
+            const AggTable::Column &col = table.m_columns[c];
+            if (col.name == metric.column)
+            {
+                st.numbers[m] = col.numbers.empty() ? NULL : &col.numbers[0];
+                st.codes[m] = col.codes.empty() ? NULL : &col.codes[0];
+            }
+        }
+    }
+    st.distinct.resize(metrics);
+
+    std::vector<int> havingMetric;
+    for (size_t h = 0; h < query.having.size(); ++h)
+    {
+        int found = -1;
+        for (size_t m = 0; m < metrics; ++m)
+        {
+            if (query.metrics[m].name == query.having[h].metric)
+                found = int(m);
+        }
+        if (found < 0)
+        {
+            error = "HAVING names unknown metric " + query.having[h].metric;
+            return false;
+        }
+        havingMetric.push_back(found);
+    }
+
+    // Mixed-radix composite key over the dictionary codes; null takes the
+    // code one past the dictionary
+    std::vector<uint64_t> keys(rows, 0);
+    uint64_t radix = 1;
+    for (size_t k = 0; k < keyColumns.size(); ++k)
+    {
+        const AggTable::Column &col = *keyColumns[k];
+        uint64_t cardinality = col.dictionary.size() + 1;
+        for (size_t r = 0; r < rows; ++r)
+        {
+            uint64_t code = col.codes[r] == AggTable::NULL_CODE ? col.dictionary.size() : col.codes[r];
+            keys[r] += code * radix;
+        }
+        if (radix > std::numeric_limits<uint64_t>::max() / cardinality)
+        {
+            error = "too many group key combinations";
+            return false;
+        }
+        radix *= cardinality;
+    }
+    st.keys = keys.empty() ? NULL : &keys[0];
+
+    // One pass with the fixed-size table; fall back to two phases if the
+    // keys outnumber it
+    int partitions = 1;
+    GroupTable groups(std::max(options.tableBits, 4));
+    if (!aggregateRows(st, groups, NULL, 0, rows))
+    {
+        rollback(st, 0, std::vector<size_t>(metrics, 0));
+        int bits = 1;
+        while ((rows >> bits) > groups.limit() / 2 && bits < MAX_PARTITION_BITS)
+        {
+            ++bits;
+        }
+        partitions = 0;
+        aggregatePartitioned(st, groups, NULL, rows, 0, bits, partitions);
+    }
+    size_t groupCount = st.groupKey.size();
+
+    // count_distinct: sort the (group, code) pairs and count runs
+    std::vector<double> values(groupCount * metrics, NaN);
+    for (size_t m = 0; m < metrics; ++m)
+    {
+        if (st.functions[m] != AGG_COUNT_DISTINCT)
+        {
+            continue;
+        }
+        std::vector<uint64_t> &pairs = st.distinct[m];
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+        for (size_t g = 0; g < groupCount; ++g)
+        {
+            values[g * metrics + m] = 0.0;
+        }
+        for (size_t i = 0; i < pairs.size(); ++i)
+        {
+            values[size_t(pairs[i] >> 32) * metrics + m] += 1.0;
+        }
+    }
+
+    for (size_t g = 0; g < groupCount; ++g)
+    {
+        for (size_t m = 0; m < metrics; ++m)
+        {
+            const Accumulator &a = st.acc[g * metrics + m];
+            double &v = values[g * metrics + m];
+            switch (st.functions[m])
+            {
+            case AGG_COUNT: v = double(st.groupRows[g]); break;
+            case AGG_SUM: v = a.sum; break;
+            case AGG_AVG: v = a.count > 0 ? a.sum / a.count : NaN; break;
+            case AGG_MIN: v = a.count > 0 ? a.min : NaN; break;
+            case AGG_MAX: v = a.count > 0 ? a.max : NaN; break;
+            case AGG_FIRST: v = a.first; break;
+            case AGG_LAST: v = a.last; break;
+            case AGG_STD:
+                v = a.count > 1 ? std::sqrt(std::max(0.0, (a.sumsq - a.sum * a.sum / a.count) / (a.count - 1)))
+                                : NaN;
+                break;
+            case AGG_COUNT_DISTINCT: break;
+            }
+        }
+    }
+
+    // First-seen order, as the Python dict of groups iterates
+    std::vector<uint32_t> order(groupCount);
+    for (size_t g = 0; g < groupCount; ++g)
+    {
+        order[g] = uint32_t(g);
+    }
+    std::sort(order.begin(), order.end(),
+              [&st](uint32_t a, uint32_t b) { return st.firstRow[a] < st.firstRow[b]; });
+
+    result = AggResult();
+    result.keyNames = query.groupBy;
+    for (size_t m = 0; m < metrics; ++m)
+    {
+        result.metricNames.push_back(query.metrics[m].name);
+    }
+    for (size_t i = 0; i < groupCount; ++i)
+    {
+        size_t g = order[i];
+        bool keep = true;
+        for (size_t h = 0; h < havingMetric.size() && keep; ++h)
+        {
+            double v = values[g * metrics + size_t(havingMetric[h])];
+            double t = query.having[h].value;
+            switch (query.having[h].op)
+            {
+            case HAVING_GT: keep = v > t; break;
+            case HAVING_LT: keep = v < t; break;
+            case HAVING_GTE: keep = v >= t; break;
+            case HAVING_LTE: keep = v <= t; break;
+            case HAVING_EQ: keep = v == t; break;
+            case HAVING_NE: keep = v == v && v != t; break;
+            }
+        }
+        if (!keep)
+        {
+            continue;
+        }
+        uint32_t row = st.firstRow[g];
+        for (size_t k = 0; k < keyColumns.size(); ++k)
+        {
+            uint32_t code = keyColumns[k]->codes[row];
+            result.keys.push_back(code == AggTable::NULL_CODE ? std::string() : keyColumns[k]->dictionary[code]);
+        }
+        result.values.insert(result.values.end(), values.begin() + g * metrics, values.begin() + (g + 1) * metrics);
+    }
+
+    if (stats != NULL)
+    {
+        stats->rows = (long long)rows;
+        stats->groups = (long long)groupCount;
+        stats->partitions = partitions;
+        stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return true;
+}
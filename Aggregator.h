@@ -0,0 +1,189 @@
+/**
+ * @file Aggregator.h
+ * @brief Group-by aggregation (sum/avg/count/min/max/...) with HAVING filters.
+ *
+ * ARCHITECTURE:
+ *   JSON file (data_engineering/data/raw/...) or a DBsystem table
+ *       |  only the referenced fields are kept, one column each:
+ *       |  numbers as doubles (NaN = null), group keys dictionary-coded
+ *       v
+ *   AggTable - column store, one composite 64-bit key per row
+ *       |
+ *       v
+ *   aggregate (You are here)
+ *       |  batches of 256 rows: look up group ids in a fixed-size
+ *       |  open-addressing table, then reduce runs of equal ids with SSE2
+ *       |  table full (high-cardinality keys): two-phase mode -
+ *       |    1. scatter row ids into partitions by key hash
+ *       |    2. aggregate each partition with the same fixed-size table
+ *       v
+ *   AggResult - one row per group in first-seen order, HAVING applied
+ *
+ * Semantics follow DataAggregator.aggregate in analytics/aggregations.py:
+ * count counts the group's rows, the other functions skip nulls, avg and
+ * std of no values are null, std is the sample standard deviation.
+ * min/max/first/last work on numeric fields; count_distinct on any field.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class DBsystem;
+
+enum AggFunction
+{
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_AVG,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_COUNT_DISTINCT,
+    AGG_FIRST,
+    AGG_LAST,
+    AGG_STD
+};
+
+/** @brief One output metric: function applied to a field. */
+struct AggMetric
+{
+    std::string name;
+    AggFunction function;
+    std::string column;     ///< Empty for count
+};
+
+enum HavingOp
+{
+    HAVING_GT,
+    HAVING_LT,
+    HAVING_GTE,
+    HAVING_LTE,
+    HAVING_EQ,
+    HAVING_NE
+};
+
+/** @brief Post-aggregation filter on a metric; groups where it is null fail. */
+struct HavingClause
+{
+    std::string metric;
+    HavingOp op;
+    double value;
+};
+
+/** @brief GROUP BY columns, metrics and HAVING filters of one aggregation. */
+struct AggQuery
+{
+    std::vector<std::string> groupBy;   ///< Empty: one group for the whole input
+    std::vector<AggMetric> metrics;
+    std::vector<HavingClause> having;
+};
+
+/** @brief Parse "avg_gpa=avg(gpa)", "avg(gpa)" (named avg_gpa) or "n=count". */
+bool parseAggMetric(const std::string &spec, AggMetric &metric);
+
+/** @brief Parse "avg_gpa>=3.5"; operators > < >= <= = == !=. */
+bool parseHaving(const std::string &spec, HavingClause &clause);
+
+/** @brief Tuning for aggregate. */
+struct AggOptions
+{
+    int tableBits;          ///< Group table has 2^tableBits slots and holds half as many groups
+
+    AggOptions() : tableBits(12) {}
+};
+
+/** @brief How an aggregation ran. */
+struct AggStats
+{
+    long long rows;
+    long long groups;       ///< Before HAVING
+    int partitions;         ///< 1 unless the two-phase mode ran
+    double seconds;
+
+    AggStats() : rows(0), groups(0), partitions(0), seconds(0.0) {}
+};
+
+/** @brief Query output: group-by values, then metric values, per row. */
+struct AggResult
+{
+    std::vector<std::string> keyNames;
+    std::vector<std::string> metricNames;
+    std::vector<std::string> keys;      ///< rows() x keyNames.size(); null keys are empty
+    std::vector<double> values;         ///< rows() x metricNames.size(); NaN is null
+
+    size_t rows() const { return metricNames.empty() ? 0 : values.size() / metricNames.size(); }
+};
+
+/**
+ * @class AggTable
+ * @brief Columns of the fields a query references.
+ */
+class AggTable
+{
+public:
+    static const uint32_t NULL_CODE = 0xFFFFFFFFu;
+
+    /** @brief Set up the columns @p query reads. */
+    explicit AggTable(const AggQuery &query);
+
+    /** @brief Append every object of a JSON Lines stream or JSON array. @return Rows added. */
+    long long loadJson(std::FILE *in);
+
+    /**
+     * @brief Append a DBsystem table: "students", "faculty", "courses" or
+     *        "enrollments", with the field names of RecordMapper.
+     */
+    bool loadTable(DBsystem &db, const std::string &table, std::string &error);
+
+    /** @brief Append one row from anything with `const std::string *find(const std::string &)`. */
+    template <typename Source>
+    void appendRow(const Source &src)
+    {
+        for (size_t c = 0; c < m_columns.size(); ++c)
+        {
+            append(c, src.find(m_columns[c].name));
+        }
+        ++m_rows;
+    }
+
+    size_t rows() const { return m_rows; }
+
+private:
+    friend bool aggregate(const AggTable &table, const AggQuery &query, const AggOptions &options,
+                          AggResult &result, AggStats *stats, std::string &error);
+
+    struct Column
+    {
+        std::string name;
+        bool coded;                             ///< Group key or count_distinct input
+        bool numeric;                           ///< Read by sum/avg/min/max/first/last/std
+        std::vector<double> numbers;            ///< numeric only; NaN when null or not a number
+        std::vector<uint32_t> codes;            ///< coded only; NULL_CODE when null
+        std::vector<std::string> dictionary;    ///< code -> text
+        std::unordered_map<std::string, uint32_t> index;
+    };
+
+    std::vector<Column> m_columns;
+    size_t m_rows;
+
+    void addColumn(const std::string &name, bool coded, bool numeric);
+    void append(size_t c, const std::string *text);
+};
+
+/**
+ * @brief Run @p query over @p table.
+ * @param error Set when the query names an unknown metric in HAVING or the
+ *        group keys have too many combinations to pack into 64 bits.
+ */
+bool aggregate(const AggTable &table, const AggQuery &query, const AggOptions &options, AggResult &result,
+               AggStats *stats, std::string &error);
+
+#endif
@@ -0,0 +1,67 @@
+#include "AsyncDB.h"
+#include "Transaction.h"
+#include "WriteAheadLog.h"
+
+AsyncDB::AsyncDB(DBsystem &db, CoScheduler &scheduler) : m_db(db), m_scheduler(scheduler)
+{
+
+}
+
+CoTask<std::optional<Student> > AsyncDB::findStudent(int studentId)
+{
+    const Student *s = m_db.findStudent(studentId);
+    co_return s != NULL ? std::optional<Student>(*s) : std::nullopt;
+}
+
+CoTask<std::optional<Faculty> > AsyncDB::findFaculty(int facultyId)
+{
+    const Faculty *f = m_db.findFaculty(facultyId);
+    co_return f != NULL ? std::optional<Faculty>(*f) : std::nullopt;
+}
+
+CoTask<bool> AsyncDB::upsertStudent(Student student)
+{
+    return logged([this, student] { return m_db.upsertStudent(student); });
+}
+
+CoTask<bool> AsyncDB::upsertFaculty(Faculty faculty)
+{
+    return logged([this, faculty] { return m_db.upsertFaculty(faculty); });
+}
+
+CoTask<bool> AsyncDB::deleteStudent(int studentId)
+{
+    return logged([this, studentId] {
+        if (m_db.findStudent(studentId) == NULL)
+            return false;
+        m_db.deleteStudent(studentId);
+        return true;
+    });
+}
+
+CoTask<bool> AsyncDB::deleteFaculty(int facultyId)
+{
+    return logged([this, facultyId] {
+        if (m_db.findFaculty(facultyId) == NULL)
+            return false;
+        m_db.deleteFaculty(facultyId);
+        return true;
+    });
+}
+
+CoTask<bool> AsyncDB::commit(Transaction &txn, std::string &error)
+{
+    return logged([this, &txn, &error] { return m_db.commit(txn, error); }, &error);
+}
+
+CoTask<DBsnapshot> AsyncDB::snapshot()
+{
+    DBsystem *db = &m_db;
+    co_return co_await m_scheduler.offload([db] { return db->snapshot(); });
+}
+
+CoTask<bool> AsyncDB::flush()
+{
+    WriteAheadLog *log = m_db.log();
+    co_return co_await m_scheduler.durable(log, log != NULL ? log->appendedLsn() : 0);
+}
@@ -0,0 +1,174 @@
+/**
+ * @file AsyncDB.h
+ * @brief DBsystem operations as C++20 coroutines: co_await a lookup, a
+ *        write, a scan, a snapshot or a log flush without holding a thread.
+ *
+ * ARCHITECTURE:
+ *   request coroutines (thousands in flight on one thread)
+ *       |  co_await adb.findStudent(id) / adb.upsertStudent(s) / ...
+ *       v
+ *   AsyncDB (You are here)
+ *       |  in-memory work runs inline; waits are suspensions on the
+ *       |  CoScheduler instead of blocked threads
+ *       v
+ *   DBsystem + CoScheduler
+ *
+ * WHERE THE TIME GOES:
+ * - Lookups are in-memory tree walks and complete without suspending.
+ *   Results are copies, so they stay valid across later suspensions.
+ * - Writes apply at once (in call order, as the synchronous API would)
+ *   and then suspend until their log record is durable. With a write-ahead
+ *   log every coroutine waiting in the meantime rides the same group
+ *   commit, so throughput grows with requests in flight, not threads.
+ * - snapshot() runs on a helper thread; the first one after many writes
+ *   rebuilds the persistent versions and can take a while.
+ * - Scans walk a snapshot in chunks, yielding between chunks so other
+ *   requests keep running; they see the table as of the scan's start.
+ *
+ * All calls must come from coroutines run by the scheduler's thread, which
+ * then is the only thread writing to the DBsystem (helpers only read it
+ * under its write lock).
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef ASYNC_DB_H
+#define ASYNC_DB_H
+
+#include <climits>
+#include <optional>
+#include <string>
+#include "Coroutine.h"
+#include "DBsystem.h"
+
+class Transaction;
+
+class AsyncDB
+{
+public:
+    AsyncDB(DBsystem &db, CoScheduler &scheduler);
+
+    DBsystem &db() { return m_db; }
+    CoScheduler &scheduler() { return m_scheduler; }
+
+    CoTask<std::optional<Student> > findStudent(int studentId);
+    CoTask<std::optional<Faculty> > findFaculty(int facultyId);
+
+    /**
+     * @brief Insert or replace; resumes once durable.
+     * @return True if the key was new and the write is durable (false if
+     *         the log failed: see DBsystem::logFailed).
+     */
+    CoTask<bool> upsertStudent(Student student);
+    CoTask<bool> upsertFaculty(Faculty faculty);
+
+    /** @brief Resumes once durable. @return True if the record existed and the delete is durable. */
+    CoTask<bool> deleteStudent(int studentId);
+    CoTask<bool> deleteFaculty(int facultyId);
+
+    /**
+     * @brief DBsystem::commit, resuming once the commit is durable; fails
+     *        with @p error if the log fails first. @p txn and @p error must
+     *        outlive the await.
+     */
+    CoTask<bool> commit(Transaction &txn, std::string &error);
+
+    /** @brief DBsystem::snapshot, built on a helper thread. */
+    CoTask<DBsnapshot> snapshot();
+
+    /** @brief Resumes once everything logged so far is durable. @return False if the log failed. */
+    CoTask<bool> flush();
+
+    /**
+     * @brief Visit students with @p lo <= id < @p hi in id order, as of the
+     *        start of the scan. @p visit must outlive the await.
+     * @return Records visited.
+     */
+    template <typename Visitor>
+    CoTask<long long> scanStudents(int lo, int hi, Visitor &visit);
+
+    template <typename Visitor>
+    CoTask<long long> scanFaculty(int lo, int hi, Visitor &visit);
+
+    /** @brief Records a scan visits between yields. */
+    static const long long SCAN_CHUNK = 256;
+
+private:
+    DBsystem &m_db;
+    CoScheduler &m_scheduler;
+
+    // Runs write() at once without waiting for the log, then suspends
+    // until what it logged is durable. False if either fails; a log
+    // failure is described in *error when one is given.
+    template <typename Write>
+    CoTask<bool> logged(Write write, std::string *error = NULL);
+
+    template <typename T, typename Visitor>
+    CoTask<long long> scan(const PersistentBST<T> DBsnapshot::*table, T lo, T hi, int hiId, Visitor &visit);
+
+    AsyncDB(const AsyncDB &);
+    AsyncDB &operator=(const AsyncDB &);
+};
+
+template <typename Write>
+CoTask<bool> AsyncDB::logged(Write write, std::string *error)
+{
+    m_db.beginBulk();
+    bool result = write();
+    uint64_t lsn = m_db.takeBulkLsn();
+    m_db.endBulk();
+    bool durable = co_await m_scheduler.durable(m_db.log(), lsn);
+    if (result && !durable && error != NULL)
+    {
+        *error = "the log has a write error; the commit is applied but not durable";
+    }
+    co_return result && durable;
+}
+
+template <typename Visitor>
+CoTask<long long> AsyncDB::scanStudents(int lo, int hi, Visitor &visit)
+{
+    return scan(&DBsnapshot::students, Student(lo, "", "", "", 0.0, 0), Student(hi, "", "", "", 0.0, 0), hi, visit);
+}
+
+template <typename Visitor>
+CoTask<long long> AsyncDB::scanFaculty(int lo, int hi, Visitor &visit)
+{
+    return scan(&DBsnapshot::faculty, Faculty(lo, "", "", ""), Faculty(hi, "", "", ""), hi, visit);
+}
+
+// Each chunk resumes just past the last id visited
+template <typename T, typename Visitor>
+CoTask<long long> AsyncDB::scan(const PersistentBST<T> DBsnapshot::*table, T lo, T hi, int hiId, Visitor &visit)
+{
+    struct Chunk
+    {
+        Visitor &visit;
+        int last;
+
+        void operator()(const T &record)
+        {
+            visit(record);
+            last = record.getID();
+        }
+    };
+
+    DBsnapshot view = co_await snapshot();
+    const PersistentBST<T> &tree = view.*table;
+    Chunk chunk = {visit, 0};
+    long long total = 0;
+    for (;;)
+    {
+        long long n = tree.visitRange(&lo, &hi, chunk, SCAN_CHUNK);
+        total += n;
+        if (n < SCAN_CHUNK || chunk.last == INT_MAX || chunk.last + 1 >= hiId)
+        {
+            co_return total;
+        }
+        lo.setID(chunk.last + 1);
+        co_await m_scheduler.yield();
+    }
+}
+
+#endif
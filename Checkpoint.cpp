@@ -0,0 +1,515 @@
+#include "Checkpoint.h"
+#include "DBsystem.h"
+#include "OutputBuffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MANIFEST_NAME[] = "MANIFEST";
+static const char MANIFEST_MAGIC[] = "udb-manifest";
+static const int MANIFEST_VERSION = 1;
+
+namespace
+{
+    bool syncDir(const std::string &dir)
+    {
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+
+    // Write, fsync and rename into place so readers see all or nothing
+    bool writeFileAtomic(const std::string &dir, const std::string &path, const std::string &data,
+                         std::string &error)
+    {
+        std::string tmpPath = path + ".tmp";
+        int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            error = "cannot create " + tmpPath + ": " + std::strerror(errno);
+            return false;
+        }
+        bool ok;
+        {
+            OutputBuffer out(fd);
+            out.append(data);
+            ok = out.sync();
+        }
+        ok = (::close(fd) == 0) && ok;
+        ok = ok && std::rename(tmpPath.c_str(), path.c_str()) == 0;
+        ok = ok && syncDir(dir);
+        if (!ok)
+        {
+            error = "write to " + path + " failed: " + std::strerror(errno);
+            ::unlink(tmpPath.c_str());
+        }
+        return ok;
+    }
+
+    // "wal-000012.log" -> 12 when prefix and suffix match
+    bool parseSeq(const std::string &name, const char *prefix, const char *suffix, uint64_t &seq)
+    {
+        size_t p = std::strlen(prefix);
+        size_t s = std::strlen(suffix);
+        if (name.size() <= p + s || name.compare(0, p, prefix) != 0 ||
+            name.compare(name.size() - s, s, suffix) != 0)
+        {
+            return false;
+        }
+        seq = 0;
+        for (size_t i = p; i < name.size() - s; ++i)
+        {
+            if (name[i] < '0' || name[i] > '9')
+            {
+                return false;
+            }
+            seq = seq * 10 + uint64_t(name[i] - '0');
+        }
+        return true;
+    }
+
+    std::vector<std::string> listDir(const std::string &dir)
+    {
+        std::vector<std::string> names;
+        DIR *d = ::opendir(dir.c_str());
+        if (d == NULL)
+        {
+            return names;
+        }
+        while (struct dirent *e = ::readdir(d))
+        {
+            names.push_back(e->d_name);
+        }
+        ::closedir(d);
+        return names;
+    }
+
+    uint64_t fileSize(const std::string &path)
+    {
+        struct stat st;
+        return ::stat(path.c_str(), &st) == 0 ? uint64_t(st.st_size) : 0;
+    }
+}
+
+Checkpointer::Checkpointer(DBsystem &db)
+    : m_db(db), m_baseBytes(0), m_logSeq(1), m_nextSeq(1), m_stop(false) {}
+
+Checkpointer::~Checkpointer()
+{
+    close();
+}
+
+std::string Checkpointer::path(const std::string &name) const
+{
+    return m_dir + "/" + name;
+}
+
+std::string Checkpointer::fileName(const char *prefix, uint64_t seq, const char *suffix) const
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%06llu", (unsigned long long)seq);
+    return std::string(prefix) + buf + suffix;
+}
+
+std::string Checkpointer::lastError()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_lastError;
+}
+
+// ---------------------------------------------------------------------------
+// Manifest
+// ---------------------------------------------------------------------------
+
+bool Checkpointer::readManifest(std::string &error)
+{
+    std::ifstream in(path(MANIFEST_NAME).c_str());
+    if (!in)
+    {
+        return true; // fresh directory
+    }
+    std::string magic;
+    int version = 0;
+    in >> magic >> version;
+    if (magic != MANIFEST_MAGIC || version != MANIFEST_VERSION)
+    {
+        error = "unrecognized manifest in " + m_dir;
+        return false;
+    }
+    std::string key;
+    while (in >> key)
+    {
+        if (key == "next")
+        {
+            in >> m_nextSeq;
+        }
+        else if (key == "log")
+        {
+            in >> m_logSeq;
+        }
+        else if (key == "base")
+        {
+            in >> m_base >> m_baseBytes;
+        }
+        else if (key == "delta")
+        {
+            DeltaFile d;
+            in >> d.name >> d.bytes;
+            m_deltas.push_back(d);
+        }
+        else
+        {
+            error = "bad manifest entry '" + key + "' in " + m_dir;
+            return false;
+        }
+        if (!in)
+        {
+            error = "truncated manifest in " + m_dir;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Checkpointer::writeManifest(std::string &error)
+{
+    std::ostringstream out;
+    out << MANIFEST_MAGIC << " " << MANIFEST_VERSION << "\n";
+    out << "next " << m_nextSeq << "\n";
+    out << "log " << m_logSeq << "\n";
+    if (!m_base.empty())
+    {
+        out << "base " << m_base << " " << m_baseBytes << "\n";
+    }
+    for (size_t i = 0; i < m_deltas.size(); ++i)
+    {
+        out << "delta " << m_deltas[i].name << " " << m_deltas[i].bytes << "\n";
+    }
+    return writeFileAtomic(m_dir, path(MANIFEST_NAME), out.str(), error);
+}
+
+bool Checkpointer::writeDelta(const std::string &name, const std::string &records, std::string &error)
+{
+    return writeFileAtomic(m_dir, path(name), records, error);
+}
+
+// Deletes files no longer reachable from the manifest: covered log
+// segments, folded deltas, replaced bases and leftovers of a crash
+void Checkpointer::removeObsolete()
+{
+    std::vector<std::string> names = listDir(m_dir);
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        const std::string &name = names[i];
+        uint64_t seq;
+        bool obsolete = false;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+        {
+            obsolete = true;
+        }
+        else if (parseSeq(name, "wal-", ".log", seq))
+        {
+            obsolete = seq < m_logSeq;
+        }
+        else if (parseSeq(name, "delta-", ".udd", seq))
+        {
+            obsolete = true;
+            for (size_t d = 0; d < m_deltas.size(); ++d)
+            {
+                obsolete = obsolete && m_deltas[d].name != name;
+            }
+        }
+        else if (parseSeq(name, "base-", ".udb", seq))
+        {
+            obsolete = name != m_base; // a mapping of it stays valid after unlink
+        }
+        if (obsolete)
+        {
+            ::unlink(path(name).c_str());
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Recovery
+// ---------------------------------------------------------------------------
+
+bool Checkpointer::open(const std::string &dir, const CheckpointPolicy &policy, std::string &error,
+                        RecoveryStats *stats)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    close();
+    m_dir = dir;
+    m_policy = policy;
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        error = "cannot create " + dir + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!readManifest(error))
+    {
+        return false;
+    }
+
+    RecoveryStats result;
+    m_db.clear();
+    if (!m_base.empty())
+    {
+        if (!m_db.open(path(m_base), error))
+        {
+            return false;
+        }
+        result.base = true;
+    }
+    for (size_t i = 0; i < m_deltas.size(); ++i)
+    {
+        ReplayStats replayed;
+        if (!WriteAheadLog::replay(path(m_deltas[i].name), m_db, replayed, error))
+        {
+            return false;
+        }
+        if (uint64_t(replayed.bytes) != m_deltas[i].bytes || replayed.truncatedBytes != 0)
+        {
+            error = "checkpoint delta " + m_deltas[i].name + " is damaged";
+            return false;
+        }
+        ++result.deltas;
+        result.deltaRecords += replayed.records;
+    }
+    // Everything so far is already in the checkpoint
+    m_db.markClean();
+
+    std::vector<uint64_t> segments;
+    std::vector<std::string> names = listDir(dir);
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        uint64_t seq;
+        if (parseSeq(names[i], "wal-", ".log", seq) || parseSeq(names[i], "delta-", ".udd", seq) ||
+            parseSeq(names[i], "base-", ".udb", seq))
+        {
+            m_nextSeq = std::max(m_nextSeq, seq + 1);
+            if (names[i][0] == 'w' && seq >= m_logSeq)
+            {
+                segments.push_back(seq);
+            }
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+
+    // The last segment is replayed by attachLog and then appended to
+    std::string current = segments.empty() ? fileName("wal-", m_nextSeq++, ".log")
+                                           : fileName("wal-", segments.back(), ".log");
+    for (size_t i = 0; i + 1 < segments.size(); ++i)
+    {
+        ReplayStats replayed;
+        if (!WriteAheadLog::replay(path(fileName("wal-", segments[i], ".log")), m_db, replayed, error))
+        {
+            return false;
+        }
+        ++result.segments;
+        result.logRecords += replayed.records;
+        result.truncatedBytes += replayed.truncatedBytes;
+    }
+    ReplayStats replayed;
+    if (!m_db.attachLog(path(current), policy.sync, error, &replayed, policy.windowMicros))
+    {
+        return false;
+    }
+    result.segments += segments.empty() ? 0 : 1;
+    result.logRecords += replayed.records;
+    result.truncatedBytes += replayed.truncatedBytes;
+
+    removeObsolete();
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (stats != NULL)
+    {
+        *stats = result;
+    }
+
+    m_stop = false;
+    m_lastError.clear();
+    m_thread = std::thread(&Checkpointer::run, this);
+    return true;
+}
+
+void Checkpointer::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Checkpoint and compaction
+// ---------------------------------------------------------------------------
+
+bool Checkpointer::checkpoint(std::string &error)
+{
+    std::lock_guard<std::mutex> run(m_runMutex);
+
+    // Retried records came from segments that are still listed, so the log
+    // must move on even if nothing changed since: otherwise recovery would
+    // replay those segments on top of the delta that holds their effects
+    std::string records = m_retry;
+    uint64_t logSeq = m_nextSeq;
+    bool rotated = false;
+    if (!m_db.captureChanges(path(fileName("wal-", logSeq, ".log")), !m_retry.empty(), records, rotated, error))
+    {
+        return false;
+    }
+    if (rotated)
+    {
+        ++m_nextSeq;
+    }
+    if (!rotated && records.empty())
+    {
+        return true; // nothing changed
+    }
+
+    uint64_t oldLogSeq = m_logSeq;
+    if (!records.empty())
+    {
+        DeltaFile delta;
+        delta.name = fileName("delta-", m_nextSeq++, ".udd");
+        delta.bytes = records.size();
+        if (!writeDelta(delta.name, records, error))
+        {
+            // The log segments stay until a later checkpoint writes these records
+            m_retry.swap(records);
+            return false;
+        }
+        m_deltas.push_back(delta);
+    }
+    if (rotated)
+    {
+        m_logSeq = logSeq;
+    }
+    if (!writeManifest(error))
+    {
+        if (!records.empty())
+        {
+            m_deltas.pop_back();
+        }
+        m_logSeq = oldLogSeq;
+        m_retry.swap(records);
+        return false;
+    }
+    m_retry.clear();
+    removeObsolete();
+
+    uint64_t deltaBytes = 0;
+    for (size_t i = 0; i < m_deltas.size(); ++i)
+    {
+        deltaBytes += m_deltas[i].bytes;
+    }
+    if (int(m_deltas.size()) >= m_policy.maxDeltas || (deltaBytes > (1 << 20) && deltaBytes > m_baseBytes / 2))
+    {
+        return compactLocked(error);
+    }
+    return true;
+}
+
+bool Checkpointer::compact(std::string &error)
+{
+    std::lock_guard<std::mutex> run(m_runMutex);
+    return compactLocked(error);
+}
+
+// Rebuilds base + deltas from the files alone, so the live trees are not
+// touched; memory use is that of loading the base fully once.
+bool Checkpointer::compactLocked(std::string &error)
+{
+    if (m_deltas.empty())
+    {
+        return true;
+    }
+    std::string name = fileName("base-", m_nextSeq++, ".udb");
+    {
+        DBsystem image;
+        if (!m_base.empty() && !image.open(path(m_base), error))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < m_deltas.size(); ++i)
+        {
+            ReplayStats replayed;
+            if (!WriteAheadLog::replay(path(m_deltas[i].name), image, replayed, error))
+            {
+                return false;
+            }
+        }
+        if (!image.save(path(name), error))
+        {
+            return false;
+        }
+    }
+    syncDir(m_dir);
+
+    std::string oldBase = m_base;
+    uint64_t oldBaseBytes = m_baseBytes;
+    std::vector<DeltaFile> oldDeltas;
+    oldDeltas.swap(m_deltas);
+    m_base = name;
+    m_baseBytes = fileSize(path(name));
+    if (!writeManifest(error))
+    {
+        m_base = oldBase;
+        m_baseBytes = oldBaseBytes;
+        m_deltas.swap(oldDeltas);
+        ::unlink(path(name).c_str());
+        return false;
+    }
+    removeObsolete();
+    return true;
+}
+
+// Checkpoints once the log segment is large enough, or after the interval
+// if anything was logged; failures are kept for lastError() and retried
+void Checkpointer::run()
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point last = Clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        m_cv.wait_for(lock, std::chrono::milliseconds(100));
+        WriteAheadLog *log = m_db.log();
+        if (m_stop || log == NULL)
+        {
+            continue;
+        }
+        uint64_t bytes = log->segmentBytes();
+        int elapsed = int(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - last).count());
+        if (bytes < m_policy.logBytes && (bytes == 0 || elapsed < m_policy.intervalMillis))
+        {
+            continue;
+        }
+        lock.unlock();
+        std::string error;
+        bool ok = checkpoint(error);
+        lock.lock();
+        m_lastError = ok ? std::string() : error;
+        last = Clock::now();
+    }
+}
@@ -0,0 +1,141 @@
+/**
+ * @file Checkpoint.h
+ * @brief Incremental checkpoints that keep DBsystem recovery time bounded.
+ *
+ * ARCHITECTURE:
+ *   DBsystem mutations --> WriteAheadLog segment (wal-N.log)
+ *       |  dirty marks in TreeNode, tombstones for deletes
+ *       v
+ *   Checkpointer (You are here) - background thread
+ *       |  1. under the write lock: drain changed records, rotate the log
+ *       |  2. unlocked: write them as delta-M.udd, publish in MANIFEST
+ *       |  3. delete log segments the delta now covers
+ *       |  4. now and then: fold base + deltas into a new base-K.udb
+ *       v
+ *   data directory:  MANIFEST, base-K.udb, delta-*.udd, wal-*.log
+ *
+ * RECOVERY:
+ *   map the base snapshot (records load lazily), apply the deltas listed
+ *   in MANIFEST, then replay the log segments from the manifest's segment
+ *   on. A checkpoint starts once the current segment reaches logBytes, and
+ *   deltas are folded into the base once they outgrow half of it, so
+ *   replay work depends on the checkpoint settings, not on uptime.
+ *
+ * Writers wait while the changed records are copied out and the log is
+ * switched to a new segment. Lookups wait for the copy too once a base is
+ * mapped, since they then take the tree lock to fault records in; without
+ * a base they never wait.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "WriteAheadLog.h"
+
+class DBsystem;
+
+/** @brief What recovery found and how long it took. */
+struct RecoveryStats
+{
+    bool base;                  ///< A base snapshot was mapped
+    int deltas;                 ///< Delta files applied
+    long long deltaRecords;
+    int segments;               ///< Log segments replayed
+    long long logRecords;
+    long long truncatedBytes;   ///< Torn log tail dropped
+    double seconds;
+
+    RecoveryStats() : base(false), deltas(0), deltaRecords(0), segments(0), logRecords(0),
+                      truncatedBytes(0), seconds(0.0) {}
+};
+
+/** @brief When the background thread checkpoints. */
+struct CheckpointPolicy
+{
+    uint64_t logBytes;          ///< Checkpoint once the log segment reaches this size
+    int intervalMillis;         ///< ... or this long after the last one, if anything changed
+    int maxDeltas;              ///< Fold into a new base after this many deltas
+    SyncPolicy sync;
+    int windowMicros;
+
+    CheckpointPolicy() : logBytes(16 << 20), intervalMillis(30000), maxDeltas(8), sync(SYNC_GROUP),
+                         windowMicros(1000) {}
+};
+
+class Checkpointer
+{
+public:
+    explicit Checkpointer(DBsystem &db);
+    ~Checkpointer();
+
+    /**
+     * @brief Recover @p db from @p dir (created if missing), attach a log
+     *        segment and start checkpointing in the background.
+     */
+    bool open(const std::string &dir, const CheckpointPolicy &policy, std::string &error,
+              RecoveryStats *stats = NULL);
+
+    /** @brief Stop the background thread. The log stays attached. */
+    void close();
+
+    /** @brief Checkpoint now. Serialized with the background thread. */
+    bool checkpoint(std::string &error);
+
+    /** @brief Fold base + deltas into a new base now. */
+    bool compact(std::string &error);
+
+    const std::string &dir() const { return m_dir; }
+
+    /** @brief Last background failure, empty if none. */
+    std::string lastError();
+
+private:
+    struct DeltaFile
+    {
+        std::string name;
+        uint64_t bytes;
+    };
+
+    DBsystem &m_db;
+    std::string m_dir;
+    CheckpointPolicy m_policy;
+
+    // MANIFEST contents
+    std::string m_base;                 ///< Base snapshot file name, empty if none
+    uint64_t m_baseBytes;
+    std::vector<DeltaFile> m_deltas;
+    uint64_t m_logSeq;                  ///< First log segment not covered by a checkpoint
+    uint64_t m_nextSeq;                 ///< Next file sequence number
+
+    std::string m_retry;                ///< Records of a delta that failed to write
+
+    std::mutex m_runMutex;              ///< One checkpoint or compaction at a time
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop;
+    std::string m_lastError;
+    std::thread m_thread;
+
+    std::string path(const std::string &name) const;
+    std::string fileName(const char *prefix, uint64_t seq, const char *suffix) const;
+    bool readManifest(std::string &error);
+    bool writeManifest(std::string &error);
+    bool writeDelta(const std::string &name, const std::string &records, std::string &error);
+    bool compactLocked(std::string &error);
+    void removeObsolete();
+    void run();
+
+    Checkpointer(const Checkpointer &);
+    Checkpointer &operator=(const Checkpointer &);
+};
+
+#endif
@@ -0,0 +1,534 @@
+/**
+ * @file ConcurrentBST.h
+ * @brief Binary search tree for many concurrent readers and writers, with
+ *        optimistic lock coupling (OLC).
+ *
+ * ARCHITECTURE:
+ *   reader / writer threads (lookup services, ingest, benchmarks)
+ *       |
+ *       v
+ *   ConcurrentBST (You are here) - LazyBST's unbalanced tree, with a
+ *       |  version word per node instead of one lock for the tree
+ *       v
+ *   Node { version, left, right, data } - data never changes once the
+ *       |  node is linked in
+ *       v
+ *   EpochManager - unlinked nodes are retired, freed once no operation
+ *       that could have reached them is still running
+ *
+ * VERSION WORD:
+ *   bit 0 obsolete (unlinked), bit 1 locked, bits 2.. change counter.
+ *   Readers never write shared memory: they note a node's version, read
+ *   its key and child pointer, and check the version again before
+ *   moving on; a change means a writer got there first, so the lookup
+ *   restarts from the root. Writers descend the same way and then lock
+ *   only the nodes they modify, by a CAS from the version they read (so a
+ *   lock also validates), top down. They never wait for a lock while
+ *   holding one: a failed CAS releases everything and restarts.
+ *
+ *   insert  - locks the parent of the new leaf
+ *   update  - locks parent and node, links in a copy of the node with the
+ *             new data, marks the old one obsolete
+ *   remove  - one child or none: locks parent and node, links the child up
+ *             two children: also locks the successor and its parent,
+ *             replaces the node with a copy holding the successor's data
+ *             and unlinks the successor
+ *
+ * MOVED KEYS: a two-child remove moves the successor's key up, out of the
+ * way of any descent that already went past the removed node. Such a
+ * descent could miss the key, or link a new leaf on the wrong side of it,
+ * so those removes count themselves in m_moves while they hold their
+ * locks. A descent that ends without the key checks the count it started
+ * with, and an insert checks it again once it holds the leaf's parent;
+ * if it changed they start over.
+ *
+ * Since data is never written in place, a reader that copies it out of a
+ * node reads a consistent value whatever writers do meanwhile, and keys
+ * are compared without a second pointer hop. Every operation runs inside
+ * an EpochGuard, so a node unlinked while a reader is on it is freed only
+ * after that reader is done (EpochManager.h). A visitInOrder holds its
+ * guard for the whole scan and delays reclamation that long.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef CONCURRENT_BST_H
+#define CONCURRENT_BST_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "EpochManager.h"
+
+/**
+ * @class ConcurrentBST
+ * @brief Ordered set of T keyed by operator<, safe for any mix of threads.
+ * @tparam T Copyable; ordered by operator<.
+ */
+template <typename T>
+class ConcurrentBST
+{
+public:
+    ConcurrentBST();
+    ~ConcurrentBST();
+
+    /** @brief Insert, or replace the element with an equal key. @return True if new. */
+    bool upsert(const T &d);
+
+    /** @brief Insert unless an equal key is present. @return True if inserted. */
+    bool insert(const T &d);
+
+    /** @return True if an element with this key was removed. */
+    bool remove(const T &key);
+
+    /** @brief Copy the element equal to @p key into @p out. @return False if absent. */
+    bool find(const T &key, T &out) const;
+
+    bool contains(const T &key) const;
+
+    long long size() const { return m_size.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Visit elements in sorted order. Each element present for the
+     *        whole visit is seen once; concurrent changes may or may not be.
+     */
+    template <typename Visitor>
+    void visitInOrder(Visitor &visit) const;
+
+    /** @brief Free this thread's retired nodes that no reader can reach any more. */
+    void reclaim();
+
+    /** @brief Remove everything. Only while no other thread uses the tree. */
+    void clear();
+
+private:
+    struct Node
+    {
+        std::atomic<uint64_t> version;
+        std::atomic<Node *> left;
+        std::atomic<Node *> right;
+        const T data;
+
+        Node() : version(0), left(NULL), right(NULL), data() {}
+        Node(const T &d, Node *l, Node *r) : version(0), left(l), right(r), data(d) {}
+    };
+
+    static const uint64_t OBSOLETE = 1;
+    static const uint64_t LOCKED = 2;
+
+    Node m_head;                            ///< Sentinel; its left child is the root
+    std::atomic<long long> m_size;
+    std::atomic<uint64_t> m_moves;          ///< Two-child removes so far (see MOVED KEYS)
+    mutable EpochManager m_epochs;
+
+    static bool readLock(const Node *n, uint64_t &version);
+    static bool validate(const Node *n, uint64_t version);
+    static bool upgrade(Node *n, uint64_t version);
+    static void unlock(Node *n);
+    static void unlockObsolete(Node *n);
+    static void restore(Node *n, uint64_t version);
+
+    bool descend(const T &key, Node *&parent, uint64_t &parentVersion, Node *&node, uint64_t &nodeVersion,
+                 bool &left, uint64_t &moves) const;
+    bool write(const T &d, bool replace);
+    void freeAll(Node *n);
+
+    ConcurrentBST(const ConcurrentBST &);
+    ConcurrentBST &operator=(const ConcurrentBST &);
+};
+
+template <typename T>
+ConcurrentBST<T>::ConcurrentBST() : m_size(0), m_moves(0)
+{
+
+}
+
+template <typename T>
+ConcurrentBST<T>::~ConcurrentBST()
+{
+    clear();
+}
+
+// ---------------------------------------------------------------------------
+// Version word
+// ---------------------------------------------------------------------------
+
+// Waits out a writer; false if the node has been unlinked
+template <typename T>
+bool ConcurrentBST<T>::readLock(const Node *n, uint64_t &version)
+{
+    version = n->version.load(std::memory_order_acquire);
+    while (version & LOCKED)
+    {
+        std::this_thread::yield();
+        version = n->version.load(std::memory_order_acquire);
+    }
+    return (version & OBSOLETE) == 0;
+}
+
+template <typename T>
+bool ConcurrentBST<T>::validate(const Node *n, uint64_t version)
+{
+    return n->version.load(std::memory_order_acquire) == version;
+}
+
+template <typename T>
+bool ConcurrentBST<T>::upgrade(Node *n, uint64_t version)
+{
+    return n->version.compare_exchange_strong(version, version + LOCKED, std::memory_order_acq_rel);
+}
+
+// +LOCKED again clears the lock bit and carries into the counter
+template <typename T>
+void ConcurrentBST<T>::unlock(Node *n)
+{
+    n->version.fetch_add(LOCKED, std::memory_order_release);
+}
+
+template <typename T>
+void ConcurrentBST<T>::unlockObsolete(Node *n)
+{
+    n->version.fetch_add(LOCKED + OBSOLETE, std::memory_order_release);
+}
+
+// Release a lock taken for a change that was abandoned
+template <typename T>
+void ConcurrentBST<T>::restore(Node *n, uint64_t version)
+{
+    n->version.store(version, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// Operations
+// ---------------------------------------------------------------------------
+
+// Optimistic descent to key. Ends at the node holding it or, with node
+// NULL, at the parent whose left or right slot it would fill. Either way
+// parent was checked after its child pointer was read. False when a
+// version changed underfoot, or a key moved up while the key was not
+// found: start again. moves is the count the descent started with.
+template <typename T>
+bool ConcurrentBST<T>::descend(const T &key, Node *&parent, uint64_t &parentVersion, Node *&node,
+                               uint64_t &nodeVersion, bool &left, uint64_t &moves) const
+{
+    moves = m_moves.load(std::memory_order_acquire);
+    parent = const_cast<Node *>(&m_head);
+    if (!readLock(parent, parentVersion))
+    {
+        return false;
+    }
+    node = parent->left.load(std::memory_order_acquire);
+    left = true;
+    if (!validate(parent, parentVersion))
+    {
+        return false;
+    }
+    while (node != NULL)
+    {
+        if (!readLock(node, nodeVersion))
+        {
+            return false;
+        }
+        bool goLeft = key < node->data;
+        if (!goLeft && !(node->data < key))
+        {
+            return true;
+        }
+        Node *child = (goLeft ? node->left : node->right).load(std::memory_order_acquire);
+        if (!validate(node, nodeVersion))
+        {
+            return false;
+        }
+        parent = node;
+        parentVersion = nodeVersion;
+        left = goLeft;
+        node = child;
+    }
+    return m_moves.load(std::memory_order_acquire) == moves;
+}
+
+template <typename T>
+bool ConcurrentBST<T>::find(const T &key, T &out) const
+{
+    Node *parent;
+    Node *node;
+    uint64_t parentVersion;
+    uint64_t nodeVersion;
+    uint64_t moves;
+    bool left;
+    EpochGuard guard(m_epochs);
+    while (!descend(key, parent, parentVersion, node, nodeVersion, left, moves))
+    {
+    }
+    if (node == NULL)
+    {
+        return false;
+    }
+    out = node->data;
+    return true;
+}
+
+template <typename T>
+bool ConcurrentBST<T>::contains(const T &key) const
+{
+    Node *parent;
+    Node *node;
+    uint64_t parentVersion;
+    uint64_t nodeVersion;
+    uint64_t moves;
+    bool left;
+    EpochGuard guard(m_epochs);
+    while (!descend(key, parent, parentVersion, node, nodeVersion, left, moves))
+    {
+    }
+    return node != NULL;
+}
+
+template <typename T>
+bool ConcurrentBST<T>::upsert(const T &d)
+{
+    return write(d, true);
+}
+
+template <typename T>
+bool ConcurrentBST<T>::insert(const T &d)
+{
+    return write(d, false);
+}
+
+template <typename T>
+bool ConcurrentBST<T>::write(const T &d, bool replace)
+{
+    Node *fresh = new Node(d, NULL, NULL);
+    EpochGuard guard(m_epochs);
+    while (true)
+    {
+        Node *parent;
+        Node *node;
+        uint64_t parentVersion;
+        uint64_t nodeVersion;
+        uint64_t moves;
+        bool left;
+        if (!descend(d, parent, parentVersion, node, nodeVersion, left, moves))
+        {
+            continue;
+        }
+        if (node != NULL && !replace)
+        {
+            delete fresh;
+            return false;
+        }
+        if (!upgrade(parent, parentVersion))
+        {
+            continue;
+        }
+        if (node == NULL)
+        {
+            if (m_moves.load(std::memory_order_acquire) != moves)
+            {
+                restore(parent, parentVersion);
+                continue;
+            }
+            (left ? parent->left : parent->right).store(fresh, std::memory_order_release);
+            unlock(parent);
+            m_size.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (!upgrade(node, nodeVersion))
+        {
+            restore(parent, parentVersion);
+            continue;
+        }
+        // Children only change under their parent's lock, so these are stable
+        fresh->left.store(node->left.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        fresh->right.store(node->right.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        (left ? parent->left : parent->right).store(fresh, std::memory_order_release);
+        unlockObsolete(node);
+        unlock(parent);
+        m_epochs.retire(node);
+        return false;
+    }
+}
+
+template <typename T>
+bool ConcurrentBST<T>::remove(const T &key)
+{
+    EpochGuard guard(m_epochs);
+    while (true)
+    {
+        Node *parent;
+        Node *node;
+        uint64_t parentVersion;
+        uint64_t nodeVersion;
+        uint64_t moves;
+        bool left;
+        if (!descend(key, parent, parentVersion, node, nodeVersion, left, moves))
+        {
+            continue;
+        }
+        if (node == NULL)
+        {
+            return false;
+        }
+        if (!upgrade(parent, parentVersion))
+        {
+            continue;
+        }
+        if (!upgrade(node, nodeVersion))
+        {
+            restore(parent, parentVersion);
+            continue;
+        }
+        Node *l = node->left.load(std::memory_order_relaxed);
+        Node *r = node->right.load(std::memory_order_relaxed);
+        std::atomic<Node *> &slot = left ? parent->left : parent->right;
+        if (l == NULL || r == NULL)
+        {
+            slot.store(l != NULL ? l : r, std::memory_order_release);
+            unlockObsolete(node);
+            unlock(parent);
+            m_epochs.retire(node);
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Two children: find the successor, then lock it and its parent
+        Node *successorParent = node;
+        uint64_t successorParentVersion = 0;
+        Node *successor = r;
+        uint64_t successorVersion;
+        bool ok = readLock(successor, successorVersion);
+        while (ok)
+        {
+            Node *next = successor->left.load(std::memory_order_acquire);
+            if (!validate(successor, successorVersion))
+            {
+                ok = false;
+            }
+            else if (next == NULL)
+            {
+                break;
+            }
+            else
+            {
+                successorParent = successor;
+                successorParentVersion = successorVersion;
+                successor = next;
+                ok = readLock(successor, successorVersion);
+            }
+        }
+        if (ok && successorParent != node && !upgrade(successorParent, successorParentVersion))
+        {
+            ok = false;
+        }
+        if (ok && !upgrade(successor, successorVersion))
+        {
+            if (successorParent != node)
+            {
+                restore(successorParent, successorParentVersion);
+            }
+            ok = false;
+        }
+        if (!ok)
+        {
+            restore(node, nodeVersion);
+            restore(parent, parentVersion);
+            continue;
+        }
+
+        // Counted before any lock is released, so a descent that sees the
+        // change through one of them sees the count too
+        m_moves.fetch_add(1, std::memory_order_release);
+        Node *successorRight = successor->right.load(std::memory_order_relaxed);
+        Node *fresh;
+        if (successorParent == node)
+        {
+            fresh = new Node(successor->data, l, successorRight);
+        }
+        else
+        {
+            fresh = new Node(successor->data, l, r);
+            successorParent->left.store(successorRight, std::memory_order_release);
+        }
+        slot.store(fresh, std::memory_order_release);
+        unlockObsolete(successor);
+        if (successorParent != node)
+        {
+            unlock(successorParent);
+        }
+        unlockObsolete(node);
+        unlock(parent);
+        m_epochs.retire(successor);
+        m_epochs.retire(node);
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+}
+
+// Explicit stack: the tree is unbalanced and may be deep
+template <typename T>
+template <typename Visitor>
+void ConcurrentBST<T>::visitInOrder(Visitor &visit) const
+{
+    EpochGuard guard(m_epochs);
+    std::vector<const Node *> stack;
+    const Node *n = m_head.left.load(std::memory_order_acquire);
+    while (n != NULL || !stack.empty())
+    {
+        while (n != NULL)
+        {
+            stack.push_back(n);
+            n = n->left.load(std::memory_order_acquire);
+        }
+        n = stack.back();
+        stack.pop_back();
+        visit(n->data);
+        n = n->right.load(std::memory_order_acquire);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Retired memory
+// ---------------------------------------------------------------------------
+
+template <typename T>
+void ConcurrentBST<T>::reclaim()
+{
+    m_epochs.collect();
+}
+
+template <typename T>
+void ConcurrentBST<T>::freeAll(Node *n)
+{
+    std::vector<Node *> stack;
+    if (n != NULL)
+    {
+        stack.push_back(n);
+    }
+    while (!stack.empty())
+    {
+        n = stack.back();
+        stack.pop_back();
+        if (Node *l = n->left.load(std::memory_order_relaxed))
+        {
+            stack.push_back(l);
+        }
+        if (Node *r = n->right.load(std::memory_order_relaxed))
+        {
+            stack.push_back(r);
+        }
+        delete n;
+    }
+}
+
+template <typename T>
+void ConcurrentBST<T>::clear()
+{
+    freeAll(m_head.left.exchange(NULL, std::memory_order_acq_rel));
+    m_size.store(0, std::memory_order_relaxed);
+    m_epochs.drain();
+}
+
+#endif
@@ -0,0 +1,215 @@
+#include "Coroutine.h"
+#include "WriteAheadLog.h"
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// A spawned task's owner: starts it from the ready queue and frees itself
+// (and with it the task) once the task finishes
+struct CoScheduler::Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object()
+        {
+            Detached d;
+            d.handle = std::coroutine_handle<promise_type>::from_promise(*this);
+            return d;
+        }
+        std::suspend_always initial_suspend() const noexcept { return std::suspend_always(); }
+        std::suspend_never final_suspend() const noexcept { return std::suspend_never(); }
+        void return_void() const {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+CoScheduler::Detached CoScheduler::detach(CoScheduler *scheduler, CoTask<void> task)
+{
+    co_await task;
+    --scheduler->m_live;
+}
+
+CoScheduler::CoScheduler(int helpers, int core)
+    : m_live(0), m_core(core), m_log(NULL), m_logWaitActive(false), m_stop(false)
+{
+    for (int i = 0; i < std::max(1, helpers); ++i)
+    {
+        m_helpers.push_back(std::thread(&CoScheduler::helperLoop, this));
+    }
+}
+
+CoScheduler::~CoScheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_jobMutex);
+        m_stop = true;
+    }
+    m_jobCv.notify_all();
+    for (size_t i = 0; i < m_helpers.size(); ++i)
+    {
+        m_helpers[i].join();
+    }
+}
+
+void CoScheduler::spawn(CoTask<void> task)
+{
+    ++m_live;
+    m_ready.push_back(detach(this, std::move(task)).handle);
+}
+
+void CoScheduler::run()
+{
+#ifdef __linux__
+    if (m_core >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_core % int(std::max(1u, std::thread::hardware_concurrency())), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
+    std::vector<std::coroutine_handle<> > posted;
+    std::vector<std::function<void()> > calls;
+    while (m_live > 0)
+    {
+        // One pass over what is ready now; coroutines readied meanwhile
+        // wait for the next pass, after the helpers' completions are in
+        for (size_t n = m_ready.size(); n > 0 && !m_ready.empty(); --n)
+        {
+            std::coroutine_handle<> h = m_ready.front();
+            m_ready.pop_front();
+            h.resume();
+        }
+        if (m_live == 0)
+        {
+            break;
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_postMutex);
+            if (m_ready.empty())
+            {
+                while (m_posted.empty() && m_postedCalls.empty())
+                {
+                    m_postCv.wait(lock);
+                }
+            }
+            posted.swap(m_posted);
+            calls.swap(m_postedCalls);
+        }
+        m_ready.insert(m_ready.end(), posted.begin(), posted.end());
+        posted.clear();
+        for (size_t i = 0; i < calls.size(); ++i)
+        {
+            calls[i]();
+        }
+        calls.clear();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+
+void CoScheduler::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_jobMutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobCv.notify_one();
+}
+
+void CoScheduler::post(std::coroutine_handle<> h)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_postMutex);
+        m_posted.push_back(h);
+    }
+    m_postCv.notify_one();
+}
+
+void CoScheduler::postCall(std::function<void()> call)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_postMutex);
+        m_postedCalls.push_back(std::move(call));
+    }
+    m_postCv.notify_one();
+}
+
+void CoScheduler::helperLoop()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_jobMutex);
+            while (m_jobs.empty() && !m_stop)
+            {
+                m_jobCv.wait(lock);
+            }
+            if (m_jobs.empty())
+            {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        job();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Log waits
+// ---------------------------------------------------------------------------
+
+bool CoScheduler::DurableAwaiter::await_ready() const
+{
+    return log == NULL || lsn == 0 || log->policy() == SYNC_ASYNC || log->durableLsn() >= lsn;
+}
+
+bool CoScheduler::DurableAwaiter::await_resume() const
+{
+    return log == NULL || lsn == 0 || log->durableLsn() >= lsn || !log->failed();
+}
+
+void CoScheduler::waitDurable(WriteAheadLog *log, uint64_t lsn, std::coroutine_handle<> h)
+{
+    m_log = log;
+    m_durableWaiters.insert(std::make_pair(lsn, h));
+    if (!m_logWaitActive)
+    {
+        startLogWait();
+    }
+}
+
+// One helper blocks for the newest LSN anyone waits on; group commit makes
+// the older ones durable in the same flush
+void CoScheduler::startLogWait()
+{
+    m_logWaitActive = true;
+    WriteAheadLog *log = m_log;
+    uint64_t target = m_durableWaiters.rbegin()->first;
+    submit([this, log, target] {
+        log->waitDurable(target);
+        postCall([this, target] {
+            m_logWaitActive = false;
+            // Past an I/O error waitDurable gives up; the waiters resume
+            // and find the failure in await_resume
+            std::multimap<uint64_t, std::coroutine_handle<> >::iterator end = m_durableWaiters.upper_bound(target);
+            for (std::multimap<uint64_t, std::coroutine_handle<> >::iterator it = m_durableWaiters.begin(); it != end; ++it)
+            {
+                m_ready.push_back(it->second);
+            }
+            m_durableWaiters.erase(m_durableWaiters.begin(), end);
+            if (!m_durableWaiters.empty())
+            {
+                startLogWait();
+            }
+        });
+    });
+}
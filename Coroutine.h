@@ -0,0 +1,288 @@
+/**
+ * @file Coroutine.h
+ * @brief C++20 coroutine tasks and a single-threaded scheduler that
+ *        resumes them, so one thread keeps thousands of requests in flight.
+ *
+ * ARCHITECTURE:
+ *   caller coroutines: co_await adb.upsertStudent(s) ...
+ *       |
+ *       v
+ *   AsyncDB - DBsystem calls as CoTasks
+ *       |
+ *       v
+ *   CoScheduler (You are here)
+ *       |  ready queue of suspended coroutines, run on the thread that
+ *       |  calls run(); blocking work goes to helper threads (offload) and
+ *       |  log waits are shared by every coroutine waiting (durable)
+ *       v
+ *   helper threads - WriteAheadLog::waitDurable, snapshot builds, ...
+ *
+ * TASKS: CoTask<T> is the return type of a coroutine producing T. It
+ * starts when first awaited and resumes its awaiter directly when it
+ * finishes (symmetric transfer), so a chain of co_awaits that never blocks
+ * costs no trip through the scheduler. Top-level tasks are handed to
+ * spawn() and run to completion inside run().
+ *
+ * PER CORE: a CoScheduler and everything it resumes belong to one thread.
+ * To use several cores, give each core its own scheduler (and its own
+ * DBsystem or shard, as ShardedDBsystem does with threads); the scheduler
+ * can pin its thread. Only offloaded work runs elsewhere.
+ *
+ * Exceptions are not used in this code base: a coroutine that throws
+ * terminates the program.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class WriteAheadLog;
+
+template <typename T>
+class CoTask;
+
+namespace detail
+{
+    // Resumes whoever awaited the finished task, or returns to the resumer
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+        {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    struct PromiseBase
+    {
+        std::coroutine_handle<> continuation;
+
+        std::suspend_always initial_suspend() const noexcept { return std::suspend_always(); }
+        FinalAwaiter final_suspend() const noexcept { return FinalAwaiter(); }
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+    template <typename T>
+    struct CoPromise : PromiseBase
+    {
+        std::optional<T> value;
+
+        CoTask<T> get_return_object();
+        void return_value(T v) { value.emplace(std::move(v)); }
+    };
+
+    template <>
+    struct CoPromise<void> : PromiseBase
+    {
+        CoTask<void> get_return_object();
+        void return_void() const {}
+    };
+}
+
+/**
+ * @class CoTask
+ * @brief A lazily started coroutine producing T; co_await it once.
+ */
+template <typename T>
+class CoTask
+{
+public:
+    typedef detail::CoPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    CoTask() : m_handle() {}
+    explicit CoTask(Handle h) : m_handle(h) {}
+    CoTask(CoTask &&other) noexcept : m_handle(std::exchange(other.m_handle, Handle())) {}
+    CoTask &operator=(CoTask &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, Handle());
+        }
+        return *this;
+    }
+    ~CoTask()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+    {
+        m_handle.promise().continuation = awaiter;
+        return m_handle;
+    }
+
+    T await_resume()
+    {
+        if constexpr (!std::is_void_v<T>)
+            return std::move(*m_handle.promise().value);
+    }
+
+private:
+    Handle m_handle;
+
+    CoTask(const CoTask &);
+    CoTask &operator=(const CoTask &);
+};
+
+template <typename T>
+CoTask<T> detail::CoPromise<T>::get_return_object()
+{
+    return CoTask<T>(std::coroutine_handle<CoPromise<T> >::from_promise(*this));
+}
+
+inline CoTask<void> detail::CoPromise<void>::get_return_object()
+{
+    return CoTask<void>(std::coroutine_handle<CoPromise<void> >::from_promise(*this));
+}
+
+/**
+ * @class CoScheduler
+ * @brief Runs spawned coroutines on the calling thread; see file comment.
+ */
+class CoScheduler
+{
+public:
+    /**
+     * @param helpers Threads for offloaded blocking work (at least 1).
+     * @param core Pin the run() thread to this CPU, or -1 to leave it.
+     */
+    explicit CoScheduler(int helpers = 2, int core = -1);
+    ~CoScheduler();
+
+    /** @brief Start @p task at the next run(); the scheduler owns it until it finishes. */
+    void spawn(CoTask<void> task);
+
+    /** @brief Resume coroutines until every spawned task has finished. */
+    void run();
+
+    /** @brief Spawned tasks not yet finished. */
+    long long live() const { return m_live; }
+
+    /** @brief co_await: let every other ready coroutine run first. */
+    struct YieldAwaiter
+    {
+        CoScheduler *scheduler;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { scheduler->m_ready.push_back(h); }
+        void await_resume() const noexcept {}
+    };
+    YieldAwaiter yield() { return YieldAwaiter{this}; }
+
+    /**
+     * @brief co_await: run @p fn on a helper thread; this coroutine resumes
+     *        here with its result while the others keep running.
+     */
+    template <typename F>
+    struct OffloadAwaiter
+    {
+        typedef std::invoke_result_t<F &> Result;
+
+        CoScheduler *scheduler;
+        F fn;
+        std::conditional_t<std::is_void_v<Result>, char, std::optional<Result> > result;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            scheduler->submit([this, h] {
+                if constexpr (std::is_void_v<Result>)
+                    fn();
+                else
+                    result.emplace(fn());
+                scheduler->post(h);
+            });
+        }
+
+        Result await_resume()
+        {
+            if constexpr (!std::is_void_v<Result>)
+                return std::move(*result);
+        }
+    };
+    template <typename F>
+    OffloadAwaiter<F> offload(F fn) { return OffloadAwaiter<F>{this, std::move(fn), {}}; }
+
+    /**
+     * @brief co_await: resume once @p lsn of @p log is durable under its
+     *        policy (at once if it already is, or if @p log is NULL). All
+     *        coroutines waiting on one scheduler share one log wait. Yields
+     *        false if the log failed instead (WriteAheadLog::failed).
+     */
+    struct DurableAwaiter
+    {
+        CoScheduler *scheduler;
+        WriteAheadLog *log;
+        uint64_t lsn;
+
+        bool await_ready() const;
+        void await_suspend(std::coroutine_handle<> h) { scheduler->waitDurable(log, lsn, h); }
+        bool await_resume() const;
+    };
+    DurableAwaiter durable(WriteAheadLog *log, uint64_t lsn) { return DurableAwaiter{this, log, lsn}; }
+
+private:
+    struct Detached;
+
+    std::deque<std::coroutine_handle<> > m_ready;   ///< Run-thread only
+    long long m_live;
+    int m_core;
+
+    // Log waits (run-thread only): waiters by LSN, one helper wait in flight
+    WriteAheadLog *m_log;
+    std::multimap<uint64_t, std::coroutine_handle<> > m_durableWaiters;
+    bool m_logWaitActive;
+
+    std::mutex m_postMutex;                         ///< Completions from helpers
+    std::condition_variable m_postCv;
+    std::vector<std::coroutine_handle<> > m_posted;
+    std::vector<std::function<void()> > m_postedCalls;
+
+    std::mutex m_jobMutex;                          ///< Work for helpers
+    std::condition_variable m_jobCv;
+    std::deque<std::function<void()> > m_jobs;
+    bool m_stop;
+    std::vector<std::thread> m_helpers;
+
+    static Detached detach(CoScheduler *scheduler, CoTask<void> task);
+    void submit(std::function<void()> job);
+    void post(std::coroutine_handle<> h);
+    void postCall(std::function<void()> call);
+    void waitDurable(WriteAheadLog *log, uint64_t lsn, std::coroutine_handle<> h);
+    void startLogWait();
+    void helperLoop();
+
+    CoScheduler(const CoScheduler &);
+    CoScheduler &operator=(const CoScheduler &);
+};
+
+#endif
@@ -0,0 +1,22 @@
+#include "Course.h"
+
+// Default Constructor
+Course::Course() : m_id(0), m_code(""), m_title(""), m_credits(0), m_department(""), m_instructor(0) {}
+
+// Parameterized Constructor
+Course::Course(int id, std::string code, std::string title, int credits, std::string department, int instructor)
+    : m_id(id), m_code(code), m_title(title), m_credits(credits), m_department(department), m_instructor(instructor) {}
+
+std::ostream &operator<<(std::ostream &os, const Course &course)
+{
+    os << "ID: " << course.getID()
+       << ", Code: " << course.getCode()
+       << ", Title: " << course.getTitle()
+       << ", Credits: " << course.getCredits()
+       << ", Department: " << course.getDepartment()
+       << ", Instructor: " << course.getInstructor();
+    return os;
+}
+
+// Destructor
+Course::~Course() {}
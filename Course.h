@@ -0,0 +1,44 @@
+#ifndef COURSE_H
+#define COURSE_H
+
+#include <iostream>
+#include <string>
+#include "LazyBST.h"
+
+class Course
+{
+public:
+    Course();
+    Course(int id, std::string code, std::string title, int credits, std::string department, int instructor);
+    ~Course();
+
+    bool operator==(const Course &other) const { return m_id == other.m_id; }
+    bool operator!=(const Course &other) const { return m_id != other.m_id; }
+    bool operator<(const Course &other) const { return m_id < other.m_id; }
+    bool operator>(const Course &other) const { return m_id > other.m_id; }
+
+    int getID() const { return m_id; }
+    void setID(int id) { m_id = id; }
+    std::string getCode() const { return m_code; }
+    void setCode(const std::string &code) { m_code = code; }
+    std::string getTitle() const { return m_title; }
+    void setTitle(const std::string &title) { m_title = title; }
+    int getCredits() const { return m_credits; }
+    void setCredits(int credits) { m_credits = credits; }
+    std::string getDepartment() const { return m_department; }
+    void setDepartment(const std::string &department) { m_department = department; }
+    int getInstructor() const { return m_instructor; }
+    void setInstructor(int instructor) { m_instructor = instructor; }
+
+    friend std::ostream &operator<<(std::ostream &os, const Course &course);
+
+private:
+    int m_id;
+    std::string m_code;         // e.g. "CS101"
+    std::string m_title;
+    int m_credits;
+    std::string m_department;
+    int m_instructor;           // Faculty id, 0 if unassigned
+};
+
+#endif // COURSE_H
@@ -0,0 +1,590 @@
+#include "CsvIO.h"
+#include "DBsystem.h"
+#include "IoRing.h"
+#include "TableExport.h"
+#include "Validator.h"
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// CsvReader
+// ---------------------------------------------------------------------------
+
+CsvReader::CsvReader(std::FILE *in, char delimiter, size_t chunkSize)
+    : m_in(in), m_ring(RingReader::open(in, chunkSize)), m_delim(delimiter), m_chunkSize(chunkSize), m_buf(chunkSize + 32), m_pos(0), m_end(0),
+      m_eof(false), m_count(0) {}
+
+CsvReader::~CsvReader()
+{
+    delete m_ring;
+}
+
+// Moves the unparsed tail to the front and appends another chunk
+bool CsvReader::fill()
+{
+    if (m_eof)
+    {
+        return false;
+    }
+    size_t keep = m_end - m_pos;
+    if (keep > 0 && m_pos > 0)
+    {
+        std::memmove(&m_buf[0], &m_buf[m_pos], keep);
+    }
+    m_pos = 0;
+    m_end = keep;
+    if (m_buf.size() - 32 - m_end < m_chunkSize / 2)
+    {
+        // A row longer than half the buffer: grow instead of spinning
+        m_buf.resize(m_buf.size() + m_chunkSize);
+    }
+    size_t n = m_ring != NULL ? m_ring->read(&m_buf[m_end], m_buf.size() - 32 - m_end)
+                              : std::fread(&m_buf[m_end], 1, m_buf.size() - 32 - m_end, m_in);
+    if (n == 0)
+    {
+        m_eof = true;
+        return false;
+    }
+    m_end += n;
+    return true;
+}
+
+// Offset of the next delimiter, CR or LF at or after pos (m_end if none)
+size_t CsvReader::scanSpecial(size_t pos) const
+{
+    const char *base = &m_buf[0];
+    const char *p = base + pos;
+    const char *end = base + m_end;
+
+#if defined(__AVX2__)
+    const __m256i d = _mm256_set1_epi8(m_delim);
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, d),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+        unsigned mask = unsigned(_mm256_movemask_epi8(hit));
+        if (mask != 0)
+        {
+            return size_t(p - base) + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i d = _mm_set1_epi8(m_delim);
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, d), _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        unsigned mask = unsigned(_mm_movemask_epi8(hit));
+        if (mask != 0)
+        {
+            return size_t(p - base) + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t d = vdupq_n_u8((uint8_t)m_delim);
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    while (end - p >= 16)
+    {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+        uint8x16_t hit = vorrq_u8(vceqq_u8(v, d), vorrq_u8(vceqq_u8(v, lf), vceqq_u8(v, cr)));
+        if (vmaxvq_u8(hit) != 0)
+        {
+            break; // locate within this block below
+        }
+        p += 16;
+    }
+#endif
+
+    for (; p != end; ++p)
+    {
+        if (*p == m_delim || *p == '\n' || *p == '\r')
+        {
+            break;
+        }
+    }
+    return size_t(p - base);
+}
+
+bool CsvReader::parseRow()
+{
+    while (true)
+    {
+        if (m_pos == m_end && !fill())
+        {
+            return false;
+        }
+
+        size_t p = m_pos;
+        m_count = 0;
+        bool needMore = false;
+        bool rowDone = false;
+
+        while (!rowDone && !needMore)
+        {
+            if (m_count == int(m_fields.size()))
+            {
+                m_fields.push_back(std::string());
+            }
+            std::string &f = m_fields[m_count];
+            f.clear();
+
+            if (p < m_end && m_buf[p] == '"')
+            {
+                // Quoted field: hop between quotes with memchr
+                ++p;
+                while (true)
+                {
+                    const char *q = static_cast<const char *>(std::memchr(&m_buf[p], '"', m_end - p));
+                    if (q == NULL)
+                    {
+                        if (m_eof)
+                        {
+                            // Unterminated quote at end of input: keep the rest
+                            f.append(&m_buf[0] + p, m_end - p);
+                            p = m_end;
+                        }
+                        else
+                        {
+                            needMore = true;
+                        }
+                        break;
+                    }
+                    size_t qi = size_t(q - &m_buf[0]);
+                    f.append(&m_buf[p], qi - p);
+                    p = qi + 1;
+                    if (p == m_end && !m_eof)
+                    {
+                        needMore = true; // cannot tell "" from end-of-field yet
+                        break;
+                    }
+                    if (p < m_end && m_buf[p] == '"')
+                    {
+                        f += '"';
+                        ++p;
+                        continue;
+                    }
+                    break;
+                }
+                if (needMore)
+                {
+                    break;
+                }
+                // Tolerate stray bytes between the closing quote and the separator
+                size_t s = scanSpecial(p);
+                f.append(&m_buf[0] + p, s - p);
+                p = s;
+            }
+            else
+            {
+                size_t s = scanSpecial(p);
+                f.assign(&m_buf[0] + p, s - p);
+                p = s;
+            }
+
+            if (p == m_end && !m_eof)
+            {
+                needMore = true;
+                break;
+            }
+            ++m_count;
+
+            if (p == m_end)
+            {
+                rowDone = true;
+            }
+            else if (m_buf[p] == m_delim)
+            {
+                ++p;
+                if (p == m_end && !m_eof)
+                {
+                    needMore = true;
+                }
+                else if (p == m_end)
+                {
+                    // Trailing delimiter at end of input: one last empty field
+                    if (m_count == int(m_fields.size()))
+                    {
+                        m_fields.push_back(std::string());
+                    }
+                    m_fields[m_count++].clear();
+                    rowDone = true;
+                }
+            }
+            else
+            {
+                if (m_buf[p] == '\r')
+                {
+                    ++p;
+                    if (p == m_end && !m_eof)
+                    {
+                        needMore = true;
+                        break;
+                    }
+                }
+                if (p < m_end && m_buf[p] == '\n')
+                {
+                    ++p;
+                }
+                rowDone = true;
+            }
+        }
+
+        if (rowDone)
+        {
+            m_pos = p;
+            // Skip blank lines
+            if (m_count == 1 && m_fields[0].empty())
+            {
+                continue;
+            }
+            return true;
+        }
+        if (!fill())
+        {
+            // End of input inside a row: parse what is left as final
+            m_eof = true;
+            if (m_pos == m_end)
+            {
+                return false;
+            }
+        }
+    }
+}
+
+bool CsvReader::readHeader()
+{
+    if (!parseRow())
+    {
+        return false;
+    }
+    m_header.assign(m_fields.begin(), m_fields.begin() + m_count);
+    m_columns.clear();
+    for (size_t i = 0; i < m_header.size(); ++i)
+    {
+        m_columns[m_header[i]] = int(i);
+    }
+    return true;
+}
+
+bool CsvReader::next()
+{
+    return parseRow();
+}
+
+const std::string *CsvReader::find(const std::string &name) const
+{
+    std::unordered_map<std::string, int>::const_iterator it = m_columns.find(name);
+    if (it == m_columns.end() || it->second >= m_count)
+    {
+        return NULL;
+    }
+    return &m_fields[it->second];
+}
+
+// ---------------------------------------------------------------------------
+// CsvWriter
+// ---------------------------------------------------------------------------
+
+CsvWriter::CsvWriter(OutputBuffer &out, char delimiter) : m_out(out), m_delim(delimiter), m_first(true) {}
+
+void CsvWriter::separator()
+{
+    if (!m_first)
+    {
+        m_out.put(m_delim);
+    }
+    m_first = false;
+}
+
+void CsvWriter::field(const std::string &s)
+{
+    separator();
+    bool quote = false;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        char c = s[i];
+        if (c == m_delim || c == '"' || c == '\n' || c == '\r')
+        {
+            quote = true;
+            break;
+        }
+    }
+    if (!quote)
+    {
+        m_out.append(s);
+        return;
+    }
+    m_out.put('"');
+    size_t start = 0;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] == '"')
+        {
+            m_out.append(s.data() + start, i + 1 - start);
+            m_out.put('"');
+            start = i + 1;
+        }
+    }
+    m_out.append(s.data() + start, s.size() - start);
+    m_out.put('"');
+}
+
+void CsvWriter::field(long long value)
+{
+    separator();
+    m_out.appendInt(value);
+}
+
+void CsvWriter::field(double value)
+{
+    separator();
+    m_out.appendDouble(value);
+}
+
+void CsvWriter::endRow()
+{
+    m_out.put('\n');
+    m_first = true;
+}
+
+// ---------------------------------------------------------------------------
+// Column mapping
+// ---------------------------------------------------------------------------
+
+std::vector<CsvColumn> defaultStudentColumns()
+{
+    std::vector<CsvColumn> cols;
+    for (int f = 0; f < RecordMapper::STUDENT_FIELDS; ++f)
+    {
+        CsvColumn c = {f, RecordMapper::studentFieldName(RecordMapper::StudentField(f)), 0};
+        cols.push_back(c);
+    }
+    return cols;
+}
+
+std::vector<CsvColumn> defaultFacultyColumns()
+{
+    std::vector<CsvColumn> cols;
+    for (int f = 0; f < RecordMapper::FACULTY_FIELDS; ++f)
+    {
+        CsvColumn c = {f, RecordMapper::facultyFieldName(RecordMapper::FacultyField(f)), 0};
+        cols.push_back(c);
+    }
+    return cols;
+}
+
+bool parseCsvColumns(const std::string &spec, bool faculty, std::vector<CsvColumn> &out)
+{
+    out.clear();
+    size_t start = 0;
+    while (start < spec.size())
+    {
+        size_t comma = spec.find(',', start);
+        if (comma == std::string::npos)
+        {
+            comma = spec.size();
+        }
+        std::string item = spec.substr(start, comma - start);
+        start = comma + 1;
+
+        // A trailing ":N" sets the fixed-width export width
+        int width = 0;
+        size_t colon = item.rfind(':');
+        if (colon != std::string::npos && colon + 1 < item.size() &&
+            item.find_first_not_of("0123456789", colon + 1) == std::string::npos)
+        {
+            width = std::atoi(item.c_str() + colon + 1);
+            item.erase(colon);
+        }
+
+        std::string name = item;
+        std::string header = item;
+        size_t eq = item.find('=');
+        if (eq != std::string::npos)
+        {
+            name = item.substr(0, eq);
+            header = item.substr(eq + 1);
+        }
+
+        int count = faculty ? int(RecordMapper::FACULTY_FIELDS) : int(RecordMapper::STUDENT_FIELDS);
+        int found = -1;
+        for (int f = 0; f < count; ++f)
+        {
+            const char *fieldName = faculty ? RecordMapper::facultyFieldName(RecordMapper::FacultyField(f))
+                                            : RecordMapper::studentFieldName(RecordMapper::StudentField(f));
+            if (name == fieldName)
+            {
+                found = f;
+                break;
+            }
+        }
+        if (found < 0)
+        {
+            return false;
+        }
+        CsvColumn c = {found, header, width};
+        out.push_back(c);
+    }
+    return !out.empty();
+}
+
+// ---------------------------------------------------------------------------
+// Export
+// ---------------------------------------------------------------------------
+
+long long exportStudentsCsv(DBsystem &db, OutputBuffer &out, const std::vector<CsvColumn> &columns, char delimiter)
+{
+    return exportStudents(db, out, columns, EXPORT_CSV, delimiter);
+}
+
+long long exportFacultyCsv(DBsystem &db, OutputBuffer &out, const std::vector<CsvColumn> &columns, char delimiter)
+{
+    return exportFaculty(db, out, columns, EXPORT_CSV, delimiter);
+}
+
+// ---------------------------------------------------------------------------
+// Import
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    const size_t IMPORT_BATCH = 8192;
+
+    // Students are applied as one sorted merge (or SCD Type-2 close-and-insert);
+    // faculty one upsert at a time, since each keeps its existing advisee list
+    void upsertRows(DBsystem &db, std::vector<Student> &rows, IngestStats &stats)
+    {
+        if (db.studentsVersioned())
+        {
+            VersionCounts counts = db.closeAndInsertStudents(rows, db.studentVersionTime());
+            stats.inserted += counts.inserted;
+            stats.updated += counts.updated;
+            stats.unchanged += counts.unchanged;
+            return;
+        }
+        UpsertCounts counts = db.upsertStudents(rows);
+        stats.inserted += counts.inserted;
+        stats.updated += counts.updated;
+    }
+
+    void upsertRows(DBsystem &db, std::vector<Faculty> &rows, IngestStats &stats)
+    {
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            if (db.upsertFaculty(rows[i]))
+                ++stats.inserted;
+            else
+                ++stats.updated;
+        }
+    }
+
+    // Upsert a buffered batch, minus the rows the validator rejects
+    template <typename Record>
+    void applyBatch(DBsystem &db, std::vector<Record> &batch, Validator *validator, IngestStats &stats)
+    {
+        std::vector<uint64_t> rejected;
+        if (validator != NULL)
+            validator->validate(db, batch, rejected);
+        size_t kept = 0;
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            if (validator != NULL && Validator::isSet(rejected, i))
+                ++stats.rejected;
+            else
+                batch[kept++] = batch[i];
+        }
+        batch.resize(kept);
+        upsertRows(db, batch, stats);
+        batch.clear();
+    }
+}
+
+IngestStats importStudentsCsv(DBsystem &db, std::FILE *in, const RecordMapper &mapper, char delimiter,
+                              Validator *validator)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    IngestStats stats;
+
+    CsvReader reader(in, delimiter);
+    if (reader.readHeader())
+    {
+        RecordMapper native = RecordMapper::native();
+        const RecordMapper &m = reader.hasColumn(mapper.studentSource(RecordMapper::S_ID)[0]) ? mapper : native;
+        Student s;
+        std::vector<Student> batch;
+        db.beginBulk();
+        while (reader.next())
+        {
+            ++stats.rows;
+            if (!m.toStudent(reader, s))
+            {
+                ++stats.skipped;
+                continue;
+            }
+            batch.push_back(s);
+            if (validator != NULL)
+                validator->capture(true, reader);
+            if (batch.size() == IMPORT_BATCH)
+                applyBatch(db, batch, validator, stats);
+        }
+        applyBatch(db, batch, validator, stats);
+        db.endBulk();
+    }
+
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
+
+IngestStats importFacultyCsv(DBsystem &db, std::FILE *in, const RecordMapper &mapper, char delimiter,
+                             Validator *validator)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    IngestStats stats;
+
+    CsvReader reader(in, delimiter);
+    if (reader.readHeader())
+    {
+        RecordMapper native = RecordMapper::native();
+        const RecordMapper &m = reader.hasColumn(mapper.facultySource(RecordMapper::F_ID)[0]) ? mapper : native;
+        Faculty f;
+        std::vector<Faculty> batch;
+        db.beginBulk();
+        while (reader.next())
+        {
+            ++stats.rows;
+            if (!m.toFaculty(reader, f))
+            {
+                ++stats.skipped;
+                continue;
+            }
+            batch.push_back(f);
+            if (validator != NULL)
+                validator->capture(false, reader);
+            if (batch.size() == IMPORT_BATCH)
+                applyBatch(db, batch, validator, stats);
+        }
+        applyBatch(db, batch, validator, stats);
+        db.endBulk();
+    }
+
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,911 @@
+#include "DBServer.h"
+#include "DBsystem.h"
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t MAX_PENDING_OUTPUT = 4 << 20;  // Replies queued before input pauses
+static const size_t READ_CHUNK = 64 << 10;
+static const size_t MAX_READ_PER_WAKE = 1 << 20;   // Then other connections get a turn
+static const size_t MAX_INLINE = 64 << 10;         // Longest inline request line
+static const long MAX_BULK = 1 << 20;              // Longest request argument
+static const long MAX_ARGS = 1024;
+static const long SCAN_DEFAULT_LIMIT = 1000;
+static const int MAX_EVENTS = 256;
+
+namespace
+{
+    // Parsed form of a listen/connect address
+    struct Endpoint
+    {
+        bool isUnix;
+        sockaddr_un un;
+        sockaddr_in in;
+    };
+
+    bool parseEndpoint(const std::string &address, Endpoint &ep, std::string &error)
+    {
+        memset(&ep, 0, sizeof(ep));
+        std::string rest = address;
+        bool isUnix = false;
+        if (rest.compare(0, 5, "unix:") == 0)
+        {
+            rest = rest.substr(5);
+            isUnix = true;
+        }
+        else if (rest.compare(0, 4, "tcp:") == 0)
+        {
+            rest = rest.substr(4);
+        }
+        else
+        {
+            isUnix = rest.find('/') != std::string::npos;
+        }
+        ep.isUnix = isUnix;
+        if (isUnix)
+        {
+            if (rest.empty() || rest.size() >= sizeof(ep.un.sun_path))
+            {
+                error = "bad socket path: " + rest;
+                return false;
+            }
+            ep.un.sun_family = AF_UNIX;
+            memcpy(ep.un.sun_path, rest.c_str(), rest.size() + 1);
+            return true;
+        }
+        std::string host = "127.0.0.1";
+        size_t colon = rest.rfind(':');
+        if (colon != std::string::npos)
+        {
+            host = rest.substr(0, colon);
+            rest = rest.substr(colon + 1);
+        }
+        char *end = NULL;
+        long port = strtol(rest.c_str(), &end, 10);
+        if (rest.empty() || *end != '\0' || port <= 0 || port > 65535)
+        {
+            error = "bad address (unix:/path or tcp:[host:]port): " + address;
+            return false;
+        }
+        ep.in.sin_family = AF_INET;
+        ep.in.sin_port = htons(uint16_t(port));
+        if (inet_pton(AF_INET, host == "localhost" ? "127.0.0.1" : host.c_str(), &ep.in.sin_addr) != 1)
+        {
+            error = "bad host: " + host;
+            return false;
+        }
+        return true;
+    }
+
+    const sockaddr *endpointAddr(const Endpoint &ep, socklen_t &len)
+    {
+        if (ep.isUnix)
+        {
+            len = sizeof(ep.un);
+            return reinterpret_cast<const sockaddr *>(&ep.un);
+        }
+        len = sizeof(ep.in);
+        return reinterpret_cast<const sockaddr *>(&ep.in);
+    }
+
+    std::string systemError(const char *what)
+    {
+        return std::string(what) + ": " + strerror(errno);
+    }
+
+    void setNoDelay(int fd)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    // ---- Reply encoding ----
+
+    void appendNumber(std::string &out, long long value)
+    {
+        char buf[24];
+        std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, r.ptr);
+    }
+
+    void appendLine(std::string &out, char type, long long value)
+    {
+        out += type;
+        appendNumber(out, value);
+        out += "\r\n";
+    }
+
+    void appendBulk(std::string &out, const char *data, size_t len)
+    {
+        appendLine(out, '$', (long long)len);
+        out.append(data, len);
+        out += "\r\n";
+    }
+
+    void appendBulk(std::string &out, const std::string &s)
+    {
+        appendBulk(out, s.data(), s.size());
+    }
+
+    void appendBulkNumber(std::string &out, long long value)
+    {
+        char buf[24];
+        std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), value);
+        appendBulk(out, buf, size_t(r.ptr - buf));
+    }
+
+    void appendError(std::string &out, const std::string &message)
+    {
+        out += "-ERR ";
+        out += message;
+        out += "\r\n";
+    }
+
+    void appendStudent(std::string &out, const Student &s)
+    {
+        out += "*6\r\n";
+        appendBulkNumber(out, s.getID());
+        appendBulk(out, s.getName());
+        appendBulk(out, s.getLevel());
+        appendBulk(out, s.getMajor());
+        char buf[32];
+        std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), s.getGPA());
+        appendBulk(out, buf, size_t(r.ptr - buf));
+        appendBulkNumber(out, s.getAdvisor());
+    }
+
+    void appendFaculty(std::string &out, const Faculty &f)
+    {
+        appendLine(out, '*', 4 + f.getAdviseeCount());
+        appendBulkNumber(out, f.getID());
+        appendBulk(out, f.getName());
+        appendBulk(out, f.getLevel());
+        appendBulk(out, f.getDepartment());
+        for (int i = 0; i < f.getAdviseeCount(); ++i)
+        {
+            appendBulkNumber(out, f.getAdvisee(i));
+        }
+    }
+
+    // Encodes visited records; the range walk itself stops at the limit
+    template <typename T>
+    struct ScanWriter
+    {
+        std::string &out;
+
+        explicit ScanWriter(std::string &o) : out(o) {}
+
+        void operator()(const T &record) { append(record); }
+
+        void append(const Student &s) { appendStudent(out, s); }
+        void append(const Faculty &f) { appendFaculty(out, f); }
+    };
+
+    // ---- Request parsing ----
+
+    bool parseLong(const std::string &s, long long &value)
+    {
+        const char *end = s.data() + s.size();
+        std::from_chars_result r = std::from_chars(s.data(), end, value);
+        return !s.empty() && r.ec == std::errc() && r.ptr == end;
+    }
+
+    bool parseId(const std::string &s, int &id)
+    {
+        long long v;
+        if (!parseLong(s, v) || v < -2147483648LL || v > 2147483647LL)
+        {
+            return false;
+        }
+        id = int(v);
+        return true;
+    }
+
+    // One "<type><integer>\r\n" header. Returns its length, 0 if incomplete, -1 if malformed.
+    long parseHeader(const char *data, size_t size, char type, long long &value)
+    {
+        const char *nl = static_cast<const char *>(memchr(data, '\n', size));
+        if (nl == NULL)
+        {
+            return size > 32 ? -1 : 0;
+        }
+        const char *end = (nl > data && nl[-1] == '\r') ? nl - 1 : nl;
+        if (data[0] != type)
+        {
+            return -1;
+        }
+        std::from_chars_result r = std::from_chars(data + 1, end, value);
+        if (r.ec != std::errc() || r.ptr != end)
+        {
+            return -1;
+        }
+        return long(nl - data) + 1;
+    }
+
+    void upper(std::string &s)
+    {
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] >= 'a' && s[i] <= 'z')
+            {
+                s[i] = char(s[i] - 'a' + 'A');
+            }
+        }
+    }
+}
+
+DBServer::DBServer(DBsystem &db) : m_db(db), m_listenFd(-1), m_epollFd(-1), m_wakeFd(-1)
+{
+
+}
+
+DBServer::~DBServer()
+{
+    closeAll();
+}
+
+// ---------------------------------------------------------------------------
+// Sockets
+// ---------------------------------------------------------------------------
+
+bool DBServer::listen(const std::string &address, std::string &error)
+{
+    closeAll();
+    Endpoint ep;
+    if (!parseEndpoint(address, ep, error))
+    {
+        return false;
+    }
+    m_listenFd = socket(ep.isUnix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0)
+    {
+        error = systemError("socket");
+        return false;
+    }
+    if (ep.isUnix)
+    {
+        unlink(ep.un.sun_path);                     // A stale socket from an earlier run
+    }
+    else
+    {
+        int one = 1;
+        setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    socklen_t len;
+    const sockaddr *sa = endpointAddr(ep, len);
+    if (bind(m_listenFd, sa, len) != 0 || ::listen(m_listenFd, 512) != 0)
+    {
+        error = systemError(address.c_str());
+        closeAll();
+        return false;
+    }
+    if (ep.isUnix)
+    {
+        m_unixPath = ep.un.sun_path;
+    }
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd < 0 || m_wakeFd < 0)
+    {
+        error = systemError("epoll");
+        closeAll();
+        return false;
+    }
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = m_listenFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &ev);
+    ev.data.fd = m_wakeFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+    return true;
+}
+
+int DBServer::connectTo(const std::string &address, std::string &error)
+{
+    Endpoint ep;
+    if (!parseEndpoint(address, ep, error))
+    {
+        return -1;
+    }
+    int fd = socket(ep.isUnix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error = systemError("socket");
+        return -1;
+    }
+    socklen_t len;
+    const sockaddr *sa = endpointAddr(ep, len);
+    if (connect(fd, sa, len) != 0)
+    {
+        error = systemError(address.c_str());
+        close(fd);
+        return -1;
+    }
+    if (!ep.isUnix)
+    {
+        setNoDelay(fd);
+    }
+    return fd;
+}
+
+void DBServer::stop()
+{
+    if (m_wakeFd >= 0)
+    {
+        uint64_t one = 1;
+        ssize_t n = write(m_wakeFd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+void DBServer::closeAll()
+{
+    for (std::unordered_map<int, Connection *>::iterator it = m_connections.begin(); it != m_connections.end(); ++it)
+    {
+        close(it->first);
+        delete it->second;
+    }
+    m_connections.clear();
+    m_ready.clear();
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+        m_listenFd = -1;
+    }
+    if (!m_unixPath.empty())
+    {
+        unlink(m_unixPath.c_str());
+        m_unixPath.clear();
+    }
+    if (m_epollFd >= 0)
+    {
+        close(m_epollFd);
+        m_epollFd = -1;
+    }
+    if (m_wakeFd >= 0)
+    {
+        close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Event loop
+// ---------------------------------------------------------------------------
+
+bool DBServer::run(std::string &error)
+{
+    if (m_epollFd < 0)
+    {
+        error = "not listening";
+        return false;
+    }
+    epoll_event events[MAX_EVENTS];
+    for (;;)
+    {
+        int n = epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            error = systemError("epoll_wait");
+            return false;
+        }
+
+        // Run everything that arrived, then wait for the log once for all of it
+        m_db.beginBulk();
+        for (int i = 0; i < n; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == m_wakeFd)
+            {
+                bool durable = m_db.endBulk();
+                uint64_t count;
+                ssize_t r = read(m_wakeFd, &count, sizeof(count));
+                (void)r;
+                for (size_t j = 0; j < m_ready.size(); ++j)
+                {
+                    if (durable)
+                        flush(m_ready[j]);
+                    else
+                        closeConnection(m_ready[j]);
+                }
+                m_ready.clear();
+                return true;
+            }
+            if (fd == m_listenFd)
+            {
+                acceptAll();
+                continue;
+            }
+            std::unordered_map<int, Connection *>::iterator it = m_connections.find(fd);
+            if (it == m_connections.end())
+            {
+                continue;
+            }
+            Connection *c = it->second;
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !c->closing &&
+                c->out.size() - c->outPos <= MAX_PENDING_OUTPUT && !readAll(c))
+            {
+                c->closing = true;                  // Peer closed: answer what it sent, then close
+            }
+            process(c);
+            m_ready.push_back(c);
+        }
+        // Every write answered below is now as durable as the log policy
+        // makes it. If the log failed the replies would claim writes that
+        // are not, so these connections are dropped unanswered instead.
+        bool durable = m_db.endBulk();
+        for (size_t i = 0; i < m_ready.size(); ++i)
+        {
+            Connection *c = m_ready[i];
+            if (!durable || !flush(c) || (c->closing && c->outPos == c->out.size()))
+            {
+                closeConnection(c);
+            }
+            else
+            {
+                updateEvents(c);
+            }
+        }
+        m_ready.clear();
+    }
+}
+
+void DBServer::acceptAll()
+{
+    for (;;)
+    {
+        int fd = accept4(m_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            return;                                 // EAGAIN, or out of descriptors until one closes
+        }
+        if (m_unixPath.empty())
+        {
+            setNoDelay(fd);
+        }
+        Connection *c = new Connection(fd);
+        c->events = EPOLLIN;
+        epoll_event ev;
+        ev.events = c->events;
+        ev.data.fd = fd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev);
+        m_connections[fd] = c;
+        ++m_stats.connections;
+    }
+}
+
+// False once the peer has closed or the socket failed
+bool DBServer::readAll(Connection *c)
+{
+    if (c->inPos == c->in.size())
+    {
+        c->in.clear();
+        c->inPos = 0;
+    }
+    else if (c->inPos > 0)
+    {
+        c->in.erase(0, c->inPos);                   // Keep only the partial request
+        c->inPos = 0;
+    }
+    size_t total = 0;
+    while (total < MAX_READ_PER_WAKE)
+    {
+        size_t old = c->in.size();
+        c->in.resize(old + READ_CHUNK);
+        ssize_t n = recv(c->fd, &c->in[old], READ_CHUNK, 0);
+        c->in.resize(old + (n > 0 ? size_t(n) : 0));
+        if (n > 0)
+        {
+            total += size_t(n);
+            m_stats.bytesIn += n;
+            if (size_t(n) < READ_CHUNK)
+            {
+                break;                              // Drained; level-triggered epoll reports more
+            }
+        }
+        else if (n == 0)
+        {
+            return false;
+        }
+        else if (errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+    return true;
+}
+
+// Runs every complete request in the input buffer (pipelining), queueing
+// the replies in order
+void DBServer::process(Connection *c)
+{
+    c->paused = false;
+    bool any = false;
+    while (c->inPos < c->in.size() && !c->closing)
+    {
+        if (c->out.size() - c->outPos > MAX_PENDING_OUTPUT)
+        {
+            c->paused = true;                       // Resumed when the client reads its replies
+            break;
+        }
+        std::string error;
+        long used = parseRequest(c->in.data() + c->inPos, c->in.size() - c->inPos, error);
+        if (used == 0)
+        {
+            break;
+        }
+        if (used < 0)
+        {
+            appendError(c->out, "protocol error: " + error);
+            c->closing = true;
+            break;
+        }
+        c->inPos += size_t(used);
+        if (m_args.empty())
+        {
+            continue;                               // Blank inline line
+        }
+        any = true;
+        ++m_stats.requests;
+        if (!execute(c->out))
+        {
+            c->closing = true;
+        }
+    }
+    if (any)
+    {
+        ++m_stats.reads;
+    }
+}
+
+bool DBServer::flush(Connection *c)
+{
+    while (c->outPos < c->out.size())
+    {
+        ssize_t n = send(c->fd, c->out.data() + c->outPos, c->out.size() - c->outPos, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            c->outPos += size_t(n);
+            m_stats.bytesOut += n;
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (c->outPos == c->out.size())
+    {
+        c->out.clear();
+        c->outPos = 0;
+    }
+    else if (c->outPos >= MAX_PENDING_OUTPUT)
+    {
+        c->out.erase(0, c->outPos);
+        c->outPos = 0;
+    }
+    return true;
+}
+
+// Reads unless closing or paused; waits for writability while replies are
+// queued, or while paused so the buffered requests get run once they drain
+void DBServer::updateEvents(Connection *c)
+{
+    bool pending = c->outPos < c->out.size();
+    uint32_t want = 0;
+    if (!c->closing && !(pending && c->out.size() - c->outPos > MAX_PENDING_OUTPUT))
+    {
+        want |= EPOLLIN;
+    }
+    if (pending || c->paused)
+    {
+        want |= EPOLLOUT;
+    }
+    if (want != c->events)
+    {
+        epoll_event ev;
+        ev.events = want;
+        ev.data.fd = c->fd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = want;
+    }
+}
+
+void DBServer::closeConnection(Connection *c)
+{
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    m_connections.erase(c->fd);
+    delete c;
+}
+
+// ---------------------------------------------------------------------------
+// Protocol
+// ---------------------------------------------------------------------------
+
+// Fills m_args from one request at data. Returns the bytes it took, 0 if the
+// request is not complete yet, or -1 (with error) if it is malformed.
+long DBServer::parseRequest(const char *data, size_t size, std::string &error)
+{
+    m_args.clear();
+    if (data[0] != '*')
+    {
+        const char *nl = static_cast<const char *>(memchr(data, '\n', size));
+        if (nl == NULL)
+        {
+            if (size > MAX_INLINE)
+            {
+                error = "inline request too long";
+                return -1;
+            }
+            return 0;
+        }
+        const char *p = data;
+        while (p < nl)
+        {
+            while (p < nl && (*p == ' ' || *p == '\t' || *p == '\r'))
+            {
+                ++p;
+            }
+            const char *start = p;
+            while (p < nl && *p != ' ' && *p != '\t' && *p != '\r')
+            {
+                ++p;
+            }
+            if (p > start)
+            {
+                m_args.push_back(std::string(start, p));
+            }
+        }
+        return long(nl - data) + 1;
+    }
+
+    long long count;
+    long used = parseHeader(data, size, '*', count);
+    if (used <= 0 || count < 0 || count > MAX_ARGS)
+    {
+        error = "bad array header";
+        return used == 0 ? 0 : -1;
+    }
+    size_t pos = size_t(used);
+    for (long long i = 0; i < count; ++i)
+    {
+        if (pos >= size)
+        {
+            return 0;
+        }
+        long long len;
+        used = parseHeader(data + pos, size - pos, '$', len);
+        if (used == 0)
+        {
+            return 0;
+        }
+        if (used < 0 || len < 0 || len > MAX_BULK)
+        {
+            error = "bad bulk string header";
+            return -1;
+        }
+        pos += size_t(used);
+        if (size - pos < size_t(len) + 2)
+        {
+            return 0;
+        }
+        if (data[pos + size_t(len)] != '\r' || data[pos + size_t(len) + 1] != '\n')
+        {
+            error = "bulk string not terminated by CRLF";
+            return -1;
+        }
+        m_args.push_back(std::string(data + pos, size_t(len)));
+        pos += size_t(len) + 2;
+    }
+    return long(pos);
+}
+
+// Runs the request in m_args and appends its reply. False if the
+// connection should close once the reply is sent.
+bool DBServer::execute(std::string &out)
+{
+    std::vector<std::string> &a = m_args;
+    upper(a[0]);
+    const std::string &cmd = a[0];
+    if (cmd == "PING")
+    {
+        if (a.size() > 1)
+            appendBulk(out, a[1]);
+        else
+            out += "+PONG\r\n";
+        return true;
+    }
+    if (cmd == "QUIT")
+    {
+        out += "+OK\r\n";
+        return false;
+    }
+
+    bool student = false;
+    if (a.size() >= 2)
+    {
+        upper(a[1]);
+        student = a[1] == "STUDENT" || a[1] == "STUDENTS";
+        if (!student && a[1] != "FACULTY")
+        {
+            appendError(out, "unknown table '" + a[1] + "' (STUDENT or FACULTY)");
+            return true;
+        }
+    }
+    int id = 0;
+    if (a.size() >= 3 && cmd != "COUNT" && !parseId(a[2], id))
+    {
+        appendError(out, "bad id '" + a[2] + "'");
+        return true;
+    }
+
+    if (cmd == "FIND" && a.size() == 3)
+    {
+        if (student)
+        {
+            const Student *s = m_db.findStudent(id);
+            if (s != NULL)
+                appendStudent(out, *s);
+            else
+                out += "$-1\r\n";
+        }
+        else
+        {
+            const Faculty *f = m_db.findFaculty(id);
+            if (f != NULL)
+                appendFaculty(out, *f);
+            else
+                out += "$-1\r\n";
+        }
+        return true;
+    }
+    if ((cmd == "ADD" || cmd == "DEL") && m_db.logFailed())
+    {
+        appendError(out, "log write failed; writes are refused");
+        return true;
+    }
+    if (cmd == "ADD" && a.size() == (student ? 8u : 6u))
+    {
+        bool inserted;
+        if (student)
+        {
+            char *end = NULL;
+            double gpa = strtod(a[6].c_str(), &end);
+            int advisor;
+            if (a[6].empty() || *end != '\0' || !parseId(a[7], advisor))
+            {
+                appendError(out, "bad gpa or advisor");
+                return true;
+            }
+            inserted = m_db.upsertStudent(Student(id, a[3], a[4], a[5], gpa, advisor));
+        }
+        else
+        {
+            inserted = m_db.upsertFaculty(Faculty(id, a[3], a[4], a[5]));
+        }
+        appendLine(out, ':', inserted ? 1 : 0);
+        return true;
+    }
+    if (cmd == "DEL" && a.size() == 3)
+    {
+        bool existed = student ? m_db.findStudent(id) != NULL : m_db.findFaculty(id) != NULL;
+        if (existed)
+        {
+            if (student)
+                m_db.deleteStudent(id);
+            else
+                m_db.deleteFaculty(id);
+        }
+        appendLine(out, ':', existed ? 1 : 0);
+        return true;
+    }
+    if (cmd == "SCAN" && (a.size() == 4 || a.size() == 5))
+    {
+        int hi;
+        long long limit = SCAN_DEFAULT_LIMIT;
+        if (!parseId(a[3], hi) || (a.size() == 5 && (!parseLong(a[4], limit) || limit < 0)))
+        {
+            appendError(out, "bad range or limit");
+            return true;
+        }
+        // Records of an opened snapshot are paged in for the range only
+        std::string body;
+        long long count;
+        if (student)
+        {
+            m_db.loadStudents(&id, &hi);
+            ScanWriter<Student> writer(body);
+            count = m_db.forEachStudentInRange(&id, &hi, writer, limit);
+        }
+        else
+        {
+            m_db.loadFaculty(&id, &hi);
+            ScanWriter<Faculty> writer(body);
+            count = m_db.forEachFacultyInRange(&id, &hi, writer, limit);
+        }
+        appendLine(out, '*', count);
+        out += body;
+        return true;
+    }
+    if (cmd == "COUNT" && a.size() == 2)
+    {
+        appendLine(out, ':', student ? m_db.studentCount() : m_db.facultyCount());
+        return true;
+    }
+    if (cmd == "FIND" || cmd == "ADD" || cmd == "DEL" || cmd == "SCAN" || cmd == "COUNT")
+    {
+        appendError(out, "wrong number of arguments for '" + cmd + "'");
+        return true;
+    }
+    appendError(out, "unknown command '" + cmd + "'");
+    return true;
+}
+
+long DBServer::replyLength(const char *data, size_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    const char *nl = static_cast<const char *>(memchr(data, '\n', size));
+    if (nl == NULL)
+    {
+        return 0;
+    }
+    size_t line = size_t(nl - data) + 1;
+    char type = data[0];
+    if (type == '+' || type == '-' || type == ':')
+    {
+        return long(line);
+    }
+    long long n;
+    if ((type != '$' && type != '*') || parseHeader(data, size, type, n) <= 0)
+    {
+        return -1;
+    }
+    if (n < 0)
+    {
+        return long(line);                          // Nil
+    }
+    if (type == '$')
+    {
+        return size < line + size_t(n) + 2 ? 0 : long(line + size_t(n) + 2);
+    }
+    size_t pos = line;
+    for (long long i = 0; i < n; ++i)
+    {
+        long used = replyLength(data + pos, size - pos);
+        if (used <= 0)
+        {
+            return used;
+        }
+        pos += size_t(used);
+    }
+    return long(pos);
+}
@@ -0,0 +1,138 @@
+/**
+ * @file DBServer.h
+ * @brief Network front end: serves find/add/delete/scan over a Unix domain
+ *        socket or a loopback TCP port from one epoll event loop.
+ *
+ * ARCHITECTURE:
+ *   clients (bench --loadgen, redis-cli, nc ...)
+ *       |  RESP-style requests, many per write (pipelining)
+ *       v
+ *   DBServer (You are here)
+ *       |  epoll: accept, read everything available, run every complete
+ *       |  request in the buffer, answer them all with one write
+ *       v
+ *   DBsystem - called from the loop thread only
+ *
+ * PROTOCOL (RESP, as spoken by Redis clients):
+ *   request - an array of bulk strings: *3\r\n$4\r\nFIND\r\n$7\r\nSTUDENT\r\n$2\r\n42\r\n
+ *             or one inline line of space-separated words: FIND STUDENT 42\r\n
+ *   replies - +simple  -ERR message  :integer  $len\r\nbytes  $-1 (nil)
+ *             *count followed by count replies
+ *
+ *   PING                                            +PONG
+ *   FIND STUDENT|FACULTY <id>                       record or $-1
+ *   ADD STUDENT <id> <name> <level> <major> <gpa> <advisor>
+ *   ADD FACULTY <id> <name> <level> <department>    :1 if new, :0 if replaced
+ *   DEL STUDENT|FACULTY <id>                        :1 if it existed, else :0
+ *   SCAN STUDENT|FACULTY <lo> <hi> [limit]          records with lo <= id < hi
+ *   COUNT STUDENT|FACULTY                           :n
+ *   QUIT                                            +OK, then the server closes
+ *
+ *   A record is an array of its fields as bulk strings (students: id, name,
+ *   level, major, gpa, advisor; faculty: id, name, level, department, then
+ *   the advisee ids).
+ *
+ * BATCHING: each epoll wake runs the requests of every ready connection
+ * inside one DBsystem::beginBulk/endBulk, so with a write-ahead log all the
+ * writes of a wake share one durability wait; replies are sent after it,
+ * with one send per connection. A client that stops reading has its input
+ * paused once MAX_PENDING_OUTPUT bytes of replies are waiting. If the log
+ * fails, the connections of that wake are closed unanswered and later ADD
+ * and DEL requests get an error.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef DB_SERVER_H
+#define DB_SERVER_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class DBsystem;
+
+/** @brief Counters kept by the event loop. */
+struct ServerStats
+{
+    long long connections;      ///< Accepted so far
+    long long requests;         ///< Commands executed
+    long long reads;            ///< Read batches that held at least one command
+    long long bytesIn;
+    long long bytesOut;
+
+    ServerStats() : connections(0), requests(0), reads(0), bytesIn(0), bytesOut(0) {}
+};
+
+class DBServer
+{
+public:
+    explicit DBServer(DBsystem &db);
+    ~DBServer();
+
+    /**
+     * @brief Bind and listen.
+     * @param address "unix:/path", a path containing '/', "tcp:host:port",
+     *        "tcp:port" or a bare port (loopback).
+     */
+    bool listen(const std::string &address, std::string &error);
+
+    /** @brief Serve until stop(). @return False on a fatal socket error. */
+    bool run(std::string &error);
+
+    /** @brief Make run() return. Safe from other threads and signal handlers. */
+    void stop();
+
+    const ServerStats &stats() const { return m_stats; }
+
+    /** @brief Blocking client socket to @p address (same forms as listen). @return fd or -1. */
+    static int connectTo(const std::string &address, std::string &error);
+
+    /**
+     * @brief Length of the complete reply at the start of @p data.
+     * @return 0 if more bytes are needed, -1 if the bytes are not a reply.
+     */
+    static long replyLength(const char *data, size_t size);
+
+private:
+    struct Connection
+    {
+        int fd;
+        std::string in;
+        size_t inPos;           ///< Start of the first unparsed request
+        std::string out;
+        size_t outPos;          ///< Start of the first unsent byte
+        bool closing;           ///< QUIT or a protocol error: close once out is sent
+        bool paused;            ///< Stopped on MAX_PENDING_OUTPUT with requests left in in
+        uint32_t events;        ///< Interest registered with epoll
+
+        Connection(int f) : fd(f), inPos(0), outPos(0), closing(false), paused(false), events(0) {}
+    };
+
+    DBsystem &m_db;
+    int m_listenFd;
+    int m_epollFd;
+    int m_wakeFd;                                   ///< eventfd written by stop()
+    std::string m_unixPath;                         ///< Unlinked on close
+    std::unordered_map<int, Connection *> m_connections;
+    std::vector<Connection *> m_ready;              ///< Connections with replies to send this wake
+    std::vector<std::string> m_args;                ///< Reused per request
+    ServerStats m_stats;
+
+    void acceptAll();
+    bool readAll(Connection *c);
+    void process(Connection *c);
+    long parseRequest(const char *data, size_t size, std::string &error);
+    bool execute(std::string &out);
+    bool flush(Connection *c);
+    void updateEvents(Connection *c);
+    void closeConnection(Connection *c);
+    void closeAll();
+
+    DBServer(const DBServer &);
+    DBServer &operator=(const DBServer &);
+};
+
+#endif
@@ -1,57 +1,1231 @@
 #include "DBsystem.h"
+#include "Checkpoint.h"
+#include "Snapshot.h"
+#include "TaskScheduler.h"
+#include "Transaction.h"
+#include <algorithm>
 
-DBsystem::DBsystem()
+namespace
 {
-    
+    // Per-thread so a bulk load never delays other writers' durability
+    thread_local int t_bulkDepth = 0;
+    thread_local uint64_t t_bulkLsn = 0;
+}
+
+DBsystem::DBsystem() : m_courseIndex(INDEX_TREE), m_enrollmentIndex(INDEX_TREE), m_base(NULL),
+                       m_baseStudentsLeft(0), m_baseFacultyLeft(0), m_log(NULL),
+                       m_versionTime(VERSION_START), m_checkpointer(NULL), m_cleared(false),
+                       m_snapshotsOn(false), m_snapshotStale(true), m_versionSeq(0), m_rebuiltSeq(0),
+                       m_activeTransactions(0)
+{
+
 }
 DBsystem::~DBsystem()
 {
-    
+    closeDurable();
+    detachLog();
+    delete m_base;
 }
 
-void DBsystem::addStudent(const Student &student)
+// Refuses an id that is taken; upsertStudent replaces instead
+bool DBsystem::addStudent(const Student &student)
 {
-    studentTree.insert(student);
+    uint64_t lsn;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed() || lookupStudent(student.getID()) != NULL)
+        {
+            return false;
+        }
+        studentTree.insert(student);
+        noteStudent(student.getID());
+        lsn = logStudent(WAL_ADD_STUDENT, student);
+    }
+    awaitDurable(lsn);
+    return true;
 }
 
 void DBsystem::deleteStudent(int studentId)
 {
+    uint64_t lsn;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed())
+        {
+            return;
+        }
+        removeStudentLocked(studentId);
+        lsn = logIds(WAL_DELETE_STUDENT, studentId, 0);
+    }
+    awaitDurable(lsn);
+}
+
+void DBsystem::removeStudentLocked(int studentId)
+{
+    faultStudent(studentId);
     Student temp(studentId, "", "", "", 0.0, 0);
+    if (m_studentHistory.chain(studentId) != NULL)
+    {
+        // Versioned: the deleted record stays readable as of earlier times
+        const Student *last = studentTree.search(temp);
+        if (studentsVersioned() && last != NULL)
+            m_studentHistory.retire(studentId, *last, m_versionTime);
+        else
+            m_studentHistory.erase(studentId);
+    }
     studentTree.remove(temp);
+    noteStudent(studentId);
+    if (m_checkpointer != NULL)
+    {
+        m_deletedStudents.push_back(studentId);
+    }
 }
 
+// Faulting a base record in reshapes the tree, so lookups over an opened
+// snapshot take the tree lock. A checkpoint holds it while it copies out the
+// changed records, not while it swaps the log
 Student *DBsystem::findStudent(int studentId)
 {
+    if (m_base != NULL)
+    {
+        std::lock_guard<std::mutex> guard(m_treeMutex);
+        return lookupStudent(studentId);
+    }
+    return lookupStudent(studentId);
+}
+
+Student *DBsystem::lookupStudent(int studentId, bool forUpdate)
+{
+    faultStudent(studentId);
+    if (forUpdate)
+    {
+        noteStudent(studentId);
+    }
     Student temp(studentId, "", "", "", 0.0, 0);
-    return studentTree.search(temp);
+    return forUpdate ? studentTree.searchForUpdate(temp) : studentTree.search(temp);
 }
 
 void DBsystem::displayAllStudents()
 {
     std::cout << "All Students:" << std::endl;
+    loadAllStudents();
     studentTree.printInOrder();
 }
 
-void DBsystem::addFaculty(const Faculty &faculty)
+// Insert or overwrite by ID. Returns true if the student was new.
+bool DBsystem::upsertStudent(const Student &student)
+{
+    bool inserted;
+    uint64_t lsn;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed())
+        {
+            return false;
+        }
+        Student *existing = lookupStudent(student.getID(), true);
+        inserted = existing == NULL;
+        if (inserted)
+            studentTree.insert(student);
+        else
+            *existing = student;
+        lsn = logStudent(WAL_UPSERT_STUDENT, student);
+    }
+    awaitDurable(lsn);
+    return inserted;
+}
+
+UpsertCounts DBsystem::upsertStudents(std::vector<Student> &batch)
+{
+    UpsertCounts counts;
+    TaskScheduler::shared().parallelStableSort(batch.begin(), batch.end());
+    size_t kept = 0;
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        if (i + 1 == batch.size() || batch[i + 1].getID() != batch[i].getID())
+        {
+            if (kept != i)
+                batch[kept] = batch[i];
+            ++kept;
+        }
+    }
+    batch.resize(kept);
+
+    uint64_t lsn = 0;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed())
+        {
+            return counts;
+        }
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            faultStudent(batch[i].getID());
+            noteStudent(batch[i].getID());
+            lsn = logStudent(WAL_UPSERT_STUDENT, batch[i]);
+        }
+        counts.inserted = studentTree.mergeSorted(batch.data(), int(batch.size()));
+        counts.updated = (long long)batch.size() - counts.inserted;
+    }
+    awaitDurable(lsn);
+    return counts;
+}
+
+// Bulk SCD Type-2 load: one lock for the batch. A new key opens its first
+// version at effectiveFrom; a changed one has its current version closed
+// there. A time at or before the current version's start rewrites that
+// version in place rather than making an empty one.
+VersionCounts DBsystem::closeAndInsertStudents(const std::vector<Student> &rows, int64_t effectiveFrom)
+{
+    VersionCounts counts;
+    uint64_t lsn = 0;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed())
+        {
+            return counts;
+        }
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            const Student &row = rows[i];
+            Student *current = lookupStudent(row.getID(), true);
+            if (current == NULL)
+            {
+                studentTree.insert(row);
+                m_studentHistory.open(row.getID(), effectiveFrom);
+                ++counts.inserted;
+            }
+            else if (VersionStore::sameVersion(*current, row))
+            {
+                ++counts.unchanged;
+                continue;
+            }
+            else
+            {
+                if (effectiveFrom > m_studentHistory.currentFrom(row.getID()))
+                    m_studentHistory.close(row.getID(), *current, effectiveFrom);
+                *current = row;
+                ++counts.updated;
+            }
+            lsn = logStudent(WAL_UPSERT_STUDENT, row);
+        }
+    }
+    awaitDurable(lsn);
+    return counts;
+}
+
+// The version effective at timestamp: the tree's record for the current
+// span (and for keys without history), the stored copy for closed ones
+const Student *DBsystem::findStudentAsOf(int studentId, int64_t timestamp, VersionSpan *span)
+{
+    bool known;
+    const VersionSpan *found = m_studentHistory.find(studentId, timestamp, known);
+    if (known && found == NULL)
+    {
+        return NULL;
+    }
+    if (found != NULL && found->record >= 0)
+    {
+        if (span != NULL)
+            *span = *found;
+        return &m_studentHistory.record(*found);
+    }
+    const Student *current = findStudent(studentId);
+    if (span != NULL && current != NULL)
+    {
+        VersionSpan always = {VERSION_START, VERSION_OPEN, -1};
+        *span = found != NULL ? *found : always;
+    }
+    return current;
+}
+
+int DBsystem::studentCount()
+{
+    return studentTree.size() + int(m_baseStudentsLeft);
+}
+
+bool DBsystem::addFaculty(const Faculty &faculty)
 {
-    facultyTree.insert(faculty);
+    uint64_t lsn;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed() || lookupFaculty(faculty.getID()) != NULL)
+        {
+            return false;
+        }
+        facultyTree.insert(faculty);
+        noteFaculty(faculty.getID());
+        lsn = logFaculty(WAL_ADD_FACULTY, faculty);
+    }
+    awaitDurable(lsn);
+    return true;
 }
 
 void DBsystem::deleteFaculty(int facultyId)
 {
+    uint64_t lsn;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed())
+        {
+            return;
+        }
+        removeFacultyLocked(facultyId);
+        lsn = logIds(WAL_DELETE_FACULTY, facultyId, 0);
+    }
+    awaitDurable(lsn);
+}
+
+void DBsystem::removeFacultyLocked(int facultyId)
+{
+    faultFaculty(facultyId);
     Faculty temp(facultyId, "", "", "");
     facultyTree.remove(temp);
+    noteFaculty(facultyId);
+    if (m_checkpointer != NULL)
+    {
+        m_deletedFaculty.push_back(facultyId);
+    }
 }
 
 Faculty *DBsystem::findFaculty(int facultyId)
 {
+    if (m_base != NULL)
+    {
+        std::lock_guard<std::mutex> guard(m_treeMutex);
+        return lookupFaculty(facultyId);
+    }
+    return lookupFaculty(facultyId);
+}
+
+Faculty *DBsystem::lookupFaculty(int facultyId, bool forUpdate)
+{
+    faultFaculty(facultyId);
+    if (forUpdate)
+    {
+        noteFaculty(facultyId);
+    }
     Faculty temp(facultyId, "", "", "");
-    return facultyTree.search(temp);
+    return forUpdate ? facultyTree.searchForUpdate(temp) : facultyTree.search(temp);
 }
 
 void DBsystem::displayAllFaculty()
 {
     std::cout << "All Faculty:" << std::endl;
+    loadAllFaculty();
     facultyTree.printInOrder();
 }
 
+// Insert or overwrite by ID. The advisee list of an existing faculty member
+// is kept, since external feeds do not carry it. Returns true if new.
+bool DBsystem::upsertFaculty(const Faculty &faculty)
+{
+    bool inserted;
+    uint64_t lsn;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed())
+        {
+            return false;
+        }
+        Faculty *existing = lookupFaculty(faculty.getID(), true);
+        inserted = existing == NULL;
+        if (inserted)
+        {
+            facultyTree.insert(faculty);
+        }
+        else
+        {
+            existing->setName(faculty.getName());
+            existing->setLevel(faculty.getLevel());
+            existing->setDepartment(faculty.getDepartment());
+        }
+        lsn = logFaculty(WAL_UPSERT_FACULTY, faculty);
+    }
+    awaitDurable(lsn);
+    return inserted;
+}
+
+int DBsystem::facultyCount()
+{
+    return facultyTree.size() + int(m_baseFacultyLeft);
+}
+
+// Switches an empty course or enrollment table between the tree and the skip list
+bool DBsystem::setTableIndex(const std::string &table, TableIndex index, std::string &error)
+{
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    TableIndex *current;
+    if (table == "courses")
+    {
+        current = &m_courseIndex;
+    }
+    else if (table == "enrollments")
+    {
+        current = &m_enrollmentIndex;
+    }
+    else
+    {
+        error = "no index choice for table '" + table + "' (courses or enrollments)";
+        return false;
+    }
+    if (*current == index)
+    {
+        return true;
+    }
+    long long rows = current == &m_courseIndex ? courseCount() : enrollmentCount();
+    if (rows != 0)
+    {
+        error = "table '" + table + "' must be empty to change its index";
+        return false;
+    }
+    *current = index;
+    return true;
+}
+
+// Under INDEX_SKIPLIST the list takes concurrent writers itself
+bool DBsystem::upsertCourse(const Course &course)
+{
+    if (m_courseIndex == INDEX_SKIPLIST)
+    {
+        return courseList.upsert(course);
+    }
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    Course *existing = courseTree.search(course);
+    if (existing != NULL)
+    {
+        *existing = course;
+        return false;
+    }
+    courseTree.insert(course, false);
+    return true;
+}
+
+// A copy, since a skip list record can be freed as soon as a concurrent
+// upsert replaces it
+bool DBsystem::findCourse(int courseId, Course &course)
+{
+    Course temp(courseId, "", "", 0, "", 0);
+    if (m_courseIndex == INDEX_SKIPLIST)
+    {
+        return courseList.find(temp, course);
+    }
+    const Course *found = courseTree.search(temp);
+    if (found == NULL)
+    {
+        return false;
+    }
+    course = *found;
+    return true;
+}
+
+int DBsystem::courseCount()
+{
+    if (m_courseIndex == INDEX_SKIPLIST)
+    {
+        return int(courseList.size());
+    }
+    return courseTree.size();
+}
+
+bool DBsystem::upsertEnrollment(const Enrollment &enrollment)
+{
+    if (m_enrollmentIndex == INDEX_SKIPLIST)
+    {
+        return enrollmentList.upsert(enrollment);
+    }
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    Enrollment *existing = enrollmentTree.search(enrollment);
+    if (existing != NULL)
+    {
+        *existing = enrollment;
+        return false;
+    }
+    enrollmentTree.insert(enrollment, false);
+    return true;
+}
+
+bool DBsystem::findEnrollment(int enrollmentId, Enrollment &enrollment)
+{
+    Enrollment temp(enrollmentId, 0, 0, "", "", 0.0);
+    if (m_enrollmentIndex == INDEX_SKIPLIST)
+    {
+        return enrollmentList.find(temp, enrollment);
+    }
+    const Enrollment *found = enrollmentTree.search(temp);
+    if (found == NULL)
+    {
+        return false;
+    }
+    enrollment = *found;
+    return true;
+}
+
+int DBsystem::enrollmentCount()
+{
+    if (m_enrollmentIndex == INDEX_SKIPLIST)
+    {
+        return int(enrollmentList.size());
+    }
+    return enrollmentTree.size();
+}
+
+// Moves a student to a new advisor, keeping both advisee lists in step
+void DBsystem::changeAdvisor(int studentId, int facultyId)
+{
+    uint64_t lsn;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed())
+        {
+            return;
+        }
+        Student *student = lookupStudent(studentId, true);
+        if (student == NULL)
+        {
+            return;
+        }
+        Faculty *oldAdvisor = lookupFaculty(student->getAdvisor(), true);
+        if (oldAdvisor != NULL)
+        {
+            oldAdvisor->removeAdvisee(studentId);
+        }
+        Faculty *newAdvisor = lookupFaculty(facultyId, true);
+        if (newAdvisor != NULL)
+        {
+            newAdvisor->addAdvisee(studentId);
+        }
+        student->setAdvisor(facultyId);
+        lsn = logIds(WAL_CHANGE_ADVISOR, studentId, facultyId);
+    }
+    awaitDurable(lsn);
+}
+
+// Drops studentId from facultyId's advisees; the student is left without
+// an advisor if that faculty member was theirs
+void DBsystem::removeAdvisee(int studentId, int facultyId)
+{
+    uint64_t lsn;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        if (logFailed())
+        {
+            return;
+        }
+        Faculty *faculty = lookupFaculty(facultyId, true);
+        if (faculty != NULL)
+        {
+            faculty->removeAdvisee(studentId);
+        }
+        Student *student = lookupStudent(studentId, true);
+        if (student != NULL && student->getAdvisor() == facultyId)
+        {
+            student->setAdvisor(0);
+        }
+        lsn = logIds(WAL_REMOVE_ADVISEE, studentId, facultyId);
+    }
+    awaitDurable(lsn);
+}
+
+// Split ids at ranks n/parts, 2n/parts, ... so every range holds the same
+// number of records whatever the tree's shape
+void DBsystem::studentSplitKeys(int parts, std::vector<int> &keys)
+{
+    loadAllStudents();
+    keys.clear();
+    long long n = studentTree.size();
+    for (int i = 1; i < parts; ++i)
+    {
+        const Student *s = studentTree.atRank(int(n * i / parts));
+        if (s != NULL && (keys.empty() || s->getID() > keys.back()))
+        {
+            keys.push_back(s->getID());
+        }
+    }
+}
+
+void DBsystem::facultySplitKeys(int parts, std::vector<int> &keys)
+{
+    loadAllFaculty();
+    keys.clear();
+    long long n = facultyTree.size();
+    for (int i = 1; i < parts; ++i)
+    {
+        const Faculty *f = facultyTree.atRank(int(n * i / parts));
+        if (f != NULL && (keys.empty() || f->getID() > keys.back()))
+        {
+            keys.push_back(f->getID());
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Write-ahead log
+// ---------------------------------------------------------------------------
+
+bool DBsystem::attachLog(const std::string &path, SyncPolicy policy, std::string &error, ReplayStats *stats,
+                         int windowMicros)
+{
+    detachLog();
+    ReplayStats replayed;
+    if (!WriteAheadLog::replay(path, *this, replayed, error, m_base != NULL ? m_base->logOffset() : 0))
+    {
+        return false;
+    }
+    if (stats != NULL)
+    {
+        *stats = replayed;
+    }
+    WriteAheadLog *log = new WriteAheadLog();
+    if (!log->open(path, policy, error, windowMicros))
+    {
+        delete log;
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(m_writeMutex);
+    m_log = log;
+    return true;
+}
+
+void DBsystem::detachLog()
+{
+    delete m_log; // closes after a final sync
+    m_log = NULL;
+}
+
+uint64_t DBsystem::logStudent(WalRecordType type, const Student &student)
+{
+    return m_log ? m_log->append(WalRecord(type).putStudent(student).bytes()) : 0;
+}
+
+uint64_t DBsystem::logFaculty(WalRecordType type, const Faculty &faculty)
+{
+    return m_log ? m_log->append(WalRecord(type).putFaculty(faculty).bytes()) : 0;
+}
+
+uint64_t DBsystem::logIds(WalRecordType type, int first, int second)
+{
+    if (m_log == NULL)
+    {
+        return 0;
+    }
+    WalRecord record(type);
+    record.putInt(first);
+    if (type == WAL_CHANGE_ADVISOR || type == WAL_REMOVE_ADVISEE)
+    {
+        record.putInt(second);
+    }
+    return m_log->append(record.bytes());
+}
+
+// Called after the write lock is released so group commit can batch writers
+bool DBsystem::awaitDurable(uint64_t lsn)
+{
+    if (t_bulkDepth > 0)
+    {
+        t_bulkLsn = std::max(t_bulkLsn, lsn);
+        return !logFailed();
+    }
+    return m_log == NULL || m_log->waitDurable(lsn);
+}
+
+bool DBsystem::logFailed()
+{
+    return m_log != NULL && m_log->failed();
+}
+
+void DBsystem::beginBulk()
+{
+    ++t_bulkDepth;
+}
+
+bool DBsystem::endBulk()
+{
+    if (t_bulkDepth > 0 && --t_bulkDepth == 0)
+    {
+        uint64_t lsn = t_bulkLsn;
+        t_bulkLsn = 0;
+        return awaitDurable(lsn);
+    }
+    return !logFailed();
+}
+
+uint64_t DBsystem::takeBulkLsn()
+{
+    uint64_t lsn = t_bulkLsn;
+    t_bulkLsn = 0;
+    return lsn;
+}
+
+// ---------------------------------------------------------------------------
+// Checkpoints
+// ---------------------------------------------------------------------------
+
+bool DBsystem::openDurable(const std::string &dir, const CheckpointPolicy &policy, std::string &error,
+                           RecoveryStats *stats)
+{
+    closeDurable();
+    detachLog();
+    m_checkpointer = new Checkpointer(*this);
+    if (!m_checkpointer->open(dir, policy, error, stats))
+    {
+        closeDurable();
+        detachLog();
+        return false;
+    }
+    return true;
+}
+
+void DBsystem::closeDurable()
+{
+    delete m_checkpointer; // stops the background thread
+    m_checkpointer = NULL;
+    std::lock_guard<std::mutex> guard(m_writeMutex);
+    m_deletedStudents.clear();
+    m_deletedFaculty.clear();
+    m_cleared = false;
+}
+
+bool DBsystem::checkpoint(std::string &error)
+{
+    if (m_checkpointer == NULL)
+    {
+        error = "no data directory is open";
+        return false;
+    }
+    return m_checkpointer->checkpoint(error);
+}
+
+// Appends every change since the last call to records as log-format
+// records (clear, then deletes, then changed records in tree pre-order)
+// and switches the log to nextLogPath, all under the write lock so the
+// records and the old log segments cover exactly the same mutations.
+// Nothing changed means no rotation, unless rotate asks for one anyway.
+bool DBsystem::captureChanges(const std::string &nextLogPath, bool rotate, std::string &records, bool &rotated,
+                              std::string &error)
+{
+    WriteAheadLog *log = NULL;
+    {
+        std::lock_guard<std::mutex> guard(m_writeMutex);
+        std::unique_lock<std::mutex> trees(m_treeMutex); // lookups may be faulting base records in
+        rotated = false;
+        if (m_log == NULL)
+        {
+            error = "no log is attached";
+            return false;
+        }
+        if (!rotate && !m_cleared && m_deletedStudents.empty() && m_deletedFaculty.empty() &&
+            !studentTree.hasDirty() && !facultyTree.hasDirty())
+        {
+            return true;
+        }
+        trees.unlock();
+        if (!m_log->rotate(nextLogPath, error))
+        {
+            return false;
+        }
+        rotated = true;
+        log = m_log;
+        trees.lock();
+
+        if (m_cleared)
+        {
+            records += WalRecord(WAL_CLEAR).bytes();
+        }
+        for (size_t i = 0; i < m_deletedStudents.size(); ++i)
+        {
+            records += WalRecord(WAL_DELETE_STUDENT).putInt(m_deletedStudents[i]).bytes();
+        }
+        for (size_t i = 0; i < m_deletedFaculty.size(); ++i)
+        {
+            records += WalRecord(WAL_DELETE_FACULTY).putInt(m_deletedFaculty[i]).bytes();
+        }
+        auto putStudent = [&](const Student &s) { records += WalRecord(WAL_UPSERT_STUDENT).putStudent(s).bytes(); };
+        studentTree.drainDirty(putStudent);
+        auto putFaculty = [&](const Faculty &f) { records += WalRecord(WAL_PUT_FACULTY).putFaculty(f).bytes(); };
+        facultyTree.drainDirty(putFaculty);
+
+        m_deletedStudents.clear();
+        m_deletedFaculty.clear();
+        m_cleared = false;
+    }
+    // The rotated-out segment is synced without the write lock, so writers
+    // and lookups only wait for the swap. A failed sync leaves the log in
+    // its error state for writers to see; the delta covers these records.
+    log->sync();
+    return true;
+}
+
+void DBsystem::markClean()
+{
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    auto ignoreStudent = [](const Student &) {};
+    studentTree.drainDirty(ignoreStudent);
+    auto ignoreFaculty = [](const Faculty &) {};
+    facultyTree.drainDirty(ignoreFaculty);
+    m_deletedStudents.clear();
+    m_deletedFaculty.clear();
+    m_cleared = false;
+}
+
+// ---------------------------------------------------------------------------
+// Snapshots
+// ---------------------------------------------------------------------------
+
+// With a log attached the snapshot records how much of it is included,
+// after syncing so that much is on disk for a replay to skip over. Writers
+// wait for the whole save so the trees and the offset agree; lookups only
+// wait while the last base records are faulted in, as none are left after.
+bool DBsystem::save(const std::string &path, std::string &error)
+{
+    std::lock_guard<std::mutex> guard(m_writeMutex);
+    {
+        std::lock_guard<std::mutex> trees(m_treeMutex);
+        loadAllStudents();
+        loadAllFaculty();
+    }
+    uint64_t logOffset = 0;
+    if (m_log != NULL)
+    {
+        if (!m_log->sync())
+        {
+            error = "cannot sync log " + m_log->path();
+            return false;
+        }
+        logOffset = m_log->segmentBytes();
+    }
+    return SnapshotWriter::write(*this, path, error, logOffset);
+}
+
+// Replaces the contents with the snapshot at path. Nothing is read beyond
+// the header; records are copied into the trees as they are first used.
+// Refused while a log is attached: the log would no longer describe the
+// data, and replaying it on top of the snapshot would apply it twice.
+bool DBsystem::open(const std::string &path, std::string &error)
+{
+    if (m_log != NULL)
+    {
+        error = "detach the write-ahead log " + m_log->path() + " before opening a snapshot";
+        return false;
+    }
+    SnapshotReader *base = new SnapshotReader();
+    if (!base->open(path, error))
+    {
+        delete base;
+        return false;
+    }
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    clearLocked();
+    m_base = base;
+    m_studentLoaded.assign(size_t(base->studentCount()), false);
+    m_facultyLoaded.assign(size_t(base->facultyCount()), false);
+    m_baseStudentsLeft = (long long)base->studentCount();
+    m_baseFacultyLeft = (long long)base->facultyCount();
+    return true;
+}
+
+bool DBsystem::verifySnapshot()
+{
+    return m_base == NULL || m_base->verify();
+}
+
+// ---------------------------------------------------------------------------
+// MVCC snapshots
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    template <typename T>
+    struct Collect
+    {
+        std::vector<T> rows;
+        void operator()(const T &row) { rows.push_back(row); }
+    };
+
+    void sortUnique(std::vector<int> &ids)
+    {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+}
+
+// The first call (and the first after a clear or open) copies both tables
+// into fresh versions; later ones path-copy just the keys written since.
+// While transactions run, each key applied is stamped with the new
+// sequence number so commit can tell what changed after a begin.
+void DBsystem::refreshVersionsLocked()
+{
+    if (m_snapshotStale)
+    {
+        loadAllStudents();
+        loadAllFaculty();
+        Collect<Student> students;
+        studentTree.visitInOrder(students);
+        m_studentVersion = PersistentBST<Student>::build(students.rows.data(), (long long)students.rows.size());
+        Collect<Faculty> faculty;
+        facultyTree.visitInOrder(faculty);
+        m_facultyVersion = PersistentBST<Faculty>::build(faculty.rows.data(), (long long)faculty.rows.size());
+        m_snapshotsOn = true;
+        m_snapshotStale = false;
+        m_rebuiltSeq = ++m_versionSeq;
+        m_studentWrittenAt.clear();
+        m_facultyWrittenAt.clear();
+    }
+    else if (!m_changedStudents.empty() || !m_changedFaculty.empty())
+    {
+        ++m_versionSeq;
+        bool stamp = m_activeTransactions > 0;
+        sortUnique(m_changedStudents);
+        for (size_t i = 0; i < m_changedStudents.size(); ++i)
+        {
+            Student temp(m_changedStudents[i], "", "", "", 0.0, 0);
+            const Student *current = studentTree.search(temp);
+            m_studentVersion = current != NULL ? m_studentVersion.insert(*current) : m_studentVersion.remove(temp);
+            if (stamp)
+                m_studentWrittenAt[m_changedStudents[i]] = m_versionSeq;
+        }
+        sortUnique(m_changedFaculty);
+        for (size_t i = 0; i < m_changedFaculty.size(); ++i)
+        {
+            Faculty temp(m_changedFaculty[i], "", "", "");
+            const Faculty *current = facultyTree.search(temp);
+            m_facultyVersion = current != NULL ? m_facultyVersion.insert(*current) : m_facultyVersion.remove(temp);
+            if (stamp)
+                m_facultyWrittenAt[m_changedFaculty[i]] = m_versionSeq;
+        }
+    }
+    m_changedStudents.clear();
+    m_changedFaculty.clear();
+}
+
+DBsnapshot DBsystem::snapshot()
+{
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    refreshVersionsLocked();
+    DBsnapshot view;
+    view.students = m_studentVersion;
+    view.faculty = m_facultyVersion;
+    return view;
+}
+
+const Student *DBsnapshot::findStudent(int studentId) const
+{
+    Student temp(studentId, "", "", "", 0.0, 0);
+    return students.search(temp);
+}
+
+const Faculty *DBsnapshot::findFaculty(int facultyId) const
+{
+    Faculty temp(facultyId, "", "", "");
+    return faculty.search(temp);
+}
+
+// ---------------------------------------------------------------------------
+// Transactions
+// ---------------------------------------------------------------------------
+
+void DBsystem::begin(Transaction &txn)
+{
+    if (txn.m_active && txn.m_db != this)
+    {
+        txn.m_db->abort(txn);
+    }
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    if (txn.m_active)
+    {
+        --m_activeTransactions;
+    }
+    txn.reset();
+    txn.m_db = this;
+    if (m_activeTransactions == 0)
+    {
+        // Stamps only matter to transactions that began before them
+        m_studentWrittenAt.clear();
+        m_facultyWrittenAt.clear();
+    }
+    refreshVersionsLocked();
+    txn.m_snapshot.students = m_studentVersion;
+    txn.m_snapshot.faculty = m_facultyVersion;
+    txn.m_startSeq = m_versionSeq;
+    txn.m_active = true;
+    ++m_activeTransactions;
+}
+
+namespace
+{
+    template <typename Writes>
+    int firstConflict(const Writes &writes, const std::unordered_map<int, uint64_t> &writtenAt, uint64_t since)
+    {
+        for (typename Writes::const_iterator it = writes.begin(); it != writes.end(); ++it)
+        {
+            std::unordered_map<int, uint64_t>::const_iterator stamp = writtenAt.find(it->first);
+            if (stamp != writtenAt.end() && stamp->second > since)
+            {
+                return it->first;
+            }
+        }
+        return -1;
+    }
+}
+
+// First committer wins: stamps every write made since begin (refresh), then
+// fails if any key this transaction writes carries a newer stamp. Otherwise
+// every write is applied under the one lock and logged as one record, so
+// neither snapshots nor recovery can see part of it.
+bool DBsystem::commit(Transaction &txn, std::string &error)
+{
+    if (!txn.m_active)
+    {
+        error = "transaction not begun";
+        return false;
+    }
+    uint64_t lsn = 0;
+    {
+        std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+        refreshVersionsLocked();
+        int student = firstConflict(txn.m_students, m_studentWrittenAt, txn.m_startSeq);
+        int faculty = firstConflict(txn.m_faculty, m_facultyWrittenAt, txn.m_startSeq);
+        if (m_rebuiltSeq > txn.m_startSeq || student >= 0 || faculty >= 0)
+        {
+            if (m_rebuiltSeq > txn.m_startSeq)
+                error = "write conflict: the database was cleared or reloaded since the transaction began";
+            else if (student >= 0)
+                error = "write conflict on student " + std::to_string(student);
+            else
+                error = "write conflict on faculty " + std::to_string(faculty);
+            --m_activeTransactions;
+            txn.reset();
+            return false;
+        }
+        if (logFailed())
+        {
+            error = "the log has a write error; the database takes no more writes";
+            --m_activeTransactions;
+            txn.reset();
+            return false;
+        }
+
+        WalRecord record(WAL_TRANSACTION);
+        record.putInt((long long)(txn.m_students.size() + txn.m_faculty.size()));
+        std::map<int, Transaction::Write<Student> >::const_iterator s;
+        for (s = txn.m_students.begin(); s != txn.m_students.end(); ++s)
+        {
+            if (s->second.deleted)
+            {
+                removeStudentLocked(s->first);
+                record.putInt(WAL_DELETE_STUDENT).putInt(s->first);
+                continue;
+            }
+            Student *existing = lookupStudent(s->first, true);
+            if (existing != NULL)
+                *existing = s->second.row;
+            else
+                studentTree.insert(s->second.row);
+            record.putInt(WAL_UPSERT_STUDENT).putStudent(s->second.row);
+        }
+        std::map<int, Transaction::Write<Faculty> >::const_iterator f;
+        for (f = txn.m_faculty.begin(); f != txn.m_faculty.end(); ++f)
+        {
+            if (f->second.deleted)
+            {
+                removeFacultyLocked(f->first);
+                record.putInt(WAL_DELETE_FACULTY).putInt(f->first);
+                continue;
+            }
+            Faculty *existing = lookupFaculty(f->first, true);
+            if (existing != NULL)
+                *existing = f->second.row;
+            else
+                facultyTree.insert(f->second.row);
+            record.putInt(WAL_PUT_FACULTY).putFaculty(f->second.row);
+        }
+        if (m_log != NULL && txn.writeCount() > 0)
+        {
+            lsn = m_log->append(record.bytes());
+        }
+        --m_activeTransactions;
+        txn.reset();
+    }
+    if (!awaitDurable(lsn))
+    {
+        error = "the log has a write error; the commit is applied but not durable";
+        return false;
+    }
+    return true;
+}
+
+void DBsystem::abort(Transaction &txn)
+{
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    if (txn.m_active)
+    {
+        --m_activeTransactions;
+    }
+    txn.reset();
+}
+
+void DBsystem::clear()
+{
+    std::scoped_lock<std::mutex, std::mutex> guard(m_writeMutex, m_treeMutex);
+    if (logFailed())
+    {
+        return;
+    }
+    uint64_t lsn = logIds(WAL_CLEAR, 0, 0);
+    clearLocked();
+    if (m_checkpointer != NULL)
+    {
+        m_cleared = true;
+        m_deletedStudents.clear();
+        m_deletedFaculty.clear();
+    }
+    if (lsn != 0)
+    {
+        m_log->sync();
+    }
+}
+
+void DBsystem::clearLocked()
+{
+    studentTree.clear();
+    facultyTree.clear();
+    courseTree.clear();
+    enrollmentTree.clear();
+    courseList.clear();
+    enrollmentList.clear();
+    m_studentHistory.clear();
+    delete m_base;
+    m_base = NULL;
+    m_studentLoaded.clear();
+    m_facultyLoaded.clear();
+    m_baseStudentsLeft = 0;
+    m_baseFacultyLeft = 0;
+    m_snapshotStale = true;
+    m_changedStudents.clear();
+    m_changedFaculty.clear();
+}
+
+// Copies the base record for studentId into the tree the first time the key
+// is touched, so the tree always holds the authoritative version afterwards
+void DBsystem::faultStudent(int studentId)
+{
+    if (m_baseStudentsLeft == 0)
+    {
+        return;
+    }
+    long long index = m_base->findStudent(studentId);
+    if (index < 0 || m_studentLoaded[size_t(index)])
+    {
+        return;
+    }
+    m_studentLoaded[size_t(index)] = true;
+    --m_baseStudentsLeft;
+    Student s;
+    if (m_base->studentAt(uint64_t(index), s))
+    {
+        studentTree.insert(s, false);
+    }
+}
+
+void DBsystem::faultFaculty(int facultyId)
+{
+    if (m_baseFacultyLeft == 0)
+    {
+        return;
+    }
+    long long index = m_base->findFaculty(facultyId);
+    if (index < 0 || m_facultyLoaded[size_t(index)])
+    {
+        return;
+    }
+    m_facultyLoaded[size_t(index)] = true;
+    --m_baseFacultyLeft;
+    Faculty f;
+    if (m_base->facultyAt(uint64_t(index), f))
+    {
+        facultyTree.insert(f, false);
+    }
+}
+
+// Records are sorted in the file; inserting middles first keeps the tree balanced
+void DBsystem::loadStudentRange(long long lo, long long hi)
+{
+    if (lo >= hi)
+    {
+        return;
+    }
+    long long mid = lo + (hi - lo) / 2;
+    if (!m_studentLoaded[size_t(mid)])
+    {
+        m_studentLoaded[size_t(mid)] = true;
+        --m_baseStudentsLeft;
+        Student s;
+        if (m_base->studentAt(uint64_t(mid), s))
+        {
+            studentTree.insert(s, false);
+        }
+    }
+    loadStudentRange(lo, mid);
+    loadStudentRange(mid + 1, hi);
+}
+
+void DBsystem::loadFacultyRange(long long lo, long long hi)
+{
+    if (lo >= hi)
+    {
+        return;
+    }
+    long long mid = lo + (hi - lo) / 2;
+    if (!m_facultyLoaded[size_t(mid)])
+    {
+        m_facultyLoaded[size_t(mid)] = true;
+        --m_baseFacultyLeft;
+        Faculty f;
+        if (m_base->facultyAt(uint64_t(mid), f))
+        {
+            facultyTree.insert(f, false);
+        }
+    }
+    loadFacultyRange(lo, mid);
+    loadFacultyRange(mid + 1, hi);
+}
+
+// Bounds are ids; the record array is sorted by id, so they map to one
+// slice of it
+void DBsystem::loadStudents(const int *lo, const int *hi)
+{
+    std::lock_guard<std::mutex> guard(m_treeMutex);
+    if (m_baseStudentsLeft > 0)
+    {
+        long long first = lo != NULL ? (long long)m_base->studentLowerBound(*lo) : 0;
+        long long last = hi != NULL ? (long long)m_base->studentLowerBound(*hi) : (long long)m_studentLoaded.size();
+        loadStudentRange(first, last);
+    }
+}
+
+void DBsystem::loadFaculty(const int *lo, const int *hi)
+{
+    std::lock_guard<std::mutex> guard(m_treeMutex);
+    if (m_baseFacultyLeft > 0)
+    {
+        long long first = lo != NULL ? (long long)m_base->facultyLowerBound(*lo) : 0;
+        long long last = hi != NULL ? (long long)m_base->facultyLowerBound(*hi) : (long long)m_facultyLoaded.size();
+        loadFacultyRange(first, last);
+    }
+}
+
+void DBsystem::loadAllStudents()
+{
+    if (m_baseStudentsLeft > 0)
+    {
+        loadStudentRange(0, (long long)m_studentLoaded.size());
+    }
+}
+
+void DBsystem::loadAllFaculty()
+{
+    if (m_baseFacultyLeft > 0)
+    {
+        loadFacultyRange(0, (long long)m_facultyLoaded.size());
+    }
+}
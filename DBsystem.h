@@ -1,9 +1,57 @@
 #ifndef DBsystem_H
 #define DBsystem_H
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "LazyBST.h"
+#include "PersistentBST.h"
+#include "SkipList.h"
 #include "Student.h"
 #include "Faculty.h"
+#include "Course.h"
+#include "Enrollment.h"
+#include "VersionStore.h"
+#include "WriteAheadLog.h"
+
+class SnapshotReader;
+
+/** @brief Outcome of a batched upsert. */
+struct UpsertCounts
+{
+        long long inserted;
+        long long updated;
+
+        UpsertCounts() : inserted(0), updated(0) {}
+};
+
+/** @brief Index behind a memory-only table (see setTableIndex). */
+enum TableIndex
+{
+        INDEX_TREE,             ///< LazyBST; writers take the write mutex
+        INDEX_SKIPLIST          ///< SkipList.h; writers and scans run lock-free
+};
+
+/**
+ * @brief The students and faculty tables as of one moment (see
+ *        DBsystem::snapshot). Readable from any thread with no locks while
+ *        the database keeps changing; the version is freed with the last
+ *        copy of the handle.
+ */
+struct DBsnapshot
+{
+        PersistentBST<Student> students;
+        PersistentBST<Faculty> faculty;
+
+        const Student *findStudent(int studentId) const;
+        const Faculty *findFaculty(int facultyId) const;
+};
+
+class Checkpointer;
+struct CheckpointPolicy;
+class Transaction;
+struct RecoveryStats;
 
 class DBsystem
 {
@@ -11,26 +59,275 @@ public:
         DBsystem();
         ~DBsystem();
 
-        void addStudent(const Student &student);
+        // False if the id is already taken (or writes are refused)
+        bool addStudent(const Student &student);
         void deleteStudent(int studentId);
         Student *findStudent(int studentId);
         void displayAllStudents();
+        bool upsertStudent(const Student &student);
+        // Sorts the batch by id (in place, on the shared TaskScheduler; the
+        // last row of an id wins), then merges it into the tree in one pass
+        UpsertCounts upsertStudents(std::vector<Student> &batch);
+        int studentCount();
+        template <typename Visitor>
+        void forEachStudent(Visitor &visit)
+        {
+                loadAllStudents();
+                studentTree.visitInOrder(visit);
+        }
 
-        void addFaculty(const Faculty &faculty);
+        // SCD Type-2 history (VersionStore.h). While a version time is set,
+        // loads close the current version of each changed student at that
+        // time instead of overwriting it. History is memory only.
+        void setStudentVersionTime(int64_t effectiveFrom) { m_versionTime = effectiveFrom; }
+        bool studentsVersioned() const { return m_versionTime != VERSION_START; }
+        int64_t studentVersionTime() const { return m_versionTime; }
+        VersionCounts closeAndInsertStudents(const std::vector<Student> &rows, int64_t effectiveFrom);
+        const Student *findStudentAsOf(int studentId, int64_t timestamp, VersionSpan *span = NULL);
+        const VersionStore &studentHistory() const { return m_studentHistory; }
+
+        bool addFaculty(const Faculty &faculty);
         void deleteFaculty(int facultyId);
         Faculty *findFaculty(int facultyId);
         void displayAllFaculty();
+        bool upsertFaculty(const Faculty &faculty);
+        int facultyCount();
+        template <typename Visitor>
+        void forEachFaculty(Visitor &visit)
+        {
+                loadAllFaculty();
+                facultyTree.visitInOrder(visit);
+        }
+
+        // Course catalog and enrollments, loaded with --ingest and joined
+        // by HashJoin.h. Memory only: not logged, snapshotted or checkpointed.
+        // Either table may be switched to a skip list while it is empty, so
+        // several ingest threads can upsert into it while others scan.
+        bool setTableIndex(const std::string &table, TableIndex index, std::string &error);
+        TableIndex courseIndex() const { return m_courseIndex; }
+        TableIndex enrollmentIndex() const { return m_enrollmentIndex; }
+
+        bool upsertCourse(const Course &course);
+        bool findCourse(int courseId, Course &course);
+        int courseCount();
+        template <typename Visitor>
+        void forEachCourse(Visitor &visit)
+        {
+                if (m_courseIndex == INDEX_SKIPLIST)
+                {
+                        courseList.visitInOrder(visit);
+                }
+                else
+                {
+                        courseTree.visitInOrder(visit);
+                }
+        }
+
+        bool upsertEnrollment(const Enrollment &enrollment);
+        bool findEnrollment(int enrollmentId, Enrollment &enrollment);
+        int enrollmentCount();
+        template <typename Visitor>
+        void forEachEnrollment(Visitor &visit)
+        {
+                if (m_enrollmentIndex == INDEX_SKIPLIST)
+                {
+                        enrollmentList.visitInOrder(visit);
+                }
+                else
+                {
+                        enrollmentTree.visitInOrder(visit);
+                }
+        }
+        template <typename Visitor>
+        void forEachEnrollmentInRange(const int *lo, const int *hi, Visitor &visit)
+        {
+                Enrollment loKey(lo ? *lo : 0, 0, 0, "", "", 0.0);
+                Enrollment hiKey(hi ? *hi : 0, 0, 0, "", "", 0.0);
+                if (m_enrollmentIndex == INDEX_SKIPLIST)
+                {
+                        enrollmentList.visitRange(lo ? &loKey : NULL, hi ? &hiKey : NULL, visit);
+                }
+                else
+                {
+                        enrollmentTree.visitRange(lo ? &loKey : NULL, hi ? &hiKey : NULL, visit);
+                }
+        }
+
+        // Range partitioning for parallel scans. The split-key calls load
+        // every snapshot record first; after that, disjoint ranges may be
+        // visited from several threads as long as nothing is written.
+        // A single-threaded range visit only needs loadStudents/loadFaculty
+        // over its own range (NULL bounds are open), which faults in just
+        // the snapshot records inside it.
+        void studentSplitKeys(int parts, std::vector<int> &keys);
+        void facultySplitKeys(int parts, std::vector<int> &keys);
+        void loadStudents(const int *lo, const int *hi);
+        void loadFaculty(const int *lo, const int *hi);
+        // Both stop after limit records (-1: no limit) and return how many
+        // they visited
+        template <typename Visitor>
+        long long forEachStudentInRange(const int *lo, const int *hi, Visitor &visit, long long limit = -1)
+        {
+                Student loKey(lo ? *lo : 0, "", "", "", 0.0, 0);
+                Student hiKey(hi ? *hi : 0, "", "", "", 0.0, 0);
+                return studentTree.visitRange(lo ? &loKey : NULL, hi ? &hiKey : NULL, visit, limit);
+        }
+        template <typename Visitor>
+        long long forEachFacultyInRange(const int *lo, const int *hi, Visitor &visit, long long limit = -1)
+        {
+                Faculty loKey(lo ? *lo : 0, "", "", "");
+                Faculty hiKey(hi ? *hi : 0, "", "", "");
+                return facultyTree.visitRange(lo ? &loKey : NULL, hi ? &hiKey : NULL, visit, limit);
+        }
+
         void MainMenu();
         void changeAdvisor(int studentId, int facultyId);
         void removeAdvisee(int studentId, int facultyId);
+
+        // Snapshots: save writes everything, open maps a file as the base
+        // layer and faults records into the trees on first access. A save
+        // notes how far into the attached log it reaches, and writers wait
+        // for it so the file matches that point; open is refused while a
+        // log is attached.
+        bool save(const std::string &path, std::string &error);
+        bool open(const std::string &path, std::string &error);
+        bool verifySnapshot();
+        void clear();
+
+        // MVCC reads for long-running reports: a consistent version of the
+        // students and faculty that later writes do not disturb. The first
+        // call loads every record; from then on writers note the keys they
+        // touch and the next call path-copies just those.
+        DBsnapshot snapshot();
+
+        // Transactions over students and faculty (Transaction.h): begin pins
+        // a snapshot; commit applies the buffered writes atomically, or
+        // fails with error (and aborts) if another writer changed one of
+        // the same keys since begin. Plain single-key calls never wait on
+        // transactions; once snapshots are on they just note their key.
+        void begin(Transaction &txn);
+        bool commit(Transaction &txn, std::string &error);
+        void abort(Transaction &txn);
+
+        // Write-ahead log: replays path (past the records the opened
+        // snapshot already holds), then logs every mutation to it.
+        // Writers are serialized; each returns once its record is durable
+        // under the chosen policy. Lookups are not synchronized with writers.
+        // Once a log write or sync fails the write that saw it stays in
+        // memory undurable, and every later mutation is refused (commit
+        // fails, the others change nothing) until a log is attached again.
+        bool attachLog(const std::string &path, SyncPolicy policy, std::string &error,
+                       ReplayStats *stats = NULL, int windowMicros = 1000);
+        void detachLog();
+        WriteAheadLog *log() { return m_log; }
+        bool logFailed();
+
+        // Bulk loads: between beginBulk and endBulk this thread's mutations
+        // do not wait for the log; endBulk waits once for all of them, and
+        // returns false if the log failed
+        void beginBulk();
+        bool endBulk();
+        // Inside a bulk section: hands the caller the LSN this thread's
+        // writes so far must wait for, and endBulk no longer waits for it.
+        // For callers that wait elsewhere (AsyncDB suspends instead).
+        uint64_t takeBulkLsn();
+
+        // Durable mode: recover from a data directory (base snapshot +
+        // deltas + log), then log every change there and checkpoint only
+        // what changed in the background. See Checkpoint.h.
+        bool openDurable(const std::string &dir, const CheckpointPolicy &policy, std::string &error,
+                         RecoveryStats *stats = NULL);
+        void closeDurable();
+        bool checkpoint(std::string &error);
+
         friend class LazyBST<Student>;
         friend class LazyBST<Faculty>;
-        
+        friend class Checkpointer;
+
 
 
 private:
         LazyBST<Student> studentTree;
         LazyBST<Faculty> facultyTree;
+        LazyBST<Course> courseTree;
+        LazyBST<Enrollment> enrollmentTree;
+        SkipList<Course> courseList;            ///< Used instead of courseTree under INDEX_SKIPLIST
+        SkipList<Enrollment> enrollmentList;
+        TableIndex m_courseIndex;
+        TableIndex m_enrollmentIndex;
+
+        SnapshotReader *m_base;                 ///< Mapped snapshot or NULL
+        std::vector<bool> m_studentLoaded;      ///< Base record already faulted in or deleted
+        std::vector<bool> m_facultyLoaded;
+        long long m_baseStudentsLeft;           ///< Base records not yet faulted in
+        long long m_baseFacultyLeft;
+
+        std::mutex m_writeMutex;                ///< Serializes mutations and their log order
+        std::mutex m_treeMutex;                 ///< Tree shape: writers, and lookups faulting in base records
+        WriteAheadLog *m_log;                   ///< Attached log or NULL
+
+        VersionStore m_studentHistory;          ///< Closed student versions
+        int64_t m_versionTime;                  ///< effective_from of versioned loads, or VERSION_START
+
+        Checkpointer *m_checkpointer;           ///< Durable mode, or NULL
+        std::vector<int> m_deletedStudents;     ///< Deleted since the last checkpoint
+        std::vector<int> m_deletedFaculty;
+        bool m_cleared;                         ///< clear() since the last checkpoint
+
+        PersistentBST<Student> m_studentVersion;    ///< As of the last snapshot()
+        PersistentBST<Faculty> m_facultyVersion;
+        bool m_snapshotsOn;                     ///< snapshot() has been called: note written keys
+        bool m_snapshotStale;                   ///< Versions must be rebuilt from the trees
+        std::vector<int> m_changedStudents;     ///< Written since the last snapshot()
+        std::vector<int> m_changedFaculty;
+        uint64_t m_versionSeq;                  ///< Bumped by every refresh that changes a version
+        uint64_t m_rebuiltSeq;                  ///< m_versionSeq of the last full rebuild
+        int m_activeTransactions;
+        std::unordered_map<int, uint64_t> m_studentWrittenAt;  ///< Key -> m_versionSeq its last write landed in
+        std::unordered_map<int, uint64_t> m_facultyWrittenAt;
+
+        // Once more keys changed than a version holds, rebuilding is cheaper
+        void noteStudent(int studentId)
+        {
+                if (m_snapshotsOn && !m_snapshotStale)
+                {
+                        m_changedStudents.push_back(studentId);
+                        m_snapshotStale = m_changedStudents.size() > size_t(m_studentVersion.size()) + 1024;
+                }
+        }
+        void noteFaculty(int facultyId)
+        {
+                if (m_snapshotsOn && !m_snapshotStale)
+                {
+                        m_changedFaculty.push_back(facultyId);
+                        m_snapshotStale = m_changedFaculty.size() > size_t(m_facultyVersion.size()) + 1024;
+                }
+        }
+
+        uint64_t logStudent(WalRecordType type, const Student &student);
+        uint64_t logFaculty(WalRecordType type, const Faculty &faculty);
+        uint64_t logIds(WalRecordType type, int first, int second);
+        bool awaitDurable(uint64_t lsn);
+        Student *lookupStudent(int studentId, bool forUpdate = false);
+        Faculty *lookupFaculty(int facultyId, bool forUpdate = false);
+
+        bool captureChanges(const std::string &nextLogPath, bool rotate, std::string &records, bool &rotated,
+                            std::string &error);
+        void markClean();
+
+        void clearLocked();
+        void refreshVersionsLocked();
+        void removeStudentLocked(int studentId);
+        void removeFacultyLocked(int facultyId);
+        void faultStudent(int studentId);
+        void faultFaculty(int facultyId);
+        void loadAllStudents();
+        void loadAllFaculty();
+        void loadStudentRange(long long lo, long long hi);
+        void loadFacultyRange(long long lo, long long hi);
+
+        DBsystem(const DBsystem &);
+        DBsystem &operator=(const DBsystem &);
 };
 
 #endif // DBsystem_H
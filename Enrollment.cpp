@@ -0,0 +1,22 @@
+#include "Enrollment.h"
+
+// Default Constructor
+Enrollment::Enrollment() : m_id(0), m_student(0), m_course(0), m_status(""), m_grade(""), m_gradePoints(0.0) {}
+
+// Parameterized Constructor
+Enrollment::Enrollment(int id, int student, int course, std::string status, std::string grade, double gradePoints)
+    : m_id(id), m_student(student), m_course(course), m_status(status), m_grade(grade), m_gradePoints(gradePoints) {}
+
+std::ostream &operator<<(std::ostream &os, const Enrollment &enrollment)
+{
+    os << "ID: " << enrollment.getID()
+       << ", Student: " << enrollment.getStudent()
+       << ", Course: " << enrollment.getCourse()
+       << ", Status: " << enrollment.getStatus()
+       << ", Grade: " << enrollment.getGrade()
+       << ", Grade Points: " << enrollment.getGradePoints();
+    return os;
+}
+
+// Destructor
+Enrollment::~Enrollment() {}
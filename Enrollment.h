@@ -0,0 +1,49 @@
+#ifndef ENROLLMENT_H
+#define ENROLLMENT_H
+
+#include <iostream>
+#include <string>
+#include "LazyBST.h"
+
+// One student in one course section. Keyed by enrollment id; the student
+// and course ids are foreign keys resolved by the join engine (HashJoin.h)
+class Enrollment
+{
+public:
+    Enrollment();
+    Enrollment(int id, int student, int course, std::string status, std::string grade, double gradePoints);
+    ~Enrollment();
+
+    bool operator==(const Enrollment &other) const { return m_id == other.m_id; }
+    bool operator!=(const Enrollment &other) const { return m_id != other.m_id; }
+    bool operator<(const Enrollment &other) const { return m_id < other.m_id; }
+    bool operator>(const Enrollment &other) const { return m_id > other.m_id; }
+
+    int getID() const { return m_id; }
+    void setID(int id) { m_id = id; }
+    int getStudent() const { return m_student; }
+    void setStudent(int student) { m_student = student; }
+    int getCourse() const { return m_course; }
+    void setCourse(int course) { m_course = course; }
+    std::string getStatus() const { return m_status; }
+    void setStatus(const std::string &status) { m_status = status; }
+    std::string getGrade() const { return m_grade; }
+    void setGrade(const std::string &grade) { m_grade = grade; }
+    double getGradePoints() const { return m_gradePoints; }
+    void setGradePoints(double gradePoints) { m_gradePoints = gradePoints; }
+
+    // Letter-graded and finished; only these count toward a GPA
+    bool isGraded() const { return !m_grade.empty() && m_status == "COMPLETED"; }
+
+    friend std::ostream &operator<<(std::ostream &os, const Enrollment &enrollment);
+
+private:
+    int m_id;
+    int m_student;
+    int m_course;
+    std::string m_status;       // ENROLLED, COMPLETED, DROPPED, WITHDRAWN
+    std::string m_grade;        // Letter grade, empty while in progress
+    double m_gradePoints;       // 4.0 scale, 0 without a grade
+};
+
+#endif // ENROLLMENT_H
@@ -0,0 +1,233 @@
+#include "EpochManager.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+// Written by the owning thread except state, which others scan
+struct alignas(64) EpochManager::Slot
+{
+    std::atomic<uint64_t> state;    ///< (epoch << 1) | 1 while inside a guard, 0 outside
+    std::atomic<bool> claimed;
+    int depth;
+    size_t sinceCollect;
+    std::atomic<size_t> pending;    ///< Retired, not yet freed; read by pending()
+    uint64_t tags[3];               ///< Epoch of each bag's contents
+    std::vector<Retired> bags[3];
+
+    Slot() : state(0), claimed(false), depth(0), sinceCollect(0), pending(0)
+    {
+        tags[0] = tags[1] = tags[2] = 0;
+    }
+};
+
+namespace
+{
+    // Managers alive, so a thread exiting after one was destroyed leaves
+    // its slot alone
+    std::mutex g_registryMutex;
+    std::vector<uint64_t> g_live;
+    std::atomic<uint64_t> g_nextId(1);
+
+    struct CachedSlot
+    {
+        uint64_t id;
+        EpochManager::Slot *slot;
+    };
+
+    // This thread's slots, one per manager it has used; released at exit
+    struct ThreadSlots
+    {
+        std::vector<CachedSlot> slots;
+        ~ThreadSlots();
+    };
+
+    thread_local ThreadSlots t_slots;
+
+    // Trivially constructed, so the fast path needs no TLS init check
+    thread_local CachedSlot t_last = {0, NULL};
+}
+
+ThreadSlots::~ThreadSlots()
+{
+    std::lock_guard<std::mutex> guard(g_registryMutex);
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        if (std::find(g_live.begin(), g_live.end(), slots[i].id) != g_live.end())
+        {
+            // The bags stay with the slot for its next owner (or the destructor)
+            slots[i].slot->depth = 0;
+            slots[i].slot->state.store(0, std::memory_order_release);
+            slots[i].slot->claimed.store(false, std::memory_order_release);
+        }
+    }
+}
+
+EpochManager::EpochManager(size_t retireThreshold)
+    : m_epoch(1), m_slotsUsed(0), m_threshold(std::max<size_t>(retireThreshold, 1)),
+      m_id(g_nextId.fetch_add(1)), m_slots(new Slot[EPOCH_MAX_THREADS])
+{
+    std::lock_guard<std::mutex> guard(g_registryMutex);
+    g_live.push_back(m_id);
+}
+
+EpochManager::~EpochManager()
+{
+    {
+        std::lock_guard<std::mutex> guard(g_registryMutex);
+        g_live.erase(std::find(g_live.begin(), g_live.end(), m_id));
+    }
+    drain();
+    delete[] m_slots;
+}
+
+EpochManager::Slot *EpochManager::slot()
+{
+    if (t_last.id == m_id)
+    {
+        return t_last.slot;
+    }
+    for (size_t i = 0; i < t_slots.slots.size(); ++i)
+    {
+        if (t_slots.slots[i].id == m_id)
+        {
+            t_last = t_slots.slots[i];
+            return t_last.slot;
+        }
+    }
+    // First use on this thread: claim a free slot, waiting if all are taken
+    Slot *claimed = NULL;
+    while (claimed == NULL)
+    {
+        for (int i = 0; i < EPOCH_MAX_THREADS && claimed == NULL; ++i)
+        {
+            bool expected = false;
+            if (!m_slots[i].claimed.load(std::memory_order_relaxed) &&
+                m_slots[i].claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                claimed = &m_slots[i];
+                int used = m_slotsUsed.load(std::memory_order_relaxed);
+                while (used < i + 1 &&
+                       !m_slotsUsed.compare_exchange_weak(used, i + 1, std::memory_order_release))
+                {
+                }
+            }
+        }
+        if (claimed == NULL)
+        {
+            std::this_thread::yield();
+        }
+    }
+    CachedSlot cached = {m_id, claimed};
+    t_slots.slots.push_back(cached);
+    t_last = cached;
+    return claimed;
+}
+
+// The seq_cst store (one xchg) orders the published epoch before every
+// read the guarded code makes, pairing with the fence in tryAdvance
+void EpochManager::enter()
+{
+    Slot *s = slot();
+    if (s->depth++ > 0)
+    {
+        return;
+    }
+    s->state.store((m_epoch.load(std::memory_order_relaxed) << 1) | 1, std::memory_order_seq_cst);
+}
+
+void EpochManager::exit()
+{
+    Slot *s = slot();
+    if (--s->depth == 0)
+    {
+        s->state.store(0, std::memory_order_release);
+    }
+}
+
+void EpochManager::retire(void *ptr, void (*deleter)(void *))
+{
+    Slot *s = slot();
+    uint64_t e = m_epoch.load(std::memory_order_acquire);
+    int b = int(e % 3);
+    if (s->tags[b] != e)
+    {
+        // Three or more epochs old, so two behind the current one at least
+        freeBag(*s, b);
+        s->tags[b] = e;
+    }
+    Retired r = {ptr, deleter};
+    s->bags[b].push_back(r);
+    s->pending.store(s->pending.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (++s->sinceCollect >= m_threshold)
+    {
+        collect(*s);
+    }
+}
+
+bool EpochManager::tryAdvance()
+{
+    uint64_t e = m_epoch.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int used = m_slotsUsed.load(std::memory_order_acquire);
+    for (int i = 0; i < used; ++i)
+    {
+        uint64_t state = m_slots[i].state.load(std::memory_order_acquire);
+        if ((state & 1) != 0 && (state >> 1) != e)
+        {
+            return false;
+        }
+    }
+    return m_epoch.compare_exchange_strong(e, e + 1, std::memory_order_acq_rel);
+}
+
+void EpochManager::collect()
+{
+    collect(*slot());
+}
+
+void EpochManager::collect(Slot &s)
+{
+    s.sinceCollect = 0;
+    tryAdvance();
+    uint64_t e = m_epoch.load(std::memory_order_acquire);
+    for (int b = 0; b < 3; ++b)
+    {
+        if (!s.bags[b].empty() && s.tags[b] + 2 <= e)
+        {
+            freeBag(s, b);
+        }
+    }
+}
+
+void EpochManager::drain()
+{
+    for (int i = 0; i < EPOCH_MAX_THREADS; ++i)
+    {
+        for (int b = 0; b < 3; ++b)
+        {
+            freeBag(m_slots[i], b);
+        }
+    }
+}
+
+size_t EpochManager::pending() const
+{
+    size_t n = 0;
+    int used = m_slotsUsed.load(std::memory_order_acquire);
+    for (int i = 0; i < used; ++i)
+    {
+        n += m_slots[i].pending.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+void EpochManager::freeBag(Slot &s, int b)
+{
+    std::vector<Retired> &bag = s.bags[b];
+    for (size_t i = 0; i < bag.size(); ++i)
+    {
+        bag[i].deleter(bag[i].ptr);
+    }
+    s.pending.store(s.pending.load(std::memory_order_relaxed) - bag.size(), std::memory_order_relaxed);
+    bag.clear();
+}
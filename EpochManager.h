@@ -0,0 +1,137 @@
+/**
+ * @file EpochManager.h
+ * @brief Epoch-based reclamation: memory unlinked from a shared structure
+ *        is freed only once no thread can still be reading it.
+ *
+ * ARCHITECTURE:
+ *   ConcurrentBST (and any other structure read without locks)
+ *       |  every operation runs inside an EpochGuard; unlinked nodes are
+ *       |  passed to retire() instead of delete
+ *       v
+ *   EpochManager (You are here)
+ *       |  one global epoch; per thread a slot with the epoch it entered
+ *       |  at and three bags of retired pointers, one per epoch mod 3
+ *       v
+ *   deleter(ptr) - once the global epoch is two past the bag's
+ *
+ * PROTOCOL:
+ *   enter   - publish (global epoch, active) in the thread's slot
+ *   exit    - publish inactive
+ *   retire  - tag the pointer with the global epoch e and put it in bag
+ *             e mod 3 of this thread. The global epoch only moves from e
+ *             to e + 1 once every active thread has entered at e, so at
+ *             e + 2 every thread that could have seen the pointer has left
+ *             the guard it saw it in, and the bag can be emptied.
+ *   advance - every retireThreshold retires a thread scans the slots and
+ *             moves the epoch on if all active ones are current, then
+ *             frees its own bags that are old enough
+ *
+ * Memory held is bounded: a bag is emptied whenever its thread reuses it
+ * three epochs later, and a thread that stays inside a guard holds back at
+ * most what others retire meanwhile. enter and exit are a thread-local
+ * lookup plus one store each (a sequentially consistent one on enter);
+ * retire is a push_back. Nested guards on one thread are counted.
+ *
+ * Slots are claimed on a thread's first use and released when it exits,
+ * leaving its bags to the next thread that claims the slot. At most
+ * EPOCH_MAX_THREADS threads use one manager at a time.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef EPOCH_MANAGER_H
+#define EPOCH_MANAGER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/** @brief Threads that may be registered with one EpochManager at once. */
+#define EPOCH_MAX_THREADS 256
+
+/**
+ * @class EpochManager
+ * @brief Global epoch, per-thread slots and retired-pointer bags.
+ */
+class EpochManager
+{
+public:
+    /** @param retireThreshold Retires per thread between attempts to advance. */
+    explicit EpochManager(size_t retireThreshold = 64);
+
+    /** @brief Frees everything still retired. No thread may be inside a guard. */
+    ~EpochManager();
+
+    /** @brief Start a read-side critical section (nestable). */
+    void enter();
+    void exit();
+
+    /** @brief Free @p ptr with @p deleter once no thread can hold it. */
+    void retire(void *ptr, void (*deleter)(void *));
+
+    template <typename T>
+    void retire(T *ptr)
+    {
+        retire(static_cast<void *>(ptr), &destroy<T>);
+    }
+
+    /** @brief Move the epoch on if every active thread has caught up. */
+    bool tryAdvance();
+
+    /** @brief Advance if possible, then free this thread's bags that are old enough. */
+    void collect();
+
+    /** @brief Free every retired pointer now. No thread may be inside a guard. */
+    void drain();
+
+    uint64_t epoch() const { return m_epoch.load(std::memory_order_relaxed); }
+
+    /** @brief Retired pointers not yet freed (approximate while threads run). */
+    size_t pending() const;
+
+    struct Slot;
+
+private:
+    struct Retired
+    {
+        void *ptr;
+        void (*deleter)(void *);
+    };
+
+    std::atomic<uint64_t> m_epoch;
+    std::atomic<int> m_slotsUsed;           ///< Slots ever claimed; scans stop here
+    size_t m_threshold;
+    uint64_t m_id;                          ///< Tells a thread's cached slots of this manager apart
+    Slot *m_slots;
+
+    Slot *slot();
+    void collect(Slot &s);
+    static void freeBag(Slot &s, int b);
+
+    template <typename T>
+    static void destroy(void *ptr)
+    {
+        delete static_cast<T *>(ptr);
+    }
+
+    EpochManager(const EpochManager &);
+    EpochManager &operator=(const EpochManager &);
+};
+
+/** @brief Holds an EpochManager critical section for its lifetime. */
+class EpochGuard
+{
+public:
+    explicit EpochGuard(EpochManager &epochs) : m_epochs(epochs) { m_epochs.enter(); }
+    ~EpochGuard() { m_epochs.exit(); }
+
+private:
+    EpochManager &m_epochs;
+
+    EpochGuard(const EpochGuard &);
+    EpochGuard &operator=(const EpochGuard &);
+};
+
+#endif
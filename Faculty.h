@@ -29,6 +29,8 @@ public:
     void addAdvisee(int adviseeId);
     void removeAdvisee(int adviseeId);
     void printAdvisees() const;
+    int getAdviseeCount() const { return m_adviseeCount; }
+    int getAdvisee(int index) const { return m_advisees[index]; }
 
     friend std::ostream &operator<<(std::ostream &os, const Faculty &faculty);
 
@@ -0,0 +1,363 @@
+#include "HashJoin.h"
+#include "DBsystem.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    const size_t PROBE_BATCH = 64;      // Slots prefetched ahead of the compares
+    const int MAX_PARTITION_BITS = 12;  // One scatter pass; more partitions thrash the TLB
+
+    // Scatter keys (and their row numbers) into 2^bits runs by the low hash
+    // bits. bounds[p]..bounds[p + 1] is partition p afterwards.
+    void partition(const int *keys, size_t count, int bits, std::vector<int> &outKeys,
+                   std::vector<uint32_t> &outRows, std::vector<size_t> &bounds)
+    {
+        size_t parts = size_t(1) << bits;
+        uint32_t mask = uint32_t(parts - 1);
+
+        bounds.assign(parts + 1, 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            ++bounds[(JoinHashTable::hash(keys[i]) & mask) + 1];
+        }
+        for (size_t p = 0; p < parts; ++p)
+        {
+            bounds[p + 1] += bounds[p];
+        }
+
+        std::vector<size_t> cursor(bounds.begin(), bounds.end() - 1);
+        outKeys.resize(count);
+        outRows.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t at = cursor[JoinHashTable::hash(keys[i]) & mask]++;
+            outKeys[at] = keys[i];
+            outRows[at] = uint32_t(i);
+        }
+    }
+
+    struct CourseCollector
+    {
+        std::vector<Course> &courses;
+        void operator()(const Course &c) { courses.push_back(c); }
+    };
+
+    struct EnrollmentCollector
+    {
+        std::vector<Enrollment> &enrollments;
+        void operator()(const Enrollment &e) { enrollments.push_back(e); }
+    };
+
+    struct StudentIdCollector
+    {
+        std::vector<int> &ids;
+        void operator()(const Student &s) { ids.push_back(s.getID()); }
+    };
+}
+
+// ---------------------------------------------------------------------------
+// JoinHashTable
+// ---------------------------------------------------------------------------
+
+const uint32_t JoinHashTable::NONE;
+
+JoinHashTable::JoinHashTable() : m_mask(0), m_shift(32)
+{
+
+}
+
+size_t JoinHashTable::tableBytes(size_t count)
+{
+    size_t capacity = 16;
+    while (capacity < count * 2)
+    {
+        capacity <<= 1;
+    }
+    return capacity * sizeof(Slot);
+}
+
+void JoinHashTable::build(const int *keys, const uint32_t *rows, size_t count)
+{
+    size_t capacity = tableBytes(count) / sizeof(Slot);
+    int bits = 0;
+    while ((size_t(1) << bits) < capacity)
+    {
+        ++bits;
+    }
+    Slot empty = {0, NONE};
+    m_slots.assign(capacity, empty);
+    m_mask = uint32_t(capacity - 1);
+    m_shift = 32 - bits;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t s = hash(keys[i]) >> m_shift;
+        while (m_slots[s].row != NONE)
+        {
+            s = (s + 1) & m_mask;
+        }
+        m_slots[s].key = keys[i];
+        m_slots[s].row = rows ? rows[i] : uint32_t(i);
+    }
+}
+
+void JoinHashTable::probe(const int *keys, const uint32_t *rows, size_t count, bool buildLeft,
+                          std::vector<JoinMatch> &out) const
+{
+    if (m_slots.empty())
+    {
+        return;
+    }
+    const Slot *slots = &m_slots[0];
+    uint32_t home[PROBE_BATCH];
+
+    for (size_t base = 0; base < count; base += PROBE_BATCH)
+    {
+        size_t n = std::min(PROBE_BATCH, count - base);
+
+        // Issue every slot load of the batch before waiting on any of them
+        for (size_t j = 0; j < n; ++j)
+        {
+            home[j] = hash(keys[base + j]) >> m_shift;
+            __builtin_prefetch(slots + home[j]);
+        }
+
+        for (size_t j = 0; j < n; ++j)
+        {
+            int key = keys[base + j];
+            uint32_t probeRow = rows ? rows[base + j] : uint32_t(base + j);
+            for (uint32_t s = home[j]; slots[s].row != NONE; s = (s + 1) & m_mask)
+            {
+                if (slots[s].key == key)
+                {
+                    JoinMatch m;
+                    m.left = buildLeft ? slots[s].row : probeRow;
+                    m.right = buildLeft ? probeRow : slots[s].row;
+                    out.push_back(m);
+                }
+            }
+        }
+    }
+}
+
+void JoinHashTable::lookup(int key, std::vector<uint32_t> &rows) const
+{
+    if (m_slots.empty())
+    {
+        return;
+    }
+    for (uint32_t s = hash(key) >> m_shift; m_slots[s].row != NONE; s = (s + 1) & m_mask)
+    {
+        if (m_slots[s].key == key)
+        {
+            rows.push_back(m_slots[s].row);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// hashJoin
+// ---------------------------------------------------------------------------
+
+void hashJoin(const int *left, size_t leftCount, const int *right, size_t rightCount, std::vector<JoinMatch> &out,
+              const JoinOptions &options, JoinStats *stats)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    bool buildLeft = leftCount <= rightCount;
+    const int *build = buildLeft ? left : right;
+    const int *probe = buildLeft ? right : left;
+    size_t buildCount = buildLeft ? leftCount : rightCount;
+    size_t probeCount = buildLeft ? rightCount : leftCount;
+
+    int bits = options.partitionBits;
+    if (bits < 0)
+    {
+        bits = 0;
+        size_t tableBytes = JoinHashTable::tableBytes(buildCount);
+        while ((tableBytes >> bits) > options.cacheBytes && bits < MAX_PARTITION_BITS)
+        {
+            ++bits;
+        }
+    }
+    bits = std::min(bits, MAX_PARTITION_BITS);
+
+    out.clear();
+    if (bits == 0)
+    {
+        JoinHashTable table;
+        table.build(build, NULL, buildCount);
+        table.probe(probe, NULL, probeCount, buildLeft, out);
+    }
+    else
+    {
+        // Matching keys hash alike, so partition p of one side only meets
+        // partition p of the other, and each partition's table fits in cache
+        std::vector<int> buildKeys, probeKeys;
+        std::vector<uint32_t> buildRows, probeRows;
+        std::vector<size_t> buildBounds, probeBounds;
+        partition(build, buildCount, bits, buildKeys, buildRows, buildBounds);
+        partition(probe, probeCount, bits, probeKeys, probeRows, probeBounds);
+
+        // Runs of partitions are joined as tasks, each into its own output.
+        // Appending them in run order groups matches by partition, not probe
+        // order, which is why the header leaves the order unspecified
+        TaskScheduler &scheduler = TaskScheduler::shared();
+        size_t parts = size_t(1) << bits;
+        size_t runs = std::min(parts, size_t(scheduler.concurrency()) * 4);
+        std::vector<std::vector<JoinMatch> > found(runs);
+        scheduler.parallelFor(0, (long long)runs, 1, [&](long long lo, long long hi) {
+            JoinHashTable table;
+            for (size_t r = size_t(lo); r < size_t(hi); ++r)
+            {
+                for (size_t p = parts * r / runs; p < parts * (r + 1) / runs; ++p)
+                {
+                    size_t b = buildBounds[p];
+                    size_t q = probeBounds[p];
+                    if (buildBounds[p + 1] == b || probeBounds[p + 1] == q)
+                    {
+                        continue;
+                    }
+                    table.build(&buildKeys[b], &buildRows[b], buildBounds[p + 1] - b);
+                    table.probe(&probeKeys[q], &probeRows[q], probeBounds[p + 1] - q, buildLeft, found[r]);
+                }
+            }
+        });
+        size_t total = 0;
+        for (size_t r = 0; r < runs; ++r)
+        {
+            total += found[r].size();
+        }
+        out.reserve(total);
+        for (size_t r = 0; r < runs; ++r)
+        {
+            out.insert(out.end(), found[r].begin(), found[r].end());
+        }
+    }
+
+    if (stats != NULL)
+    {
+        stats->buildRows = (long long)buildCount;
+        stats->probeRows = (long long)probeCount;
+        stats->matches = (long long)out.size();
+        stats->partitions = 1 << bits;
+        stats->buildLeft = buildLeft;
+        stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TranscriptIndex
+// ---------------------------------------------------------------------------
+
+TranscriptIndex::TranscriptIndex() : m_unmatchedCourses(0), m_unmatchedStudents(0)
+{
+
+}
+
+void TranscriptIndex::build(DBsystem &db, const JoinOptions &options)
+{
+    m_enrollments.clear();
+    m_courses.clear();
+    m_enrollments.reserve(size_t(db.enrollmentCount()));
+    m_courses.reserve(size_t(db.courseCount()));
+    EnrollmentCollector enrollments = {m_enrollments};
+    db.forEachEnrollment(enrollments);
+    CourseCollector courses = {m_courses};
+    db.forEachCourse(courses);
+    std::vector<int> studentIds;
+    studentIds.reserve(size_t(db.studentCount()));
+    StudentIdCollector students = {studentIds};
+    db.forEachStudent(students);
+
+    std::vector<int> courseKeys(m_enrollments.size());
+    std::vector<int> studentKeys(m_enrollments.size());
+    for (size_t i = 0; i < m_enrollments.size(); ++i)
+    {
+        courseKeys[i] = m_enrollments[i].getCourse();
+        studentKeys[i] = m_enrollments[i].getStudent();
+    }
+    std::vector<int> courseIds(m_courses.size());
+    for (size_t i = 0; i < m_courses.size(); ++i)
+    {
+        courseIds[i] = m_courses[i].getID();
+    }
+
+    std::vector<JoinMatch> matches;
+    const int *none = NULL;
+
+    // enrollments.course_id = courses.id (course ids are unique)
+    hashJoin(courseKeys.empty() ? none : &courseKeys[0], courseKeys.size(), courseIds.empty() ? none : &courseIds[0],
+             courseIds.size(), matches, options, &m_courseJoin);
+    m_courseRow.assign(m_enrollments.size(), JoinHashTable::NONE);
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+        m_courseRow[matches[i].left] = matches[i].right;
+    }
+    m_unmatchedCourses = (long long)std::count(m_courseRow.begin(), m_courseRow.end(), JoinHashTable::NONE);
+
+    // enrollments.student_id = students.id, only to count orphans
+    hashJoin(studentKeys.empty() ? none : &studentKeys[0], studentKeys.size(),
+             studentIds.empty() ? none : &studentIds[0], studentIds.size(), matches, options, &m_studentJoin);
+    std::vector<bool> hasStudent(m_enrollments.size(), false);
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+        hasStudent[matches[i].left] = true;
+    }
+    m_unmatchedStudents = (long long)std::count(hasStudent.begin(), hasStudent.end(), false);
+
+    m_byStudent.build(studentKeys.empty() ? none : &studentKeys[0], NULL, studentKeys.size());
+}
+
+bool TranscriptIndex::lookup(DBsystem &db, int studentId, Transcript &out) const
+{
+    out = Transcript();
+    Student *student = db.findStudent(studentId);
+    if (student != NULL)
+    {
+        out.student = *student;
+        out.known = true;
+    }
+    else
+    {
+        out.student.setID(studentId);
+    }
+
+    std::vector<uint32_t> rows;
+    m_byStudent.lookup(studentId, rows);
+    std::sort(rows.begin(), rows.end());
+
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const Enrollment &e = m_enrollments[rows[i]];
+        TranscriptLine line;
+        line.enrollment = e;
+        line.credits = 0;
+        uint32_t c = m_courseRow[rows[i]];
+        if (c != JoinHashTable::NONE)
+        {
+            line.code = m_courses[c].getCode();
+            line.title = m_courses[c].getTitle();
+            line.credits = m_courses[c].getCredits();
+        }
+        out.lines.push_back(line);
+
+        if (e.getStatus() != "DROPPED")
+        {
+            out.creditsAttempted += line.credits;
+        }
+        if (e.isGraded())
+        {
+            out.gradedCredits += line.credits;
+            out.qualityPoints += e.getGradePoints() * line.credits;
+            if (e.getGrade() != "F")
+            {
+                out.creditsEarned += line.credits;
+            }
+        }
+    }
+    return out.known || !out.lines.empty();
+}
@@ -0,0 +1,196 @@
+/**
+ * @file HashJoin.h
+ * @brief Equi-joins on integer keys, and the per-student transcript built on them.
+ *
+ * ARCHITECTURE:
+ *   DBsystem tables (students, courses, enrollments)
+ *       |  key columns copied out into flat int arrays
+ *       v
+ *   hashJoin (You are here)
+ *       |  build: open-addressing table on the smaller input
+ *       |  probe: batches of 64 keys - hash all, prefetch all slots, then compare
+ *       |  build table bigger than cacheBytes: radix-partition both inputs on
+ *       |  the low hash bits first, then build and probe each partition in
+ *       |  cache, runs of partitions in parallel on the shared TaskScheduler
+ *       v
+ *   JoinMatch pairs (row in left input, row in right input)
+ *       |
+ *       v
+ *   TranscriptIndex - enrollments joined to courses and students once,
+ *                     then indexed by student id for single-student lookups
+ *
+ * The table is a flat array of (key, row) slots with linear probing and a
+ * load factor of at most 1/2. Duplicate keys take separate slots, so a probe
+ * walks its run up to the first empty slot and reports every equal key.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef HASH_JOIN_H
+#define HASH_JOIN_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Student.h"
+#include "Course.h"
+#include "Enrollment.h"
+
+class DBsystem;
+
+/** @brief One join result: row numbers in the left and right inputs. */
+struct JoinMatch
+{
+    uint32_t left;
+    uint32_t right;
+};
+
+/** @brief Tuning for hashJoin. */
+struct JoinOptions
+{
+    size_t cacheBytes;      ///< Partition once the build table outgrows this
+    int partitionBits;      ///< -1 = decide from cacheBytes, 0 = never, > 0 = 2^bits partitions
+
+    JoinOptions() : cacheBytes(256 << 10), partitionBits(-1) {}
+};
+
+/** @brief How a join was executed. */
+struct JoinStats
+{
+    long long buildRows;
+    long long probeRows;
+    long long matches;
+    int partitions;         ///< 1 when not partitioned
+    bool buildLeft;         ///< The left input was the build side
+    double seconds;
+
+    JoinStats() : buildRows(0), probeRows(0), matches(0), partitions(0), buildLeft(true), seconds(0.0) {}
+};
+
+/**
+ * @class JoinHashTable
+ * @brief Open-addressing multimap from int keys to row numbers.
+ */
+class JoinHashTable
+{
+public:
+    static const uint32_t NONE = 0xFFFFFFFFu;
+
+    JoinHashTable();
+
+    /**
+     * @brief Replace the contents with keys[i] -> rows[i].
+     * @param rows Row numbers, or NULL for 0..count-1.
+     */
+    void build(const int *keys, const uint32_t *rows, size_t count);
+
+    /**
+     * @brief Append a match for every stored key equal to some keys[i].
+     * @param rows Probe row numbers, or NULL for 0..count-1.
+     * @param buildLeft Put the stored row in JoinMatch::left (else right).
+     */
+    void probe(const int *keys, const uint32_t *rows, size_t count, bool buildLeft,
+               std::vector<JoinMatch> &out) const;
+
+    /** @brief Append the rows stored under @p key. */
+    void lookup(int key, std::vector<uint32_t> &rows) const;
+
+    /** @brief Size of a table holding @p count keys. */
+    static size_t tableBytes(size_t count);
+
+    static uint32_t hash(int key)
+    {
+        // murmur3 finalizer: every output bit depends on every key bit, so
+        // the low bits pick partitions and the high bits pick slots
+        uint32_t h = uint32_t(key);
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return h;
+    }
+
+private:
+    struct Slot
+    {
+        int key;
+        uint32_t row;       ///< NONE marks an empty slot
+    };
+
+    std::vector<Slot> m_slots;
+    uint32_t m_mask;
+    int m_shift;            ///< hash >> m_shift is the home slot
+};
+
+/**
+ * @brief Inner equi-join of two key columns. The smaller input is the build
+ *        side; the order of @p out is unspecified.
+ * @param out Cleared, then filled with matching row pairs.
+ */
+void hashJoin(const int *left, size_t leftCount, const int *right, size_t rightCount, std::vector<JoinMatch> &out,
+              const JoinOptions &options = JoinOptions(), JoinStats *stats = NULL);
+
+/** @brief One course on a transcript. Course fields are empty if the course is unknown. */
+struct TranscriptLine
+{
+    Enrollment enrollment;
+    std::string code;
+    std::string title;
+    int credits;
+};
+
+/** @brief A student's enrollments with course credits and grade points. */
+struct Transcript
+{
+    Student student;
+    bool known;                 ///< The student exists in DBsystem
+    std::vector<TranscriptLine> lines;
+    int creditsAttempted;       ///< All but dropped
+    int creditsEarned;          ///< Completed with a passing grade
+    int gradedCredits;          ///< Completed with any grade, F included
+    double qualityPoints;       ///< Sum of grade points x credits
+
+    Transcript() : known(false), creditsAttempted(0), creditsEarned(0), gradedCredits(0), qualityPoints(0.0) {}
+    double gpa() const { return gradedCredits > 0 ? qualityPoints / gradedCredits : 0.0; }
+};
+
+/**
+ * @class TranscriptIndex
+ * @brief Enrollments joined to courses and students, indexed by student.
+ *
+ * A copy of the tables as of build(); rebuild after they change.
+ */
+class TranscriptIndex
+{
+public:
+    TranscriptIndex();
+
+    /** @brief Copy out and join the course, enrollment and student tables of @p db. */
+    void build(DBsystem &db, const JoinOptions &options = JoinOptions());
+
+    /**
+     * @brief Assemble the transcript of @p studentId.
+     * @return False if the id is neither a student nor on any enrollment.
+     */
+    bool lookup(DBsystem &db, int studentId, Transcript &out) const;
+
+    long long enrollments() const { return (long long)m_enrollments.size(); }
+    long long unmatchedCourses() const { return m_unmatchedCourses; }
+    long long unmatchedStudents() const { return m_unmatchedStudents; }
+    const JoinStats &courseJoin() const { return m_courseJoin; }
+    const JoinStats &studentJoin() const { return m_studentJoin; }
+
+private:
+    std::vector<Enrollment> m_enrollments;      ///< In enrollment id order
+    std::vector<Course> m_courses;
+    std::vector<uint32_t> m_courseRow;          ///< Per enrollment: row in m_courses or NONE
+    JoinHashTable m_byStudent;                  ///< Student id -> enrollment rows
+    long long m_unmatchedCourses;
+    long long m_unmatchedStudents;
+    JoinStats m_courseJoin;
+    JoinStats m_studentJoin;
+};
+
+#endif
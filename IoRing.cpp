@@ -0,0 +1,508 @@
+#include "IoRing.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+bool IoRing::s_enabled = true;
+
+namespace
+{
+    int ringSetup(unsigned entries, struct io_uring_params *p)
+    {
+        return int(::syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    int ringEnter(int fd, unsigned submit, unsigned waitFor, unsigned flags)
+    {
+        return int(::syscall(__NR_io_uring_enter, fd, submit, waitFor, flags, NULL, 0));
+    }
+
+    int ringRegister(int fd, unsigned opcode, const void *arg, unsigned count)
+    {
+        return int(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    }
+}
+
+IoRing::IoRing(unsigned entries)
+    : m_fd(-1), m_entries(entries), m_queued(0), m_inFlight(0), m_registered(false), m_sqMap(NULL),
+      m_sqMapSize(0), m_cqMap(NULL), m_cqMapSize(0), m_sqes(NULL), m_sqesSize(0), m_sqHead(NULL), m_sqTail(NULL),
+      m_sqMask(0), m_sqArray(NULL), m_cqHead(NULL), m_cqTail(NULL), m_cqMask(0), m_cqes(NULL)
+{
+    if (s_enabled)
+    {
+        setup(entries);
+    }
+}
+
+IoRing::~IoRing()
+{
+    // The kernel may still be writing into the callers' buffers
+    while (m_inFlight > 0 || m_queued > 0)
+    {
+        IoCompletion done;
+        if (!submit(1))
+        {
+            break;
+        }
+        while (reap(done))
+        {
+        }
+    }
+    if (m_fd >= 0)
+    {
+        ::munmap(m_sqes, m_sqesSize);
+        if (m_cqMap != m_sqMap)
+        {
+            ::munmap(m_cqMap, m_cqMapSize);
+        }
+        ::munmap(m_sqMap, m_sqMapSize);
+        ::close(m_fd);
+    }
+}
+
+void IoRing::setEnabled(bool on)
+{
+    s_enabled = on;
+}
+
+bool IoRing::enabled()
+{
+    return s_enabled;
+}
+
+// Maps the shared queues; on any failure the ring stays in fallback mode
+bool IoRing::setup(unsigned entries)
+{
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    int fd = ringSetup(entries, &p);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // IORING_OP_READ/WRITE arrived with this feature bit (5.6)
+    if (!(p.features & IORING_FEAT_RW_CUR_POS))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    m_sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+    {
+        m_sqMapSize = m_cqMapSize = std::max(m_sqMapSize, m_cqMapSize);
+    }
+    void *sq = ::mmap(NULL, m_sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *cq = sq;
+    if (!single)
+    {
+        cq = ::mmap(NULL, m_cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED)
+        {
+            ::munmap(sq, m_sqMapSize);
+            ::close(fd);
+            return false;
+        }
+    }
+    m_sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = ::mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        if (cq != sq)
+        {
+            ::munmap(cq, m_cqMapSize);
+        }
+        ::munmap(sq, m_sqMapSize);
+        ::close(fd);
+        return false;
+    }
+
+    char *sqBase = static_cast<char *>(sq);
+    char *cqBase = static_cast<char *>(cq);
+    m_sqMap = sq;
+    m_cqMap = cq;
+    m_sqes = sqes;
+    m_sqHead = reinterpret_cast<unsigned *>(sqBase + p.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned *>(sqBase + p.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned *>(sqBase + p.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned *>(sqBase + p.sq_off.array);
+    m_cqHead = reinterpret_cast<unsigned *>(cqBase + p.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned *>(cqBase + p.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned *>(cqBase + p.cq_off.ring_mask);
+    m_cqes = cqBase + p.cq_off.cqes;
+    m_entries = p.sq_entries;
+    m_fd = fd;
+    return true;
+}
+
+bool IoRing::registerBuffers(const struct iovec *buffers, unsigned count)
+{
+    if (m_fd >= 0 && !m_registered && count > 0)
+    {
+        m_registered = ringRegister(m_fd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+    }
+    return m_registered;
+}
+
+void IoRing::read(int fd, void *buf, unsigned len, uint64_t offset, uint64_t tag, int buffer, unsigned flags)
+{
+    Op op = {OP_READ, fd, static_cast<char *>(buf), len, offset, tag, buffer, flags};
+    queue(op);
+}
+
+void IoRing::write(int fd, const void *buf, unsigned len, uint64_t offset, uint64_t tag, int buffer, unsigned flags)
+{
+    Op op = {OP_WRITE, fd, const_cast<char *>(static_cast<const char *>(buf)), len, offset, tag, buffer, flags};
+    queue(op);
+}
+
+void IoRing::fsync(int fd, uint64_t tag, unsigned flags)
+{
+    Op op = {OP_FSYNC, fd, NULL, 0, 0, tag, -1, flags};
+    queue(op);
+}
+
+void IoRing::queue(const Op &op)
+{
+    if (m_fd < 0)
+    {
+        m_pending.push_back(op);
+        ++m_queued;
+        return;
+    }
+    // A full queue goes to the kernel early
+    unsigned tail = *m_sqTail;
+    if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_entries)
+    {
+        submit(0);
+    }
+    unsigned index = tail & m_sqMask;
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(m_sqes) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    bool fixed = m_registered && op.buffer >= 0;
+    switch (op.opcode)
+    {
+    case OP_READ:
+        sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        break;
+    case OP_WRITE:
+        sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        break;
+    case OP_FSYNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        break;
+    }
+    sqe->fd = op.fd;
+    sqe->addr = uint64_t(uintptr_t(op.buf));
+    sqe->len = op.len;
+    sqe->off = op.offset;
+    sqe->user_data = op.tag;
+    if (fixed)
+    {
+        sqe->buf_index = uint16_t(op.buffer);
+    }
+    if (op.flags & IO_LINK)
+    {
+        sqe->flags |= IOSQE_IO_LINK;
+    }
+    if (op.flags & IO_DRAIN)
+    {
+        sqe->flags |= IOSQE_IO_DRAIN;
+    }
+    m_sqArray[index] = index;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++m_queued;
+}
+
+bool IoRing::submit(unsigned waitFor)
+{
+    if (waitFor > m_inFlight + m_queued)
+    {
+        waitFor = m_inFlight + m_queued;
+    }
+    if (m_fd < 0)
+    {
+        runSync();
+        return true;
+    }
+    for (;;)
+    {
+        int n = ringEnter(m_fd, m_queued, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        m_queued -= unsigned(n);
+        m_inFlight += unsigned(n);
+        if (m_queued == 0 || n == 0)
+        {
+            return m_queued == 0;
+        }
+        // Submitted part of the batch (queue pressure); hand over the rest
+    }
+}
+
+bool IoRing::reap(IoCompletion &done)
+{
+    if (m_fd < 0)
+    {
+        if (m_done.empty())
+        {
+            return false;
+        }
+        done = m_done.front();
+        m_done.pop_front();
+        --m_inFlight;
+        return true;
+    }
+    unsigned head = *m_cqHead;
+    if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+    const struct io_uring_cqe *cqe = static_cast<const struct io_uring_cqe *>(m_cqes) + (head & m_cqMask);
+    done.tag = cqe->user_data;
+    done.result = cqe->res;
+    __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+    --m_inFlight;
+    return true;
+}
+
+// Fallback: everything queued runs now, in order. A failed link cancels
+// the rest of its chain, as the kernel does.
+void IoRing::runSync()
+{
+    bool cancel = false;
+    for (size_t i = 0; i < m_pending.size(); ++i)
+    {
+        const Op &op = m_pending[i];
+        int result = 0;
+        if (cancel)
+        {
+            result = -ECANCELED;
+        }
+        else if (op.opcode == OP_FSYNC)
+        {
+            result = ::fsync(op.fd) == 0 ? 0 : -errno;
+        }
+        else
+        {
+            size_t done = 0;
+            int err = 0;
+            while (done < op.len)
+            {
+                ssize_t n = op.opcode == OP_READ ? ::pread(op.fd, op.buf + done, op.len - done, off_t(op.offset + done))
+                                                 : ::pwrite(op.fd, op.buf + done, op.len - done, off_t(op.offset + done));
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n < 0)
+                {
+                    err = errno;
+                    break;
+                }
+                if (n == 0)
+                {
+                    break;
+                }
+                done += size_t(n);
+            }
+            result = (err != 0 && done == 0) ? -err : int(done);
+        }
+        // A short transfer breaks a chain too
+        bool failed = result < 0 || (op.opcode != OP_FSYNC && unsigned(result) < op.len);
+        cancel = (op.flags & IO_LINK) && (cancel || failed);
+        IoCompletion c = {op.tag, result};
+        m_done.push_back(c);
+    }
+    m_inFlight += unsigned(m_pending.size());
+    m_queued = 0;
+    m_pending.clear();
+}
+
+// ---------------------------------------------------------------------------
+// RingReader
+// ---------------------------------------------------------------------------
+
+RingReader *RingReader::open(std::FILE *in, size_t chunkSize)
+{
+    int fd = ::fileno(in);
+    struct stat st;
+    if (!IoRing::enabled() || fd < 0 || ::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || chunkSize == 0 || chunkSize > (1u << 30))
+    {
+        return NULL;
+    }
+    // Nothing may sit in the stdio buffer yet, or those bytes would be lost
+    off_t pos = ::lseek(fd, 0, SEEK_CUR);
+    if (pos < 0 || std::ftell(in) != long(pos))
+    {
+        return NULL;
+    }
+    return new RingReader(fd, uint64_t(pos), chunkSize);
+}
+
+RingReader::RingReader(int fd, uint64_t offset, size_t chunkSize)
+    : m_ring(2 * DEPTH), m_fd(fd), m_chunkSize(chunkSize), m_current(0), m_consumed(0), m_nextOffset(offset),
+      m_eof(false), m_ok(true)
+{
+    ::posix_fadvise(fd, off_t(offset), 0, POSIX_FADV_SEQUENTIAL);
+    struct iovec buffers[DEPTH];
+    for (int i = 0; i < DEPTH; ++i)
+    {
+        void *p = NULL;
+        if (::posix_memalign(&p, 4096, chunkSize) != 0)
+        {
+            p = NULL;
+            m_ok = false;
+        }
+        m_slots[i].data = static_cast<char *>(p);
+        m_slots[i].busy = false;
+        buffers[i].iov_base = p;
+        buffers[i].iov_len = chunkSize;
+    }
+    if (m_ok)
+    {
+        m_ring.registerBuffers(buffers, DEPTH);
+        restart(offset);
+    }
+}
+
+RingReader::~RingReader()
+{
+    drain();
+    for (int i = 0; i < DEPTH; ++i)
+    {
+        std::free(m_slots[i].data);
+    }
+}
+
+void RingReader::issue(int slot)
+{
+    Slot &s = m_slots[slot];
+    s.offset = m_nextOffset;
+    s.busy = true;
+    s.result = 0;
+    m_ring.read(m_fd, s.data, unsigned(m_chunkSize), s.offset, uint64_t(slot), slot);
+    m_nextOffset += m_chunkSize;
+}
+
+// Records every completion available now
+void RingReader::collect()
+{
+    IoCompletion done;
+    while (m_ring.reap(done))
+    {
+        Slot &s = m_slots[done.tag];
+        s.busy = false;
+        s.result = done.result;
+        if (done.result < 0)
+        {
+            m_ok = false;
+        }
+    }
+}
+
+bool RingReader::await(int slot)
+{
+    collect();
+    while (m_slots[slot].busy && m_ok)
+    {
+        if (!m_ring.submit(1))
+        {
+            m_ok = false;
+            break;
+        }
+        collect();
+    }
+    return m_ok;
+}
+
+void RingReader::drain()
+{
+    while (m_ring.inFlight() > 0)
+    {
+        if (!m_ring.submit(m_ring.inFlight()))
+        {
+            break;
+        }
+        collect();
+    }
+}
+
+// Refills every slot with consecutive chunks starting at @p offset
+void RingReader::restart(uint64_t offset)
+{
+    drain();
+    m_nextOffset = offset;
+    m_current = 0;
+    m_consumed = 0;
+    for (int i = 0; i < DEPTH; ++i)
+    {
+        issue(i);
+    }
+    if (!m_ring.submit(0))
+    {
+        m_ok = false;
+    }
+}
+
+size_t RingReader::read(char *dst, size_t len)
+{
+    size_t total = 0;
+    while (total < len && !m_eof && m_ok)
+    {
+        if (!await(m_current))
+        {
+            break;
+        }
+        Slot &s = m_slots[m_current];
+        size_t have = size_t(s.result);
+        if (have == 0)
+        {
+            m_eof = true;
+            break;
+        }
+        size_t n = std::min(have - m_consumed, len - total);
+        std::memcpy(dst + total, s.data + m_consumed, n);
+        m_consumed += n;
+        total += n;
+        if (m_consumed < have)
+        {
+            continue;
+        }
+        if (have < m_chunkSize)
+        {
+            // End of file, or a short read mid-file: go on from right here
+            restart(s.offset + have);
+            continue;
+        }
+        // Drained: this slot now reads the chunk after the last one queued
+        issue(m_current);
+        if (!m_ring.submit(0))
+        {
+            m_ok = false;
+        }
+        m_current = (m_current + 1) % DEPTH;
+        m_consumed = 0;
+    }
+    return total;
+}
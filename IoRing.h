@@ -0,0 +1,218 @@
+/**
+ * @file IoRing.h
+ * @brief File I/O through io_uring: batched submissions, registered
+ *        buffers and chained fsync, with a synchronous fallback.
+ *
+ * ARCHITECTURE:
+ *   JsonLinesReader / CsvReader          OutputBuffer (exports, save files)
+ *       |  RingReader: chunks read          |  full buffers written while the
+ *       |  ahead while parsing              |  next one fills; fsync chained
+ *       v                                   v
+ *   IoRing (You are here) - submission and completion queues shared with
+ *       |  the kernel; one io_uring_enter submits a whole batch
+ *       v
+ *   kernel (io_uring)  or  pread/pwrite/fsync on kernels without it
+ *
+ * The ring is driven with the raw system calls, so no liburing is needed.
+ * When io_uring_setup fails (kernel older than 5.6, disabled by sysctl or
+ * seccomp) the same calls run each queued operation synchronously inside
+ * submit() with pread/pwrite/fsync and report it as a completion, so
+ * callers have a single code path. IoRing::setEnabled(false) sends the
+ * readers and OutputBuffer back to plain fread and write(2).
+ *
+ * ORDERING: operations run concurrently unless flagged. IO_LINK makes the
+ * next operation wait for this one (and fail with -ECANCELED if this one
+ * fails); IO_DRAIN makes this one wait for everything queued before it.
+ *
+ * A ring belongs to one thread.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <sys/uio.h>
+
+/** @brief Per-operation flags for IoRing. */
+enum IoFlags
+{
+    IO_LINK = 1,    ///< The next operation starts after this one succeeds
+    IO_DRAIN = 2    ///< Starts after every earlier operation has finished
+};
+
+/** @brief One finished operation. */
+struct IoCompletion
+{
+    uint64_t tag;   ///< As passed when queued
+    int result;     ///< Bytes transferred, or -errno
+};
+
+/**
+ * @class IoRing
+ * @brief An io_uring instance (or its synchronous stand-in); see file comment.
+ */
+class IoRing
+{
+public:
+    /** @param entries Submission queue size; more queued operations submit early. */
+    explicit IoRing(unsigned entries = 64);
+    ~IoRing();
+
+    /** @brief True if the kernel ring is in use, false for the fallback. */
+    bool kernel() const { return m_fd >= 0; }
+
+    /** @brief With false, new rings use the fallback and readers/OutputBuffer skip rings (default true). */
+    static void setEnabled(bool on);
+    static bool enabled();
+
+    /**
+     * @brief Pin @p count buffers so operations can name them by index,
+     *        which saves mapping the pages on every request.
+     * @return False if the kernel refused (operations still work unregistered).
+     */
+    bool registerBuffers(const struct iovec *buffers, unsigned count);
+
+    /**
+     * @brief Queue a read of @p len bytes at @p offset. @p buffer is the
+     *        registered index holding @p buf, or -1.
+     */
+    void read(int fd, void *buf, unsigned len, uint64_t offset, uint64_t tag, int buffer = -1, unsigned flags = 0);
+
+    /** @brief Queue a write; as read(). */
+    void write(int fd, const void *buf, unsigned len, uint64_t offset, uint64_t tag, int buffer = -1,
+               unsigned flags = 0);
+
+    /** @brief Queue an fsync of @p fd. */
+    void fsync(int fd, uint64_t tag, unsigned flags = 0);
+
+    /**
+     * @brief Submit everything queued in one call and wait until at least
+     *        @p waitFor completions are available to reap.
+     * @return False if the kernel rejected the submission.
+     */
+    bool submit(unsigned waitFor = 0);
+
+    /** @brief Pop one completion if any is available. */
+    bool reap(IoCompletion &done);
+
+    /** @brief Operations submitted and not yet reaped. */
+    unsigned inFlight() const { return m_inFlight; }
+
+private:
+    enum Opcode
+    {
+        OP_READ,
+        OP_WRITE,
+        OP_FSYNC
+    };
+
+    struct Op
+    {
+        Opcode opcode;
+        int fd;
+        char *buf;
+        unsigned len;
+        uint64_t offset;
+        uint64_t tag;
+        int buffer;
+        unsigned flags;
+    };
+
+    int m_fd;                       ///< io_uring descriptor, -1 for the fallback
+    unsigned m_entries;
+    unsigned m_queued;              ///< SQEs written but not yet submitted
+    unsigned m_inFlight;
+    bool m_registered;
+
+    // Kernel ring mappings
+    void *m_sqMap;
+    size_t m_sqMapSize;
+    void *m_cqMap;
+    size_t m_cqMapSize;
+    void *m_sqes;
+    size_t m_sqesSize;
+    unsigned *m_sqHead;
+    unsigned *m_sqTail;
+    unsigned m_sqMask;
+    unsigned *m_sqArray;
+    unsigned *m_cqHead;
+    unsigned *m_cqTail;
+    unsigned m_cqMask;
+    void *m_cqes;
+
+    // Fallback: queued operations and their results
+    std::vector<Op> m_pending;
+    std::deque<IoCompletion> m_done;
+
+    static bool s_enabled;
+
+    bool setup(unsigned entries);
+    void queue(const Op &op);
+    void runSync();
+
+    IoRing(const IoRing &);
+    IoRing &operator=(const IoRing &);
+};
+
+/**
+ * @class RingReader
+ * @brief Sequential reader of a regular file that keeps several chunk
+ *        reads in flight, so the disk works while the caller parses.
+ */
+class RingReader
+{
+public:
+    /**
+     * @brief A reader for @p in if it is a regular file, otherwise NULL
+     *        (pipes and terminals stay with fread).
+     * @param chunkSize Bytes per read request.
+     */
+    static RingReader *open(std::FILE *in, size_t chunkSize);
+
+    ~RingReader();
+
+    /** @brief Copy up to @p len bytes; short only at end of file. @return 0 at end or on error. */
+    size_t read(char *dst, size_t len);
+
+    /** @brief False once a read has failed. */
+    bool ok() const { return m_ok; }
+
+private:
+    static const int DEPTH = 4;     ///< Chunk reads in flight
+
+    struct Slot
+    {
+        char *data;
+        uint64_t offset;
+        bool busy;                  ///< Read in flight
+        int result;                 ///< Bytes read, or -errno
+    };
+
+    IoRing m_ring;
+    int m_fd;
+    size_t m_chunkSize;
+    Slot m_slots[DEPTH];
+    int m_current;                  ///< Slot being consumed, in file order
+    size_t m_consumed;              ///< Bytes of the current slot handed out
+    uint64_t m_nextOffset;          ///< Where the next queued read starts
+    bool m_eof;
+    bool m_ok;
+
+    RingReader(int fd, uint64_t offset, size_t chunkSize);
+    void issue(int slot);
+    void collect();
+    bool await(int slot);
+    void drain();
+    void restart(uint64_t offset);
+
+    RingReader(const RingReader &);
+    RingReader &operator=(const RingReader &);
+};
+
+#endif
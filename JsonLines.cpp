@@ -0,0 +1,555 @@
+#include "JsonLines.h"
+#include "DBsystem.h"
+#include "IoRing.h"
+#include "RecordMapper.h"
+#include "Validator.h"
+#include <chrono>
+#include <cstring>
+
+// ---------------------------------------------------------------------------
+// JsonObject
+// ---------------------------------------------------------------------------
+
+JsonObject::JsonObject() : m_count(0) {}
+
+static void skipSpace(const char *&p, const char *end)
+{
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    {
+        ++p;
+    }
+}
+
+static void appendUtf8(std::string &out, unsigned cp)
+{
+    if (cp < 0x80)
+    {
+        out += char(cp);
+    }
+    else if (cp < 0x800)
+    {
+        out += char(0xC0 | (cp >> 6));
+        out += char(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        out += char(0xE0 | (cp >> 12));
+        out += char(0x80 | ((cp >> 6) & 0x3F));
+        out += char(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        out += char(0xF0 | (cp >> 18));
+        out += char(0x80 | ((cp >> 12) & 0x3F));
+        out += char(0x80 | ((cp >> 6) & 0x3F));
+        out += char(0x80 | (cp & 0x3F));
+    }
+}
+
+static bool parseHex4(const char *p, const char *end, unsigned &cp)
+{
+    if (end - p < 4)
+    {
+        return false;
+    }
+    cp = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        char c = p[i];
+        cp <<= 4;
+        if (c >= '0' && c <= '9')
+            cp |= unsigned(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            cp |= unsigned(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            cp |= unsigned(c - 'A' + 10);
+        else
+            return false;
+    }
+    return true;
+}
+
+// p points at the opening quote; leaves p one past the closing quote
+bool JsonObject::parseString(const char *&p, const char *end, std::string &out)
+{
+    out.clear();
+    ++p;
+    while (p != end)
+    {
+        // Copy the run up to the next quote or escape in one go
+        const char *run = p;
+        while (p != end && *p != '"' && *p != '\\')
+        {
+            ++p;
+        }
+        out.append(run, p - run);
+        if (p == end)
+        {
+            return false;
+        }
+        if (*p == '"')
+        {
+            ++p;
+            return true;
+        }
+        ++p; // backslash
+        if (p == end)
+        {
+            return false;
+        }
+        switch (*p)
+        {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+        {
+            unsigned cp;
+            if (!parseHex4(p + 1, end, cp))
+            {
+                return false;
+            }
+            p += 4;
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p > 6 && p[1] == '\\' && p[2] == 'u')
+            {
+                unsigned low;
+                if (parseHex4(p + 3, end, low) && low >= 0xDC00 && low < 0xE000)
+                {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+        ++p;
+    }
+    return false;
+}
+
+// Skips a nested object or array, honouring strings
+bool JsonObject::skipValue(const char *&p, const char *end)
+{
+    int depth = 0;
+    bool inString = false;
+    for (; p != end; ++p)
+    {
+        char c = *p;
+        if (inString)
+        {
+            if (c == '\\')
+                ++p;
+            else if (c == '"')
+                inString = false;
+            if (p == end)
+                return false;
+            continue;
+        }
+        if (c == '"')
+            inString = true;
+        else if (c == '{' || c == '[')
+            ++depth;
+        else if (c == '}' || c == ']')
+        {
+            if (--depth == 0)
+            {
+                ++p;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool JsonObject::parse(const char *p, const char *end)
+{
+    m_count = 0;
+    skipSpace(p, end);
+    if (p == end || *p != '{')
+    {
+        return false;
+    }
+    ++p;
+    skipSpace(p, end);
+    if (p != end && *p == '}')
+    {
+        return true;
+    }
+
+    while (p != end)
+    {
+        if (m_count == int(m_fields.size()))
+        {
+            m_fields.push_back(Field());
+        }
+        Field &f = m_fields[m_count];
+
+        skipSpace(p, end);
+        if (p == end || *p != '"' || !parseString(p, end, f.key))
+        {
+            return false;
+        }
+        skipSpace(p, end);
+        if (p == end || *p != ':')
+        {
+            return false;
+        }
+        ++p;
+        skipSpace(p, end);
+        if (p == end)
+        {
+            return false;
+        }
+
+        f.type = JSON_LITERAL;
+        if (*p == '"')
+        {
+            f.type = JSON_STRING;
+            if (!parseString(p, end, f.value))
+            {
+                return false;
+            }
+        }
+        else if (*p == '{' || *p == '[')
+        {
+            f.type = JSON_NESTED;
+            const char *start = p;
+            if (!skipValue(p, end))
+            {
+                return false;
+            }
+            f.value.assign(start, p - start);
+        }
+        else
+        {
+            const char *start = p;
+            while (p != end && *p != ',' && *p != '}' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+            {
+                ++p;
+            }
+            f.value.assign(start, p - start);
+            if (f.value == "null")
+            {
+                f.value.clear();
+                f.type = JSON_NULL;
+            }
+        }
+        ++m_count;
+
+        skipSpace(p, end);
+        if (p == end)
+        {
+            return false;
+        }
+        if (*p == '}')
+        {
+            return true;
+        }
+        if (*p != ',')
+        {
+            return false;
+        }
+        ++p;
+    }
+    return false;
+}
+
+const std::string *JsonObject::find(const std::string &key) const
+{
+    for (int i = 0; i < m_count; ++i)
+    {
+        if (m_fields[i].key == key)
+        {
+            return m_fields[i].type == JSON_NULL ? NULL : &m_fields[i].value;
+        }
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// JsonLinesReader
+// ---------------------------------------------------------------------------
+
+JsonLinesReader::JsonLinesReader(std::FILE *in, size_t chunkSize)
+    : m_in(in), m_ring(RingReader::open(in, chunkSize)), m_chunkSize(chunkSize), m_buf(chunkSize), m_begin(0), m_end(0), m_scan(0),
+      m_objStart(0), m_depth(0), m_inString(false), m_escape(false), m_eof(false),
+      m_malformed(0), m_bytesRead(0) {}
+
+JsonLinesReader::~JsonLinesReader()
+{
+    delete m_ring;
+}
+
+// Moves the unconsumed tail to the front and reads another chunk
+bool JsonLinesReader::fill()
+{
+    if (m_eof)
+    {
+        return false;
+    }
+    size_t keep = m_end - m_begin;
+    if (keep > 0 && m_begin > 0)
+    {
+        std::memmove(&m_buf[0], &m_buf[m_begin], keep);
+    }
+    m_scan -= m_begin;
+    if (m_depth != 0)
+    {
+        m_objStart -= m_begin;
+    }
+    m_begin = 0;
+    m_end = keep;
+
+    // A single object larger than the buffer: grow rather than fail
+    if (m_buf.size() - m_end < m_chunkSize / 2)
+    {
+        m_buf.resize(m_buf.size() + m_chunkSize);
+    }
+
+    size_t n = m_ring != NULL ? m_ring->read(&m_buf[m_end], m_buf.size() - m_end)
+                              : std::fread(&m_buf[m_end], 1, m_buf.size() - m_end, m_in);
+    if (n == 0)
+    {
+        m_eof = true;
+        return false;
+    }
+    m_end += n;
+    m_bytesRead += n;
+    return true;
+}
+
+bool JsonLinesReader::next(JsonObject &obj)
+{
+    const char *begin;
+    const char *end;
+    while (nextRaw(begin, end))
+    {
+        if (obj.parse(begin, end))
+        {
+            return true;
+        }
+        ++m_malformed;
+    }
+    return false;
+}
+
+bool JsonLinesReader::nextRaw(const char *&begin, const char *&end)
+{
+    while (true)
+    {
+        while (m_scan < m_end)
+        {
+            char c = m_buf[m_scan];
+            if (m_depth == 0)
+            {
+                // Between objects: skip newlines, array brackets and commas
+                if (c == '{')
+                {
+                    m_objStart = m_scan;
+                    m_depth = 1;
+                }
+                ++m_scan;
+                m_begin = m_depth ? m_objStart : m_scan;
+                continue;
+            }
+
+            if (m_inString)
+            {
+                // Jump straight to the next quote or backslash inside strings
+                const char *p = &m_buf[m_scan];
+                const char *end = &m_buf[0] + m_end;
+                if (m_escape)
+                {
+                    m_escape = false;
+                    ++m_scan;
+                    continue;
+                }
+                while (p != end && *p != '"' && *p != '\\')
+                {
+                    ++p;
+                }
+                m_scan = p - &m_buf[0];
+                if (p == end)
+                {
+                    break;
+                }
+                if (*p == '\\')
+                    m_escape = true;
+                else
+                    m_inString = false;
+                ++m_scan;
+                continue;
+            }
+
+            ++m_scan;
+            if (c == '"')
+            {
+                m_inString = true;
+            }
+            else if (c == '{' || c == '[')
+            {
+                ++m_depth;
+            }
+            else if (c == '}' || c == ']')
+            {
+                if (--m_depth == 0)
+                {
+                    begin = &m_buf[m_objStart];
+                    end = &m_buf[0] + m_scan;
+                    m_begin = m_scan;
+                    return true;
+                }
+            }
+        }
+
+        if (!fill())
+        {
+            if (m_depth != 0)
+            {
+                // Truncated final object
+                ++m_malformed;
+                m_depth = 0;
+            }
+            return false;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Ingest driver
+// ---------------------------------------------------------------------------
+
+IngestStats ingestJsonLines(DBsystem &db, std::FILE *in, const RecordMapper &mapper, size_t batchSize,
+                            Validator *validator)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    IngestStats stats;
+    JsonLinesReader reader(in);
+    JsonObject obj;
+    std::vector<Student> students;
+    std::vector<Faculty> faculty;
+    std::vector<Course> courses;
+    std::vector<Enrollment> enrollments;
+    std::vector<uint64_t> rejected;
+    students.reserve(batchSize);
+    faculty.reserve(batchSize);
+
+    bool more = true;
+    while (more)
+    {
+        // Parse a batch, then apply it; the batch bounds memory use
+        while (students.size() + faculty.size() + courses.size() + enrollments.size() < batchSize &&
+               (more = reader.next(obj)))
+        {
+            ++stats.rows;
+            Student s;
+            Faculty f;
+            Course c;
+            Enrollment e;
+            // Enrollments first: they also carry student_id and course_id
+            if (mapper.isEnrollment(obj))
+            {
+                if (mapper.toEnrollment(obj, e))
+                    enrollments.push_back(e);
+                else
+                    ++stats.skipped;
+            }
+            else if (mapper.isCourse(obj))
+            {
+                if (mapper.toCourse(obj, c))
+                    courses.push_back(c);
+                else
+                    ++stats.skipped;
+            }
+            else if (mapper.isStudent(obj) && mapper.toStudent(obj, s))
+            {
+                students.push_back(s);
+                if (validator != NULL)
+                    validator->capture(true, obj);
+            }
+            else if (mapper.isFaculty(obj) && mapper.toFaculty(obj, f))
+            {
+                faculty.push_back(f);
+                if (validator != NULL)
+                    validator->capture(false, obj);
+            }
+            else
+            {
+                ++stats.skipped;
+            }
+        }
+
+        // Faculty go in first, so students may name an advisor from the same batch
+        db.beginBulk();
+        if (validator != NULL)
+            validator->validate(db, faculty, rejected);
+        for (size_t i = 0; i < faculty.size(); ++i)
+        {
+            if (validator != NULL && Validator::isSet(rejected, i))
+                ++stats.rejected;
+            else if (db.upsertFaculty(faculty[i]))
+                ++stats.inserted;
+            else
+                ++stats.updated;
+        }
+        if (validator != NULL)
+            validator->validate(db, students, rejected);
+        size_t kept = 0;
+        for (size_t i = 0; i < students.size(); ++i)
+        {
+            if (validator != NULL && Validator::isSet(rejected, i))
+                ++stats.rejected;
+            else
+                students[kept++] = students[i];
+        }
+        students.resize(kept);
+        if (db.studentsVersioned())
+        {
+            // SCD Type-2: changed rows close their current version
+            VersionCounts counts = db.closeAndInsertStudents(students, db.studentVersionTime());
+            stats.inserted += counts.inserted;
+            stats.updated += counts.updated;
+            stats.unchanged += counts.unchanged;
+        }
+        else
+        {
+            UpsertCounts counts = db.upsertStudents(students);
+            stats.inserted += counts.inserted;
+            stats.updated += counts.updated;
+        }
+        db.endBulk();
+        for (size_t i = 0; i < courses.size(); ++i)
+        {
+            if (db.upsertCourse(courses[i]))
+                ++stats.inserted;
+            else
+                ++stats.updated;
+        }
+        for (size_t i = 0; i < enrollments.size(); ++i)
+        {
+            if (db.upsertEnrollment(enrollments[i]))
+                ++stats.inserted;
+            else
+                ++stats.updated;
+        }
+        students.clear();
+        faculty.clear();
+        courses.clear();
+        enrollments.clear();
+    }
+
+    stats.rows += reader.malformed();
+    stats.skipped += reader.malformed();
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,158 @@
+/**
+ * @file JsonLines.h
+ * @brief Streaming reader for JSON Lines (and plain JSON arrays) of flat objects.
+ *
+ * ARCHITECTURE:
+ *   data_engineering (Python) - FileLoader._load_jsonl / generators
+ *       |
+ *       v  stdin, FIFO or file
+ *   JsonLinesReader (You are here) - splits the stream into objects
+ *       |
+ *       v
+ *   RecordMapper - turns each object into a Student / Faculty / Course / Enrollment
+ *       |
+ *       v
+ *   Validator (optional) - rejects rows of a batch that break a rule
+ *       |
+ *       v
+ *   DBsystem - upsertStudent / upsertFaculty / upsertCourse / upsertEnrollment
+ *
+ * The reader pulls large chunks (read ahead through io_uring when the
+ * source is a regular file, fread otherwise) and scans them for top-level
+ * objects, so memory stays constant no matter how long the stream is.
+ * Object boundaries are found by brace depth rather than by newline, which
+ * means the pretty-printed arrays in data_engineering/data/raw load too.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef JSON_LINES_H
+#define JSON_LINES_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "RecordMapper.h"
+
+class DBsystem;
+class RingReader;
+class Validator;
+
+/** @brief What a JsonObject value was in the source text. */
+enum JsonType
+{
+    JSON_NULL,
+    JSON_STRING,
+    JSON_LITERAL,   ///< Number, true or false
+    JSON_NESTED     ///< Object or array, kept raw
+};
+
+/**
+ * @class JsonObject
+ * @brief One parsed flat JSON object: string keys mapped to scalar text.
+ *
+ * String values are unescaped, numbers/true/false are kept as their literal
+ * text, null becomes an empty value, and nested objects/arrays are kept raw.
+ * Field storage is reused between records to avoid per-row allocations.
+ */
+class JsonObject
+{
+public:
+    JsonObject();
+
+    /** @brief Parse text of a single object. @return False on malformed input. */
+    bool parse(const char *begin, const char *end);
+
+    /** @brief Look up a field. @return Pointer to value or NULL if missing/null. */
+    const std::string *find(const std::string &key) const;
+
+    /** @brief Number of fields in the last parsed object. */
+    int size() const { return m_count; }
+
+    /** @brief The i-th field, in source order. */
+    const std::string &key(int i) const { return m_fields[i].key; }
+    const std::string &value(int i) const { return m_fields[i].value; }
+    JsonType type(int i) const { return m_fields[i].type; }
+
+private:
+    struct Field
+    {
+        std::string key;
+        std::string value;
+        JsonType type;
+    };
+
+    std::vector<Field> m_fields;
+    int m_count;
+
+    bool parseString(const char *&p, const char *end, std::string &out);
+    bool skipValue(const char *&p, const char *end);
+};
+
+/**
+ * @class JsonLinesReader
+ * @brief Splits a byte stream into top-level JSON objects.
+ */
+class JsonLinesReader
+{
+public:
+    /** @brief Wrap an open stream. @param in Stream to read (not closed). @param chunkSize Bytes per fread. */
+    JsonLinesReader(std::FILE *in, size_t chunkSize = 1 << 20);
+    ~JsonLinesReader();
+
+    /** @brief Fetch the next object. @return False at end of stream. */
+    bool next(JsonObject &obj);
+
+    /**
+     * @brief Find the next object without parsing it, for handing the text
+     *        to other threads. [begin, end) stays valid until the next call.
+     * @return False at end of stream.
+     */
+    bool nextRaw(const char *&begin, const char *&end);
+
+    /** @brief Count an object that nextRaw returned but that failed to parse. */
+    void addMalformed() { ++m_malformed; }
+
+    /** @brief Objects that failed to parse so far. */
+    long long malformed() const { return m_malformed; }
+
+    /** @brief Bytes consumed so far. */
+    long long bytesRead() const { return m_bytesRead; }
+
+private:
+    std::FILE *m_in;
+    RingReader *m_ring;  ///< Read-ahead when m_in is a regular file
+    size_t m_chunkSize;
+    std::vector<char> m_buf;
+    size_t m_begin;      ///< First unconsumed byte
+    size_t m_end;        ///< One past last valid byte
+    size_t m_scan;       ///< Scan position inside the current object
+    size_t m_objStart;   ///< Start of the current object
+    int m_depth;
+    bool m_inString;
+    bool m_escape;
+    bool m_eof;
+    long long m_malformed;
+    long long m_bytesRead;
+
+    bool fill();
+
+    JsonLinesReader(const JsonLinesReader &);
+    JsonLinesReader &operator=(const JsonLinesReader &);
+};
+
+/**
+ * @brief Stream objects from @p in into @p db, upserting each by id.
+ * @param db Target database.
+ * @param in Open stream (stdin, FIFO or file).
+ * @param mapper Field mapping for all four tables.
+ * @param batchSize Records buffered before they are applied.
+ * @param validator If not NULL, each batch of students and faculty is
+ *        checked before it is applied and failing rows are rejected.
+ * @return Counters and elapsed time.
+ */
+IngestStats ingestJsonLines(DBsystem &db, std::FILE *in, const RecordMapper &mapper, size_t batchSize = 8192,
+                            Validator *validator = NULL);
+
+#endif
@@ -19,6 +19,14 @@
  * - search: O(log n) average, O(n) worst
  * - remove: O(log n) average, O(n) worst
  * - printInOrder: O(n) - prints sorted order
+ * - visitRange: O(depth + k) - visits the k elements in [lo, hi); a limit
+ *   stops the walk after that many
+ * - atRank: O(depth) - k-th smallest element via subtree counts, for
+ *   choosing range split points
+ * - drainDirty: O(changed nodes + their ancestors) - visits records
+ *   changed since the last drain, for incremental checkpoints
+ * - mergeSorted: O(n + k) - upserts k sorted keys in one in-order pass and
+ *   relinks the tree perfectly balanced
  * 
  * @author Julian Carbajal
  * @date Spring 2024
@@ -27,6 +35,7 @@
 #ifndef LazyBST_H
 #define LazyBST_H
 
+#include <vector>
 #include "TreeNode.h"
 
 /**
@@ -55,10 +64,47 @@ public:
     
     /** @brief Print all elements in post-order. */
     void printTreePostOrder();
+
+    /** @brief Visit all elements in sorted order. @param visit Callable taking const T&. */
+    template <typename Visitor>
+    void visitInOrder(Visitor &visit);
+
+    /**
+     * @brief Visit elements in [*lo, *hi) in sorted order. Read-only, so
+     *        several threads may visit disjoint ranges at once.
+     * @param lo Inclusive lower bound, or NULL for none.
+     * @param hi Exclusive upper bound, or NULL for none.
+     */
+    template <typename Visitor>
+    void visitRange(const T *lo, const T *hi, Visitor &visit) const;
+
+    /** @brief As above, stopping after @p limit elements. @return Elements visited. */
+    template <typename Visitor>
+    long long visitRange(const T *lo, const T *hi, Visitor &visit, long long limit) const;
+
+    /** @brief The element of rank @p rank (0 = smallest). @return NULL if out of range. */
+    const T *atRank(int rank) const;
     
-    /** @brief Insert data into tree. @param d Data to insert. */
-    void insert(T d);
+    /**
+     * @brief Insert data into tree.
+     * @param d Data to insert.
+     * @param dirty False for records loaded from durable storage, which a
+     *        checkpoint need not write again.
+     */
+    void insert(T d, bool dirty = true);
     
+    /**
+     * @brief Upsert a batch sorted by key without duplicates: keys already in
+     *        the tree are overwritten in place, the others inserted. The
+     *        in-order walk and the batch are merged into one node array that
+     *        is relinked balanced; existing nodes are reused, not copied. A
+     *        batch much smaller than the tree takes one search per key
+     *        instead.
+     * @param dirty As for insert; also applies to overwritten records.
+     * @return Number of keys inserted (the rest were updated).
+     */
+    int mergeSorted(const T *batch, int n, bool dirty = true);
+
     /** @brief Get number of elements. @return Tree size. */
     int size();
     
@@ -77,6 +123,23 @@ public:
     /** @brief Search and return pointer to data. @param key Data to find. @return Pointer to data or NULL. */
     T* search(T key);
 
+    /** @brief Like search, but marks the record changed for the next drainDirty. */
+    T* searchForUpdate(T key);
+
+    /**
+     * @brief Visit every record inserted or updated since the last drain, in
+     *        pre-order (re-inserting them in this order rebuilds the same
+     *        shape), and clear the marks. Clean subtrees are skipped.
+     */
+    template <typename Visitor>
+    void drainDirty(Visitor &visit);
+
+    /** @brief True if drainDirty may find something (conservative). */
+    bool hasDirty() const { return m_root != NULL && m_root->m_dirtyBelow; }
+
+    /** @brief Delete every node, leaving an empty tree. */
+    void clear();
+
 private:
     TreeNode<T> *m_root;  ///< Root node of the tree
     int m_size;           ///< Number of elements
@@ -84,11 +147,19 @@ private:
     bool recContainsHelper(TreeNode<T> *n, T d);
     void printIOHelper(TreeNode<T> *n);
     void printTreePostOrderHelper(TreeNode<T> *subTreeRoot);
-    void insertHelper(TreeNode<T> *&subTreeRoot, T &d);
+    template <typename Visitor>
+    void visitIOHelper(TreeNode<T> *n, Visitor &visit);
+    template <typename Visitor>
+    void visitRangeHelper(const TreeNode<T> *n, const T *lo, const T *hi, Visitor &visit, long long &left) const;
+    void insertHelper(TreeNode<T> *&subTreeRoot, T &d, bool dirty);
+    TreeNode<T> *buildBalanced(TreeNode<T> **nodes, int n);
+    template <typename Visitor>
+    void drainDirtyHelper(TreeNode<T> *n, Visitor &visit);
     T getMaxHelper(TreeNode<T> *n);
     T getMinHelper(TreeNode<T> *n);
     void findTarget(T key, TreeNode<T> *&target, TreeNode<T> *&parent);
     TreeNode<T> *getSuccessor(TreeNode<T> *rightChild);
+    void uncountPath(TreeNode<T> *target);
 };
 
 template <typename T>
@@ -179,7 +250,7 @@ void LazyBST<T>::printIOHelper(TreeNode<T> *n)
     if (n != NULL)
     {
         printIOHelper(n->m_left);
-        std::cout << n->m_data << std::endl;
+        std::cout << n->m_data << '\n';
         printIOHelper(n->m_right);
     }
 }
@@ -197,34 +268,214 @@ void LazyBST<T>::printTreePostOrderHelper(TreeNode<T> *subTreeRoot)
     {
         printTreePostOrderHelper(subTreeRoot->m_left);
         printTreePostOrderHelper(subTreeRoot->m_right);
-        std::cout << subTreeRoot->m_data << std::endl;
+        std::cout << subTreeRoot->m_data << '\n';
+    }
+}
+
+template <typename T>
+template <typename Visitor>
+void LazyBST<T>::visitInOrder(Visitor &visit)
+{
+    visitIOHelper(m_root, visit);
+}
+
+template <typename T>
+template <typename Visitor>
+void LazyBST<T>::visitIOHelper(TreeNode<T> *n, Visitor &visit)
+{
+    if (n != NULL)
+    {
+        visitIOHelper(n->m_left, visit);
+        visit(static_cast<const T &>(n->m_data));
+        visitIOHelper(n->m_right, visit);
+    }
+}
+
+template <typename T>
+template <typename Visitor>
+void LazyBST<T>::visitRange(const T *lo, const T *hi, Visitor &visit) const
+{
+    visitRange(lo, hi, visit, -1);
+}
+
+template <typename T>
+template <typename Visitor>
+long long LazyBST<T>::visitRange(const T *lo, const T *hi, Visitor &visit, long long limit) const
+{
+    long long left = limit;
+    visitRangeHelper(m_root, lo, hi, visit, left);
+    return limit - left;
+}
+
+// left counts down to 0, where the walk stops; starting at -1 it never gets there
+template <typename T>
+template <typename Visitor>
+void LazyBST<T>::visitRangeHelper(const TreeNode<T> *n, const T *lo, const T *hi, Visitor &visit,
+                                  long long &left) const
+{
+    if (n == NULL || left == 0)
+    {
+        return;
+    }
+    bool aboveLo = lo == NULL || !(n->m_data < *lo);
+    bool belowHi = hi == NULL || n->m_data < *hi;
+    if (aboveLo)
+    {
+        visitRangeHelper(n->m_left, lo, hi, visit, left);
     }
+    if (aboveLo && belowHi && left != 0)
+    {
+        visit(static_cast<const T &>(n->m_data));
+        --left;
+    }
+    if (belowHi)
+    {
+        visitRangeHelper(n->m_right, lo, hi, visit, left);
+    }
+}
+
+template <typename T>
+const T *LazyBST<T>::atRank(int rank) const
+{
+    const TreeNode<T> *n = m_root;
+    while (n != NULL)
+    {
+        int left = n->m_left != NULL ? n->m_left->m_count : 0;
+        if (rank < left)
+        {
+            n = n->m_left;
+        }
+        else if (rank == left)
+        {
+            return &n->m_data;
+        }
+        else
+        {
+            rank -= left + 1;
+            n = n->m_right;
+        }
+    }
+    return NULL;
 }
 
 template <typename T>
-void LazyBST<T>::insert(T d)
+void LazyBST<T>::insert(T d, bool dirty)
 {
-    insertHelper(m_root, d);
+    insertHelper(m_root, d, dirty);
     ++m_size;
 }
 
 template <typename T>
-void LazyBST<T>::insertHelper(TreeNode<T> *&subTreeRoot, T &d)
+void LazyBST<T>::insertHelper(TreeNode<T> *&subTreeRoot, T &d, bool dirty)
 {
     if (subTreeRoot == NULL)
     {
         subTreeRoot = new TreeNode<T>(d);
+        subTreeRoot->m_dirty = dirty;
+        subTreeRoot->m_dirtyBelow = dirty;
+        return;
+    }
+    ++subTreeRoot->m_count;
+    if (dirty)
+    {
+        subTreeRoot->m_dirtyBelow = true;
     }
-    else if (d > subTreeRoot->m_data)
+    if (d > subTreeRoot->m_data)
     {
-        insertHelper(subTreeRoot->m_right, d);
+        insertHelper(subTreeRoot->m_right, d, dirty);
     }
     else
     {
-        insertHelper(subTreeRoot->m_left, d);
+        insertHelper(subTreeRoot->m_left, d, dirty);
     }
 }
 
+template <typename T>
+int LazyBST<T>::mergeSorted(const T *batch, int n, bool dirty)
+{
+    int inserted = 0;
+    if (n == 0)
+    {
+        return 0;
+    }
+    if (n < m_size / 64)
+    {
+        // A few keys into a large tree: a search each beats relinking it all
+        for (int i = 0; i < n; ++i)
+        {
+            T *existing = dirty ? searchForUpdate(batch[i]) : search(batch[i]);
+            if (existing != NULL)
+            {
+                *existing = batch[i];
+            }
+            else
+            {
+                insert(batch[i], dirty);
+                ++inserted;
+            }
+        }
+        return inserted;
+    }
+
+    std::vector<TreeNode<T> *> nodes;
+    nodes.reserve(size_t(m_size) + size_t(n));
+    std::vector<TreeNode<T> *> stack;   // Iterative: a degenerate tree may be deep
+    TreeNode<T> *current = m_root;
+    int i = 0;
+    while (current != NULL || !stack.empty())
+    {
+        while (current != NULL)
+        {
+            stack.push_back(current);
+            current = current->m_left;
+        }
+        current = stack.back();
+        stack.pop_back();
+        for (; i < n && batch[i] < current->m_data; ++i, ++inserted)
+        {
+            TreeNode<T> *node = new TreeNode<T>(batch[i]);
+            node->m_dirty = dirty;
+            nodes.push_back(node);
+        }
+        if (i < n && batch[i] == current->m_data)
+        {
+            current->m_data = batch[i++];
+            current->m_dirty = current->m_dirty || dirty;
+        }
+        nodes.push_back(current);
+        current = current->m_right;
+    }
+    for (; i < n; ++i, ++inserted)
+    {
+        TreeNode<T> *node = new TreeNode<T>(batch[i]);
+        node->m_dirty = dirty;
+        nodes.push_back(node);
+    }
+
+    m_root = buildBalanced(nodes.data(), int(nodes.size()));
+    m_size += inserted;
+    return inserted;
+}
+
+// Middle node as root, halves as subtrees; counts and dirty marks are
+// recomputed on the way up
+template <typename T>
+TreeNode<T> *LazyBST<T>::buildBalanced(TreeNode<T> **nodes, int n)
+{
+    if (n == 0)
+    {
+        return NULL;
+    }
+    int mid = n / 2;
+    TreeNode<T> *root = nodes[mid];
+    root->m_left = buildBalanced(nodes, mid);
+    root->m_right = buildBalanced(nodes + mid + 1, n - mid - 1);
+    root->m_count = n;
+    root->m_dirtyBelow = root->m_dirty || (root->m_left != NULL && root->m_left->m_dirtyBelow) ||
+                         (root->m_right != NULL && root->m_right->m_dirtyBelow);
+    return root;
+}
+
 template <typename T>
 int LazyBST<T>::size()
 {
@@ -302,6 +553,16 @@ TreeNode<T> *LazyBST<T>::getSuccessor(TreeNode<T> *rightChild)
     return rightChild;
 }
 
+// Called before target is unlinked: its ancestors lose one node
+template <typename T>
+void LazyBST<T>::uncountPath(TreeNode<T> *target)
+{
+    for (TreeNode<T> *n = m_root; n != target; n = (target->m_data < n->m_data) ? n->m_left : n->m_right)
+    {
+        --n->m_count;
+    }
+}
+
 template <typename T>
 void LazyBST<T>::remove(T d)
 {
@@ -318,6 +579,7 @@ void LazyBST<T>::remove(T d)
 
     if (target->m_left == NULL && target->m_right == NULL)
     {
+        uncountPath(target);
         if (target == m_root)
         {
             m_root = NULL;
@@ -340,8 +602,14 @@ void LazyBST<T>::remove(T d)
     {
         TreeNode<T> *suc = getSuccessor(target->m_right);
         T value = suc->m_data;
+        bool dirty = suc->m_dirty;
         remove(value);
         target->m_data = value;
+        if (dirty)
+        {
+            // The successor's pending change moves with its data
+            searchForUpdate(value);
+        }
     }
     else
     {
@@ -355,6 +623,7 @@ void LazyBST<T>::remove(T d)
             child = target->m_right;
         }
 
+        uncountPath(target);
         if (target == m_root)
         {
             m_root = child;
@@ -400,4 +669,61 @@ T* LazyBST<T>::search(T key)
     return NULL; // Return NULL if the key is not found
 }
 
+template <typename T>
+T* LazyBST<T>::searchForUpdate(T key)
+{
+    TreeNode<T> *current = m_root;
+    while (current != NULL)
+    {
+        current->m_dirtyBelow = true; // conservative on a miss; cleared by the next drain
+        if (key < current->m_data)
+        {
+            current = current->m_left;
+        }
+        else if (key > current->m_data)
+        {
+            current = current->m_right;
+        }
+        else
+        {
+            current->m_dirty = true;
+            return &(current->m_data);
+        }
+    }
+    return NULL;
+}
+
+template <typename T>
+template <typename Visitor>
+void LazyBST<T>::drainDirty(Visitor &visit)
+{
+    drainDirtyHelper(m_root, visit);
+}
+
+template <typename T>
+template <typename Visitor>
+void LazyBST<T>::drainDirtyHelper(TreeNode<T> *n, Visitor &visit)
+{
+    if (n == NULL || !n->m_dirtyBelow)
+    {
+        return;
+    }
+    if (n->m_dirty)
+    {
+        visit(static_cast<const T &>(n->m_data));
+        n->m_dirty = false;
+    }
+    n->m_dirtyBelow = false;
+    drainDirtyHelper(n->m_left, visit);
+    drainDirtyHelper(n->m_right, visit);
+}
+
+template <typename T>
+void LazyBST<T>::clear()
+{
+    delete m_root; // TreeNode's destructor frees both subtrees
+    m_root = NULL;
+    m_size = 0;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,569 @@
+/**
+ * @file MessageBroker.h
+ * @brief In-process topics with partitions, consumer groups, committed
+ *        offsets and lag, on bounded lock-free logs.
+ *
+ * ARCHITECTURE:
+ *   producers (DBsystem change feed, JSON readers, ...)
+ *       |  produce(topic, partition, records, n) - batch copy, no locks
+ *       v
+ *   MessageBroker<T> (You are here)
+ *       |  topic -> partitions; each partition is a ring of 2^k records
+ *       |  addressed by offset (offset & mask) plus one cursor per group
+ *       v
+ *   consumers: consume(topic, group, partition, out, max) - batch copy
+ *   (WindowAggregator, Aggregator, ...)
+ *
+ * OFFSETS:
+ *   Offsets count up from 0 per partition. A group's cursor is its
+ *   committed offset: the next record it reads. consume advances it (auto
+ *   commit); commit moves it back or forward within the retained records.
+ *   lag = end offset - cursor. Records stay until every group of the topic
+ *   has read them, so the slowest group is the producers' back-pressure:
+ *   produce returns how many records fit and never blocks.
+ *
+ * PARTITION MODES:
+ *   PARTITION_SPSC - one producer thread per partition and one consumer
+ *       thread per group and partition. The producer writes, then publishes
+ *       the new end with one release store; readers acquire it. This is
+ *       SpscRing (RingBuffer.h) with one head per group.
+ *   PARTITION_MPMC - any number of producers and of consumers per group.
+ *       Producers claim a run of offsets with one CAS and publish each slot
+ *       through its sequence number (MpmcRing); consumers of a group claim
+ *       runs the same way and retire them in offset order.
+ *
+ * Producers only re-scan the group cursors when their cached floor (the
+ * slowest cursor) says the ring is full. Joins and commits that move a
+ * cursor backwards hold the epoch odd (a seqlock), so a scan that raced
+ * them is repeated, and never go below the slowest cursor, which keeps
+ * the floor monotonic.
+ *
+ * Topics, groups and rewinds go through a mutex (control plane); produce,
+ * consume and lag are lock-free. Topics live as long as the broker.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef MESSAGE_BROKER_H
+#define MESSAGE_BROKER_H
+
+#include "RingBuffer.h"
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** @brief Fixed-size event for stream processors (WindowAggregator::add takes the same fields). */
+struct StreamEvent
+{
+    int64_t timestamp;      ///< Epoch milliseconds
+    uint32_t key;           ///< Interned key id
+    uint32_t flags;
+    double value;
+};
+
+enum PartitionMode
+{
+    PARTITION_SPSC,
+    PARTITION_MPMC
+};
+
+/**
+ * @class MessageBroker
+ * @brief Topics of records of type T (copy-assignable, default-constructible).
+ */
+template <typename T>
+class MessageBroker
+{
+public:
+    static const int MAX_TOPICS = 64;
+    static const int MAX_GROUPS = 16;   ///< Consumer groups per topic
+
+    MessageBroker();
+    ~MessageBroker();
+
+    /**
+     * @brief Create a topic, or return the existing one of that name.
+     * @param capacity Records retained per partition, rounded up to a power of two.
+     * @return Topic id, or -1 when MAX_TOPICS exist or @p partitions < 1.
+     */
+    int createTopic(const std::string &name, int partitions, size_t capacity, PartitionMode mode);
+
+    /** @return Topic id of @p name, or -1. */
+    int topicId(const std::string &name) const;
+
+    int partitions(int topic) const { return m_topics[topic].load(std::memory_order_acquire)->partitionCount; }
+
+    /** @brief Partition of @p key: a fixed hash, so equal keys stay in order. */
+    int partitionFor(int topic, uint64_t key) const;
+
+    /**
+     * @brief Join consumer group @p group, created at the oldest retained
+     *        offset of every partition on first use.
+     * @return Group id within the topic, or -1 when MAX_GROUPS exist.
+     */
+    int joinGroup(int topic, const std::string &group);
+
+    /** @brief Append a prefix of @p records. @return Records accepted (0 if full). */
+    size_t produce(int topic, int partition, const T *records, size_t count);
+
+    /**
+     * @brief Copy up to @p max records after the group's cursor into @p out
+     *        and commit past them.
+     * @param firstOffset If not NULL, receives the offset of out[0].
+     * @return Records read, 0 if the group is caught up.
+     */
+    size_t consume(int topic, int group, int partition, T *out, size_t max, uint64_t *firstOffset = NULL);
+
+    /**
+     * @brief Move the group's cursor to @p offset. In PARTITION_MPMC mode
+     *        the group's consumers must be idle.
+     * @return False if @p offset is past the end or no longer retained.
+     */
+    bool commit(int topic, int group, int partition, uint64_t offset);
+
+    /** @brief Offset the next produced record of the partition gets. */
+    uint64_t endOffset(int topic, int partition) const;
+
+    /** @brief The group's next offset to read in @p partition. */
+    uint64_t committed(int topic, int group, int partition) const;
+
+    /** @brief Records produced but not yet consumed by @p group, over all partitions. */
+    uint64_t lag(int topic, int group) const;
+
+private:
+    struct Cell
+    {
+        std::atomic<uint64_t> sequence;     ///< offset + 1 once written (MPMC)
+        T value;
+    };
+
+    struct Cursor
+    {
+        alignas(RING_CACHE_LINE) std::atomic<uint64_t> done;   ///< Committed: everything below is read
+        std::atomic<uint64_t> claim;                            ///< MPMC: next offset to hand out
+    };
+
+    struct Partition
+    {
+        Cell *cells;
+        uint64_t mask;
+        alignas(RING_CACHE_LINE) std::atomic<uint64_t> tail;    ///< SPSC: published end; MPMC: claimed end
+        alignas(RING_CACHE_LINE) std::atomic<uint64_t> floor;   ///< A lower bound of every group's cursor
+        Cursor groups[MAX_GROUPS];
+    };
+
+    struct Topic
+    {
+        std::string name;
+        PartitionMode mode;
+        int partitionCount;
+        Partition *partitions;
+        std::vector<std::string> groupNames;
+        std::atomic<int> groupCount;
+        alignas(RING_CACHE_LINE) std::atomic<uint64_t> epoch;  ///< Odd during a join or rewind
+    };
+
+    std::atomic<Topic *> m_topics[MAX_TOPICS];
+    std::atomic<int> m_topicCount;
+    mutable std::mutex m_adminMutex;
+
+    Topic *topic(int id) const { return m_topics[id].load(std::memory_order_acquire); }
+    uint64_t refreshFloor(Topic *t, Partition &p);
+    uint64_t slowest(Topic *t, Partition &p, int skip) const;
+
+    MessageBroker(const MessageBroker &);
+    MessageBroker &operator=(const MessageBroker &);
+};
+
+template <typename T>
+const int MessageBroker<T>::MAX_TOPICS;
+
+template <typename T>
+const int MessageBroker<T>::MAX_GROUPS;
+
+template <typename T>
+MessageBroker<T>::MessageBroker() : m_topicCount(0)
+{
+    for (int i = 0; i < MAX_TOPICS; ++i)
+    {
+        m_topics[i].store(NULL, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+MessageBroker<T>::~MessageBroker()
+{
+    for (int i = 0; i < m_topicCount.load(); ++i)
+    {
+        Topic *t = topic(i);
+        for (int p = 0; p < t->partitionCount; ++p)
+        {
+            delete[] t->partitions[p].cells;
+        }
+        delete[] t->partitions;
+        delete t;
+    }
+}
+
+template <typename T>
+int MessageBroker<T>::createTopic(const std::string &name, int partitions, size_t capacity, PartitionMode mode)
+{
+    std::lock_guard<std::mutex> lock(m_adminMutex);
+    int count = m_topicCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i)
+    {
+        if (topic(i)->name == name)
+        {
+            return i;
+        }
+    }
+    if (count == MAX_TOPICS || partitions < 1)
+    {
+        return -1;
+    }
+
+    Topic *t = new Topic();
+    t->name = name;
+    t->mode = mode;
+    t->partitionCount = partitions;
+    t->partitions = new Partition[partitions];
+    t->groupCount.store(0, std::memory_order_relaxed);
+    t->epoch.store(0, std::memory_order_relaxed);
+    size_t slots = ringCapacity(capacity);
+    for (int p = 0; p < partitions; ++p)
+    {
+        Partition &part = t->partitions[p];
+        part.cells = new Cell[slots];
+        part.mask = slots - 1;
+        for (size_t i = 0; i < slots; ++i)
+        {
+            // Never matches offset + 1 before the slot is first written
+            part.cells[i].sequence.store(0, std::memory_order_relaxed);
+        }
+        part.tail.store(0, std::memory_order_relaxed);
+        part.floor.store(0, std::memory_order_relaxed);
+        for (int g = 0; g < MAX_GROUPS; ++g)
+        {
+            part.groups[g].done.store(0, std::memory_order_relaxed);
+            part.groups[g].claim.store(0, std::memory_order_relaxed);
+        }
+    }
+    m_topics[count].store(t, std::memory_order_release);
+    m_topicCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+template <typename T>
+int MessageBroker<T>::topicId(const std::string &name) const
+{
+    int count = m_topicCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i)
+    {
+        if (topic(i)->name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename T>
+int MessageBroker<T>::partitionFor(int id, uint64_t key) const
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return int(key % uint64_t(topic(id)->partitionCount));
+}
+
+// Smallest cursor of the topic's groups other than @p skip, or the
+// partition's floor when there are none
+template <typename T>
+uint64_t MessageBroker<T>::slowest(Topic *t, Partition &p, int skip) const
+{
+    uint64_t low = ~uint64_t(0);
+    int groups = t->groupCount.load(std::memory_order_acquire);
+    for (int g = 0; g < groups; ++g)
+    {
+        if (g != skip)
+        {
+            uint64_t c = p.groups[g].done.load(std::memory_order_seq_cst);
+            low = c < low ? c : low;
+        }
+    }
+    if (low == ~uint64_t(0))
+    {
+        low = p.floor.load(std::memory_order_seq_cst);
+    }
+    return low;
+}
+
+// Re-scan the cursors and raise the shared floor to the slowest one. The
+// epoch is odd while a join or rewind runs; a scan that overlapped one is
+// repeated, like a seqlock read.
+template <typename T>
+uint64_t MessageBroker<T>::refreshFloor(Topic *t, Partition &p)
+{
+    uint64_t low;
+    while (true)
+    {
+        uint64_t before = t->epoch.load(std::memory_order_seq_cst);
+        if (before & 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        low = slowest(t, p, -1);
+        if (t->epoch.load(std::memory_order_seq_cst) == before)
+        {
+            break;
+        }
+    }
+
+    uint64_t floor = p.floor.load(std::memory_order_relaxed);
+    while (low > floor && !p.floor.compare_exchange_weak(floor, low, std::memory_order_seq_cst))
+    {
+    }
+    return low > floor ? low : floor;
+}
+
+template <typename T>
+int MessageBroker<T>::joinGroup(int id, const std::string &group)
+{
+    std::lock_guard<std::mutex> lock(m_adminMutex);
+    Topic *t = topic(id);
+    int count = t->groupCount.load(std::memory_order_relaxed);
+    for (int g = 0; g < count; ++g)
+    {
+        if (t->groupNames[g] == group)
+        {
+            return g;
+        }
+    }
+    if (count == MAX_GROUPS)
+    {
+        return -1;
+    }
+
+    t->groupNames.push_back(group);
+    t->epoch.fetch_add(1, std::memory_order_seq_cst);
+    for (int p = 0; p < t->partitionCount; ++p)
+    {
+        // At or above anything a producer may have taken as the floor
+        Partition &part = t->partitions[p];
+        uint64_t start = slowest(t, part, -1);
+        part.groups[count].claim.store(start, std::memory_order_relaxed);
+        part.groups[count].done.store(start, std::memory_order_seq_cst);
+    }
+    t->groupCount.store(count + 1, std::memory_order_seq_cst);
+    t->epoch.fetch_add(1, std::memory_order_seq_cst);
+    return count;
+}
+
+template <typename T>
+size_t MessageBroker<T>::produce(int id, int partition, const T *records, size_t count)
+{
+    Topic *t = topic(id);
+    Partition &p = t->partitions[partition];
+    uint64_t capacity = p.mask + 1;
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    if (t->mode == PARTITION_SPSC)
+    {
+        uint64_t tail = p.tail.load(std::memory_order_relaxed);
+        uint64_t floor = p.floor.load(std::memory_order_relaxed);
+        if (tail + count > floor + capacity)
+        {
+            floor = refreshFloor(t, p);
+        }
+        uint64_t room = floor + capacity - tail;
+        size_t n = count < room ? count : size_t(room);
+        for (size_t i = 0; i < n; ++i)
+        {
+            p.cells[(tail + i) & p.mask].value = records[i];
+        }
+        if (n > 0)
+        {
+            p.tail.store(tail + n, std::memory_order_release);
+        }
+        return n;
+    }
+
+    uint64_t pos = p.tail.load(std::memory_order_relaxed);
+    size_t n;
+    while (true)
+    {
+        uint64_t floor = p.floor.load(std::memory_order_acquire);
+        if (pos + count > floor + capacity)
+        {
+            floor = refreshFloor(t, p);
+        }
+        if (pos >= floor + capacity)
+        {
+            uint64_t now = p.tail.load(std::memory_order_relaxed);
+            if (now == pos)
+            {
+                return 0;
+            }
+            pos = now;
+            continue;
+        }
+        uint64_t room = floor + capacity - pos;
+        n = count < room ? count : size_t(room);
+        if (p.tail.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        Cell &cell = p.cells[(pos + i) & p.mask];
+        cell.value = records[i];
+        cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return n;
+}
+
+template <typename T>
+size_t MessageBroker<T>::consume(int id, int group, int partition, T *out, size_t max, uint64_t *firstOffset)
+{
+    Topic *t = topic(id);
+    Partition &p = t->partitions[partition];
+    Cursor &c = p.groups[group];
+    if (max == 0)
+    {
+        return 0;
+    }
+
+    if (t->mode == PARTITION_SPSC)
+    {
+        uint64_t head = c.done.load(std::memory_order_relaxed);
+        uint64_t ready = p.tail.load(std::memory_order_acquire) - head;
+        size_t n = max < ready ? max : size_t(ready);
+        for (size_t i = 0; i < n; ++i)
+        {
+            out[i] = p.cells[(head + i) & p.mask].value;
+        }
+        if (firstOffset != NULL)
+        {
+            *firstOffset = head;
+        }
+        if (n > 0)
+        {
+            c.done.store(head + n, std::memory_order_release);
+        }
+        return n;
+    }
+
+    uint64_t pos = c.claim.load(std::memory_order_relaxed);
+    size_t n;
+    while (true)
+    {
+        n = 0;
+        while (n < max && p.cells[(pos + n) & p.mask].sequence.load(std::memory_order_acquire) == pos + n + 1)
+        {
+            ++n;
+        }
+        if (n == 0)
+        {
+            uint64_t now = c.claim.load(std::memory_order_relaxed);
+            if (now == pos)
+            {
+                return 0;
+            }
+            pos = now;
+            continue;
+        }
+        if (c.claim.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = p.cells[(pos + i) & p.mask].value;
+    }
+    if (firstOffset != NULL)
+    {
+        *firstOffset = pos;
+    }
+
+    // Retire in offset order: the producers may reuse these slots as soon
+    // as the cursor passes them
+    while (c.done.load(std::memory_order_acquire) != pos)
+    {
+        std::this_thread::yield();
+    }
+    c.done.store(pos + n, std::memory_order_release);
+    return n;
+}
+
+template <typename T>
+bool MessageBroker<T>::commit(int id, int group, int partition, uint64_t offset)
+{
+    Topic *t = topic(id);
+    Partition &p = t->partitions[partition];
+    Cursor &c = p.groups[group];
+    if (offset > p.tail.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    uint64_t current = c.done.load(std::memory_order_relaxed);
+    if (offset < current)
+    {
+        // Rewinding: only to records every producer still treats as live
+        std::lock_guard<std::mutex> lock(m_adminMutex);
+        t->epoch.fetch_add(1, std::memory_order_seq_cst);
+        uint64_t low = slowest(t, p, group);
+        low = current < low ? current : low;
+        uint64_t floor = p.floor.load(std::memory_order_seq_cst);
+        if (offset < low || offset < floor)
+        {
+            t->epoch.fetch_add(1, std::memory_order_seq_cst);
+            return false;
+        }
+        c.claim.store(offset, std::memory_order_relaxed);
+        c.done.store(offset, std::memory_order_seq_cst);
+        t->epoch.fetch_add(1, std::memory_order_seq_cst);
+        return true;
+    }
+    c.claim.store(offset, std::memory_order_relaxed);
+    c.done.store(offset, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+uint64_t MessageBroker<T>::endOffset(int id, int partition) const
+{
+    return topic(id)->partitions[partition].tail.load(std::memory_order_acquire);
+}
+
+template <typename T>
+uint64_t MessageBroker<T>::committed(int id, int group, int partition) const
+{
+    return topic(id)->partitions[partition].groups[group].done.load(std::memory_order_acquire);
+}
+
+template <typename T>
+uint64_t MessageBroker<T>::lag(int id, int group) const
+{
+    Topic *t = topic(id);
+    uint64_t total = 0;
+    for (int p = 0; p < t->partitionCount; ++p)
+    {
+        uint64_t done = t->partitions[p].groups[group].done.load(std::memory_order_acquire);
+        uint64_t end = t->partitions[p].tail.load(std::memory_order_acquire);
+        total += end > done ? end - done : 0;
+    }
+    return total;
+}
+
+#endif
@@ -0,0 +1,387 @@
+#include "OutputBuffer.h"
+#include "IoRing.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t DIRECT_AFTER = 8 << 20;   // File offset where full buffers switch to O_DIRECT
+static const size_t DIRECT_ALIGN = 4096;
+static const uint64_t PATCH_TAG = 100;          // Ring tags; buffers use their slot index
+static const uint64_t SYNC_TAG = 101;
+
+namespace
+{
+    char *allocateBuffer(size_t size)
+    {
+        void *p = NULL;
+        if (::posix_memalign(&p, DIRECT_ALIGN, size) != 0)
+        {
+            std::abort();
+        }
+        return static_cast<char *>(p);
+    }
+}
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity)
+    : m_fd(fd), m_data(NULL), m_capacity(capacity < 64 ? 64 : capacity), m_used(0), m_flushed(0), m_ok(true),
+      m_ring(NULL), m_slot(0), m_registered(false), m_offset(0), m_directFd(-1), m_patchOffset(0), m_fixups(0)
+{
+    for (int i = 0; i < SLOTS; ++i)
+    {
+        m_slots[i] = NULL;
+        m_lengths[i] = 0;
+        m_offsets[i] = 0;
+        m_viaDirect[i] = false;
+    }
+    off_t pos = ::lseek(fd, 0, SEEK_CUR);
+    m_offset = pos > 0 ? uint64_t(pos) : 0;
+    struct stat st;
+    if (IoRing::enabled() && pos >= 0 && ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        (::fcntl(fd, F_GETFL) & O_APPEND) == 0)
+    {
+        m_ring = new IoRing(2 * SLOTS);
+        m_capacity = (m_capacity + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    }
+    m_slots[0] = allocateBuffer(m_capacity);
+    m_data = m_slots[0];
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+    delete m_ring;
+    if (m_directFd >= 0)
+    {
+        ::close(m_directFd);
+    }
+    for (int i = 0; i < SLOTS; ++i)
+    {
+        std::free(m_slots[i]);
+    }
+}
+
+bool OutputBuffer::flush()
+{
+    if (m_ring == NULL)
+    {
+        writeAll(m_data, m_used);
+        m_flushed += (long long)m_used;
+        m_offset += m_used;
+        m_used = 0;
+        return m_ok;
+    }
+    spill();
+    waitAll();
+    ::lseek(m_fd, off_t(m_offset), SEEK_SET);
+    return m_ok;
+}
+
+bool OutputBuffer::patch(uint64_t offset, const void *data, size_t len)
+{
+    const char *bytes = static_cast<const char *>(data);
+    if (offset >= m_offset && offset + len <= m_offset + m_used)
+    {
+        // Still in the buffer being filled
+        std::memcpy(m_data + (offset - m_offset), bytes, len);
+        return m_ok;
+    }
+    if (m_ring == NULL || offset + len > m_offset)
+    {
+        flush();
+        return pwriteAll(bytes, len, offset);
+    }
+    // Already handed to the ring: queue it behind those writes
+    if (!m_patch.empty())
+    {
+        waitAll();
+    }
+    m_patch.assign(bytes, bytes + len);
+    m_patchOffset = offset;
+    m_ring->write(m_fd, &m_patch[0], unsigned(len), offset, PATCH_TAG, -1, IO_DRAIN);
+    return m_ok;
+}
+
+bool OutputBuffer::sync()
+{
+    if (m_ring == NULL)
+    {
+        flush();
+        if (m_ok && ::fsync(m_fd) != 0)
+        {
+            m_ok = false;
+        }
+        return m_ok;
+    }
+    // The last buffer, a pending patch and the fsync go out in one submission
+    long long fixups = m_fixups;
+    spill();
+    m_ring->fsync(m_fd, SYNC_TAG, IO_DRAIN);
+    waitAll();
+    ::lseek(m_fd, off_t(m_offset), SEEK_SET);
+    if (m_fixups != fixups && m_ok && ::fsync(m_fd) != 0)
+    {
+        // Bytes rewritten synchronously may have missed the queued fsync
+        m_ok = false;
+    }
+    return m_ok;
+}
+
+// Hands the filled part of the buffer on. With a ring the write is queued
+// and the next slot becomes the buffer, waiting only if it is still in flight.
+void OutputBuffer::spill()
+{
+    if (m_ring == NULL)
+    {
+        flush();
+        return;
+    }
+    if (m_used == 0)
+    {
+        return;
+    }
+    if (m_slots[1] == NULL)
+    {
+        // More than one buffer of output: worth the other slots and pinning them
+        struct iovec buffers[SLOTS];
+        for (int i = 0; i < SLOTS; ++i)
+        {
+            if (m_slots[i] == NULL)
+            {
+                m_slots[i] = allocateBuffer(m_capacity);
+            }
+            buffers[i].iov_base = m_slots[i];
+            buffers[i].iov_len = m_capacity;
+        }
+        m_registered = m_ring->registerBuffers(buffers, SLOTS);
+    }
+
+    int fd = m_fd;
+    bool direct = false;
+    if (m_used == m_capacity && m_offset >= DIRECT_AFTER && m_offset % DIRECT_ALIGN == 0 && directFd() >= 0)
+    {
+        fd = m_directFd;
+        direct = true;
+    }
+    m_ring->write(fd, m_data, unsigned(m_used), m_offset, uint64_t(m_slot), m_registered ? m_slot : -1);
+    m_lengths[m_slot] = m_used;
+    m_offsets[m_slot] = m_offset;
+    m_viaDirect[m_slot] = direct;
+    m_offset += m_used;
+    m_flushed += (long long)m_used;
+    m_used = 0;
+    if (!m_ring->submit(0))
+    {
+        m_ok = false;
+    }
+
+    m_slot = (m_slot + 1) % SLOTS;
+    while (m_lengths[m_slot] != 0 && reap(true))
+    {
+    }
+    if (m_lengths[m_slot] != 0)
+    {
+        // The ring itself failed; the output is lost anyway
+        m_ok = false;
+        m_lengths[m_slot] = 0;
+    }
+    m_data = m_slots[m_slot];
+}
+
+// Large payloads bypass the buffer once it has been drained
+void OutputBuffer::appendSlow(const char *data, size_t len)
+{
+    if (m_ring != NULL)
+    {
+        // Buffer by buffer instead, so the ring keeps writing behind
+        while (len > 0)
+        {
+            size_t n = std::min(len, m_capacity - m_used);
+            std::memcpy(m_data + m_used, data, n);
+            m_used += n;
+            data += n;
+            len -= n;
+            if (m_used == m_capacity)
+            {
+                spill();
+            }
+        }
+        return;
+    }
+    flush();
+    if (len >= m_capacity)
+    {
+        writeAll(data, len);
+        m_flushed += (long long)len;
+        m_offset += len;
+        return;
+    }
+    std::memcpy(m_data, data, len);
+    m_used = len;
+}
+
+char *OutputBuffer::reserve(size_t len)
+{
+    if (m_capacity - m_used < len)
+    {
+        spill();
+    }
+    return m_data + m_used;
+}
+
+bool OutputBuffer::writeAll(const char *data, size_t len)
+{
+    while (len > 0 && m_ok)
+    {
+        ssize_t n = ::write(m_fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            m_ok = false;
+            break;
+        }
+        data += n;
+        len -= size_t(n);
+    }
+    return m_ok;
+}
+
+bool OutputBuffer::pwriteAll(const char *data, size_t len, uint64_t offset)
+{
+    while (len > 0 && m_ok)
+    {
+        ssize_t n = ::pwrite(m_fd, data, len, off_t(offset));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            m_ok = false;
+            break;
+        }
+        data += n;
+        len -= size_t(n);
+        offset += uint64_t(n);
+    }
+    return m_ok;
+}
+
+// Opened on first use through /proc, so callers keep passing one descriptor
+int OutputBuffer::directFd()
+{
+    if (m_directFd == -1)
+    {
+        char path[64];
+        std::snprintf(path, sizeof(path), "/proc/self/fd/%d", m_fd);
+        m_directFd = ::open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+        if (m_directFd < 0)
+        {
+            m_directFd = -2;
+        }
+    }
+    return m_directFd;
+}
+
+// Handles every completion available, first waiting for one if @p wait
+bool OutputBuffer::reap(bool wait)
+{
+    if (wait && !m_ring->submit(1))
+    {
+        m_ok = false;
+        return false;
+    }
+    IoCompletion done;
+    while (m_ring->reap(done))
+    {
+        if (done.tag == SYNC_TAG)
+        {
+            if (done.result < 0)
+            {
+                errno = -done.result;
+                m_ok = false;
+            }
+            continue;
+        }
+        bool isPatch = done.tag == PATCH_TAG;
+        int slot = isPatch ? -1 : int(done.tag);
+        const char *data = isPatch ? &m_patch[0] : m_slots[slot];
+        size_t len = isPatch ? m_patch.size() : m_lengths[slot];
+        uint64_t offset = isPatch ? m_patchOffset : m_offsets[slot];
+        if (done.result != int(len))
+        {
+            bool refused = !isPatch && m_viaDirect[slot] && done.result == -EINVAL;
+            if (done.result < 0 && !refused)
+            {
+                errno = -done.result;
+                m_ok = false;
+            }
+            else
+            {
+                if (refused && m_directFd >= 0)
+                {
+                    // This filesystem takes no O_DIRECT writes after all
+                    ::close(m_directFd);
+                    m_directFd = -2;
+                }
+                // Short or refused: write the rest the plain way
+                size_t written = done.result > 0 ? size_t(done.result) : 0;
+                pwriteAll(data + written, len - written, offset + written);
+                ++m_fixups;
+            }
+        }
+        if (isPatch)
+        {
+            m_patch.clear();
+        }
+        else
+        {
+            m_lengths[slot] = 0;
+        }
+    }
+    return true;
+}
+
+void OutputBuffer::waitAll()
+{
+    if (!m_ring->submit(0))
+    {
+        m_ok = false;
+    }
+    while (m_ring->inFlight() > 0 && reap(true))
+    {
+    }
+}
+
+void OutputBuffer::appendInt(long long value)
+{
+    char *p = reserve(24);
+    std::to_chars_result r = std::to_chars(p, p + 24, value);
+    m_used += size_t(r.ptr - p);
+}
+
+void OutputBuffer::appendDouble(double value)
+{
+    char *p = reserve(32);
+    std::to_chars_result r = std::to_chars(p, p + 32, value);
+    m_used += size_t(r.ptr - p);
+}
+
+void OutputBuffer::appendFixed(double value, int precision)
+{
+    char *p = reserve(64);
+    std::to_chars_result r = std::to_chars(p, p + 64, value, std::chars_format::fixed, precision);
+    if (r.ec != std::errc())
+    {
+        // Out of range for fixed notation; fall back to shortest form
+        r = std::to_chars(p, p + 64, value);
+    }
+    m_used += size_t(r.ptr - p);
+}
@@ -0,0 +1,134 @@
+/**
+ * @file OutputBuffer.h
+ * @brief Large user-space write buffer over a file descriptor.
+ *
+ * Exports format straight into one big buffer (numbers via std::to_chars)
+ * and hand it to write(2) only when it fills, so a dump of millions of rows
+ * costs a few hundred syscalls instead of one flush per row.
+ *
+ * REGULAR FILES: when the descriptor is a regular file (not opened for
+ * append), a full buffer is queued on an IoRing and formatting goes on in
+ * the next of 4 buffers while the kernel writes it. Once the file passes
+ * 8 MiB, full buffers go through an O_DIRECT twin of the descriptor, so
+ * large exports and save files skip the copy into the page cache. The
+ * tail, and anything on filesystems without O_DIRECT, is written normally.
+ * sync() queues the fsync behind the last writes in the same submission.
+ * Pipes, terminals and IoRing::setEnabled(false) keep plain write(2).
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class IoRing;
+
+class OutputBuffer
+{
+public:
+    /** @brief Buffer writes to @p fd. @param fd Open descriptor (not closed). @param capacity Buffer size. */
+    OutputBuffer(int fd, size_t capacity = 1 << 20);
+
+    /** @brief Flushes remaining bytes. */
+    ~OutputBuffer();
+
+    /** @brief Append raw bytes. */
+    void append(const char *data, size_t len)
+    {
+        if (len > m_capacity - m_used)
+        {
+            appendSlow(data, len);
+            return;
+        }
+        std::memcpy(m_data + m_used, data, len);
+        m_used += len;
+    }
+
+    void append(const std::string &s) { append(s.data(), s.size()); }
+
+    /** @brief Append one byte. */
+    void put(char c)
+    {
+        if (m_used == m_capacity)
+        {
+            spill();
+        }
+        m_data[m_used++] = c;
+    }
+
+    /** @brief Append an integer in decimal. */
+    void appendInt(long long value);
+
+    /** @brief Append a double in shortest round-trip form. */
+    void appendDouble(double value);
+
+    /** @brief Append a double with a fixed number of decimals. */
+    void appendFixed(double value, int precision);
+
+    /**
+     * @brief Write buffered bytes to the descriptor and wait for them; the
+     *        file offset ends up after the last byte. @return False on I/O error.
+     */
+    bool flush();
+
+    /**
+     * @brief Overwrite @p len bytes at file offset @p offset, which were
+     *        appended earlier (a header whose fields are known only at the
+     *        end), after everything before has been written.
+     * @return False on I/O error.
+     */
+    bool patch(uint64_t offset, const void *data, size_t len);
+
+    /** @brief flush() and fsync(). @return False on I/O error. */
+    bool sync();
+
+    /** @brief False once any write has failed. */
+    bool ok() const { return m_ok; }
+
+    /** @brief Total bytes accepted so far. */
+    long long bytesWritten() const { return m_flushed + (long long)m_used; }
+
+private:
+    static const int SLOTS = 4;
+
+    int m_fd;
+    char *m_data;           ///< Buffer being filled
+    size_t m_capacity;
+    size_t m_used;
+    long long m_flushed;
+    bool m_ok;
+
+    // Regular files only: buffers written through a ring while the next fills
+    IoRing *m_ring;
+    char *m_slots[SLOTS];
+    size_t m_lengths[SLOTS];    ///< Bytes in flight per slot, 0 if free
+    uint64_t m_offsets[SLOTS];
+    bool m_viaDirect[SLOTS];
+    int m_slot;
+    bool m_registered;
+    uint64_t m_offset;          ///< File offset of m_data[0]
+    int m_directFd;             ///< O_DIRECT twin of m_fd; -1 not opened, -2 unusable
+    std::vector<char> m_patch;  ///< Patch bytes in flight
+    uint64_t m_patchOffset;
+    long long m_fixups;         ///< Synchronous rewrites after failed ring writes
+
+    void spill();
+    void appendSlow(const char *data, size_t len);
+    char *reserve(size_t len);
+    bool writeAll(const char *data, size_t len);
+    bool pwriteAll(const char *data, size_t len, uint64_t offset);
+    int directFd();
+    bool reap(bool wait);
+    void waitAll();
+
+    OutputBuffer(const OutputBuffer &);
+    OutputBuffer &operator=(const OutputBuffer &);
+};
+
+#endif
@@ -0,0 +1,458 @@
+/**
+ * @file PersistentBST.h
+ * @brief Persistent (path-copying) search tree: every insert or remove
+ *        returns a new version and leaves the old one intact.
+ *
+ * ARCHITECTURE:
+ *   DBsystem::snapshot() - DBsnapshot handles for long-running reports
+ *       |
+ *       v
+ *   PersistentBST (You are here) - one immutable version per handle
+ *       |  insert/remove copy the root-to-key path (O(log n) new nodes);
+ *       |  every other subtree is shared with the version they started from
+ *       v
+ *   Node { data, left, right, priority, refs }
+ *
+ * SHAPE: a treap. Each node draws a random priority and parents outrank
+ * their children, so the shape is that of a random BST whatever the insert
+ * order: expected depth O(log n), where LazyBST degrades on sorted input.
+ *
+ * VERSIONS: nodes are never modified once another version can see them.
+ * Each node counts the versions and parent nodes referring to it; dropping
+ * the last handle of a version frees exactly the nodes no other version
+ * shares. Any number of threads may read versions (and copy or drop their
+ * own handles) at once with no locks; one handle object itself must not be
+ * reassigned while another thread reads it.
+ *
+ * OPERATIONS:
+ * - insert: O(log n) - upsert by key; returns the new version
+ * - remove: O(log n) - returns the new version (this one if key is absent)
+ * - search: O(log n)
+ * - visitInOrder / visitRange: O(depth + k), iterative; a limit makes
+ *   range scans resumable in chunks
+ * - build: O(n) - a version from a sorted array, for a first snapshot;
+ *   large arrays are built in chunks on the TaskScheduler and joined
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef PERSISTENT_BST_H
+#define PERSISTENT_BST_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "TaskScheduler.h"
+
+/**
+ * @class PersistentBST
+ * @brief One immutable version of an ordered set; copying a handle pins it.
+ * @tparam T Copyable; ordered by operator<.
+ */
+template <typename T>
+class PersistentBST
+{
+public:
+    /** @brief The empty version. */
+    PersistentBST();
+    PersistentBST(const PersistentBST &other);
+    PersistentBST &operator=(const PersistentBST &other);
+    ~PersistentBST();
+
+    /** @brief A version holding @p n elements sorted by key without duplicates. */
+    static PersistentBST build(const T *sorted, long long n);
+
+    /**
+     * @brief This version plus @p d (replacing an equal key).
+     * @param added Set to true if the key was new.
+     */
+    PersistentBST insert(const T &d, bool *added = NULL) const;
+
+    /**
+     * @brief This version without @p key.
+     * @param removed Set to true if the key was present.
+     */
+    PersistentBST remove(const T &key, bool *removed = NULL) const;
+
+    /** @brief The element equal to @p key, or NULL. Valid while this version is held. */
+    const T *search(const T &key) const;
+
+    bool contains(const T &key) const { return search(key) != NULL; }
+
+    long long size() const { return m_size; }
+    bool isEmpty() const { return m_root == NULL; }
+
+    /** @brief Visit all elements in sorted order. @param visit Callable taking const T&. */
+    template <typename Visitor>
+    void visitInOrder(Visitor &visit) const;
+
+    /**
+     * @brief Visit elements in [*lo, *hi) in sorted order.
+     * @param lo Inclusive lower bound, or NULL for none.
+     * @param hi Exclusive upper bound, or NULL for none.
+     */
+    template <typename Visitor>
+    void visitRange(const T *lo, const T *hi, Visitor &visit) const;
+
+    /** @brief As above, stopping after @p limit elements. @return Elements visited. */
+    template <typename Visitor>
+    long long visitRange(const T *lo, const T *hi, Visitor &visit, long long limit) const;
+
+private:
+    struct Node
+    {
+        const T data;
+        Node *left;             ///< Owned references; fixed once the node is shared
+        Node *right;
+        uint32_t priority;
+        std::atomic<int> refs;
+
+        Node(const T &d, Node *l, Node *r, uint32_t p) : data(d), left(l), right(r), priority(p), refs(1) {}
+    };
+
+    Node *m_root;
+    long long m_size;
+
+    PersistentBST(Node *root, long long size) : m_root(root), m_size(size) {}
+
+    static Node *acquire(Node *n);
+    static void release(Node *n);
+    static uint32_t randomPriority();
+    static Node *insertAt(const Node *n, const T &d, bool &added);
+    static Node *removeAt(const Node *n, const T &key);
+    static Node *merge(Node *a, Node *b);
+    static Node *buildSpine(const T *sorted, long long n);
+    static Node *joinFresh(Node *a, Node *b);
+};
+
+template <typename T>
+PersistentBST<T>::PersistentBST() : m_root(NULL), m_size(0)
+{
+
+}
+
+template <typename T>
+PersistentBST<T>::PersistentBST(const PersistentBST &other) : m_root(acquire(other.m_root)), m_size(other.m_size)
+{
+
+}
+
+template <typename T>
+PersistentBST<T> &PersistentBST<T>::operator=(const PersistentBST &other)
+{
+    Node *root = acquire(other.m_root);
+    release(m_root);
+    m_root = root;
+    m_size = other.m_size;
+    return *this;
+}
+
+template <typename T>
+PersistentBST<T>::~PersistentBST()
+{
+    release(m_root);
+}
+
+template <typename T>
+typename PersistentBST<T>::Node *PersistentBST<T>::acquire(Node *n)
+{
+    if (n != NULL)
+    {
+        n->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return n;
+}
+
+// Frees n and, through it, whatever only n still referred to
+template <typename T>
+void PersistentBST<T>::release(Node *n)
+{
+    while (n != NULL && n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        release(n->left);
+        Node *right = n->right;
+        delete n;
+        n = right;
+    }
+}
+
+template <typename T>
+uint32_t PersistentBST<T>::randomPriority()
+{
+    static thread_local uint32_t x = 0;
+    if (x == 0)
+    {
+        x = uint32_t(reinterpret_cast<uintptr_t>(&x) >> 4) | 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// Chunks of the array become treaps of their own in parallel; joining
+// them in key order gives the same shape distribution as one build
+template <typename T>
+PersistentBST<T> PersistentBST<T>::build(const T *sorted, long long n)
+{
+    const long long CHUNK = 1 << 16;
+    TaskScheduler &scheduler = TaskScheduler::shared();
+    if (n < 2 * CHUNK || scheduler.concurrency() == 1)
+    {
+        return PersistentBST(buildSpine(sorted, n), n);
+    }
+    long long chunks = (n + CHUNK - 1) / CHUNK;
+    std::vector<Node *> roots(size_t(chunks), NULL);
+    scheduler.parallelFor(0, chunks, 1, [&](long long lo, long long hi) {
+        for (long long c = lo; c < hi; ++c)
+        {
+            long long begin = c * CHUNK;
+            roots[size_t(c)] = buildSpine(sorted + begin, std::min(CHUNK, n - begin));
+        }
+    });
+    Node *root = roots[0];
+    for (size_t c = 1; c < roots.size(); ++c)
+    {
+        root = joinFresh(root, roots[c]);
+    }
+    return PersistentBST(root, n);
+}
+
+// Cartesian tree over the sorted keys: a stack holds the right spine, and
+// each new key pops the lower-priority nodes off it as its left subtree
+template <typename T>
+typename PersistentBST<T>::Node *PersistentBST<T>::buildSpine(const T *sorted, long long n)
+{
+    std::vector<Node *> spine;
+    for (long long i = 0; i < n; ++i)
+    {
+        Node *node = new Node(sorted[i], NULL, NULL, randomPriority());
+        Node *last = NULL;
+        while (!spine.empty() && spine.back()->priority < node->priority)
+        {
+            last = spine.back();
+            spine.pop_back();
+        }
+        node->left = last;
+        if (!spine.empty())
+        {
+            spine.back()->right = node;
+        }
+        spine.push_back(node);
+    }
+    return spine.empty() ? NULL : spine.front();
+}
+
+// merge() for trees no version sees yet (every key of a below b's): the
+// right spine of a and the left spine of b are zipped in place
+template <typename T>
+typename PersistentBST<T>::Node *PersistentBST<T>::joinFresh(Node *a, Node *b)
+{
+    Node *root = NULL;
+    Node **link = &root;
+    while (a != NULL && b != NULL)
+    {
+        if (a->priority > b->priority)
+        {
+            *link = a;
+            link = &a->right;
+            a = a->right;
+        }
+        else
+        {
+            *link = b;
+            link = &b->left;
+            b = b->left;
+        }
+    }
+    *link = a != NULL ? a : b;
+    return root;
+}
+
+// ---------------------------------------------------------------------------
+// Path copying
+// ---------------------------------------------------------------------------
+
+template <typename T>
+PersistentBST<T> PersistentBST<T>::insert(const T &d, bool *added) const
+{
+    bool isNew = false;
+    Node *root = insertAt(m_root, d, isNew);
+    if (added != NULL)
+    {
+        *added = isNew;
+    }
+    return PersistentBST(root, m_size + (isNew ? 1 : 0));
+}
+
+// Returns a new reference to the copied subtree. Nodes it returns are
+// fresh (no other version sees them yet), so a new key can still be
+// rotated up past its fresh parent by relinking them in place.
+template <typename T>
+typename PersistentBST<T>::Node *PersistentBST<T>::insertAt(const Node *n, const T &d, bool &added)
+{
+    if (n == NULL)
+    {
+        added = true;
+        return new Node(d, NULL, NULL, randomPriority());
+    }
+    if (d < n->data)
+    {
+        Node *left = insertAt(n->left, d, added);
+        Node *fresh = new Node(n->data, left, acquire(n->right), n->priority);
+        if (left->priority > fresh->priority)
+        {
+            fresh->left = left->right;
+            left->right = fresh;
+            return left;
+        }
+        return fresh;
+    }
+    if (n->data < d)
+    {
+        Node *right = insertAt(n->right, d, added);
+        Node *fresh = new Node(n->data, acquire(n->left), right, n->priority);
+        if (right->priority > fresh->priority)
+        {
+            fresh->right = right->left;
+            right->left = fresh;
+            return right;
+        }
+        return fresh;
+    }
+    added = false;
+    return new Node(d, acquire(n->left), acquire(n->right), n->priority);
+}
+
+template <typename T>
+PersistentBST<T> PersistentBST<T>::remove(const T &key, bool *removed) const
+{
+    bool present = search(key) != NULL;
+    if (removed != NULL)
+    {
+        *removed = present;
+    }
+    if (!present)
+    {
+        return *this;
+    }
+    return PersistentBST(removeAt(m_root, key), m_size - 1);
+}
+
+// key must be present below n
+template <typename T>
+typename PersistentBST<T>::Node *PersistentBST<T>::removeAt(const Node *n, const T &key)
+{
+    if (key < n->data)
+    {
+        return new Node(n->data, removeAt(n->left, key), acquire(n->right), n->priority);
+    }
+    if (n->data < key)
+    {
+        return new Node(n->data, acquire(n->left), removeAt(n->right, key), n->priority);
+    }
+    return merge(n->left, n->right);
+}
+
+// Joins two subtrees (every key of a below every key of b) into a new
+// reference, copying only the seam between them
+template <typename T>
+typename PersistentBST<T>::Node *PersistentBST<T>::merge(Node *a, Node *b)
+{
+    if (a == NULL)
+    {
+        return acquire(b);
+    }
+    if (b == NULL)
+    {
+        return acquire(a);
+    }
+    if (a->priority > b->priority)
+    {
+        return new Node(a->data, acquire(a->left), merge(a->right, b), a->priority);
+    }
+    return new Node(b->data, merge(a, b->left), acquire(b->right), b->priority);
+}
+
+// ---------------------------------------------------------------------------
+// Reads
+// ---------------------------------------------------------------------------
+
+template <typename T>
+const T *PersistentBST<T>::search(const T &key) const
+{
+    const Node *n = m_root;
+    while (n != NULL)
+    {
+        if (key < n->data)
+        {
+            n = n->left;
+        }
+        else if (n->data < key)
+        {
+            n = n->right;
+        }
+        else
+        {
+            return &n->data;
+        }
+    }
+    return NULL;
+}
+
+template <typename T>
+template <typename Visitor>
+void PersistentBST<T>::visitInOrder(Visitor &visit) const
+{
+    visitRange(NULL, NULL, visit);
+}
+
+template <typename T>
+template <typename Visitor>
+void PersistentBST<T>::visitRange(const T *lo, const T *hi, Visitor &visit) const
+{
+    visitRange(lo, hi, visit, -1);
+}
+
+template <typename T>
+template <typename Visitor>
+long long PersistentBST<T>::visitRange(const T *lo, const T *hi, Visitor &visit, long long limit) const
+{
+    long long visited = 0;
+    std::vector<const Node *> path;
+    const Node *n = m_root;
+    while (n != NULL || !path.empty())
+    {
+        while (n != NULL)
+        {
+            if (lo != NULL && n->data < *lo)
+            {
+                n = n->right;           // Everything on the left is below lo
+            }
+            else
+            {
+                path.push_back(n);
+                n = n->left;
+            }
+        }
+        if (path.empty() || visited == limit)
+        {
+            return visited;
+        }
+        n = path.back();
+        path.pop_back();
+        if (hi != NULL && !(n->data < *hi))
+        {
+            return visited;
+        }
+        visit(n->data);
+        ++visited;
+        n = n->right;
+    }
+    return visited;
+}
+
+#endif
@@ -0,0 +1,620 @@
+#include "Profiler.h"
+#include "DBsystem.h"
+#include "RecordMapper.h"
+#include "RingBuffer.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace
+{
+    const char *TYPE_NAMES[PROFILE_TYPES] = {"bool", "int", "float", "date", "string", "array", "object"};
+
+    inline bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    // ^\d{4}-\d{2}-\d{2} or ^\d{2}/\d{2}/\d{4}, as _is_date_string
+    bool isDate(const std::string &s)
+    {
+        static const char ISO[] = "dddd-dd-dd";
+        static const char US[] = "dd/dd/dddd";
+        if (s.size() < 10)
+        {
+            return false;
+        }
+        bool iso = true;
+        bool us = true;
+        for (size_t i = 0; i < 10; ++i)
+        {
+            iso = iso && (ISO[i] == 'd' ? isDigit(s[i]) : s[i] == ISO[i]);
+            us = us && (US[i] == 'd' ? isDigit(s[i]) : s[i] == US[i]);
+        }
+        return iso || us;
+    }
+
+    // Length in characters: UTF-8 continuation bytes do not count
+    long long characters(const std::string &s)
+    {
+        long long n = 0;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            n += (static_cast<unsigned char>(s[i]) & 0xC0) != 0x80;
+        }
+        return n;
+    }
+
+    ProfileType classify(JsonType type, const std::string &value, double &number)
+    {
+        if (type == JSON_STRING)
+        {
+            return isDate(value) ? PROFILE_DATE : PROFILE_STRING;
+        }
+        if (type == JSON_NESTED)
+        {
+            return (!value.empty() && value[0] == '[') ? PROFILE_ARRAY : PROFILE_OBJECT;
+        }
+        if (value == "true" || value == "false")
+        {
+            return PROFILE_BOOL;
+        }
+        if (!RecordMapper::parseDouble(value, number))
+        {
+            return PROFILE_STRING;
+        }
+        return value.find_first_of(".eE") == std::string::npos ? PROFILE_INT : PROFILE_FLOAT;
+    }
+
+    // Object text of up to ProfileOptions::batchBytes, handed to a task
+    struct ProfileBatch
+    {
+        std::vector<char> text;
+        std::vector<size_t> ends;   ///< End offset of each object in text
+    };
+
+    // A Profile and parse buffer used by one task at a time
+    struct PartialProfile
+    {
+        Profile profile;
+        JsonObject obj;
+        long long malformed;
+
+        PartialProfile() : malformed(0) {}
+    };
+
+    template <typename T>
+    void pushWait(MpmcRing<T> &ring, const T &item)
+    {
+        while (!ring.tryPush(item))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    template <typename T>
+    T popWait(MpmcRing<T> &ring)
+    {
+        T item;
+        while (!ring.tryPop(item))
+        {
+            std::this_thread::yield();
+        }
+        return item;
+    }
+
+    // Profiles one batch into whichever partial is idle, then hands the
+    // partial and the emptied batch back
+    struct ProfileTask
+    {
+        ProfileBatch *batch;
+        MpmcRing<ProfileBatch *> *free;
+        MpmcRing<PartialProfile *> *idle;
+
+        void operator()() const
+        {
+            PartialProfile *partial = popWait(*idle);
+            size_t begin = 0;
+            for (size_t i = 0; i < batch->ends.size(); ++i)
+            {
+                const char *text = batch->text.data();
+                if (partial->obj.parse(text + begin, text + batch->ends[i]))
+                {
+                    partial->profile.addObject(partial->obj);
+                }
+                else
+                {
+                    ++partial->malformed;
+                }
+                begin = batch->ends[i];
+            }
+            pushWait(*idle, partial);
+            batch->text.clear();
+            batch->ends.clear();
+            pushWait(*free, batch);
+        }
+    };
+
+    // The next empty batch. While every batch is queued or being profiled,
+    // the reading thread profiles one itself rather than wait.
+    ProfileBatch *nextFree(MpmcRing<ProfileBatch *> &free, TaskScheduler &scheduler)
+    {
+        ProfileBatch *batch;
+        while (!free.tryPop(batch))
+        {
+            if (!scheduler.helpOnce())
+            {
+                std::this_thread::yield();
+            }
+        }
+        return batch;
+    }
+
+    // Typed fields of DBsystem records. The records keep a missing string as
+    // "" and a missing advisor/instructor as 0; both profile as null.
+    struct TableRows
+    {
+        Profile &profile;
+        std::vector<ColumnProfile *> columns;
+        std::string text;
+
+        void integer(size_t c, long long value)
+        {
+            char digits[24];
+            std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+            text.assign(digits, size_t(r.ptr - digits));
+            columns[c]->add(PROFILE_INT, text, double(value));
+        }
+
+        void real(size_t c, double value)
+        {
+            char digits[32];
+            std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+            text.assign(digits, size_t(r.ptr - digits));
+            columns[c]->add(PROFILE_FLOAT, text, value);
+        }
+
+        void string(size_t c, const std::string &value)
+        {
+            if (!value.empty())
+            {
+                columns[c]->add(isDate(value) ? PROFILE_DATE : PROFILE_STRING, value);
+            }
+        }
+
+        void reference(size_t c, int id)
+        {
+            if (id != 0)
+            {
+                integer(c, id);
+            }
+        }
+
+        void operator()(const Student &s)
+        {
+            integer(0, s.getID());
+            string(1, s.getName());
+            string(2, s.getLevel());
+            string(3, s.getMajor());
+            real(4, s.getGPA());
+            reference(5, s.getAdvisor());
+            profile.addRow();
+        }
+
+        void operator()(const Faculty &f)
+        {
+            integer(0, f.getID());
+            string(1, f.getName());
+            string(2, f.getLevel());
+            string(3, f.getDepartment());
+            integer(4, f.getAdviseeCount());
+            profile.addRow();
+        }
+
+        void operator()(const Course &c)
+        {
+            integer(0, c.getID());
+            string(1, c.getCode());
+            string(2, c.getTitle());
+            integer(3, c.getCredits());
+            string(4, c.getDepartment());
+            reference(5, c.getInstructor());
+            profile.addRow();
+        }
+
+        void operator()(const Enrollment &e)
+        {
+            integer(0, e.getID());
+            integer(1, e.getStudent());
+            integer(2, e.getCourse());
+            string(3, e.getStatus());
+            string(4, e.getGrade());
+            if (!e.getGrade().empty())
+            {
+                real(5, e.getGradePoints());    // grade_points is null until graded
+            }
+            profile.addRow();
+        }
+    };
+}
+
+// ---------------------------------------------------------------------------
+// ColumnProfile
+// ---------------------------------------------------------------------------
+
+ColumnProfile::ColumnProfile(const std::string &name)
+    : name(name), values(0), numbers(0), min(std::numeric_limits<double>::infinity()),
+      max(-std::numeric_limits<double>::infinity()), mean(0.0), m2(0.0), strings(0),
+      minLength(std::numeric_limits<long long>::max()), maxLength(0), totalLength(0)
+{
+    std::fill(types, types + PROFILE_TYPES, 0);
+}
+
+void ColumnProfile::add(ProfileType type, const std::string &text, double number)
+{
+    ++values;
+    ++types[type];
+    uint64_t hash = hashBytes(text.data(), text.size());
+    distinct.add(hash);
+    top.add(text, hash);
+
+    if (type == PROFILE_INT || type == PROFILE_FLOAT)
+    {
+        // Welford's update keeps the variance stable over long streams
+        ++numbers;
+        double delta = number - mean;
+        mean += delta / double(numbers);
+        m2 += delta * (number - mean);
+        min = std::min(min, number);
+        max = std::max(max, number);
+        quantiles.add(number);
+    }
+    else if (type == PROFILE_STRING || type == PROFILE_DATE)
+    {
+        long long length = characters(text);
+        ++strings;
+        minLength = std::min(minLength, length);
+        maxLength = std::max(maxLength, length);
+        totalLength += length;
+    }
+}
+
+void ColumnProfile::merge(const ColumnProfile &other)
+{
+    values += other.values;
+    for (int t = 0; t < PROFILE_TYPES; ++t)
+    {
+        types[t] += other.types[t];
+    }
+    distinct.merge(other.distinct);
+    top.merge(other.top);
+
+    if (other.numbers > 0)
+    {
+        // Chan et al.: combine two partial means and sums of squares
+        double n = double(numbers + other.numbers);
+        double delta = other.mean - mean;
+        m2 += other.m2 + delta * delta * double(numbers) * double(other.numbers) / n;
+        mean += delta * double(other.numbers) / n;
+        numbers += other.numbers;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        quantiles.merge(other.quantiles);
+    }
+    strings += other.strings;
+    minLength = std::min(minLength, other.minLength);
+    maxLength = std::max(maxLength, other.maxLength);
+    totalLength += other.totalLength;
+}
+
+const char *ColumnProfile::typeName() const
+{
+    if (values == 0)
+    {
+        return "null";
+    }
+    return TYPE_NAMES[std::max_element(types, types + PROFILE_TYPES) - types];
+}
+
+bool ColumnProfile::numeric() const
+{
+    int best = int(std::max_element(types, types + PROFILE_TYPES) - types);
+    return values > 0 && (best == PROFILE_INT || best == PROFILE_FLOAT);
+}
+
+double ColumnProfile::stddev() const
+{
+    return numbers > 1 ? std::sqrt(m2 / double(numbers - 1)) : std::numeric_limits<double>::quiet_NaN();
+}
+
+// The estimate can overshoot by its error; there are never more distinct
+// values than values
+long long ColumnProfile::distinctCount() const
+{
+    return std::min((long long)std::llround(distinct.distinct()), values);
+}
+
+// ---------------------------------------------------------------------------
+// Profile
+// ---------------------------------------------------------------------------
+
+Profile::Profile() : m_rows(0)
+{
+
+}
+
+size_t Profile::columnIndex(const std::string &name)
+{
+    std::unordered_map<std::string, size_t>::iterator it = m_index.find(name);
+    if (it != m_index.end())
+    {
+        return it->second;
+    }
+    m_columns.push_back(ColumnProfile(name));
+    m_index[name] = m_columns.size() - 1;
+    return m_columns.size() - 1;
+}
+
+ColumnProfile &Profile::column(const std::string &name)
+{
+    return m_columns[columnIndex(name)];
+}
+
+void Profile::addObject(const JsonObject &obj)
+{
+    ++m_rows;
+    for (int i = 0; i < obj.size(); ++i)
+    {
+        if (obj.type(i) == JSON_NULL)
+        {
+            continue;
+        }
+        // Rows of one file usually list their keys in the same order, so the
+        // column at this position last time is checked before the hash map
+        size_t slot = size_t(i);
+        if (slot >= m_slots.size())
+        {
+            m_slots.resize(slot + 1, m_columns.size());
+        }
+        if (m_slots[slot] >= m_columns.size() || m_columns[m_slots[slot]].name != obj.key(i))
+        {
+            m_slots[slot] = columnIndex(obj.key(i));
+        }
+        double number = 0.0;
+        ProfileType type = classify(obj.type(i), obj.value(i), number);
+        m_columns[m_slots[slot]].add(type, obj.value(i), number);
+    }
+}
+
+void Profile::merge(const Profile &other)
+{
+    m_rows += other.m_rows;
+    for (size_t c = 0; c < other.m_columns.size(); ++c)
+    {
+        column(other.m_columns[c].name).merge(other.m_columns[c]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Drivers
+// ---------------------------------------------------------------------------
+
+void profileJson(std::FILE *in, const ProfileOptions &options, Profile &profile, ProfileStats *stats)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    TaskScheduler &scheduler = TaskScheduler::shared();
+    int threads = options.threads > 0 ? std::min(options.threads, scheduler.concurrency()) : scheduler.concurrency();
+    JsonLinesReader reader(in);
+    long long malformed = 0;
+
+    if (threads == 1)
+    {
+        JsonObject obj;
+        while (reader.next(obj))
+        {
+            profile.addObject(obj);
+        }
+    }
+    else
+    {
+        // Two batches per thread: one being profiled, one being filled. A
+        // partial per batch, so a task never waits for one.
+        size_t batches = size_t(threads) * 2;
+        std::vector<ProfileBatch> pool(batches);
+        std::vector<PartialProfile> partial(batches);
+        MpmcRing<ProfileBatch *> free(ringCapacity(batches));
+        MpmcRing<PartialProfile *> idle(ringCapacity(batches));
+        for (size_t b = 0; b < batches; ++b)
+        {
+            pool[b].text.reserve(options.batchBytes + 4096);
+            free.tryPush(&pool[b]);
+            idle.tryPush(&partial[b]);
+        }
+
+        TaskGroup group(scheduler);
+        ProfileBatch *batch = nextFree(free, scheduler);
+        const char *begin;
+        const char *end;
+        while (reader.nextRaw(begin, end))
+        {
+            batch->text.insert(batch->text.end(), begin, end);
+            batch->ends.push_back(batch->text.size());
+            if (batch->text.size() >= options.batchBytes)
+            {
+                ProfileTask task = {batch, &free, &idle};
+                group.run(task);
+                batch = nextFree(free, scheduler);
+            }
+        }
+        if (!batch->ends.empty())
+        {
+            ProfileTask task = {batch, &free, &idle};
+            group.run(task);
+        }
+        group.wait();
+        for (size_t b = 0; b < batches; ++b)
+        {
+            profile.merge(partial[b].profile);
+            malformed += partial[b].malformed;
+        }
+    }
+
+    if (stats != NULL)
+    {
+        stats->rows = profile.rows();
+        stats->malformed = reader.malformed() + malformed;
+        stats->bytes = reader.bytesRead();
+        stats->threads = threads;
+        stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+bool profileTable(DBsystem &db, const std::string &table, Profile &profile, std::string &error, ProfileStats *stats)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    TableRows rows = {profile, std::vector<ColumnProfile *>(), std::string()};
+    std::vector<std::string> names;
+    if (table == "students")
+    {
+        for (int f = 0; f < RecordMapper::STUDENT_FIELDS; ++f)
+            names.push_back(RecordMapper::studentFieldName(RecordMapper::StudentField(f)));
+    }
+    else if (table == "faculty")
+    {
+        for (int f = 0; f < RecordMapper::FACULTY_FIELDS; ++f)
+            names.push_back(RecordMapper::facultyFieldName(RecordMapper::FacultyField(f)));
+    }
+    else if (table == "courses")
+    {
+        for (int f = 0; f < RecordMapper::COURSE_FIELDS; ++f)
+            names.push_back(RecordMapper::courseFieldName(RecordMapper::CourseField(f)));
+    }
+    else if (table == "enrollments")
+    {
+        for (int f = 0; f < RecordMapper::ENROLLMENT_FIELDS; ++f)
+            names.push_back(RecordMapper::enrollmentFieldName(RecordMapper::EnrollmentField(f)));
+    }
+    else
+    {
+        error = "unknown table " + table;
+        return false;
+    }
+
+    // Create every column first: the pointers must survive the whole walk
+    for (size_t c = 0; c < names.size(); ++c)
+    {
+        profile.column(names[c]);
+    }
+    for (size_t c = 0; c < names.size(); ++c)
+    {
+        rows.columns.push_back(&profile.column(names[c]));
+    }
+
+    if (table == "students")
+        db.forEachStudent(rows);
+    else if (table == "faculty")
+        db.forEachFaculty(rows);
+    else if (table == "courses")
+        db.forEachCourse(rows);
+    else
+        db.forEachEnrollment(rows);
+
+    if (stats != NULL)
+    {
+        stats->rows = profile.rows();
+        stats->threads = 1;
+        stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Output
+// ---------------------------------------------------------------------------
+
+// Cells that do not apply to a column (numeric statistics of a string
+// column, say) are empty, or null in JSON Lines
+long long writeProfile(const Profile &profile, OutputBuffer &out, ExportFormat format, char delimiter)
+{
+    static const char *names[] = {"column", "type", "count", "nulls", "distinct", "min", "max", "mean", "std",
+                                  "p25", "p50", "p75", "p95", "p99", "min_length", "max_length", "avg_length",
+                                  "top_values"};
+    static const int widths[] = {20, 7, 10, 10, 10, 12, 12, 12, 12, 12, 12, 12, 12, 12, 10, 10, 10, 40};
+    static const double quantiles[] = {0.25, 0.5, 0.75, 0.95, 0.99};
+    const int COLUMNS = 18;
+    std::vector<CsvColumn> columns;
+    for (int c = 0; c < COLUMNS; ++c)
+    {
+        CsvColumn column = {c, names[c], widths[c]};
+        columns.push_back(column);
+    }
+
+    TableWriter writer(out, format, columns, false, delimiter);
+    writer.header();
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    const std::vector<ColumnProfile> &cols = profile.columns();
+    for (size_t c = 0; c < cols.size(); ++c)
+    {
+        const ColumnProfile &col = cols[c];
+        bool numeric = col.numeric();
+        bool text = !numeric && col.strings > 0 && col.typeName() == std::string("string");
+        double cells[COLUMNS] = {};
+        for (int f = 5; f < 17; ++f)
+        {
+            cells[f] = NaN;
+        }
+        if (numeric)
+        {
+            cells[5] = col.min;
+            cells[6] = col.max;
+            cells[7] = col.mean;
+            cells[8] = col.stddev();
+            for (int q = 0; q < 5; ++q)
+            {
+                cells[9 + q] = col.quantiles.quantile(quantiles[q]);
+            }
+        }
+        if (text)
+        {
+            cells[14] = double(col.minLength);
+            cells[15] = double(col.maxLength);
+            cells[16] = double(col.totalLength) / double(col.strings);
+        }
+        writer.field(col.name);
+        writer.field(std::string(col.typeName()));
+        writer.field(profile.rows());
+        writer.field(profile.nulls(col));
+        writer.field(col.distinctCount());
+        for (int f = 5; f < 17; ++f)
+        {
+            if (cells[f] != cells[f] && format != EXPORT_JSON)
+            {
+                writer.field(std::string());
+            }
+            else if ((f == 14 || f == 15) && cells[f] == cells[f])
+            {
+                writer.field((long long)cells[f]);
+            }
+            else
+            {
+                writer.field(cells[f]);
+            }
+        }
+        std::string top;
+        std::vector<FrequentItem> items = col.top.top(5);
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            // "~": an upper bound, the value took over an evicted counter
+            top += (i ? "|" : "") + items[i].value + (items[i].error > 0 ? "=~" : "=") + std::to_string(items[i].count);
+        }
+        writer.field(top);
+        writer.endRow();
+    }
+    return (long long)cols.size();
+}
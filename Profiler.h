@@ -0,0 +1,161 @@
+/**
+ * @file Profiler.h
+ * @brief Single-pass column profiles (types, nulls, distinct counts,
+ *        numeric and length statistics, quantiles, top values) in bounded
+ *        memory.
+ *
+ * ARCHITECTURE:
+ *   JSON stream (data_engineering/data/raw/...) or a DBsystem table
+ *       |  JSON: the calling thread finds object boundaries (nextRaw) and
+ *       |  copies ~1 MiB of object text per batch; each batch becomes a
+ *       |  task on the shared TaskScheduler and comes back through an
+ *       |  MpmcRing of free batches, so memory is fixed
+ *       v
+ *   profile tasks (You are here) - each parses one batch into an idle
+ *       |  partial Profile: per column a HyperLogLog, a KllSketch and a
+ *       |  SpaceSaving summary plus exact count/min/max/mean/variance
+ *       v
+ *   Profile::merge - the partial profiles folded into one
+ *       v
+ *   writeProfile - one row per column, through TableWriter (CSV, JSON
+ *       Lines or fixed width)
+ *
+ * Semantics follow DataProfiler in quality/profiler.py: a row without the
+ * column counts as null, the type is the most common of bool, int, float,
+ * date (^\d{4}-\d{2}-\d{2} or ^\d{2}/\d{2}/\d{4}), string, array and
+ * object (over all values rather than the first 100), numeric statistics
+ * are reported for int/float columns and lengths (in characters) for
+ * string columns, and std is the sample standard deviation. Distinct counts
+ * are exact up to 2048 values and within about 1% above; quantiles are
+ * within about 1% of rank; top values come from 256 counters and are exact
+ * unless marked "~" (an upper bound).
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "JsonLines.h"
+#include "Sketches.h"
+#include "TableExport.h"
+
+class DBsystem;
+
+enum ProfileType
+{
+    PROFILE_BOOL,
+    PROFILE_INT,
+    PROFILE_FLOAT,
+    PROFILE_DATE,
+    PROFILE_STRING,
+    PROFILE_ARRAY,
+    PROFILE_OBJECT,
+    PROFILE_TYPES
+};
+
+/** @brief Everything known about one column. */
+struct ColumnProfile
+{
+    std::string name;
+    long long values;                   ///< Non-null values
+    long long types[PROFILE_TYPES];
+
+    long long numbers;                  ///< Numeric values (int and float)
+    double min;
+    double max;
+    double mean;
+    double m2;                          ///< Sum of squared deviations from the mean
+    KllSketch quantiles;
+
+    long long strings;                  ///< String values (string and date)
+    long long minLength;
+    long long maxLength;
+    long long totalLength;
+
+    HyperLogLog distinct;
+    SpaceSaving top;
+
+    explicit ColumnProfile(const std::string &name);
+
+    /** @brief Fold in one non-null value; @p number is its value for int and float. */
+    void add(ProfileType type, const std::string &text, double number = 0.0);
+    void merge(const ColumnProfile &other);
+
+    /** @brief Most common type; "null" when the column has no values. */
+    const char *typeName() const;
+    bool numeric() const;
+    double stddev() const;
+
+    /** @brief The HyperLogLog estimate, at most the number of non-null values. */
+    long long distinctCount() const;
+};
+
+/**
+ * @class Profile
+ * @brief Column profiles of one dataset, in first-seen column order.
+ */
+class Profile
+{
+public:
+    Profile();
+
+    /** @brief Fold in one row. */
+    void addObject(const JsonObject &obj);
+
+    /** @brief Column by name, added (with all earlier rows null) on first use. */
+    ColumnProfile &column(const std::string &name);
+
+    /** @brief Count a row whose values were added through column(). */
+    void addRow() { ++m_rows; }
+
+    void merge(const Profile &other);
+
+    long long rows() const { return m_rows; }
+    long long nulls(const ColumnProfile &c) const { return m_rows - c.values; }
+    const std::vector<ColumnProfile> &columns() const { return m_columns; }
+
+private:
+    long long m_rows;
+    std::vector<ColumnProfile> m_columns;
+    std::unordered_map<std::string, size_t> m_index;
+    std::vector<size_t> m_slots;    ///< Column of each field position in the last row
+
+    size_t columnIndex(const std::string &name);
+};
+
+struct ProfileOptions
+{
+    int threads;            ///< At most the scheduler's concurrency; 0 = all of it
+    size_t batchBytes;      ///< Object text per batch handed to a task
+
+    ProfileOptions() : threads(1), batchBytes(1 << 20) {}
+};
+
+struct ProfileStats
+{
+    long long rows;
+    long long malformed;
+    long long bytes;
+    int threads;
+    double seconds;
+
+    ProfileStats() : rows(0), malformed(0), bytes(0), threads(0), seconds(0.0) {}
+};
+
+/** @brief Profile every object of a JSON Lines stream (or JSON array). */
+void profileJson(std::FILE *in, const ProfileOptions &options, Profile &profile, ProfileStats *stats = NULL);
+
+/** @brief Profile a table: students, faculty, courses or enrollments. */
+bool profileTable(DBsystem &db, const std::string &table, Profile &profile, std::string &error,
+                  ProfileStats *stats = NULL);
+
+/** @brief Write one row per column (name, type, counts, statistics, top values). @return Rows written. */
+long long writeProfile(const Profile &profile, OutputBuffer &out, ExportFormat format, char delimiter = ',');
+
+#endif
@@ -0,0 +1,242 @@
+#include "RecordMapper.h"
+#include <charconv>
+#include <climits>
+
+// Default mapping: field names and id prefixes written by data_engineering/generators
+RecordMapper::RecordMapper()
+    : m_studentPrefix("STU"), m_facultyPrefix("FAC"), m_coursePrefix("CRS"), m_enrollmentPrefix("ENR")
+{
+    setStudentField(S_ID, "student_id");
+    setStudentField(S_NAME, "first_name+last_name");
+    setStudentField(S_LEVEL, "academic_level");
+    setStudentField(S_MAJOR, "major");
+    setStudentField(S_GPA, "gpa");
+    setStudentField(S_ADVISOR, "advisor_id");
+
+    setFacultyField(F_ID, "faculty_id");
+    setFacultyField(F_NAME, "first_name+last_name");
+    setFacultyField(F_LEVEL, "rank");
+    setFacultyField(F_DEPARTMENT, "department_id");
+    setFacultyField(F_ADVISEES, "advisee_ids");
+
+    setCourseField(C_ID, "course_id");
+    setCourseField(C_CODE, "course_code");
+    setCourseField(C_TITLE, "title");
+    setCourseField(C_CREDITS, "credits");
+    setCourseField(C_DEPARTMENT, "department_id");
+    setCourseField(C_INSTRUCTOR, "instructor_id");
+
+    setEnrollmentField(E_ID, "enrollment_id");
+    setEnrollmentField(E_STUDENT, "student_id");
+    setEnrollmentField(E_COURSE, "course_id");
+    setEnrollmentField(E_STATUS, "status");
+    setEnrollmentField(E_GRADE, "grade");
+    setEnrollmentField(E_POINTS, "grade_points");
+}
+
+// Mapping that reads back what the C++ side writes itself. Courses and
+// enrollments keep the generator names: the C++ side never writes them, and
+// a bare "id" would claim every object for the enrollment table
+RecordMapper RecordMapper::native()
+{
+    RecordMapper m;
+    for (int f = 0; f < STUDENT_FIELDS; ++f)
+    {
+        m.setStudentField(StudentField(f), studentFieldName(StudentField(f)));
+    }
+    for (int f = 0; f < FACULTY_FIELDS; ++f)
+    {
+        m.setFacultyField(FacultyField(f), facultyFieldName(FacultyField(f)));
+    }
+    return m;
+}
+
+const char *RecordMapper::studentFieldName(StudentField field)
+{
+    static const char *names[STUDENT_FIELDS] = {"id", "name", "level", "major", "gpa", "advisor"};
+    return names[field];
+}
+
+const char *RecordMapper::facultyFieldName(FacultyField field)
+{
+    static const char *names[FACULTY_FIELDS] = {"id", "name", "level", "department", "advisees"};
+    return names[field];
+}
+
+const char *RecordMapper::courseFieldName(CourseField field)
+{
+    static const char *names[COURSE_FIELDS] = {"id", "code", "title", "credits", "department", "instructor"};
+    return names[field];
+}
+
+const char *RecordMapper::enrollmentFieldName(EnrollmentField field)
+{
+    static const char *names[ENROLLMENT_FIELDS] = {"id", "student", "course", "status", "grade", "grade_points"};
+    return names[field];
+}
+
+std::vector<std::string> RecordMapper::splitSpec(const std::string &spec)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= spec.size())
+    {
+        size_t plus = spec.find('+', start);
+        if (plus == std::string::npos)
+        {
+            plus = spec.size();
+        }
+        if (plus > start)
+        {
+            parts.push_back(spec.substr(start, plus - start));
+        }
+        start = plus + 1;
+    }
+    if (parts.empty())
+    {
+        parts.push_back(spec);
+    }
+    return parts;
+}
+
+void RecordMapper::setStudentField(StudentField field, const std::string &spec)
+{
+    m_student[field] = splitSpec(spec);
+}
+
+void RecordMapper::setFacultyField(FacultyField field, const std::string &spec)
+{
+    m_faculty[field] = splitSpec(spec);
+}
+
+void RecordMapper::setCourseField(CourseField field, const std::string &spec)
+{
+    m_course[field] = splitSpec(spec);
+}
+
+void RecordMapper::setEnrollmentField(EnrollmentField field, const std::string &spec)
+{
+    m_enrollment[field] = splitSpec(spec);
+}
+
+bool RecordMapper::parseMapping(const std::string &assignment)
+{
+    size_t dot = assignment.find('.');
+    size_t eq = assignment.find('=');
+    if (dot == std::string::npos || eq == std::string::npos || eq < dot || eq + 1 == assignment.size())
+    {
+        return false;
+    }
+    std::string table = assignment.substr(0, dot);
+    std::string field = assignment.substr(dot + 1, eq - dot - 1);
+    std::string spec = assignment.substr(eq + 1);
+
+    if (field == "id_prefix")
+    {
+        std::string *prefix = table == "student"      ? &m_studentPrefix
+                              : table == "faculty"    ? &m_facultyPrefix
+                              : table == "course"     ? &m_coursePrefix
+                              : table == "enrollment" ? &m_enrollmentPrefix
+                                                      : NULL;
+        if (prefix == NULL)
+        {
+            return false;
+        }
+        *prefix = spec;
+        return true;
+    }
+    if (table == "student")
+    {
+        for (int f = 0; f < STUDENT_FIELDS; ++f)
+        {
+            if (field == studentFieldName(StudentField(f)))
+            {
+                setStudentField(StudentField(f), spec);
+                return true;
+            }
+        }
+    }
+    else if (table == "faculty")
+    {
+        for (int f = 0; f < FACULTY_FIELDS; ++f)
+        {
+            if (field == facultyFieldName(FacultyField(f)))
+            {
+                setFacultyField(FacultyField(f), spec);
+                return true;
+            }
+        }
+    }
+    else if (table == "course")
+    {
+        for (int f = 0; f < COURSE_FIELDS; ++f)
+        {
+            if (field == courseFieldName(CourseField(f)))
+            {
+                setCourseField(CourseField(f), spec);
+                return true;
+            }
+        }
+    }
+    else if (table == "enrollment")
+    {
+        for (int f = 0; f < ENROLLMENT_FIELDS; ++f)
+        {
+            if (field == enrollmentFieldName(EnrollmentField(f)))
+            {
+                setEnrollmentField(EnrollmentField(f), spec);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Only the expected prefix may be dropped: ids of another namespace
+// ("SRV-US-1627", "SRV-EU-1627") would otherwise share one key
+bool RecordMapper::parseId(const std::string &text, int &id, const std::string &prefix)
+{
+    const char *p = text.data();
+    const char *end = p + text.size();
+    while (p != end && *p == ' ')
+    {
+        ++p;
+    }
+    while (end != p && end[-1] == ' ')
+    {
+        --end;
+    }
+    size_t at = size_t(p - text.data());
+    if (!prefix.empty() && size_t(end - p) > prefix.size() && text.compare(at, prefix.size(), prefix) == 0)
+    {
+        p += prefix.size();
+    }
+    if (p == end || *p < '0' || *p > '9')
+    {
+        return false;
+    }
+    long long value = 0;
+    std::from_chars_result r = std::from_chars(p, end, value);
+    if (r.ec != std::errc() || r.ptr != end || value > INT_MAX)
+    {
+        return false;
+    }
+    id = int(value);
+    return true;
+}
+
+bool RecordMapper::parseDouble(const std::string &text, double &value)
+{
+    const char *p = text.data();
+    const char *end = p + text.size();
+    while (p != end && *p == ' ')
+    {
+        ++p;
+    }
+    while (end != p && end[-1] == ' ')
+    {
+        --end;
+    }
+    std::from_chars_result r = std::from_chars(p, end, value);
+    return r.ec == std::errc() && p != end && r.ptr == end;
+}
@@ -0,0 +1,310 @@
+/**
+ * @file RecordMapper.h
+ * @brief Configurable mapping from external field names to Student/Faculty/Course/Enrollment.
+ *
+ * The defaults follow the university generator in data_engineering
+ * (student_id, first_name + last_name, academic_level, ...). Each target
+ * field can be remapped with a spec such as "student.name=full_name" or
+ * "faculty.name=first_name+last_name" ('+' joins parts with a space).
+ *
+ * An object's table is decided by which id field it carries, checked in
+ * the order enrollment, course, student, faculty: an enrollment also
+ * carries student_id and course_id.
+ *
+ * Ids are digits, optionally after the table's prefix (STU, FAC, CRS and
+ * ENR by default; "student.id_prefix=SRV-US-" changes it). A row whose id
+ * has any other prefix or trailing text is skipped rather than folded
+ * onto the digits another id shares.
+ *
+ * A Source is anything with `const std::string *find(const std::string &)`
+ * returning NULL for a missing field (JsonObject, CsvRow).
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef RECORD_MAPPER_H
+#define RECORD_MAPPER_H
+
+#include <string>
+#include <vector>
+#include "Student.h"
+#include "Faculty.h"
+#include "Course.h"
+#include "Enrollment.h"
+
+/** @brief Counters reported after an ingest run. */
+struct IngestStats
+{
+    long long rows;        ///< Objects seen
+    long long inserted;    ///< New keys
+    long long updated;     ///< Existing keys overwritten
+    long long skipped;     ///< Objects with no usable key or bad fields
+    long long rejected;    ///< Rows that failed a validation rule
+    long long unchanged;   ///< Versioned loads: rows equal to the current version
+    double seconds;        ///< Wall time
+
+    IngestStats() : rows(0), inserted(0), updated(0), skipped(0), rejected(0), unchanged(0), seconds(0.0) {}
+    double rowsPerSecond() const { return seconds > 0.0 ? rows / seconds : 0.0; }
+};
+
+class RecordMapper
+{
+public:
+    enum StudentField { S_ID, S_NAME, S_LEVEL, S_MAJOR, S_GPA, S_ADVISOR, STUDENT_FIELDS };
+    enum FacultyField { F_ID, F_NAME, F_LEVEL, F_DEPARTMENT, F_ADVISEES, FACULTY_FIELDS };
+    enum CourseField { C_ID, C_CODE, C_TITLE, C_CREDITS, C_DEPARTMENT, C_INSTRUCTOR, COURSE_FIELDS };
+    enum EnrollmentField { E_ID, E_STUDENT, E_COURSE, E_STATUS, E_GRADE, E_POINTS, ENROLLMENT_FIELDS };
+
+    /** @brief Mapping matching the Python generators. */
+    RecordMapper();
+
+    /** @brief Mapping matching the C++ member names (id, name, level, ...). */
+    static RecordMapper native();
+
+    /** @brief Set the source of a student field. @param spec Field name(s), '+'-joined. */
+    void setStudentField(StudentField field, const std::string &spec);
+
+    /** @brief Set the source of a faculty field. @param spec Field name(s), '+'-joined. */
+    void setFacultyField(FacultyField field, const std::string &spec);
+
+    /** @brief Set the source of a course field. @param spec Field name(s), '+'-joined. */
+    void setCourseField(CourseField field, const std::string &spec);
+
+    /** @brief Set the source of an enrollment field. @param spec Field name(s), '+'-joined. */
+    void setEnrollmentField(EnrollmentField field, const std::string &spec);
+
+    /**
+     * @brief Apply "student.gpa=cumulative_gpa" style assignment, or
+     *        "student.id_prefix=STU" for the id prefix. @return False if unrecognised.
+     */
+    bool parseMapping(const std::string &assignment);
+
+    /** @brief Source field names for a student field. */
+    const std::vector<std::string> &studentSource(StudentField field) const { return m_student[field]; }
+
+    /** @brief Source field names for a faculty field. */
+    const std::vector<std::string> &facultySource(FacultyField field) const { return m_faculty[field]; }
+
+    /** @brief Source field names for a course field. */
+    const std::vector<std::string> &courseSource(CourseField field) const { return m_course[field]; }
+
+    /** @brief Source field names for an enrollment field. */
+    const std::vector<std::string> &enrollmentSource(EnrollmentField field) const { return m_enrollment[field]; }
+
+    /** @brief Header names used when writing students. */
+    static const char *studentFieldName(StudentField field);
+
+    /** @brief Header names used when writing faculty. */
+    static const char *facultyFieldName(FacultyField field);
+
+    /** @brief Field names accepted by "course.<name>=..." mappings. */
+    static const char *courseFieldName(CourseField field);
+
+    /** @brief Field names accepted by "enrollment.<name>=..." mappings. */
+    static const char *enrollmentFieldName(EnrollmentField field);
+
+    /**
+     * @brief Extract the integer key from "STU70985739" (with @p prefix "STU"),
+     *        "101" etc. @return False unless the text is digits, optionally
+     *        after @p prefix, that fit an int.
+     */
+    static bool parseId(const std::string &text, int &id, const std::string &prefix = std::string());
+
+    /** @brief Prefix expected before the digits of a student id. */
+    const std::string &studentPrefix() const { return m_studentPrefix; }
+
+    /** @brief Parse a floating point value. @return False unless all of it, spaces around it aside, is a number. */
+    static bool parseDouble(const std::string &text, double &value);
+
+    template <typename Source>
+    bool isStudent(const Source &src) const { return src.find(m_student[S_ID][0]) != NULL; }
+
+    template <typename Source>
+    bool isFaculty(const Source &src) const { return src.find(m_faculty[F_ID][0]) != NULL; }
+
+    template <typename Source>
+    bool isCourse(const Source &src) const { return src.find(m_course[C_ID][0]) != NULL; }
+
+    template <typename Source>
+    bool isEnrollment(const Source &src) const { return src.find(m_enrollment[E_ID][0]) != NULL; }
+
+    /** @brief Build a Student from @p src. @return False if the id is missing or malformed. */
+    template <typename Source>
+    bool toStudent(const Source &src, Student &out) const;
+
+    /** @brief Build a Faculty from @p src. @return False if the id is missing or malformed. */
+    template <typename Source>
+    bool toFaculty(const Source &src, Faculty &out) const;
+
+    /** @brief Build a Course from @p src. @return False if the id is missing or malformed. */
+    template <typename Source>
+    bool toCourse(const Source &src, Course &out) const;
+
+    /** @brief Build an Enrollment from @p src. @return False if any of the three ids is missing or malformed. */
+    template <typename Source>
+    bool toEnrollment(const Source &src, Enrollment &out) const;
+
+private:
+    std::vector<std::string> m_student[STUDENT_FIELDS];
+    std::vector<std::string> m_faculty[FACULTY_FIELDS];
+    std::vector<std::string> m_course[COURSE_FIELDS];
+    std::vector<std::string> m_enrollment[ENROLLMENT_FIELDS];
+    std::string m_studentPrefix;
+    std::string m_facultyPrefix;
+    std::string m_coursePrefix;
+    std::string m_enrollmentPrefix;
+
+    static std::vector<std::string> splitSpec(const std::string &spec);
+
+    template <typename Source>
+    static std::string joined(const Source &src, const std::vector<std::string> &parts);
+};
+
+template <typename Source>
+std::string RecordMapper::joined(const Source &src, const std::vector<std::string> &parts)
+{
+    if (parts.size() == 1)
+    {
+        const std::string *v = src.find(parts[0]);
+        return v ? *v : std::string();
+    }
+    std::string out;
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        const std::string *v = src.find(parts[i]);
+        if (v == NULL || v->empty())
+        {
+            continue;
+        }
+        if (!out.empty())
+        {
+            out += ' ';
+        }
+        out += *v;
+    }
+    return out;
+}
+
+template <typename Source>
+bool RecordMapper::toStudent(const Source &src, Student &out) const
+{
+    const std::string *idText = src.find(m_student[S_ID][0]);
+    int id;
+    if (idText == NULL || !parseId(*idText, id, m_studentPrefix))
+    {
+        return false;
+    }
+
+    double gpa = 0.0;
+    const std::string *gpaText = src.find(m_student[S_GPA][0]);
+    if (gpaText != NULL && !gpaText->empty() && !parseDouble(*gpaText, gpa))
+    {
+        return false;
+    }
+
+    int advisor = 0;
+    const std::string *advisorText = src.find(m_student[S_ADVISOR][0]);
+    if (advisorText != NULL && !advisorText->empty() && !parseId(*advisorText, advisor, m_facultyPrefix))
+    {
+        return false;
+    }
+
+    out = Student(id, joined(src, m_student[S_NAME]), joined(src, m_student[S_LEVEL]),
+                  joined(src, m_student[S_MAJOR]), gpa, advisor);
+    return true;
+}
+
+template <typename Source>
+bool RecordMapper::toFaculty(const Source &src, Faculty &out) const
+{
+    const std::string *idText = src.find(m_faculty[F_ID][0]);
+    int id;
+    if (idText == NULL || !parseId(*idText, id, m_facultyPrefix))
+    {
+        return false;
+    }
+
+    out = Faculty(id, joined(src, m_faculty[F_NAME]), joined(src, m_faculty[F_LEVEL]),
+                  joined(src, m_faculty[F_DEPARTMENT]));
+
+    // Advisees travel as "12;34;56"
+    const std::string *advisees = src.find(m_faculty[F_ADVISEES][0]);
+    if (advisees != NULL)
+    {
+        size_t start = 0;
+        while (start < advisees->size())
+        {
+            size_t sep = advisees->find(';', start);
+            if (sep == std::string::npos)
+            {
+                sep = advisees->size();
+            }
+            int advisee;
+            if (parseId(advisees->substr(start, sep - start), advisee, m_studentPrefix))
+            {
+                out.addAdvisee(advisee);
+            }
+            start = sep + 1;
+        }
+    }
+    return true;
+}
+
+template <typename Source>
+bool RecordMapper::toCourse(const Source &src, Course &out) const
+{
+    const std::string *idText = src.find(m_course[C_ID][0]);
+    int id;
+    if (idText == NULL || !parseId(*idText, id, m_coursePrefix))
+    {
+        return false;
+    }
+
+    double credits = 0.0;
+    const std::string *creditsText = src.find(m_course[C_CREDITS][0]);
+    if (creditsText != NULL && !creditsText->empty() && !parseDouble(*creditsText, credits))
+    {
+        return false;
+    }
+
+    int instructor = 0;
+    const std::string *instructorText = src.find(m_course[C_INSTRUCTOR][0]);
+    if (instructorText != NULL && !instructorText->empty() && !parseId(*instructorText, instructor, m_facultyPrefix))
+    {
+        return false;
+    }
+
+    out = Course(id, joined(src, m_course[C_CODE]), joined(src, m_course[C_TITLE]), int(credits),
+                 joined(src, m_course[C_DEPARTMENT]), instructor);
+    return true;
+}
+
+template <typename Source>
+bool RecordMapper::toEnrollment(const Source &src, Enrollment &out) const
+{
+    const std::string *idText = src.find(m_enrollment[E_ID][0]);
+    const std::string *studentText = src.find(m_enrollment[E_STUDENT][0]);
+    const std::string *courseText = src.find(m_enrollment[E_COURSE][0]);
+    int id, student, course;
+    if (idText == NULL || !parseId(*idText, id, m_enrollmentPrefix) || studentText == NULL ||
+        !parseId(*studentText, student, m_studentPrefix) || courseText == NULL ||
+        !parseId(*courseText, course, m_coursePrefix))
+    {
+        return false;
+    }
+
+    // grade_points is null until the course is graded
+    double points = 0.0;
+    const std::string *pointsText = src.find(m_enrollment[E_POINTS][0]);
+    if (pointsText != NULL && !pointsText->empty() && !parseDouble(*pointsText, points))
+    {
+        return false;
+    }
+
+    out = Enrollment(id, student, course, joined(src, m_enrollment[E_STATUS]), joined(src, m_enrollment[E_GRADE]),
+                     points);
+    return true;
+}
+
+#endif
@@ -0,0 +1,341 @@
+/**
+ * @file RingBuffer.h
+ * @brief Bounded lock-free queues: single-producer/single-consumer and
+ *        multi-producer/multi-consumer.
+ *
+ * ARCHITECTURE:
+ *   producer thread(s)
+ *       |  tryPush / pushBatch - never block, return what fit
+ *       v
+ *   SpscRing / MpmcRing (You are here) - power-of-two array of slots
+ *       |  tryPop / popBatch
+ *       v
+ *   consumer thread(s)
+ *
+ * SpscRing: the producer owns the tail and the consumer the head, each on
+ * its own cache line. Each side keeps a private copy of the other's index
+ * and only re-reads the shared one when the copy says full (or empty), so
+ * a batch costs one acquire load and one release store.
+ *
+ * MpmcRing (Vyukov's bounded queue): every slot carries a sequence number.
+ * A producer claims position p with a CAS on the tail when slot p has
+ * sequence p, writes, then publishes sequence p + 1; a consumer claims p
+ * when the slot has sequence p + 1 and frees it with p + capacity. Batches
+ * claim a whole run of ready slots with one CAS. Threads only contend on
+ * the tail (or head) counter, never on a lock.
+ *
+ * T must be copy-assignable and default-constructible.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/** @brief Size of the false-sharing padding between hot indices. */
+#define RING_CACHE_LINE 64
+
+/** @brief Smallest power of two >= @p n (and >= 2). */
+inline size_t ringCapacity(size_t n)
+{
+    size_t capacity = 2;
+    while (capacity < n)
+    {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/**
+ * @class SpscRing
+ * @brief Bounded queue for exactly one producer thread and one consumer thread.
+ */
+template <typename T>
+class SpscRing
+{
+public:
+    /** @brief Holds @p capacity items, rounded up to a power of two. */
+    explicit SpscRing(size_t capacity);
+
+    /** @brief Producer only. @return False if full. */
+    bool tryPush(const T &item);
+
+    /** @brief Producer only. @return Items pushed (a prefix of @p items), 0 if full. */
+    size_t pushBatch(const T *items, size_t count);
+
+    /** @brief Consumer only. @return False if empty. */
+    bool tryPop(T &item);
+
+    /** @brief Consumer only. @return Items moved into @p out, up to @p max. */
+    size_t popBatch(T *out, size_t max);
+
+    /** @brief Items queued; exact only when both sides are idle. */
+    size_t size() const;
+
+    size_t capacity() const { return m_slots.size(); }
+
+private:
+    std::vector<T> m_slots;
+    size_t m_mask;
+
+    alignas(RING_CACHE_LINE) std::atomic<uint64_t> m_head;     ///< Next to pop (consumer writes)
+    uint64_t m_tailCache;                                       ///< Consumer's copy of m_tail
+
+    alignas(RING_CACHE_LINE) std::atomic<uint64_t> m_tail;     ///< Next to push (producer writes)
+    uint64_t m_headCache;                                       ///< Producer's copy of m_head
+
+    char m_pad[RING_CACHE_LINE - sizeof(uint64_t)];
+};
+
+/**
+ * @class MpmcRing
+ * @brief Bounded queue for any number of producer and consumer threads.
+ */
+template <typename T>
+class MpmcRing
+{
+public:
+    /** @brief Holds @p capacity items, rounded up to a power of two. */
+    explicit MpmcRing(size_t capacity);
+    ~MpmcRing();
+
+    /** @return False if full. */
+    bool tryPush(const T &item);
+
+    /** @return False if empty. */
+    bool tryPop(T &item);
+
+    /** @brief Push a prefix of @p items with one claim. @return Items pushed, 0 if full. */
+    size_t pushBatch(const T *items, size_t count);
+
+    /** @brief Pop up to @p max items with one claim. @return Items popped, 0 if empty. */
+    size_t popBatch(T *out, size_t max);
+
+    /** @brief Items queued; approximate while threads are active. */
+    size_t size() const;
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+
+    Cell *m_cells;
+    size_t m_mask;
+
+    alignas(RING_CACHE_LINE) std::atomic<uint64_t> m_tail;
+    alignas(RING_CACHE_LINE) std::atomic<uint64_t> m_head;
+    char m_pad[RING_CACHE_LINE - sizeof(uint64_t)];
+
+    MpmcRing(const MpmcRing &);
+    MpmcRing &operator=(const MpmcRing &);
+};
+
+// ---------------------------------------------------------------------------
+// SpscRing
+// ---------------------------------------------------------------------------
+
+template <typename T>
+SpscRing<T>::SpscRing(size_t capacity)
+    : m_slots(ringCapacity(capacity)), m_mask(ringCapacity(capacity) - 1), m_head(0), m_tailCache(0), m_tail(0),
+      m_headCache(0)
+{
+
+}
+
+template <typename T>
+bool SpscRing<T>::tryPush(const T &item)
+{
+    return pushBatch(&item, 1) == 1;
+}
+
+template <typename T>
+size_t SpscRing<T>::pushBatch(const T *items, size_t count)
+{
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t capacity = m_mask + 1;
+    if (tail + count - m_headCache > capacity)
+    {
+        m_headCache = m_head.load(std::memory_order_acquire);
+    }
+    size_t room = capacity - size_t(tail - m_headCache);
+    size_t n = count < room ? count : room;
+    for (size_t i = 0; i < n; ++i)
+    {
+        m_slots[(tail + i) & m_mask] = items[i];
+    }
+    if (n > 0)
+    {
+        m_tail.store(tail + n, std::memory_order_release);
+    }
+    return n;
+}
+
+template <typename T>
+bool SpscRing<T>::tryPop(T &item)
+{
+    return popBatch(&item, 1) == 1;
+}
+
+template <typename T>
+size_t SpscRing<T>::popBatch(T *out, size_t max)
+{
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (m_tailCache - head < max)
+    {
+        m_tailCache = m_tail.load(std::memory_order_acquire);
+    }
+    size_t ready = size_t(m_tailCache - head);
+    size_t n = max < ready ? max : ready;
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = m_slots[(head + i) & m_mask];
+    }
+    if (n > 0)
+    {
+        m_head.store(head + n, std::memory_order_release);
+    }
+    return n;
+}
+
+template <typename T>
+size_t SpscRing<T>::size() const
+{
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    return size_t(m_tail.load(std::memory_order_acquire) - head);
+}
+
+// ---------------------------------------------------------------------------
+// MpmcRing
+// ---------------------------------------------------------------------------
+
+template <typename T>
+MpmcRing<T>::MpmcRing(size_t capacity) : m_cells(NULL), m_mask(ringCapacity(capacity) - 1), m_tail(0), m_head(0)
+{
+    m_cells = new Cell[m_mask + 1];
+    for (size_t i = 0; i <= m_mask; ++i)
+    {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+MpmcRing<T>::~MpmcRing()
+{
+    delete[] m_cells;
+}
+
+template <typename T>
+bool MpmcRing<T>::tryPush(const T &item)
+{
+    return pushBatch(&item, 1) == 1;
+}
+
+template <typename T>
+bool MpmcRing<T>::tryPop(T &item)
+{
+    return popBatch(&item, 1) == 1;
+}
+
+// Claim the run of free slots at the tail with one CAS. A slot with
+// sequence == position can only change after it is claimed, so the run
+// counted before the CAS is still free once the CAS succeeds.
+template <typename T>
+size_t MpmcRing<T>::pushBatch(const T *items, size_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint64_t pos = m_tail.load(std::memory_order_relaxed);
+    size_t n;
+    while (true)
+    {
+        n = 0;
+        while (n < count && m_cells[(pos + n) & m_mask].sequence.load(std::memory_order_acquire) == pos + n)
+        {
+            ++n;
+        }
+        if (n == 0)
+        {
+            Cell &cell = m_cells[pos & m_mask];
+            if (int64_t(cell.sequence.load(std::memory_order_acquire) - pos) < 0)
+            {
+                return 0;   // A lap behind: the slot still holds an unread item
+            }
+            pos = m_tail.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (m_tail.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        Cell &cell = m_cells[(pos + i) & m_mask];
+        cell.value = items[i];
+        cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return n;
+}
+
+// Same for the run of published slots at the head
+template <typename T>
+size_t MpmcRing<T>::popBatch(T *out, size_t max)
+{
+    if (max == 0)
+    {
+        return 0;
+    }
+    uint64_t pos = m_head.load(std::memory_order_relaxed);
+    size_t n;
+    while (true)
+    {
+        n = 0;
+        while (n < max && m_cells[(pos + n) & m_mask].sequence.load(std::memory_order_acquire) == pos + n + 1)
+        {
+            ++n;
+        }
+        if (n == 0)
+        {
+            Cell &cell = m_cells[pos & m_mask];
+            if (int64_t(cell.sequence.load(std::memory_order_acquire) - (pos + 1)) < 0)
+            {
+                return 0;   // Not yet published
+            }
+            pos = m_head.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (m_head.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        Cell &cell = m_cells[(pos + i) & m_mask];
+        out[i] = cell.value;
+        cell.sequence.store(pos + i + m_mask + 1, std::memory_order_release);
+    }
+    return n;
+}
+
+template <typename T>
+size_t MpmcRing<T>::size() const
+{
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t tail = m_tail.load(std::memory_order_acquire);
+    return tail > head ? size_t(tail - head) : 0;
+}
+
+#endif
@@ -0,0 +1,642 @@
+#include "ShardedDBsystem.h"
+#include "RingBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    enum ShardOp
+    {
+        OP_UPSERT_STUDENT,
+        OP_DELETE_STUDENT,
+        OP_FIND_STUDENT,
+        OP_UPSERT_FACULTY,
+        OP_DELETE_FACULTY,
+        OP_FIND_FACULTY,
+        OP_UPSERT_STUDENTS,
+        OP_FIND_STUDENTS,
+        OP_COUNT,
+        OP_TASK
+    };
+
+    // Empty polls before an idle shard thread goes to sleep
+    const int IDLE_SPINS = 64;
+    const size_t SERVE_BATCH = 64;
+
+    // Sorts a shard's rows by id and keeps the last row of each id
+    void sortUnique(std::vector<Student> &rows)
+    {
+        std::stable_sort(rows.begin(), rows.end());
+        size_t kept = 0;
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            if (i + 1 == rows.size() || rows[i + 1].getID() != rows[i].getID())
+            {
+                if (kept != i)
+                    rows[kept] = rows[i];
+                ++kept;
+            }
+        }
+        rows.resize(kept);
+    }
+
+    // Partial GPA summaries of one shard, keyed by group value
+    struct GpaByTask : public ShardTask
+    {
+        int field;      // 0 none, 1 major, 2 level, 3 advisor
+        std::map<std::string, ShardGroupStats> groups;
+
+        struct Visit
+        {
+            GpaByTask &task;
+            void operator()(const Student &s)
+            {
+                std::string key;
+                if (task.field == 1)
+                    key = s.getMajor();
+                else if (task.field == 2)
+                    key = s.getLevel();
+                else if (task.field == 3)
+                {
+                    std::ostringstream text;
+                    text << s.getAdvisor();
+                    key = text.str();
+                }
+                ShardGroupStats &g = task.groups[key];
+                if (g.count == 0)
+                    g.key = key;
+                g.add(s.getGPA());
+            }
+        };
+
+        void run(int, LazyBST<Student> &students, LazyBST<Faculty> &)
+        {
+            Visit visit = {*this};
+            students.visitInOrder(visit);
+        }
+    };
+}
+
+void ShardGroupStats::add(double gpa)
+{
+    min = (count == 0 || gpa < min) ? gpa : min;
+    max = (count == 0 || gpa > max) ? gpa : max;
+    sum += gpa;
+    ++count;
+}
+
+void ShardGroupStats::merge(const ShardGroupStats &other)
+{
+    if (other.count == 0)
+        return;
+    min = (count == 0 || other.min < min) ? other.min : min;
+    max = (count == 0 || other.max > max) ? other.max : max;
+    sum += other.sum;
+    count += other.count;
+}
+
+// One request in flight. The caller owns it and spins on done; the shard
+// thread fills in the results and releases done last.
+struct ShardedDBsystem::Request
+{
+    ShardOp op;
+    int id;
+    const Student *student;
+    const Faculty *faculty;
+    std::vector<Student> *rows;         ///< OP_UPSERT_STUDENTS: this shard's rows
+    const int *ids;                     ///< OP_FIND_STUDENTS: ids[slots[i]] for i < count
+    const size_t *slots;
+    size_t count;
+    Student *studentOut;                ///< Indexed like ids for OP_FIND_STUDENTS
+    Faculty *facultyOut;
+    char *found;
+    ShardTask *task;
+    long long result[2];
+    std::atomic<int> done;
+
+    Request() : op(OP_COUNT), id(0), student(NULL), faculty(NULL), rows(NULL), ids(NULL), slots(NULL), count(0),
+                studentOut(NULL), facultyOut(NULL), found(NULL), task(NULL), done(0)
+    {
+        result[0] = result[1] = 0;
+    }
+};
+
+struct ShardedDBsystem::Shard
+{
+    LazyBST<Student> students;
+    LazyBST<Faculty> faculty;
+    MpmcRing<Request *> inbox;
+
+    std::atomic<bool> sleeping;
+    std::atomic<bool> stop;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread thread;
+
+    explicit Shard(size_t depth) : inbox(depth), sleeping(false), stop(false) {}
+};
+
+ShardedDBsystem::ShardedDBsystem(const ShardOptions &options)
+    : m_routing(options.routing), m_studentSplits(options.studentSplits), m_facultySplits(options.facultySplits)
+{
+    int cores = int(std::max(1u, std::thread::hardware_concurrency()));
+    int count = options.shards > 0 ? options.shards : cores;
+    bool pin = options.pin && count <= cores;
+    for (int i = 0; i < count; ++i)
+    {
+        m_shards.push_back(new Shard(options.queueDepth));
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        m_shards[i]->thread = std::thread(serve, m_shards[i], i, pin);
+    }
+}
+
+ShardedDBsystem::~ShardedDBsystem()
+{
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        Shard &shard = *m_shards[i];
+        {
+            std::lock_guard<std::mutex> guard(shard.wakeMutex);
+            shard.stop.store(true);
+        }
+        shard.wake.notify_one();
+    }
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        m_shards[i]->thread.join();
+        delete m_shards[i];
+    }
+}
+
+int ShardedDBsystem::route(int id, const std::vector<int> &splits) const
+{
+    if (m_routing == SHARD_BY_RANGE)
+    {
+        return int(std::upper_bound(splits.begin(), splits.end(), id) - splits.begin());
+    }
+    // Fibonacci hashing, then a multiply-shift into [0, shards)
+    uint32_t h = uint32_t(id) * 2654435769u;
+    return int((uint64_t(h) * m_shards.size()) >> 32);
+}
+
+int ShardedDBsystem::studentShard(int studentId) const
+{
+    return route(studentId, m_studentSplits);
+}
+
+int ShardedDBsystem::facultyShard(int facultyId) const
+{
+    return route(facultyId, m_facultySplits);
+}
+
+// ---------------------------------------------------------------------------
+// Request passing
+// ---------------------------------------------------------------------------
+
+// The fence pairs with the one the shard thread issues after raising
+// sleeping: either this thread sees the flag, or the shard sees the request
+void ShardedDBsystem::submit(int index, Request *request)
+{
+    Shard &shard = *m_shards[index];
+    while (!shard.inbox.tryPush(request))
+    {
+        std::this_thread::yield();
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (shard.sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> guard(shard.wakeMutex);
+        shard.wake.notify_one();
+    }
+}
+
+void ShardedDBsystem::await(Request *requests, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        while (requests[i].done.load(std::memory_order_acquire) == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ShardedDBsystem::serve(Shard *shard, int index, bool pin)
+{
+#ifdef __linux__
+    if (pin)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % int(std::max(1u, std::thread::hardware_concurrency())), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#else
+    (void)pin;
+#endif
+    Request *batch[SERVE_BATCH];
+    int idle = 0;
+    while (true)
+    {
+        size_t n = shard->inbox.popBatch(batch, SERVE_BATCH);
+        if (n > 0)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                execute(*shard, index, *batch[i]);
+                batch[i]->done.store(1, std::memory_order_release);
+            }
+            idle = 0;
+            continue;
+        }
+        if (shard->stop.load(std::memory_order_acquire) && shard->inbox.size() == 0)
+        {
+            return;
+        }
+        if (++idle < IDLE_SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(shard->wakeMutex);
+        shard->sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (shard->inbox.size() == 0 && !shard->stop.load(std::memory_order_relaxed))
+        {
+            shard->wake.wait(lock);
+        }
+        shard->sleeping.store(false, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+void ShardedDBsystem::execute(Shard &shard, int index, Request &request)
+{
+    switch (request.op)
+    {
+    case OP_UPSERT_STUDENT:
+    {
+        Student *existing = shard.students.search(*request.student);
+        request.result[0] = existing == NULL;
+        if (existing == NULL)
+            shard.students.insert(*request.student, false);
+        else
+            *existing = *request.student;
+        break;
+    }
+    case OP_DELETE_STUDENT:
+    {
+        Student temp(request.id, "", "", "", 0.0, 0);
+        int before = shard.students.size();
+        shard.students.remove(temp);
+        request.result[0] = shard.students.size() < before;
+        break;
+    }
+    case OP_FIND_STUDENT:
+    {
+        Student *s = shard.students.search(Student(request.id, "", "", "", 0.0, 0));
+        request.result[0] = s != NULL;
+        if (s != NULL)
+            *request.studentOut = *s;
+        break;
+    }
+    case OP_UPSERT_FACULTY:
+    {
+        Faculty *existing = shard.faculty.search(*request.faculty);
+        request.result[0] = existing == NULL;
+        if (existing == NULL)
+        {
+            shard.faculty.insert(*request.faculty, false);
+        }
+        else
+        {
+            existing->setName(request.faculty->getName());
+            existing->setLevel(request.faculty->getLevel());
+            existing->setDepartment(request.faculty->getDepartment());
+        }
+        break;
+    }
+    case OP_DELETE_FACULTY:
+    {
+        Faculty temp(request.id, "", "", "");
+        int before = shard.faculty.size();
+        shard.faculty.remove(temp);
+        request.result[0] = shard.faculty.size() < before;
+        break;
+    }
+    case OP_FIND_FACULTY:
+    {
+        Faculty *f = shard.faculty.search(Faculty(request.id, "", "", ""));
+        request.result[0] = f != NULL;
+        if (f != NULL)
+            *request.facultyOut = *f;
+        break;
+    }
+    case OP_UPSERT_STUDENTS:
+    {
+        sortUnique(*request.rows);
+        int inserted = shard.students.mergeSorted(request.rows->data(), int(request.rows->size()), false);
+        request.result[0] = inserted;
+        request.result[1] = (long long)request.rows->size() - inserted;
+        break;
+    }
+    case OP_FIND_STUDENTS:
+    {
+        long long hits = 0;
+        Student key;
+        for (size_t i = 0; i < request.count; ++i)
+        {
+            size_t slot = request.slots[i];
+            key.setID(request.ids[slot]);
+            Student *s = shard.students.search(key);
+            request.found[slot] = s != NULL;
+            if (s != NULL)
+            {
+                request.studentOut[slot] = *s;
+                ++hits;
+            }
+        }
+        request.result[0] = hits;
+        break;
+    }
+    case OP_COUNT:
+        request.result[0] = shard.students.size();
+        request.result[1] = shard.faculty.size();
+        break;
+    case OP_TASK:
+        request.task->run(index, shard.students, shard.faculty);
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Single-key operations: one shard, one request
+// ---------------------------------------------------------------------------
+
+bool ShardedDBsystem::upsertStudent(const Student &student)
+{
+    Request request;
+    request.op = OP_UPSERT_STUDENT;
+    request.student = &student;
+    submit(studentShard(student.getID()), &request);
+    await(&request, 1);
+    return request.result[0] != 0;
+}
+
+bool ShardedDBsystem::deleteStudent(int studentId)
+{
+    Request request;
+    request.op = OP_DELETE_STUDENT;
+    request.id = studentId;
+    submit(studentShard(studentId), &request);
+    await(&request, 1);
+    return request.result[0] != 0;
+}
+
+bool ShardedDBsystem::findStudent(int studentId, Student &out)
+{
+    Request request;
+    request.op = OP_FIND_STUDENT;
+    request.id = studentId;
+    request.studentOut = &out;
+    submit(studentShard(studentId), &request);
+    await(&request, 1);
+    return request.result[0] != 0;
+}
+
+bool ShardedDBsystem::upsertFaculty(const Faculty &faculty)
+{
+    Request request;
+    request.op = OP_UPSERT_FACULTY;
+    request.faculty = &faculty;
+    submit(facultyShard(faculty.getID()), &request);
+    await(&request, 1);
+    return request.result[0] != 0;
+}
+
+bool ShardedDBsystem::deleteFaculty(int facultyId)
+{
+    Request request;
+    request.op = OP_DELETE_FACULTY;
+    request.id = facultyId;
+    submit(facultyShard(facultyId), &request);
+    await(&request, 1);
+    return request.result[0] != 0;
+}
+
+bool ShardedDBsystem::findFaculty(int facultyId, Faculty &out)
+{
+    Request request;
+    request.op = OP_FIND_FACULTY;
+    request.id = facultyId;
+    request.facultyOut = &out;
+    submit(facultyShard(facultyId), &request);
+    await(&request, 1);
+    return request.result[0] != 0;
+}
+
+// ---------------------------------------------------------------------------
+// Scatter-gather
+// ---------------------------------------------------------------------------
+
+UpsertCounts ShardedDBsystem::upsertStudents(const std::vector<Student> &batch)
+{
+    std::vector<std::vector<Student> > parts(m_shards.size());
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        parts[studentShard(batch[i].getID())].push_back(batch[i]);
+    }
+    std::vector<Request> requests(m_shards.size());
+    for (size_t s = 0; s < m_shards.size(); ++s)
+    {
+        requests[s].op = OP_UPSERT_STUDENTS;
+        requests[s].rows = &parts[s];
+        submit(int(s), &requests[s]);
+    }
+    await(requests.data(), requests.size());
+
+    UpsertCounts counts;
+    for (size_t s = 0; s < requests.size(); ++s)
+    {
+        counts.inserted += requests[s].result[0];
+        counts.updated += requests[s].result[1];
+    }
+    return counts;
+}
+
+size_t ShardedDBsystem::findStudents(const std::vector<int> &ids, std::vector<Student> &out,
+                                     std::vector<char> &found)
+{
+    out.resize(ids.size());
+    found.assign(ids.size(), 0);
+    std::vector<std::vector<size_t> > slots(m_shards.size());
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        slots[studentShard(ids[i])].push_back(i);
+    }
+    // Every shard writes only the slots of its own ids
+    std::vector<Request> requests(m_shards.size());
+    for (size_t s = 0; s < m_shards.size(); ++s)
+    {
+        requests[s].op = OP_FIND_STUDENTS;
+        requests[s].ids = ids.data();
+        requests[s].slots = slots[s].data();
+        requests[s].count = slots[s].size();
+        requests[s].studentOut = out.data();
+        requests[s].found = found.data();
+        submit(int(s), &requests[s]);
+    }
+    await(requests.data(), requests.size());
+
+    size_t hits = 0;
+    for (size_t s = 0; s < requests.size(); ++s)
+    {
+        hits += size_t(requests[s].result[0]);
+    }
+    return hits;
+}
+
+long long ShardedDBsystem::studentCount()
+{
+    std::vector<Request> requests(m_shards.size());
+    for (size_t s = 0; s < m_shards.size(); ++s)
+    {
+        submit(int(s), &requests[s]);
+    }
+    await(requests.data(), requests.size());
+    long long total = 0;
+    for (size_t s = 0; s < requests.size(); ++s)
+    {
+        total += requests[s].result[0];
+    }
+    return total;
+}
+
+long long ShardedDBsystem::facultyCount()
+{
+    std::vector<Request> requests(m_shards.size());
+    for (size_t s = 0; s < m_shards.size(); ++s)
+    {
+        submit(int(s), &requests[s]);
+    }
+    await(requests.data(), requests.size());
+    long long total = 0;
+    for (size_t s = 0; s < requests.size(); ++s)
+    {
+        total += requests[s].result[1];
+    }
+    return total;
+}
+
+void ShardedDBsystem::scatter(ShardTask *const *tasks)
+{
+    std::vector<Request> requests(m_shards.size());
+    for (size_t s = 0; s < m_shards.size(); ++s)
+    {
+        requests[s].op = OP_TASK;
+        requests[s].task = tasks[s];
+        submit(int(s), &requests[s]);
+    }
+    await(requests.data(), requests.size());
+}
+
+bool ShardedDBsystem::studentGpaBy(const std::string &field, std::vector<ShardGroupStats> &groups,
+                                   std::string &error)
+{
+    int code;
+    if (field.empty())
+        code = 0;
+    else if (field == "major")
+        code = 1;
+    else if (field == "level")
+        code = 2;
+    else if (field == "advisor")
+        code = 3;
+    else
+    {
+        error = "cannot group students by " + field;
+        return false;
+    }
+
+    std::vector<GpaByTask> partials(m_shards.size());
+    std::vector<ShardTask *> tasks(m_shards.size());
+    for (size_t s = 0; s < m_shards.size(); ++s)
+    {
+        partials[s].field = code;
+        tasks[s] = &partials[s];
+    }
+    scatter(tasks.data());
+
+    std::map<std::string, ShardGroupStats> merged;
+    for (size_t s = 0; s < partials.size(); ++s)
+    {
+        std::map<std::string, ShardGroupStats>::const_iterator it;
+        for (it = partials[s].groups.begin(); it != partials[s].groups.end(); ++it)
+        {
+            ShardGroupStats &g = merged[it->first];
+            g.key = it->first;
+            g.merge(it->second);
+        }
+    }
+    groups.clear();
+    for (std::map<std::string, ShardGroupStats>::const_iterator it = merged.begin(); it != merged.end(); ++it)
+    {
+        groups.push_back(it->second);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Loading
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    struct CollectStudents
+    {
+        std::vector<Student> &rows;
+        void operator()(const Student &s) { rows.push_back(s); }
+    };
+
+    struct CollectFaculty
+    {
+        std::vector<Faculty> &rows;
+        void operator()(const Faculty &f) { rows.push_back(f); }
+    };
+}
+
+void ShardedDBsystem::copyFrom(DBsystem &db)
+{
+    if (m_routing == SHARD_BY_RANGE && studentCount() == 0 && facultyCount() == 0)
+    {
+        if (m_studentSplits.empty())
+            db.studentSplitKeys(shards(), m_studentSplits);
+        if (m_facultySplits.empty())
+            db.facultySplitKeys(shards(), m_facultySplits);
+    }
+
+    std::vector<Student> students;
+    CollectStudents collectStudents = {students};
+    db.forEachStudent(collectStudents);
+    upsertStudents(students);
+
+    // Advisee lists come along with the record, so faculty go in one by one
+    std::vector<Faculty> faculty;
+    CollectFaculty collectFaculty = {faculty};
+    db.forEachFaculty(collectFaculty);
+    for (size_t i = 0; i < faculty.size(); ++i)
+    {
+        upsertFaculty(faculty[i]);
+    }
+}
@@ -0,0 +1,177 @@
+/**
+ * @file ShardedDBsystem.h
+ * @brief Students and faculty split over N shards, each owned by one
+ *        thread, with keys routed by hash or by range.
+ *
+ * ARCHITECTURE:
+ *   caller threads (bench --shard-bench, library users)
+ *       |  single key: route id -> shard, push one request, wait for it
+ *       |  batch / scan / aggregate: one request per shard (scatter), wait
+ *       |  for all of them, then merge the partial results (gather)
+ *       v
+ *   ShardedDBsystem (You are here)
+ *       |  per shard an MpmcRing inbox of request pointers
+ *       v
+ *   shard threads - one per shard, pinned to a core while there are
+ *       enough; each is the only thread that ever touches its two
+ *       LazyBSTs, so lookups and updates take no lock
+ *
+ * ROUTING:
+ *   SHARD_BY_HASH  - a multiplicative hash of the id; even spread for any
+ *                    id distribution, but every scan visits every shard
+ *   SHARD_BY_RANGE - ids below splitKeys[0] go to shard 0, and so on;
+ *                    copyFrom picks split keys that give each shard the
+ *                    same number of records (DBsystem::studentSplitKeys)
+ *
+ * Records are copied in and out: a pointer into a shard's tree would be
+ * read while the shard thread changes it. Tree nodes are allocated by the
+ * shard thread that owns them, so malloc serves each shard from that
+ * thread's own arena. Idle shard threads spin briefly, then sleep until a
+ * request arrives; waking one is the only place a mutex is taken.
+ *
+ * Sharded mode keeps records only: no snapshot, log or history, and
+ * advisee lists are not kept in step with advisor changes, since the two
+ * records usually live on different shards.
+ *
+ * The class is a library: the CLI menu and main's options work on one
+ * DBsystem, and only bench --shard-bench drives a sharded store.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef SHARDED_DBSYSTEM_H
+#define SHARDED_DBSYSTEM_H
+
+#include <string>
+#include <vector>
+#include "DBsystem.h"
+#include "Faculty.h"
+#include "LazyBST.h"
+#include "Student.h"
+
+enum ShardRouting
+{
+    SHARD_BY_HASH,
+    SHARD_BY_RANGE
+};
+
+struct ShardOptions
+{
+    int shards;                         ///< 0 = one per core
+    ShardRouting routing;
+    std::vector<int> studentSplits;     ///< SHARD_BY_RANGE: shards - 1 ascending ids
+    std::vector<int> facultySplits;
+    size_t queueDepth;                  ///< Requests each inbox holds before callers wait
+    bool pin;                           ///< Pin shard i to core i (mod cores)
+
+    ShardOptions() : shards(0), routing(SHARD_BY_HASH), queueDepth(1024), pin(true) {}
+};
+
+/** @brief GPA summary of one group of students. */
+struct ShardGroupStats
+{
+    std::string key;
+    long long count;
+    double sum;
+    double min;
+    double max;
+
+    ShardGroupStats() : count(0), sum(0.0), min(0.0), max(0.0) {}
+    void add(double gpa);
+    void merge(const ShardGroupStats &other);
+};
+
+/**
+ * @class ShardTask
+ * @brief Work run on a shard's own thread against its trees. scatter runs
+ *        one task per shard at once, so a task must only write its own
+ *        state.
+ */
+class ShardTask
+{
+public:
+    virtual ~ShardTask() {}
+    virtual void run(int shard, LazyBST<Student> &students, LazyBST<Faculty> &faculty) = 0;
+};
+
+/**
+ * @class ShardedDBsystem
+ * @brief Thread-per-shard student and faculty store.
+ */
+class ShardedDBsystem
+{
+public:
+    explicit ShardedDBsystem(const ShardOptions &options = ShardOptions());
+    ~ShardedDBsystem();
+
+    int shards() const { return int(m_shards.size()); }
+    int studentShard(int studentId) const;
+    int facultyShard(int facultyId) const;
+
+    /** @brief Insert or overwrite by ID. @return True if the student was new. */
+    bool upsertStudent(const Student &student);
+    /** @return True if a student was removed. */
+    bool deleteStudent(int studentId);
+    /** @brief Copy the student into @p out. @return False if absent. */
+    bool findStudent(int studentId, Student &out);
+
+    /** @brief Insert or overwrite by ID, keeping an existing advisee list. @return True if new. */
+    bool upsertFaculty(const Faculty &faculty);
+    bool deleteFaculty(int facultyId);
+    bool findFaculty(int facultyId, Faculty &out);
+
+    /**
+     * @brief Split the batch by shard; every shard sorts its rows and merges
+     *        them in one pass (LazyBST::mergeSorted), all shards at once.
+     *        The last row of an id wins.
+     */
+    UpsertCounts upsertStudents(const std::vector<Student> &batch);
+
+    /**
+     * @brief Look up many ids, each shard its own share in parallel.
+     * @param out Resized to @p ids; out[i] is the student of ids[i] when found[i].
+     * @return Students found.
+     */
+    size_t findStudents(const std::vector<int> &ids, std::vector<Student> &out, std::vector<char> &found);
+
+    long long studentCount();
+    long long facultyCount();
+
+    /**
+     * @brief GPA count/sum/min/max per value of @p field ("major", "level",
+     *        "advisor", or "" for one group), aggregated on every shard and
+     *        merged. Groups come back sorted by key.
+     */
+    bool studentGpaBy(const std::string &field, std::vector<ShardGroupStats> &groups, std::string &error);
+
+    /** @brief Run tasks[i] on shard i, all at once; returns when all are done. */
+    void scatter(ShardTask *const *tasks);
+
+    /**
+     * @brief Copy every student and faculty member of @p db in. With range
+     *        routing and no split keys yet, picks them from @p db first
+     *        (only while this store is empty).
+     */
+    void copyFrom(DBsystem &db);
+
+private:
+    struct Shard;
+    struct Request;
+
+    std::vector<Shard *> m_shards;
+    ShardRouting m_routing;
+    std::vector<int> m_studentSplits;
+    std::vector<int> m_facultySplits;
+
+    int route(int id, const std::vector<int> &splits) const;
+    void submit(int shard, Request *request);
+    void await(Request *requests, size_t count);
+    static void serve(Shard *shard, int index, bool pin);
+    static void execute(Shard &shard, int index, Request &request);
+
+    ShardedDBsystem(const ShardedDBsystem &);
+    ShardedDBsystem &operator=(const ShardedDBsystem &);
+};
+
+#endif
@@ -0,0 +1,478 @@
+#include "Sketches.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+    inline uint64_t fmix64(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    inline uint64_t nextRandom(uint64_t &state)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    bool byCountDesc(const FrequentItem &a, const FrequentItem &b)
+    {
+        return a.count != b.count ? a.count > b.count : a.value < b.value;
+    }
+}
+
+uint64_t hashBytes(const char *data, size_t size)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ (size * 0xC2B2AE3D27D4EB4FULL);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        h = (h ^ fmix64(w)) * 0x9E3779B97F4A7C15ULL;
+    }
+    if (i < size)
+    {
+        uint64_t w = 0;
+        std::memcpy(&w, data + i, size - i);
+        h = (h ^ fmix64(w)) * 0x9E3779B97F4A7C15ULL;
+    }
+    return fmix64(h);
+}
+
+// ---------------------------------------------------------------------------
+// HyperLogLog
+// ---------------------------------------------------------------------------
+
+const int HyperLogLog::PRECISION;
+const size_t HyperLogLog::EXACT_LIMIT;
+
+HyperLogLog::HyperLogLog()
+{
+
+}
+
+void HyperLogLog::addRegister(uint64_t hash)
+{
+    // Top PRECISION bits pick the register; the rest give the rank of the
+    // first set bit
+    size_t index = size_t(hash >> (64 - PRECISION));
+    uint64_t rest = (hash << PRECISION) | (uint64_t(1) << (PRECISION - 1));
+    uint8_t rank = uint8_t(__builtin_clzll(rest) + 1);
+    if (rank > m_registers[index])
+    {
+        m_registers[index] = rank;
+    }
+}
+
+void HyperLogLog::toRegisters()
+{
+    m_registers.assign(size_t(1) << PRECISION, 0);
+    for (std::unordered_set<uint64_t>::const_iterator it = m_exact.begin(); it != m_exact.end(); ++it)
+    {
+        addRegister(*it);
+    }
+    std::unordered_set<uint64_t>().swap(m_exact);
+}
+
+void HyperLogLog::add(uint64_t hash)
+{
+    if (!m_registers.empty())
+    {
+        addRegister(hash);
+        return;
+    }
+    m_exact.insert(hash);
+    if (m_exact.size() > EXACT_LIMIT)
+    {
+        toRegisters();
+    }
+}
+
+void HyperLogLog::merge(const HyperLogLog &other)
+{
+    if (other.exact())
+    {
+        for (std::unordered_set<uint64_t>::const_iterator it = other.m_exact.begin(); it != other.m_exact.end(); ++it)
+        {
+            add(*it);
+        }
+        return;
+    }
+    if (exact())
+    {
+        toRegisters();
+    }
+    for (size_t i = 0; i < m_registers.size(); ++i)
+    {
+        m_registers[i] = std::max(m_registers[i], other.m_registers[i]);
+    }
+}
+
+double HyperLogLog::distinct() const
+{
+    if (exact())
+    {
+        return double(m_exact.size());
+    }
+    double m = double(m_registers.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < m_registers.size(); ++i)
+    {
+        sum += std::ldexp(1.0, -int(m_registers[i]));
+        zeros += (m_registers[i] == 0);
+    }
+    double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0)
+    {
+        // Linear counting is more accurate while many registers are empty
+        estimate = m * std::log(m / double(zeros));
+    }
+    return estimate;
+}
+
+// ---------------------------------------------------------------------------
+// KllSketch
+// ---------------------------------------------------------------------------
+
+KllSketch::KllSketch(int k) : m_k(k < 8 ? 8 : k), m_count(0), m_levels(1), m_random(0x2545F4914F6CDD1DULL)
+{
+
+}
+
+size_t KllSketch::capacity(size_t level) const
+{
+    // The top level holds k; each level below 2/3 of the one above
+    size_t depth = m_levels.size() - 1 - level;
+    double c = double(m_k) * std::pow(2.0 / 3.0, double(depth));
+    return std::max<size_t>(2, size_t(std::ceil(c)));
+}
+
+size_t KllSketch::retained() const
+{
+    size_t n = 0;
+    for (size_t h = 0; h < m_levels.size(); ++h)
+    {
+        n += m_levels[h].size();
+    }
+    return n;
+}
+
+void KllSketch::compress()
+{
+    for (size_t h = 0; h < m_levels.size(); ++h)
+    {
+        if (m_levels[h].size() < capacity(h))
+        {
+            continue;
+        }
+        if (h + 1 == m_levels.size())
+        {
+            m_levels.push_back(std::vector<double>());
+        }
+        std::vector<double> &level = m_levels[h];
+        std::sort(level.begin(), level.end());
+        // An odd item out stays behind so the weights add up
+        size_t keepBack = level.size() & 1;
+        size_t offset = size_t(nextRandom(m_random) & 1);
+        std::vector<double> &up = m_levels[h + 1];
+        for (size_t i = offset; i + keepBack < level.size(); i += 2)
+        {
+            up.push_back(level[i]);
+        }
+        if (keepBack)
+        {
+            double last = level.back();
+            level.clear();
+            level.push_back(last);
+        }
+        else
+        {
+            level.clear();
+        }
+        break;
+    }
+}
+
+void KllSketch::add(double value)
+{
+    if (value != value)
+    {
+        return;
+    }
+    ++m_count;
+    m_levels[0].push_back(value);
+    if (m_levels[0].size() >= capacity(0))
+    {
+        compress();
+    }
+}
+
+void KllSketch::merge(const KllSketch &other)
+{
+    if (other.m_levels.size() > m_levels.size())
+    {
+        m_levels.resize(other.m_levels.size());
+    }
+    for (size_t h = 0; h < other.m_levels.size(); ++h)
+    {
+        m_levels[h].insert(m_levels[h].end(), other.m_levels[h].begin(), other.m_levels[h].end());
+    }
+    m_count += other.m_count;
+
+    // Compact until every level is back under its capacity
+    bool over = true;
+    while (over)
+    {
+        over = false;
+        for (size_t h = 0; h < m_levels.size(); ++h)
+        {
+            if (m_levels[h].size() >= capacity(h))
+            {
+                over = true;
+                break;
+            }
+        }
+        if (over)
+        {
+            compress();
+        }
+    }
+}
+
+double KllSketch::quantile(double q) const
+{
+    std::vector<std::pair<double, uint64_t> > items;
+    items.reserve(retained());
+    uint64_t total = 0;
+    for (size_t h = 0; h < m_levels.size(); ++h)
+    {
+        uint64_t weight = uint64_t(1) << h;
+        for (size_t i = 0; i < m_levels[h].size(); ++i)
+        {
+            items.push_back(std::make_pair(m_levels[h][i], weight));
+            total += weight;
+        }
+    }
+    if (items.empty())
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    std::sort(items.begin(), items.end());
+    q = std::min(1.0, std::max(0.0, q));
+    double target = q * double(total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        seen += items[i].second;
+        if (double(seen) >= target)
+        {
+            return items[i].first;
+        }
+    }
+    return items.back().first;
+}
+
+// ---------------------------------------------------------------------------
+// SpaceSaving
+// ---------------------------------------------------------------------------
+
+SpaceSaving::SpaceSaving(size_t capacity) : m_capacity(capacity < 1 ? 1 : capacity)
+{
+    size_t tableSize = 4;
+    while (tableSize < m_capacity * 4)
+    {
+        tableSize <<= 1;
+    }
+    m_table.assign(tableSize, -1);
+    m_mask = tableSize - 1;
+}
+
+size_t SpaceSaving::probe(const std::string &value, uint64_t hash) const
+{
+    size_t slot = size_t(hash) & m_mask;
+    while (m_table[slot] >= 0)
+    {
+        size_t id = size_t(m_table[slot]);
+        if (m_hashes[id] == hash && m_items[id].value == value)
+        {
+            break;
+        }
+        slot = (slot + 1) & m_mask;
+    }
+    return slot;
+}
+
+void SpaceSaving::unlink(size_t slot)
+{
+    // Backward-shift deletion: pull later entries of the run into the hole
+    // unless their home slot lies cyclically in (hole, entry]
+    size_t hole = slot;
+    size_t next = slot;
+    while (true)
+    {
+        next = (next + 1) & m_mask;
+        if (m_table[next] < 0)
+        {
+            break;
+        }
+        size_t home = size_t(m_hashes[size_t(m_table[next])]) & m_mask;
+        bool stays = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!stays)
+        {
+            m_table[hole] = m_table[next];
+            hole = next;
+        }
+    }
+    m_table[hole] = -1;
+}
+
+void SpaceSaving::insert(const FrequentItem &item, uint64_t hash)
+{
+    uint32_t id = uint32_t(m_items.size());
+    m_items.push_back(item);
+    m_hashes.push_back(hash);
+    m_position.push_back(uint32_t(m_heap.size()));
+    m_heap.push_back(id);
+    m_table[probe(item.value, hash)] = int32_t(id);
+    siftUp(m_heap.size() - 1);
+}
+
+void SpaceSaving::swapSlots(size_t a, size_t b)
+{
+    std::swap(m_heap[a], m_heap[b]);
+    m_position[m_heap[a]] = uint32_t(a);
+    m_position[m_heap[b]] = uint32_t(b);
+}
+
+void SpaceSaving::siftDown(size_t i)
+{
+    while (true)
+    {
+        size_t smallest = i;
+        size_t l = 2 * i + 1;
+        size_t r = l + 1;
+        if (l < m_heap.size() && m_items[m_heap[l]].count < m_items[m_heap[smallest]].count)
+            smallest = l;
+        if (r < m_heap.size() && m_items[m_heap[r]].count < m_items[m_heap[smallest]].count)
+            smallest = r;
+        if (smallest == i)
+            return;
+        swapSlots(i, smallest);
+        i = smallest;
+    }
+}
+
+void SpaceSaving::siftUp(size_t i)
+{
+    while (i > 0 && m_items[m_heap[(i - 1) / 2]].count > m_items[m_heap[i]].count)
+    {
+        swapSlots(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void SpaceSaving::add(const std::string &value, uint64_t hash, long long count)
+{
+    size_t slot = probe(value, hash);
+    if (m_table[slot] >= 0)
+    {
+        size_t id = size_t(m_table[slot]);
+        m_items[id].count += count;
+        siftDown(m_position[id]);
+        return;
+    }
+    if (m_items.size() < m_capacity)
+    {
+        FrequentItem item = {value, count, 0};
+        insert(item, hash);
+        return;
+    }
+    // Evict the minimum: the newcomer may have been counted there already
+    size_t id = m_heap[0];
+    FrequentItem &min = m_items[id];
+    unlink(probe(min.value, m_hashes[id]));
+    min.error = min.count;
+    min.count += count;
+    min.value = value;
+    m_hashes[id] = hash;
+    m_table[probe(value, hash)] = int32_t(id);
+    siftDown(0);
+}
+
+void SpaceSaving::merge(const SpaceSaving &other)
+{
+    // Mergeable summaries (Agarwal et al.): a value missing from a full
+    // summary may have up to that summary's minimum count
+    bool thisFull = m_items.size() >= m_capacity;
+    bool otherFull = other.m_items.size() >= other.m_capacity;
+    long long minThis = thisFull ? m_items[m_heap[0]].count : 0;
+    long long minOther = otherFull ? other.m_items[other.m_heap[0]].count : 0;
+
+    std::unordered_map<std::string, FrequentItem> combined;
+    for (size_t i = 0; i < m_items.size(); ++i)
+    {
+        FrequentItem item = m_items[i];
+        item.count += minOther;
+        item.error += minOther;
+        combined[item.value] = item;
+    }
+    for (size_t i = 0; i < other.m_items.size(); ++i)
+    {
+        const FrequentItem &o = other.m_items[i];
+        std::unordered_map<std::string, FrequentItem>::iterator it = combined.find(o.value);
+        if (it == combined.end())
+        {
+            FrequentItem item = {o.value, o.count + minThis, o.error + minThis};
+            combined[o.value] = item;
+        }
+        else
+        {
+            // Undo the allowance added above: this side counted it
+            it->second.count += o.count - minOther;
+            it->second.error += o.error - minOther;
+        }
+    }
+
+    std::vector<FrequentItem> items;
+    items.reserve(combined.size());
+    for (std::unordered_map<std::string, FrequentItem>::iterator it = combined.begin(); it != combined.end(); ++it)
+    {
+        items.push_back(it->second);
+    }
+    std::sort(items.begin(), items.end(), byCountDesc);
+    if (items.size() > m_capacity)
+    {
+        items.resize(m_capacity);
+    }
+    m_items.clear();
+    m_hashes.clear();
+    m_heap.clear();
+    m_position.clear();
+    std::fill(m_table.begin(), m_table.end(), -1);
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        insert(items[i], hashBytes(items[i].value.data(), items[i].value.size()));
+    }
+}
+
+std::vector<FrequentItem> SpaceSaving::top(size_t n) const
+{
+    std::vector<FrequentItem> items(m_items);
+    std::sort(items.begin(), items.end(), byCountDesc);
+    if (items.size() > n)
+    {
+        items.resize(n);
+    }
+    return items;
+}
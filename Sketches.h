@@ -0,0 +1,143 @@
+/**
+ * @file Sketches.h
+ * @brief Fixed-memory, mergeable summaries of a stream: distinct count
+ *        (HyperLogLog), quantiles (KLL) and most frequent values
+ *        (Space-Saving).
+ *
+ * ARCHITECTURE:
+ *   Profiler - one set of sketches per column and thread
+ *       |
+ *       v
+ *   Sketches (You are here)
+ *       |  add() one value at a time, merge() another thread's sketch
+ *       v
+ *   estimates: distinct(), quantile(q), top(n)
+ *
+ * HyperLogLog: 2^14 one-byte registers (16 KiB, ~0.8% standard error).
+ *   Below 2048 distinct hashes the sketch keeps the exact set instead, so
+ *   low-cardinality columns count exactly.
+ * KllSketch: compactors with capacities k, 2k/3, 4k/9, ... (min 2) per
+ *   level from the top down; a full level is sorted and every other item
+ *   (random offset) moves up with double weight. About 3k items and a
+ *   rank error around 1.7/k.
+ * SpaceSaving: m counters; an unseen value evicts the smallest counter
+ *   and inherits its count as error, so every value whose true count is
+ *   above n/m is present. Counters live in a min-heap of ids and are
+ *   found through an open-addressing index on the value hash, so an
+ *   eviction allocates nothing.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef SKETCHES_H
+#define SKETCHES_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/** @brief 64-bit hash of a byte string (multiply-xorshift over 8-byte words). */
+uint64_t hashBytes(const char *data, size_t size);
+
+/**
+ * @class HyperLogLog
+ * @brief Distinct-count estimate of a stream of 64-bit hashes.
+ */
+class HyperLogLog
+{
+public:
+    static const int PRECISION = 14;
+    static const size_t EXACT_LIMIT = 2048;
+
+    HyperLogLog();
+
+    void add(uint64_t hash);
+    void merge(const HyperLogLog &other);
+
+    /** @brief Exact below EXACT_LIMIT distinct hashes, estimated above. */
+    double distinct() const;
+    bool exact() const { return m_registers.empty(); }
+
+private:
+    std::unordered_set<uint64_t> m_exact;
+    std::vector<uint8_t> m_registers;   ///< Empty while counting exactly
+
+    void addRegister(uint64_t hash);
+    void toRegisters();
+};
+
+/**
+ * @class KllSketch
+ * @brief Approximate quantiles of a stream of doubles.
+ */
+class KllSketch
+{
+public:
+    explicit KllSketch(int k = 200);
+
+    void add(double value);
+    void merge(const KllSketch &other);
+
+    /** @brief Value at rank q in [0, 1]; NaN when empty. */
+    double quantile(double q) const;
+
+    long long count() const { return m_count; }
+    size_t retained() const;
+
+private:
+    int m_k;
+    long long m_count;
+    std::vector<std::vector<double> > m_levels;    ///< Level h items weigh 2^h
+    uint64_t m_random;
+
+    size_t capacity(size_t level) const;
+    void compress();
+};
+
+/** @brief One Space-Saving counter. */
+struct FrequentItem
+{
+    std::string value;
+    long long count;    ///< Upper bound of the true count
+    long long error;    ///< count - error is a lower bound
+};
+
+/**
+ * @class SpaceSaving
+ * @brief Most frequent values of a stream of strings.
+ */
+class SpaceSaving
+{
+public:
+    explicit SpaceSaving(size_t capacity = 256);
+
+    void add(const std::string &value, long long count = 1) { add(value, hashBytes(value.data(), value.size()), count); }
+
+    /** @brief Add with the value's hashBytes already computed. */
+    void add(const std::string &value, uint64_t hash, long long count = 1);
+    void merge(const SpaceSaving &other);
+
+    /** @brief Up to @p n counters, largest count first. */
+    std::vector<FrequentItem> top(size_t n) const;
+
+private:
+    size_t m_capacity;
+    std::vector<FrequentItem> m_items;  ///< Counters, in no particular order
+    std::vector<uint64_t> m_hashes;     ///< Hash of each counter's value
+    std::vector<uint32_t> m_heap;       ///< Counter ids, min-heap by count
+    std::vector<uint32_t> m_position;   ///< Heap slot of each counter
+    std::vector<int32_t> m_table;       ///< Linear probing: counter id or -1
+    size_t m_mask;
+
+    size_t probe(const std::string &value, uint64_t hash) const;
+    void unlink(size_t slot);
+    void insert(const FrequentItem &item, uint64_t hash);
+    void siftDown(size_t i);
+    void siftUp(size_t i);
+    void swapSlots(size_t a, size_t b);
+};
+
+#endif
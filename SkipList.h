@@ -0,0 +1,531 @@
+/**
+ * @file SkipList.h
+ * @brief Lock-free ordered index with LazyBST's operations, for tables
+ *        written by several ingest threads at once.
+ *
+ * ARCHITECTURE:
+ *   ingest threads / readers / scans
+ *       |  every operation inside an EpochGuard
+ *       v
+ *   SkipList (You are here)
+ *       |  level 0: every node in key order; level i: about 1 in 4^i of
+ *       |  them. Links are atomic words whose low bit marks the node that
+ *       |  owns the link as deleted at that level
+ *       v
+ *   Node { record, height, next[height] } -> immutable record (T)
+ *       |  replaced and removed memory goes to
+ *       v
+ *   EpochManager - freed once no operation can still hold it
+ *
+ * OPERATIONS (Harris-style marked links, as in Fraser's skip list):
+ *   search  - walk down from the top level; never writes
+ *   insert  - link level 0 with one CAS (the linearization point), then
+ *             the upper levels one CAS each
+ *   upsert  - an existing key gets a new record by swapping its record
+ *             pointer; otherwise insert. If the node turns out marked
+ *             after the swap, a remove took it: insert again
+ *   remove  - mark the node's links top down; whoever marks level 0 owns
+ *             the removal. Marked nodes are unlinked (snipped) by any
+ *             operation that walks past them
+ *   scans   - walk level 0, skipping marked nodes: keys come out strictly
+ *             increasing, and every key present for the whole scan is
+ *             seen exactly once, however many inserts arrive meanwhile
+ *
+ * A node is retired only when both its inserter has finished linking it
+ * and its remover has marked it (whichever is last snips it from every
+ * level first), so a late upper-level link can never leave a retired node
+ * reachable. No operation waits for another thread.
+ *
+ * No pointer into the list outlives an operation: a concurrent upsert or
+ * remove may free a record as soon as the reader's epoch ends, so lookups
+ * copy the record out (find) while still inside their guard.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef SKIP_LIST_H
+#define SKIP_LIST_H
+
+#include <stdint.h>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include "EpochManager.h"
+
+/** @brief Levels of the tallest tower; enough for 4^16 keys. */
+#define SKIP_LIST_LEVELS 16
+
+/**
+ * @class SkipList
+ * @brief Lock-free ordered set of T keyed by operator<.
+ * @tparam T Copyable; ordered by operator<.
+ */
+template <typename T>
+class SkipList
+{
+public:
+    SkipList();
+    ~SkipList();
+
+    /** @brief Insert unless an equal key is present. @return True if inserted. */
+    bool insert(const T &d);
+
+    /** @brief Insert, or replace the element with an equal key. @return True if new. */
+    bool upsert(const T &d);
+
+    /** @return True if an element with this key was removed. */
+    bool remove(const T &key);
+
+    /** @brief Copy the element equal to @p key into @p out. @return False if absent. */
+    bool find(const T &key, T &out) const;
+
+    bool contains(const T &key) const;
+
+    long long size() const { return m_size.load(std::memory_order_relaxed); }
+
+    /** @brief Visit elements in sorted order (see scans above). */
+    template <typename Visitor>
+    void visitInOrder(Visitor &visit) const;
+
+    /**
+     * @brief Visit elements in [*lo, *hi) in sorted order.
+     * @param lo Inclusive lower bound, or NULL for none.
+     * @param hi Exclusive upper bound, or NULL for none.
+     */
+    template <typename Visitor>
+    void visitRange(const T *lo, const T *hi, Visitor &visit) const;
+
+    /** @brief Remove everything. Only while no other thread uses the list. */
+    void clear();
+
+private:
+    static const uintptr_t MARK = 1;
+    static const int LINKED = 1;      ///< Inserter done linking
+    static const int REMOVED = 2;     ///< Remover done marking
+
+    // One allocation: header, tower, then the first record, so a fresh
+    // node costs a single cache miss to compare against
+    struct Node
+    {
+        std::atomic<const T *> record;      ///< The inline record, or a replacement
+        std::atomic<int> state;
+        int height;
+        std::atomic<uintptr_t> next[1];     ///< height entries
+    };
+
+    Node *m_head;                           ///< Sentinel below every key, SKIP_LIST_LEVELS tall
+    std::atomic<long long> m_size;
+    mutable EpochManager m_epochs;
+
+    static size_t towerBytes(int height);
+    static const T *inlineRecord(const Node *node);
+    static Node *allocate(int height, const T *d);
+    static void destroy(void *node);
+    static void destroyRecord(void *record);
+    static Node *pointer(uintptr_t link) { return reinterpret_cast<Node *>(link & ~MARK); }
+    static bool marked(uintptr_t link) { return (link & MARK) != 0; }
+    static uintptr_t word(Node *node) { return reinterpret_cast<uintptr_t>(node); }
+    static int randomHeight();
+
+    bool write(const T &d, bool replace);
+    bool locate(const T &key, Node **preds, Node **succs) const;
+    Node *seek(const T &key) const;
+    void finish(Node *node, int flag);
+
+    SkipList(const SkipList &);
+    SkipList &operator=(const SkipList &);
+};
+
+template <typename T>
+SkipList<T>::SkipList() : m_head(allocate(SKIP_LIST_LEVELS, NULL)), m_size(0)
+{
+
+}
+
+template <typename T>
+SkipList<T>::~SkipList()
+{
+    clear();
+    destroy(m_head);
+}
+
+// ---------------------------------------------------------------------------
+// Nodes
+// ---------------------------------------------------------------------------
+
+template <typename T>
+size_t SkipList<T>::towerBytes(int height)
+{
+    size_t bytes = sizeof(Node) + size_t(height - 1) * sizeof(std::atomic<uintptr_t>);
+    return (bytes + alignof(T) - 1) / alignof(T) * alignof(T);
+}
+
+template <typename T>
+const T *SkipList<T>::inlineRecord(const Node *node)
+{
+    return reinterpret_cast<const T *>(reinterpret_cast<const char *>(node) + towerBytes(node->height));
+}
+
+// The head sentinel (d NULL) has no record
+template <typename T>
+typename SkipList<T>::Node *SkipList<T>::allocate(int height, const T *d)
+{
+    void *block = ::operator new(towerBytes(height) + (d != NULL ? sizeof(T) : 0));
+    Node *node = static_cast<Node *>(block);
+    node->height = height;
+    new (&node->record) std::atomic<const T *>(d != NULL ? new (const_cast<T *>(inlineRecord(node))) T(*d) : NULL);
+    new (&node->state) std::atomic<int>(0);
+    for (int i = 0; i < height; ++i)
+    {
+        new (&node->next[i]) std::atomic<uintptr_t>(0);
+    }
+    return node;
+}
+
+template <typename T>
+void SkipList<T>::destroy(void *block)
+{
+    Node *node = static_cast<Node *>(block);
+    const T *record = node->record.load(std::memory_order_relaxed);
+    if (record != NULL)
+    {
+        if (record != inlineRecord(node))
+        {
+            delete record;
+        }
+        inlineRecord(node)->~T();
+    }
+    ::operator delete(block);
+}
+
+template <typename T>
+void SkipList<T>::destroyRecord(void *record)
+{
+    delete static_cast<const T *>(record);
+}
+
+// P(height > h) = 4^-h, from a per-thread xorshift
+template <typename T>
+int SkipList<T>::randomHeight()
+{
+    static thread_local uint64_t x = 0;
+    if (x == 0)
+    {
+        x = reinterpret_cast<uintptr_t>(&x) | 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    int height = 1;
+    uint64_t bits = x;
+    while (height < SKIP_LIST_LEVELS && (bits & 3) == 0)
+    {
+        ++height;
+        bits >>= 2;
+    }
+    return height;
+}
+
+// ---------------------------------------------------------------------------
+// Search
+// ---------------------------------------------------------------------------
+
+// Fills preds[i] / succs[i] with the last node below key and the first at
+// or above it on every level, snipping marked nodes on the way. True when
+// succs[0] holds key. A failed snip means pred changed: start again.
+template <typename T>
+bool SkipList<T>::locate(const T &key, Node **preds, Node **succs) const
+{
+retry:
+    Node *pred = m_head;
+    for (int level = SKIP_LIST_LEVELS - 1; level >= 0; --level)
+    {
+        Node *curr = pointer(pred->next[level].load(std::memory_order_acquire));
+        while (curr != NULL)
+        {
+            uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+            while (marked(succ))
+            {
+                uintptr_t expected = word(curr);
+                if (!pred->next[level].compare_exchange_strong(expected, succ & ~MARK, std::memory_order_acq_rel))
+                {
+                    goto retry;
+                }
+                curr = pointer(succ);
+                if (curr == NULL)
+                {
+                    break;
+                }
+                succ = curr->next[level].load(std::memory_order_acquire);
+            }
+            if (curr == NULL || !(*curr->record.load(std::memory_order_acquire) < key))
+            {
+                break;
+            }
+            pred = curr;
+            curr = pointer(succ);
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return succs[0] != NULL && !(key < *succs[0]->record.load(std::memory_order_acquire));
+}
+
+// Read-only descent: the first unmarked node at or above key, or NULL
+template <typename T>
+typename SkipList<T>::Node *SkipList<T>::seek(const T &key) const
+{
+    Node *pred = m_head;
+    Node *curr = NULL;
+    for (int level = SKIP_LIST_LEVELS - 1; level >= 0; --level)
+    {
+        curr = pointer(pred->next[level].load(std::memory_order_acquire));
+        while (curr != NULL)
+        {
+            uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+            if (marked(succ))
+            {
+                curr = pointer(succ);
+                continue;
+            }
+            if (!(*curr->record.load(std::memory_order_acquire) < key))
+            {
+                break;
+            }
+            pred = curr;
+            curr = pointer(succ);
+        }
+    }
+    return curr;
+}
+
+template <typename T>
+bool SkipList<T>::contains(const T &key) const
+{
+    EpochGuard guard(m_epochs);
+    Node *node = seek(key);
+    return node != NULL && !(key < *node->record.load(std::memory_order_acquire));
+}
+
+template <typename T>
+bool SkipList<T>::find(const T &key, T &out) const
+{
+    EpochGuard guard(m_epochs);
+    Node *node = seek(key);
+    if (node == NULL)
+    {
+        return false;
+    }
+    const T *record = node->record.load(std::memory_order_acquire);
+    if (key < *record)
+    {
+        return false;
+    }
+    out = *record;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Updates
+// ---------------------------------------------------------------------------
+
+template <typename T>
+bool SkipList<T>::insert(const T &d)
+{
+    return write(d, false);
+}
+
+template <typename T>
+bool SkipList<T>::upsert(const T &d)
+{
+    return write(d, true);
+}
+
+template <typename T>
+bool SkipList<T>::write(const T &d, bool replace)
+{
+    Node *preds[SKIP_LIST_LEVELS];
+    Node *succs[SKIP_LIST_LEVELS];
+    Node *node = NULL;
+    EpochGuard guard(m_epochs);
+    while (true)
+    {
+        if (locate(d, preds, succs))
+        {
+            if (node != NULL)
+            {
+                destroy(node);              // Never linked
+            }
+            if (!replace)
+            {
+                return false;
+            }
+            // Present: swap in a new record; the inline one lives as long as its node
+            Node *found = succs[0];
+            const T *old = found->record.exchange(new T(d), std::memory_order_acq_rel);
+            if (old != inlineRecord(found))
+            {
+                m_epochs.retire(const_cast<T *>(old), &destroyRecord);
+            }
+            // A remover that marked level 0 meanwhile took the new record
+            // down with the node: the write then lands after the removal
+            if (!marked(found->next[0].load(std::memory_order_acquire)))
+            {
+                return false;
+            }
+            continue;
+        }
+        if (node == NULL)
+        {
+            node = allocate(randomHeight(), &d);
+        }
+        for (int i = 0; i < node->height; ++i)
+        {
+            node->next[i].store(word(succs[i]), std::memory_order_relaxed);
+        }
+        uintptr_t expected = word(succs[0]);
+        if (preds[0]->next[0].compare_exchange_strong(expected, word(node), std::memory_order_acq_rel))
+        {
+            break;
+        }
+    }
+    m_size.fetch_add(1, std::memory_order_relaxed);
+
+    for (int i = 1; i < node->height; ++i)
+    {
+        while (true)
+        {
+            uintptr_t link = node->next[i].load(std::memory_order_acquire);
+            if (marked(link))
+            {
+                finish(node, LINKED);       // Removed meanwhile: stop linking
+                return true;
+            }
+            if (pointer(link) != succs[i] &&
+                !node->next[i].compare_exchange_strong(link, word(succs[i]), std::memory_order_acq_rel))
+            {
+                continue;
+            }
+            uintptr_t expected = word(succs[i]);
+            if (preds[i]->next[i].compare_exchange_strong(expected, word(node), std::memory_order_acq_rel))
+            {
+                break;
+            }
+            locate(d, preds, succs);
+            if (succs[0] != node)
+            {
+                finish(node, LINKED);       // Removed (and maybe replaced) meanwhile
+                return true;
+            }
+        }
+    }
+    finish(node, LINKED);
+    return true;
+}
+
+template <typename T>
+bool SkipList<T>::remove(const T &key)
+{
+    Node *preds[SKIP_LIST_LEVELS];
+    Node *succs[SKIP_LIST_LEVELS];
+    EpochGuard guard(m_epochs);
+    if (!locate(key, preds, succs))
+    {
+        return false;
+    }
+    Node *node = succs[0];
+    for (int i = node->height - 1; i >= 1; --i)
+    {
+        uintptr_t link = node->next[i].load(std::memory_order_acquire);
+        while (!marked(link) && !node->next[i].compare_exchange_weak(link, link | MARK, std::memory_order_acq_rel))
+        {
+        }
+    }
+    uintptr_t link = node->next[0].load(std::memory_order_acquire);
+    while (true)
+    {
+        if (marked(link))
+        {
+            return false;                   // Another remover got there first
+        }
+        if (node->next[0].compare_exchange_weak(link, link | MARK, std::memory_order_acq_rel))
+        {
+            break;
+        }
+    }
+    m_size.fetch_sub(1, std::memory_order_relaxed);
+    finish(node, REMOVED);
+    return true;
+}
+
+// The inserter and the remover each report here once; the second one
+// snips the node from every level (locate does it) and retires it
+template <typename T>
+void SkipList<T>::finish(Node *node, int flag)
+{
+    if ((node->state.fetch_or(flag, std::memory_order_acq_rel) | flag) != (LINKED | REMOVED))
+    {
+        return;
+    }
+    Node *preds[SKIP_LIST_LEVELS];
+    Node *succs[SKIP_LIST_LEVELS];
+    locate(*node->record.load(std::memory_order_acquire), preds, succs);
+    m_epochs.retire(node, &destroy);
+}
+
+// ---------------------------------------------------------------------------
+// Scans
+// ---------------------------------------------------------------------------
+
+template <typename T>
+template <typename Visitor>
+void SkipList<T>::visitInOrder(Visitor &visit) const
+{
+    visitRange(NULL, NULL, visit);
+}
+
+template <typename T>
+template <typename Visitor>
+void SkipList<T>::visitRange(const T *lo, const T *hi, Visitor &visit) const
+{
+    EpochGuard guard(m_epochs);
+    Node *node = lo != NULL ? seek(*lo) : pointer(m_head->next[0].load(std::memory_order_acquire));
+    while (node != NULL)
+    {
+        uintptr_t next = node->next[0].load(std::memory_order_acquire);
+        if (!marked(next))
+        {
+            const T *record = node->record.load(std::memory_order_acquire);
+            if (hi != NULL && !(*record < *hi))
+            {
+                return;
+            }
+            visit(*record);
+        }
+        node = pointer(next);
+    }
+}
+
+template <typename T>
+void SkipList<T>::clear()
+{
+    Node *node = pointer(m_head->next[0].load(std::memory_order_acquire));
+    while (node != NULL)
+    {
+        Node *next = pointer(node->next[0].load(std::memory_order_relaxed));
+        if ((node->state.load(std::memory_order_relaxed) & REMOVED) == 0)
+        {
+            destroy(node);                  // Removed ones are already retired
+        }
+        node = next;
+    }
+    for (int i = 0; i < SKIP_LIST_LEVELS; ++i)
+    {
+        m_head->next[i].store(0, std::memory_order_relaxed);
+    }
+    m_size.store(0, std::memory_order_relaxed);
+    m_epochs.drain();
+}
+
+#endif
@@ -0,0 +1,479 @@
+#include "Snapshot.h"
+#include "DBsystem.h"
+#include "OutputBuffer.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char SNAPSHOT_MAGIC[8] = {'U', 'D', 'B', 'S', 'N', 'A', 'P', '\0'};
+
+// ---------------------------------------------------------------------------
+// SnapshotChecksum
+// ---------------------------------------------------------------------------
+
+SnapshotChecksum::SnapshotChecksum() : m_hash(0x9E3779B97F4A7C15ULL), m_length(0), m_pendingLen(0) {}
+
+void SnapshotChecksum::mix(uint64_t word)
+{
+    m_hash ^= word * 0xBF58476D1CE4E5B9ULL;
+    m_hash = (m_hash << 31) | (m_hash >> 33);
+    m_hash *= 0x94D049BB133111EBULL;
+}
+
+void SnapshotChecksum::update(const void *data, size_t len)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    m_length += len;
+
+    // Top up a partial word left by the previous call
+    while (m_pendingLen > 0 && m_pendingLen < 8 && len > 0)
+    {
+        m_pending[m_pendingLen++] = *p++;
+        --len;
+    }
+    if (m_pendingLen == 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, m_pending, 8);
+        mix(w);
+        m_pendingLen = 0;
+    }
+
+    while (len >= 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        mix(w);
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        m_pending[m_pendingLen++] = *p++;
+        --len;
+    }
+}
+
+uint64_t SnapshotChecksum::finish() const
+{
+    SnapshotChecksum tail = *this;
+    uint64_t w = 0;
+    std::memcpy(&w, tail.m_pending, tail.m_pendingLen);
+    tail.mix(w ^ (tail.m_length << 3));
+    uint64_t h = tail.m_hash;
+    h ^= h >> 29;
+    return h;
+}
+
+// ---------------------------------------------------------------------------
+// SnapshotWriter
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    // Sequential body writer that keeps the running checksum and offset
+    struct BodyWriter
+    {
+        OutputBuffer out;
+        SnapshotChecksum sum;
+        uint64_t pos;
+
+        BodyWriter(int fd) : out(fd), pos(0) {}
+
+        void write(const void *data, size_t len)
+        {
+            out.append(static_cast<const char *>(data), len);
+            sum.update(data, len);
+            pos += len;
+        }
+
+        void pad8()
+        {
+            static const char zeros[8] = {0};
+            if (pos % 8 != 0)
+            {
+                write(zeros, 8 - pos % 8);
+            }
+        }
+    };
+
+    // Interns level/major/department strings into the dictionary page
+    struct Dictionary
+    {
+        std::unordered_map<std::string, uint32_t> codes;
+        std::vector<std::string> strings;
+
+        uint32_t code(const std::string &s)
+        {
+            std::unordered_map<std::string, uint32_t>::iterator it = codes.find(s);
+            if (it != codes.end())
+            {
+                return it->second;
+            }
+            uint32_t c = uint32_t(strings.size());
+            codes[s] = c;
+            strings.push_back(s);
+            return c;
+        }
+    };
+}
+
+bool SnapshotWriter::write(DBsystem &db, const std::string &path, std::string &error, uint64_t logOffset)
+{
+    std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        error = "cannot create " + tmpPath + ": " + std::strerror(errno);
+        return false;
+    }
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.logOffset = logOffset;
+    header.headerSize = sizeof(SnapshotHeader);
+
+    Dictionary dict;
+    bool ok;
+    {
+        BodyWriter body(fd);
+        // Header placeholder; patched once offsets are known
+        body.out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+        body.pos = 0;
+
+        // Pass 1: names into the heap, interning dictionary strings
+        header.heapOffset = sizeof(header);
+        auto studentNames = [&](const Student &s) {
+            const std::string name = s.getName();
+            body.write(name.data(), name.size());
+            dict.code(s.getLevel());
+            dict.code(s.getMajor());
+            ++header.studentCount;
+        };
+        db.forEachStudent(studentNames);
+        auto facultyNames = [&](const Faculty &f) {
+            const std::string name = f.getName();
+            body.write(name.data(), name.size());
+            dict.code(f.getLevel());
+            dict.code(f.getDepartment());
+            header.adviseeCount += uint64_t(f.getAdviseeCount());
+            ++header.facultyCount;
+        };
+        db.forEachFaculty(facultyNames);
+
+        std::vector<SnapshotDictEntry> entries(dict.strings.size());
+        for (size_t i = 0; i < dict.strings.size(); ++i)
+        {
+            entries[i].offset = body.pos;
+            entries[i].length = uint32_t(dict.strings[i].size());
+            entries[i].reserved = 0;
+            body.write(dict.strings[i].data(), dict.strings[i].size());
+        }
+        header.heapSize = body.pos;
+        body.pad8();
+
+        header.dictCount = entries.size();
+        header.dictOffset = sizeof(header) + body.pos;
+        if (!entries.empty())
+        {
+            body.write(&entries[0], entries.size() * sizeof(SnapshotDictEntry));
+        }
+
+        // Pass 2: fixed-size records, recomputing heap offsets in the same order
+        uint64_t nameOffset = 0;
+        header.studentOffset = sizeof(header) + body.pos;
+        auto studentRecords = [&](const Student &s) {
+            SnapshotStudent r;
+            r.id = s.getID();
+            r.advisor = s.getAdvisor();
+            r.gpa = s.getGPA();
+            r.nameOffset = nameOffset;
+            r.nameLength = uint32_t(s.getName().size());
+            r.levelCode = dict.code(s.getLevel());
+            r.majorCode = dict.code(s.getMajor());
+            r.reserved = 0;
+            nameOffset += r.nameLength;
+            body.write(&r, sizeof(r));
+        };
+        db.forEachStudent(studentRecords);
+
+        uint32_t adviseeStart = 0;
+        header.facultyOffset = sizeof(header) + body.pos;
+        auto facultyRecords = [&](const Faculty &f) {
+            SnapshotFaculty r;
+            r.id = f.getID();
+            r.nameOffset = nameOffset;
+            r.nameLength = uint32_t(f.getName().size());
+            r.levelCode = dict.code(f.getLevel());
+            r.departmentCode = dict.code(f.getDepartment());
+            r.adviseeStart = adviseeStart;
+            r.adviseeCount = uint32_t(f.getAdviseeCount());
+            nameOffset += r.nameLength;
+            adviseeStart += r.adviseeCount;
+            body.write(&r, sizeof(r));
+        };
+        db.forEachFaculty(facultyRecords);
+
+        // Pass 3: advisee runs
+        header.adviseeOffset = sizeof(header) + body.pos;
+        auto advisees = [&](const Faculty &f) {
+            for (int i = 0; i < f.getAdviseeCount(); ++i)
+            {
+                int32_t id = f.getAdvisee(i);
+                body.write(&id, sizeof(id));
+            }
+        };
+        db.forEachFaculty(advisees);
+        body.pad8();
+
+        header.fileSize = sizeof(header) + body.pos;
+        header.bodyChecksum = body.sum.finish();
+        SnapshotChecksum hsum;
+        hsum.update(&header, sizeof(header));
+        header.headerChecksum = hsum.finish();
+
+        // The real header, then fsync, queued behind the body writes
+        ok = body.out.patch(0, &header, sizeof(header)) && body.out.sync();
+    }
+    ok = (::close(fd) == 0) && ok;
+    if (!ok)
+    {
+        error = "write to " + tmpPath + " failed: " + std::strerror(errno);
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    // Rename last so an open mapping of the old file stays valid
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        error = "cannot rename " + tmpPath + ": " + std::strerror(errno);
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// SnapshotReader
+// ---------------------------------------------------------------------------
+
+SnapshotReader::SnapshotReader()
+    : m_fd(-1), m_data(NULL), m_size(0), m_header(NULL), m_logOffset(0), m_students(NULL), m_faculty(NULL),
+      m_advisees(NULL), m_dict(NULL), m_heap(NULL) {}
+
+SnapshotReader::~SnapshotReader()
+{
+    close();
+}
+
+void SnapshotReader::close()
+{
+    if (m_data != NULL)
+    {
+        ::munmap(const_cast<char *>(m_data), m_size);
+    }
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+    m_data = NULL;
+    m_size = 0;
+    m_header = NULL;
+    m_logOffset = 0;
+}
+
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize)
+{
+    return offset % 8 == 0 && offset <= fileSize && count <= (fileSize - offset) / size;
+}
+
+bool SnapshotReader::open(const std::string &path, std::string &error)
+{
+    close();
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+    {
+        error = "cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0 || size_t(st.st_size) < sizeof(SnapshotHeader))
+    {
+        error = path + " is not a snapshot (too small)";
+        close();
+        return false;
+    }
+    m_size = size_t(st.st_size);
+    void *map = ::mmap(NULL, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        error = "cannot map " + path + ": " + std::strerror(errno);
+        m_size = 0;
+        close();
+        return false;
+    }
+    m_data = static_cast<const char *>(map);
+
+    // Only the header is read here; record pages fault in on first lookup
+    SnapshotHeader h;
+    std::memcpy(&h, m_data, sizeof(h));
+    uint64_t stored = h.headerChecksum;
+    h.headerChecksum = 0;
+    SnapshotChecksum hsum;
+    hsum.update(&h, sizeof(h));
+
+    if (std::memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0)
+        error = path + " is not a snapshot (bad magic)";
+    else if (h.version != SNAPSHOT_VERSION)
+        error = path + " has unsupported snapshot version " + std::to_string(h.version);
+    else if (hsum.finish() != stored)
+        error = path + " has a corrupt header";
+    else if (h.headerSize != sizeof(SnapshotHeader) || h.fileSize != m_size)
+        error = path + " is truncated";
+    else if (h.heapOffset != sizeof(SnapshotHeader) || !sectionFits(h.heapOffset, h.heapSize, 1, m_size) ||
+             !sectionFits(h.dictOffset, h.dictCount, sizeof(SnapshotDictEntry), m_size) ||
+             !sectionFits(h.studentOffset, h.studentCount, sizeof(SnapshotStudent), m_size) ||
+             !sectionFits(h.facultyOffset, h.facultyCount, sizeof(SnapshotFaculty), m_size) ||
+             !sectionFits(h.adviseeOffset, h.adviseeCount, sizeof(int32_t), m_size))
+        error = path + " has an invalid section table";
+    else
+        error.clear();
+
+    if (!error.empty())
+    {
+        close();
+        return false;
+    }
+
+    m_header = reinterpret_cast<const SnapshotHeader *>(m_data);
+    m_logOffset = h.logOffset;
+    m_heap = m_data + h.heapOffset;
+    m_dict = reinterpret_cast<const SnapshotDictEntry *>(m_data + h.dictOffset);
+    m_students = reinterpret_cast<const SnapshotStudent *>(m_data + h.studentOffset);
+    m_faculty = reinterpret_cast<const SnapshotFaculty *>(m_data + h.facultyOffset);
+    m_advisees = reinterpret_cast<const int32_t *>(m_data + h.adviseeOffset);
+
+    // Lookups are binary searches: don't let readahead pull in whole arrays
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size_t recordsStart = size_t(h.studentOffset) & ~(page - 1);
+    ::madvise(const_cast<char *>(m_data) + recordsStart, m_size - recordsStart, MADV_RANDOM);
+    return true;
+}
+
+bool SnapshotReader::verify() const
+{
+    if (m_header == NULL)
+    {
+        return false;
+    }
+    SnapshotChecksum sum;
+    sum.update(m_data + m_header->headerSize, m_size - m_header->headerSize);
+    return sum.finish() == m_header->bodyChecksum;
+}
+
+uint64_t SnapshotReader::studentLowerBound(int id) const
+{
+    uint64_t lo = 0;
+    uint64_t hi = studentCount();
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (m_students[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+uint64_t SnapshotReader::facultyLowerBound(int id) const
+{
+    uint64_t lo = 0;
+    uint64_t hi = facultyCount();
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (m_faculty[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+long long SnapshotReader::findStudent(int id) const
+{
+    uint64_t lo = studentLowerBound(id);
+    return (lo < studentCount() && m_students[lo].id == id) ? (long long)lo : -1;
+}
+
+long long SnapshotReader::findFaculty(int id) const
+{
+    uint64_t lo = facultyLowerBound(id);
+    return (lo < facultyCount() && m_faculty[lo].id == id) ? (long long)lo : -1;
+}
+
+bool SnapshotReader::heapString(uint64_t offset, uint32_t length, std::string &out) const
+{
+    if (offset > m_header->heapSize || length > m_header->heapSize - offset)
+    {
+        return false;
+    }
+    out.assign(m_heap + offset, length);
+    return true;
+}
+
+bool SnapshotReader::dictString(uint32_t code, std::string &out) const
+{
+    if (code >= m_header->dictCount)
+    {
+        return false;
+    }
+    return heapString(m_dict[code].offset, m_dict[code].length, out);
+}
+
+bool SnapshotReader::studentAt(uint64_t index, Student &out) const
+{
+    if (index >= studentCount())
+    {
+        return false;
+    }
+    const SnapshotStudent &r = m_students[index];
+    std::string name, level, major;
+    if (!heapString(r.nameOffset, r.nameLength, name) || !dictString(r.levelCode, level) ||
+        !dictString(r.majorCode, major))
+    {
+        return false;
+    }
+    out = Student(r.id, name, level, major, r.gpa, r.advisor);
+    return true;
+}
+
+bool SnapshotReader::facultyAt(uint64_t index, Faculty &out) const
+{
+    if (index >= facultyCount())
+    {
+        return false;
+    }
+    const SnapshotFaculty &r = m_faculty[index];
+    std::string name, level, department;
+    if (!heapString(r.nameOffset, r.nameLength, name) || !dictString(r.levelCode, level) ||
+        !dictString(r.departmentCode, department) || uint64_t(r.adviseeStart) + r.adviseeCount > m_header->adviseeCount)
+    {
+        return false;
+    }
+    out = Faculty(r.id, name, level, department);
+    for (uint32_t i = 0; i < r.adviseeCount; ++i)
+    {
+        out.addAdvisee(m_advisees[r.adviseeStart + i]);
+    }
+    return true;
+}
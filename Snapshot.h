@@ -0,0 +1,192 @@
+/**
+ * @file Snapshot.h
+ * @brief Versioned, checksummed binary snapshot of DBsystem that is used in place via mmap.
+ *
+ * ARCHITECTURE:
+ *   DBsystem::save -> SnapshotWriter (You are here) -> .udb file
+ *   DBsystem::open -> SnapshotReader (You are here) <- mmap of .udb file
+ *                         ^
+ *                         | record lookups on a tree miss
+ *                     DBsystem trees (only the records touched so far)
+ *
+ * FILE LAYOUT (little-endian, sections 8-byte aligned):
+ *   SnapshotHeader     magic, version, section offsets, checksums, log offset
+ *   string heap        names and dictionary strings, not terminated
+ *   dictionary page    {offset, length} per distinct level/major/department
+ *   student records    fixed 40-byte records sorted by id
+ *   faculty records    fixed 32-byte records sorted by id
+ *   advisee ids        int32 runs referenced by faculty records
+ *
+ * Records refer to strings by 64-bit heap offset or dictionary code, so nothing
+ * needs to be deserialized up front: open() maps the file and checks the
+ * header, and pages fault in as records are first looked up (binary search
+ * over the sorted record array). verify() checksums the body on demand.
+ *
+ * LOG OFFSET: a snapshot saved while a write-ahead log is attached records
+ * how far into that log file it reaches, so replaying the same log on top
+ * of it skips the records it already holds.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <string>
+#include "Student.h"
+#include "Faculty.h"
+
+class DBsystem;
+
+static const uint32_t SNAPSHOT_VERSION = 3;
+
+struct SnapshotHeader
+{
+    char magic[8];              ///< "UDBSNAP\0"
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t fileSize;
+    uint64_t studentCount;
+    uint64_t facultyCount;
+    uint64_t adviseeCount;
+    uint64_t dictCount;
+    uint64_t heapOffset;
+    uint64_t heapSize;
+    uint64_t dictOffset;
+    uint64_t studentOffset;
+    uint64_t facultyOffset;
+    uint64_t adviseeOffset;
+    uint64_t bodyChecksum;      ///< Over bytes [headerSize, fileSize)
+    uint64_t headerChecksum;    ///< Over this header with this field zeroed
+    uint64_t logOffset;         ///< Bytes of the attached log already applied
+};
+
+struct SnapshotStudent
+{
+    int32_t id;
+    int32_t advisor;
+    double gpa;
+    uint64_t nameOffset;        ///< Heap offset
+    uint32_t nameLength;
+    uint32_t levelCode;         ///< Dictionary code
+    uint32_t majorCode;         ///< Dictionary code
+    uint32_t reserved;
+};
+
+struct SnapshotFaculty
+{
+    int32_t id;
+    uint32_t nameLength;
+    uint64_t nameOffset;        ///< Heap offset
+    uint32_t levelCode;
+    uint32_t departmentCode;
+    uint32_t adviseeStart;      ///< Index into the advisee section
+    uint32_t adviseeCount;
+};
+
+struct SnapshotDictEntry
+{
+    uint64_t offset;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+/**
+ * @class SnapshotChecksum
+ * @brief Streaming 64-bit checksum; the result does not depend on how the input is chunked.
+ */
+class SnapshotChecksum
+{
+public:
+    SnapshotChecksum();
+    void update(const void *data, size_t len);
+    uint64_t finish() const;
+
+private:
+    uint64_t m_hash;
+    uint64_t m_length;
+    unsigned char m_pending[8];
+    size_t m_pendingLen;
+
+    void mix(uint64_t word);
+};
+
+/**
+ * @class SnapshotWriter
+ * @brief Writes the trees of a DBsystem as a snapshot file (temp file + rename).
+ */
+class SnapshotWriter
+{
+public:
+    /**
+     * @brief Write @p db to @p path. @param logOffset Stored in the header.
+     * @param error Set on failure. @return True on success.
+     */
+    static bool write(DBsystem &db, const std::string &path, std::string &error, uint64_t logOffset = 0);
+};
+
+/**
+ * @class SnapshotReader
+ * @brief Read-only view over a memory-mapped snapshot.
+ */
+class SnapshotReader
+{
+public:
+    SnapshotReader();
+    ~SnapshotReader();
+
+    /** @brief Map @p path and validate its header. @param error Set on failure. */
+    bool open(const std::string &path, std::string &error);
+
+    /** @brief Unmap the file. */
+    void close();
+
+    /** @brief Checksum the whole body (touches every page). */
+    bool verify() const;
+
+    uint64_t studentCount() const { return m_header ? m_header->studentCount : 0; }
+    uint64_t facultyCount() const { return m_header ? m_header->facultyCount : 0; }
+
+    /** @brief Bytes of its log the snapshot already holds; 0 if saved without one. */
+    uint64_t logOffset() const { return m_logOffset; }
+
+    /** @brief Position of student @p id in the record array. @return -1 if absent. */
+    long long findStudent(int id) const;
+
+    /** @brief Position of faculty @p id in the record array. @return -1 if absent. */
+    long long findFaculty(int id) const;
+
+    /** @brief Position of the first student whose id is at least @p id (studentCount() if none). */
+    uint64_t studentLowerBound(int id) const;
+
+    /** @brief Position of the first faculty member whose id is at least @p id. */
+    uint64_t facultyLowerBound(int id) const;
+
+    /** @brief Materialize the student record at @p index. @return False if corrupt. */
+    bool studentAt(uint64_t index, Student &out) const;
+
+    /** @brief Materialize the faculty record at @p index. @return False if corrupt. */
+    bool facultyAt(uint64_t index, Faculty &out) const;
+
+private:
+    int m_fd;
+    const char *m_data;
+    size_t m_size;
+    const SnapshotHeader *m_header;
+    uint64_t m_logOffset;
+    const SnapshotStudent *m_students;
+    const SnapshotFaculty *m_faculty;
+    const int32_t *m_advisees;
+    const SnapshotDictEntry *m_dict;
+    const char *m_heap;
+
+    bool heapString(uint64_t offset, uint32_t length, std::string &out) const;
+    bool dictString(uint32_t code, std::string &out) const;
+
+    SnapshotReader(const SnapshotReader &);
+    SnapshotReader &operator=(const SnapshotReader &);
+};
+
+#endif
@@ -0,0 +1,531 @@
+#include "TableExport.h"
+#include "DBsystem.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const int STUDENT_WIDTHS[RecordMapper::STUDENT_FIELDS] = {10, 28, 10, 24, 5, 10};
+static const int FACULTY_WIDTHS[RecordMapper::FACULTY_FIELDS] = {10, 28, 20, 24, 40};
+
+bool parseExportFormat(const std::string &name, ExportFormat &format)
+{
+    if (name == "csv")
+        format = EXPORT_CSV;
+    else if (name == "json" || name == "jsonl")
+        format = EXPORT_JSON;
+    else if (name == "fixed")
+        format = EXPORT_FIXED;
+    else
+        return false;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// TableWriter
+// ---------------------------------------------------------------------------
+
+TableWriter::TableWriter(OutputBuffer &out, ExportFormat format, const std::vector<CsvColumn> &columns,
+                         bool faculty, char delimiter)
+    : m_out(out), m_format(format), m_columns(columns), m_csv(out, delimiter), m_col(0)
+{
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        int width = columns[i].width;
+        if (width <= 0)
+        {
+            width = faculty ? FACULTY_WIDTHS[columns[i].field] : STUDENT_WIDTHS[columns[i].field];
+        }
+        m_widths.push_back(width);
+    }
+}
+
+void TableWriter::header()
+{
+    if (m_format == EXPORT_JSON)
+    {
+        return;
+    }
+    for (size_t i = 0; i < m_columns.size(); ++i)
+    {
+        field(m_columns[i].header);
+    }
+    endRow();
+}
+
+void TableWriter::beginField()
+{
+    if (m_format == EXPORT_JSON)
+    {
+        m_out.put(m_col == 0 ? '{' : ',');
+        jsonString(m_columns[m_col].header);
+        m_out.put(':');
+    }
+    else if (m_format == EXPORT_FIXED && m_col > 0)
+    {
+        m_out.put(' ');
+    }
+}
+
+// Pads the cell that began at byte offset start out to the column width
+void TableWriter::pad(long long start)
+{
+    long long used = m_out.bytesWritten() - start;
+    for (long long i = used; i < m_widths[m_col]; ++i)
+    {
+        m_out.put(' ');
+    }
+}
+
+void TableWriter::jsonString(const std::string &s)
+{
+    static const char HEX[] = "0123456789abcdef";
+    m_out.put('"');
+    size_t run = 0;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        m_out.append(s.data() + run, i - run);
+        run = i + 1;
+        m_out.put('\\');
+        switch (c)
+        {
+        case '"': m_out.put('"'); break;
+        case '\\': m_out.put('\\'); break;
+        case '\n': m_out.put('n'); break;
+        case '\r': m_out.put('r'); break;
+        case '\t': m_out.put('t'); break;
+        default:
+            m_out.append("u00", 3);
+            m_out.put(HEX[c >> 4]);
+            m_out.put(HEX[c & 0xF]);
+        }
+    }
+    m_out.append(s.data() + run, s.size() - run);
+    m_out.put('"');
+}
+
+void TableWriter::field(const std::string &s)
+{
+    switch (m_format)
+    {
+    case EXPORT_CSV:
+        m_csv.field(s);
+        break;
+    case EXPORT_JSON:
+        beginField();
+        jsonString(s);
+        break;
+    case EXPORT_FIXED:
+    {
+        beginField();
+        long long start = m_out.bytesWritten();
+        size_t width = size_t(m_widths[m_col]);
+        m_out.append(s.data(), s.size() < width ? s.size() : width);
+        pad(start);
+        break;
+    }
+    }
+    ++m_col;
+}
+
+void TableWriter::field(long long value)
+{
+    if (m_format == EXPORT_CSV)
+    {
+        m_csv.field(value);
+        ++m_col;
+        return;
+    }
+    beginField();
+    if (m_format == EXPORT_JSON)
+    {
+        m_out.appendInt(value);
+    }
+    else
+    {
+        char digits[24];
+        std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+        for (long long i = r.ptr - digits; i < m_widths[m_col]; ++i)
+        {
+            m_out.put(' ');
+        }
+        m_out.append(digits, size_t(r.ptr - digits));
+    }
+    ++m_col;
+}
+
+void TableWriter::field(double value)
+{
+    if (m_format == EXPORT_CSV)
+    {
+        m_csv.field(value);
+        ++m_col;
+        return;
+    }
+    beginField();
+    if (m_format == EXPORT_JSON)
+    {
+        if (std::isfinite(value))
+            m_out.appendDouble(value);
+        else
+            m_out.append("null", 4);
+    }
+    else
+    {
+        char digits[32];
+        std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, 2);
+        for (long long i = r.ptr - digits; i < m_widths[m_col]; ++i)
+        {
+            m_out.put(' ');
+        }
+        m_out.append(digits, size_t(r.ptr - digits));
+    }
+    ++m_col;
+}
+
+// Advisee lists: a JSON array, otherwise ids joined with ';'
+void TableWriter::field(const std::vector<int> &ids)
+{
+    if (m_format == EXPORT_JSON)
+    {
+        beginField();
+        m_out.put('[');
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            if (i > 0)
+            {
+                m_out.put(',');
+            }
+            m_out.appendInt(ids[i]);
+        }
+        m_out.put(']');
+        ++m_col;
+        return;
+    }
+    m_scratch.clear();
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i > 0)
+        {
+            m_scratch += ';';
+        }
+        char digits[16];
+        std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), ids[i]);
+        m_scratch.append(digits, size_t(r.ptr - digits));
+    }
+    field(m_scratch);
+}
+
+void TableWriter::endRow()
+{
+    if (m_format == EXPORT_CSV)
+    {
+        m_csv.endRow();
+    }
+    else
+    {
+        if (m_format == EXPORT_JSON)
+        {
+            m_out.append(m_col == 0 ? "{}" : "}", m_col == 0 ? 2 : 1);
+        }
+        m_out.put('\n');
+    }
+    m_col = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Table exports
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    struct StudentRowVisitor
+    {
+        TableWriter &w;
+        const std::vector<CsvColumn> &columns;
+        long long rows;
+
+        void operator()(const Student &s)
+        {
+            for (size_t i = 0; i < columns.size(); ++i)
+            {
+                switch (columns[i].field)
+                {
+                case RecordMapper::S_ID: w.field((long long)s.getID()); break;
+                case RecordMapper::S_NAME: w.field(s.getName()); break;
+                case RecordMapper::S_LEVEL: w.field(s.getLevel()); break;
+                case RecordMapper::S_MAJOR: w.field(s.getMajor()); break;
+                case RecordMapper::S_GPA: w.field(s.getGPA()); break;
+                case RecordMapper::S_ADVISOR: w.field((long long)s.getAdvisor()); break;
+                }
+            }
+            w.endRow();
+            ++rows;
+        }
+    };
+
+    struct FacultyRowVisitor
+    {
+        TableWriter &w;
+        const std::vector<CsvColumn> &columns;
+        long long rows;
+        std::vector<int> advisees;
+
+        void operator()(const Faculty &f)
+        {
+            for (size_t i = 0; i < columns.size(); ++i)
+            {
+                switch (columns[i].field)
+                {
+                case RecordMapper::F_ID: w.field((long long)f.getID()); break;
+                case RecordMapper::F_NAME: w.field(f.getName()); break;
+                case RecordMapper::F_LEVEL: w.field(f.getLevel()); break;
+                case RecordMapper::F_DEPARTMENT: w.field(f.getDepartment()); break;
+                case RecordMapper::F_ADVISEES:
+                    advisees.clear();
+                    for (int a = 0; a < f.getAdviseeCount(); ++a)
+                    {
+                        advisees.push_back(f.getAdvisee(a));
+                    }
+                    w.field(advisees);
+                    break;
+                }
+            }
+            w.endRow();
+            ++rows;
+        }
+    };
+}
+
+long long exportStudents(DBsystem &db, OutputBuffer &out, const std::vector<CsvColumn> &columns,
+                         ExportFormat format, char delimiter)
+{
+    TableWriter w(out, format, columns, false, delimiter);
+    w.header();
+    StudentRowVisitor visit = {w, columns, 0};
+    db.forEachStudent(visit);
+    out.flush();
+    return visit.rows;
+}
+
+long long exportFaculty(DBsystem &db, OutputBuffer &out, const std::vector<CsvColumn> &columns,
+                        ExportFormat format, char delimiter)
+{
+    TableWriter w(out, format, columns, true, delimiter);
+    w.header();
+    FacultyRowVisitor visit = {w, columns, 0, std::vector<int>()};
+    db.forEachFaculty(visit);
+    out.flush();
+    return visit.rows;
+}
+
+// ---------------------------------------------------------------------------
+// Parallel export
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    std::string partPath(const std::string &path, int part)
+    {
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), ".part-%04d", part);
+        return path + suffix;
+    }
+
+    // Appends the file at src to out, in the kernel where possible
+    bool appendFile(int out, const std::string &src)
+    {
+        int in = ::open(src.c_str(), O_RDONLY);
+        if (in < 0)
+        {
+            return false;
+        }
+        bool ok = true;
+        bool fallback = false;
+        while (!fallback)
+        {
+            ssize_t n = ::copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+            if (n == 0)
+            {
+                break;
+            }
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                fallback = errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP;
+                ok = fallback;
+                break;
+            }
+        }
+        std::vector<char> buf(fallback ? (1 << 20) : 0);
+        while (fallback && ok)
+        {
+            ssize_t n = ::read(in, &buf[0], buf.size());
+            if (n <= 0)
+            {
+                ok = n == 0;
+                break;
+            }
+            for (ssize_t done = 0; ok && done < n;)
+            {
+                ssize_t w = ::write(out, &buf[size_t(done)], size_t(n - done));
+                ok = w > 0 || (w < 0 && errno == EINTR);
+                done += w > 0 ? w : 0;
+            }
+        }
+        ::close(in);
+        return ok;
+    }
+
+    // Shared state of one parallel export; workers claim ranges in order
+    struct ExportJob
+    {
+        DBsystem &db;
+        bool faculty;
+        std::string path;
+        const std::vector<CsvColumn> &columns;
+        ExportFormat format;
+        char delimiter;
+        bool shards;
+        std::vector<int> splits;
+        std::atomic<int> next;
+        std::atomic<long long> rows;
+        std::atomic<long long> bytes;
+        std::atomic<bool> failed;
+
+        ExportJob(DBsystem &d, bool f, const std::string &p, const std::vector<CsvColumn> &c, ExportFormat fmt,
+                  char delim, bool s)
+            : db(d), faculty(f), path(p), columns(c), format(fmt), delimiter(delim), shards(s), next(0), rows(0),
+              bytes(0), failed(false) {}
+
+        int parts() const { return int(splits.size()) + 1; }
+
+        void exportPart(int part)
+        {
+            int fd = ::open(partPath(path, part).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                failed = true;
+                return;
+            }
+            const int *lo = part > 0 ? &splits[size_t(part - 1)] : NULL;
+            const int *hi = part < int(splits.size()) ? &splits[size_t(part)] : NULL;
+            {
+                OutputBuffer out(fd);
+                TableWriter w(out, format, columns, faculty, delimiter);
+                if (part == 0 || shards)
+                {
+                    w.header();
+                }
+                long long count;
+                if (faculty)
+                {
+                    FacultyRowVisitor visit = {w, columns, 0, std::vector<int>()};
+                    db.forEachFacultyInRange(lo, hi, visit);
+                    count = visit.rows;
+                }
+                else
+                {
+                    StudentRowVisitor visit = {w, columns, 0};
+                    db.forEachStudentInRange(lo, hi, visit);
+                    count = visit.rows;
+                }
+                if (!out.flush())
+                {
+                    failed = true;
+                }
+                rows += count;
+                bytes += out.bytesWritten();
+            }
+            ::close(fd);
+        }
+
+        void work()
+        {
+            for (int part = next++; part < parts() && !failed; part = next++)
+            {
+                exportPart(part);
+            }
+        }
+    };
+}
+
+bool exportTableParallel(DBsystem &db, bool faculty, const std::string &path, const std::vector<CsvColumn> &columns,
+                         ExportFormat format, const ParallelExportOptions &options, ParallelExportStats &stats,
+                         std::string &error)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    TaskScheduler &scheduler = TaskScheduler::shared();
+    int threads = options.threads > 0 ? std::min(options.threads, scheduler.concurrency()) : scheduler.concurrency();
+    // Shards are a fixed count; otherwise over-partition so a worker that
+    // is descheduled does not hold up the rest
+    int parts = options.shards > 0 ? options.shards : threads * 4;
+
+    ExportJob job(db, faculty, path, columns, format, options.delimiter, options.shards > 0);
+    if (faculty)
+        db.facultySplitKeys(parts, job.splits);
+    else
+        db.studentSplitKeys(parts, job.splits);
+    // Shards keep their requested count even if the table is too small to split
+    while (options.shards > 0 && job.parts() < options.shards)
+    {
+        job.splits.push_back(job.splits.empty() ? 0 : job.splits.back());
+    }
+
+    // Each task claims parts until none are left; this thread is one of them
+    TaskGroup group(scheduler);
+    for (int t = 1; t < std::min(threads, job.parts()); ++t)
+    {
+        group.run([&job]() { job.work(); });
+    }
+    job.work();
+    group.wait();
+
+    bool ok = !job.failed;
+    if (ok && options.shards <= 0)
+    {
+        int out = (path == "-") ? 1 : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok = out >= 0;
+        for (int part = 0; ok && part < job.parts(); ++part)
+        {
+            ok = appendFile(out, partPath(path, part));
+        }
+        if (out > 1)
+        {
+            ::close(out);
+        }
+    }
+    if (!ok)
+    {
+        error = "cannot write " + path + ": " + std::strerror(errno);
+    }
+    if (!ok || options.shards <= 0)
+    {
+        for (int part = 0; part < job.parts(); ++part)
+        {
+            ::unlink(partPath(path, part).c_str());
+        }
+    }
+
+    stats.threads = threads;
+    stats.parts = job.parts();
+    stats.rows = job.rows;
+    stats.bytes = job.bytes;
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return ok;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file TableExport.h
+ * @brief Bulk export of the Student and Faculty tables as CSV, JSON Lines or fixed-width text.
+ *
+ * ARCHITECTURE:
+ *   DBsystem::forEachStudent / forEachFaculty (in-order tree walk)
+ *       |
+ *       v
+ *   TableWriter (You are here) - one row per record, fields in column order
+ *       |  numbers via std::to_chars, no iostreams, no per-row flush
+ *       v
+ *   OutputBuffer - 1 MiB user-space buffer, one write per fill (queued
+ *       |          on an io_uring for files, write(2) for pipes)
+ *       v
+ *   file descriptor (file, pipe or stdout)
+ *
+ * PARALLEL EXPORT:
+ *   split ids at evenly spaced ranks (from subtree counts) cut the table
+ *   into 4 ranges per thread; tasks on the shared TaskScheduler claim ranges
+ *   in order, walk them with visitRange and each writes its own part file.
+ *   Parts are kept as shards (each with its own header) or concatenated in
+ *   key order with copy_file_range.
+ *
+ * FORMATS:
+ *   EXPORT_CSV   - header row, RFC 4180 quoting (see CsvWriter)
+ *   EXPORT_JSON  - JSON Lines, one object per record keyed by the column
+ *                  headers; loads back with --ingest
+ *   EXPORT_FIXED - header row, columns padded/truncated to their widths and
+ *                  separated by one space; numbers right-aligned
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef TABLE_EXPORT_H
+#define TABLE_EXPORT_H
+
+#include <string>
+#include <vector>
+#include "CsvIO.h"
+#include "OutputBuffer.h"
+
+class DBsystem;
+
+enum ExportFormat
+{
+    EXPORT_CSV,
+    EXPORT_JSON,
+    EXPORT_FIXED
+};
+
+/** @brief Parse "csv", "json" or "fixed". */
+bool parseExportFormat(const std::string &name, ExportFormat &format);
+
+/**
+ * @class TableWriter
+ * @brief Formats rows field by field into an OutputBuffer.
+ */
+class TableWriter
+{
+public:
+    /**
+     * @param faculty Selects default fixed widths for the faculty fields.
+     * @param delimiter CSV field separator.
+     */
+    TableWriter(OutputBuffer &out, ExportFormat format, const std::vector<CsvColumn> &columns, bool faculty,
+                char delimiter = ',');
+
+    /** @brief Write the header row (nothing for JSON Lines). */
+    void header();
+
+    void field(const std::string &s);
+    void field(long long value);
+    void field(double value);
+    void field(const std::vector<int> &ids);
+    void endRow();
+
+private:
+    OutputBuffer &m_out;
+    ExportFormat m_format;
+    const std::vector<CsvColumn> &m_columns;
+    std::vector<int> m_widths;
+    CsvWriter m_csv;
+    size_t m_col;
+    std::string m_scratch;
+
+    void beginField();
+    void pad(long long start);
+    void jsonString(const std::string &s);
+};
+
+/** @brief Write all students in key order. @return Rows written. */
+long long exportStudents(DBsystem &db, OutputBuffer &out, const std::vector<CsvColumn> &columns,
+                         ExportFormat format, char delimiter = ',');
+
+/** @brief Write all faculty in key order. @return Rows written. */
+long long exportFaculty(DBsystem &db, OutputBuffer &out, const std::vector<CsvColumn> &columns,
+                        ExportFormat format, char delimiter = ',');
+
+/** @brief How a parallel export was split and how it went. */
+struct ParallelExportStats
+{
+    int threads;
+    int parts;
+    long long rows;
+    long long bytes;
+    double seconds;
+
+    ParallelExportStats() : threads(0), parts(0), rows(0), bytes(0), seconds(0.0) {}
+};
+
+/** @brief Options for exportTableParallel. */
+struct ParallelExportOptions
+{
+    int threads;        ///< At most this many parts at once; 0 = the scheduler's concurrency
+    int shards;         ///< > 0: leave this many files path.part-NNNN instead of one file
+    char delimiter;
+
+    ParallelExportOptions() : threads(0), shards(0), delimiter(',') {}
+};
+
+/**
+ * @brief Export a whole table with several threads by key range. Must not
+ *        run concurrently with writers.
+ * @param faculty False for students.
+ * @param error Set on failure.
+ */
+bool exportTableParallel(DBsystem &db, bool faculty, const std::string &path, const std::vector<CsvColumn> &columns,
+                         ExportFormat format, const ParallelExportOptions &options, ParallelExportStats &stats,
+                         std::string &error);
+
+#endif
@@ -0,0 +1,367 @@
+#include "TaskScheduler.h"
+#include <chrono>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using detail::PoolTask;
+
+namespace
+{
+    const int SPINS = 64;   // Empty looks (with a yield) before a thread sleeps
+
+    thread_local const TaskScheduler *t_scheduler = NULL;   // Scheduler this thread works for
+    thread_local int t_worker = -1;
+
+    // Chase-Lev deque, with the orderings of Le et al., "Correct and
+    // Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013). Only
+    // the owner pushes and pops at the bottom; any thread steals at the top.
+    class WorkDeque
+    {
+    public:
+        WorkDeque() : m_top(0), m_bottom(0), m_array(new Array(256)) {}
+
+        ~WorkDeque()
+        {
+            delete m_array.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < m_retired.size(); ++i)
+            {
+                delete m_retired[i];
+            }
+        }
+
+        void push(PoolTask *task)
+        {
+            long long b = m_bottom.load(std::memory_order_relaxed);
+            long long t = m_top.load(std::memory_order_acquire);
+            Array *a = m_array.load(std::memory_order_relaxed);
+            if (b - t > a->capacity - 1)
+            {
+                a = grow(a, t, b);
+            }
+            a->put(b, task);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // Newest first
+        PoolTask *pop()
+        {
+            long long b = m_bottom.load(std::memory_order_relaxed) - 1;
+            Array *a = m_array.load(std::memory_order_relaxed);
+            m_bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            long long t = m_top.load(std::memory_order_relaxed);
+            if (t > b)
+            {
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return NULL;
+            }
+            PoolTask *task = a->get(b);
+            if (t == b)
+            {
+                // The last task: thieves may be after it too
+                if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    task = NULL;
+                }
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        // Oldest first; NULL if empty or another thread took it first
+        PoolTask *steal()
+        {
+            long long t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            long long b = m_bottom.load(std::memory_order_acquire);
+            if (t >= b)
+            {
+                return NULL;
+            }
+            Array *a = m_array.load(std::memory_order_acquire);
+            PoolTask *task = a->get(t);
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return NULL;
+            }
+            return task;
+        }
+
+    private:
+        struct Array
+        {
+            long long capacity;     // Power of two
+            std::atomic<PoolTask *> *slots;
+
+            explicit Array(long long c) : capacity(c), slots(new std::atomic<PoolTask *>[c]) {}
+            ~Array() { delete[] slots; }
+
+            PoolTask *get(long long i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void put(long long i, PoolTask *task) { slots[i & (capacity - 1)].store(task, std::memory_order_relaxed); }
+
+        private:
+            Array(const Array &);
+            Array &operator=(const Array &);
+        };
+
+        alignas(64) std::atomic<long long> m_top;
+        alignas(64) std::atomic<long long> m_bottom;
+        std::atomic<Array *> m_array;
+        std::vector<Array *> m_retired;     // Outgrown arrays; a thief may still be reading one
+
+        Array *grow(Array *a, long long t, long long b)
+        {
+            Array *bigger = new Array(a->capacity * 2);
+            for (long long i = t; i < b; ++i)
+            {
+                bigger->put(i, a->get(i));
+            }
+            m_retired.push_back(a);
+            m_array.store(bigger, std::memory_order_release);
+            return bigger;
+        }
+
+        WorkDeque(const WorkDeque &);
+        WorkDeque &operator=(const WorkDeque &);
+    };
+}
+
+struct TaskScheduler::Worker
+{
+    WorkDeque deque;
+    std::thread thread;
+};
+
+int TaskScheduler::s_sharedThreads = 0;
+TaskScheduler::Pinning TaskScheduler::s_sharedPinning = TaskScheduler::PIN_NONE;
+std::atomic<bool> TaskScheduler::s_sharedStarted(false);
+
+TaskScheduler::TaskScheduler(int threads, Pinning pinning)
+    : m_pinning(pinning), m_queued(0), m_sleeping(0), m_stop(false)
+{
+    if (threads <= 0)
+    {
+        threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i + 1 < threads; ++i)
+    {
+        m_workers.push_back(new Worker());
+    }
+    // Started once every deque exists, as workers steal from each other
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        m_workers[i]->thread = std::thread(&TaskScheduler::workerLoop, this, int(i));
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        m_workers[i]->thread.join();
+        delete m_workers[i];
+    }
+}
+
+TaskScheduler &TaskScheduler::shared()
+{
+    static TaskScheduler scheduler(s_sharedThreads, s_sharedPinning);
+    s_sharedStarted.store(true, std::memory_order_relaxed);
+    return scheduler;
+}
+
+bool TaskScheduler::configureShared(int threads, Pinning pinning)
+{
+    if (s_sharedStarted.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    s_sharedThreads = threads;
+    s_sharedPinning = pinning;
+    return true;
+}
+
+int TaskScheduler::selfIndex() const
+{
+    return t_scheduler == this ? t_worker : -1;
+}
+
+bool TaskScheduler::helpOnce()
+{
+    PoolTask *task = take(selfIndex());
+    if (task == NULL)
+    {
+        return false;
+    }
+    execute(task);
+    return true;
+}
+
+// The counter goes up after the task is visible and is read by a worker
+// about to sleep after it announced itself, so one of the two sees the other
+void TaskScheduler::submit(PoolTask *task)
+{
+    int self = selfIndex();
+    if (self >= 0)
+    {
+        m_workers[size_t(self)]->deque.push(task);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> guard(m_injectMutex);
+        m_injected.push_back(task);
+    }
+    m_queued.fetch_add(1);
+    if (m_sleeping.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_sleepMutex);
+        }
+        m_wake.notify_one();
+    }
+}
+
+// Own deque first, then the injection queue, then the other workers
+PoolTask *TaskScheduler::take(int self)
+{
+    if (m_queued.load(std::memory_order_acquire) == 0)
+    {
+        return NULL;
+    }
+    PoolTask *task = NULL;
+    if (self >= 0)
+    {
+        task = m_workers[size_t(self)]->deque.pop();
+    }
+    if (task == NULL)
+    {
+        std::lock_guard<std::mutex> guard(m_injectMutex);
+        if (!m_injected.empty())
+        {
+            task = m_injected.front();
+            m_injected.pop_front();
+        }
+    }
+    size_t n = m_workers.size();
+    size_t start = self >= 0 ? size_t(self) + 1 : 0;
+    for (size_t k = 0; task == NULL && k < n; ++k)
+    {
+        size_t victim = (start + k) % n;
+        if (int(victim) != self)
+        {
+            task = m_workers[victim]->deque.steal();
+        }
+    }
+    if (task != NULL)
+    {
+        m_queued.fetch_sub(1);
+    }
+    return task;
+}
+
+void TaskScheduler::execute(PoolTask *task)
+{
+    TaskGroup *group = task->group;
+    task->run();
+    delete task;
+    group->finished();
+}
+
+void TaskScheduler::workerLoop(int index)
+{
+    t_scheduler = this;
+    t_worker = index;
+#ifdef __linux__
+    if (m_pinning == PIN_CORES)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET((index + 1) % int(std::max(1u, std::thread::hardware_concurrency())), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
+    int idle = 0;
+    while (true)
+    {
+        PoolTask *task = take(index);
+        if (task != NULL)
+        {
+            execute(task);
+            idle = 0;
+            continue;
+        }
+        if (++idle < SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleeping.fetch_add(1);
+        while (!m_stop && m_queued.load() == 0)
+        {
+            m_wake.wait(lock);
+        }
+        m_sleeping.fetch_sub(1);
+        if (m_stop)
+        {
+            return;
+        }
+        idle = 0;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TaskGroup
+// ---------------------------------------------------------------------------
+
+TaskGroup::TaskGroup(TaskScheduler &scheduler) : m_scheduler(scheduler), m_pending(0)
+{
+
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+void TaskGroup::wait()
+{
+    int idle = 0;
+    while (m_pending.load(std::memory_order_acquire) > 0)
+    {
+        if (m_scheduler.helpOnce())
+        {
+            idle = 0;
+            continue;
+        }
+        if (++idle < SPINS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        // What is left runs elsewhere; look for new work now and then
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait_for(lock, std::chrono::milliseconds(1),
+                        [this]() { return m_pending.load(std::memory_order_acquire) == 0; });
+    }
+    // The last task may still be inside finished()
+    std::lock_guard<std::mutex> guard(m_mutex);
+}
+
+void TaskGroup::finished()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        m_done.notify_all();
+    }
+}
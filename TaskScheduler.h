@@ -0,0 +1,259 @@
+/**
+ * @file TaskScheduler.h
+ * @brief Work-stealing thread pool shared by the parallel paths: task
+ *        groups, parallelFor, parallelReduce and parallelStableSort.
+ *
+ * ARCHITECTURE:
+ *   exportTableParallel  profileJson  hashJoin      upsertStudents  PersistentBST::build
+ *   (file parts)         (batches)    (partitions)  (sort)          (chunks)
+ *       |                    |            |             |               |
+ *       +--------------------+-----+------+-------------+---------------+
+ *                                  v
+ *   TaskScheduler::shared() (You are here)
+ *       |  one worker per core less one: the thread waiting on a group
+ *       |  runs tasks as well, so no more threads are busy than cores
+ *       v
+ *   per-worker deques (Chase-Lev): the owner pushes and pops the newest
+ *   task at the bottom, still warm in its cache; idle workers steal the
+ *   oldest at the top, which for a split range is the largest piece left
+ *
+ * SUBMITTING: a task started on a worker goes on that worker's deque; one
+ * started from any other thread goes on a shared injection queue. Workers
+ * that find nothing to run or steal sleep until the next submission.
+ *
+ * WAITING: TaskGroup::wait() runs queued tasks until its own are done, so
+ * a task may start and wait on a nested group without tying up a thread.
+ * parallelFor hands off the upper half of its range until one grain is
+ * left, and only thieves split further what they take. As a waiting
+ * thread may run any queued task, tasks take no locks a waiter could hold
+ * (PersistentBST::build waits under DBsystem's write lock).
+ *
+ * PINNING: configureShared(threads, PIN_CORES) before first use pins
+ * worker i to core i + 1, leaving core 0 to the main thread.
+ *
+ * Threads that block for a living (ShardedDBsystem shards, the log and
+ * checkpoint writers, CoScheduler helpers, DBServer) keep their own
+ * threads: a blocked task would hold a worker hostage.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class TaskGroup;
+
+namespace detail
+{
+    // A queued closure and the group that waits for it
+    struct PoolTask
+    {
+        TaskGroup *group;
+
+        explicit PoolTask(TaskGroup *g) : group(g) {}
+        virtual ~PoolTask() {}
+        virtual void run() = 0;
+    };
+
+    template <typename F>
+    struct FnTask : PoolTask
+    {
+        F fn;
+
+        FnTask(TaskGroup *g, const F &f) : PoolTask(g), fn(f) {}
+        void run() { fn(); }
+    };
+}
+
+/**
+ * @class TaskScheduler
+ * @brief A fixed set of workers running tasks from work-stealing deques;
+ *        see file comment.
+ */
+class TaskScheduler
+{
+public:
+    enum Pinning
+    {
+        PIN_NONE,
+        PIN_CORES   ///< Worker i runs on core i + 1 only
+    };
+
+    /**
+     * @param threads Tasks run at once, counting the thread that waits;
+     *        0 = one per core. 1 runs everything on the waiting thread.
+     */
+    explicit TaskScheduler(int threads = 0, Pinning pinning = PIN_NONE);
+
+    /** @brief Stops the workers. Every group must have been waited for. */
+    ~TaskScheduler();
+
+    /** @brief The process-wide scheduler, started on first use. */
+    static TaskScheduler &shared();
+
+    /** @brief Size and pinning of shared(). @return False once it has started. */
+    static bool configureShared(int threads, Pinning pinning);
+
+    /** @brief Workers plus the waiting thread. */
+    int concurrency() const { return int(m_workers.size()) + 1; }
+
+    /** @brief Run one queued task on this thread. @return False if none was available. */
+    bool helpOnce();
+
+    /**
+     * @brief Call body(lo, hi) on disjoint ranges covering [begin, end),
+     *        each at most @p grain long unless the scheduler has no workers.
+     */
+    template <typename F>
+    void parallelFor(long long begin, long long end, long long grain, const F &body);
+
+    /**
+     * @brief combine() of map(lo, hi) over ranges of [begin, end) as in
+     *        parallelFor; ranges are combined left to right, so combine
+     *        only needs to be associative. @return identity if empty.
+     */
+    template <typename T, typename Map, typename Combine>
+    T parallelReduce(long long begin, long long end, long long grain, const T &identity, const Map &map,
+                     const Combine &combine);
+
+    /** @brief std::stable_sort, with runs of up to @p grain sorted and merged in parallel. */
+    template <typename It>
+    void parallelStableSort(It first, It last, long long grain = 1 << 14);
+
+private:
+    struct Worker;
+    friend class TaskGroup;
+
+    std::vector<Worker *> m_workers;
+    Pinning m_pinning;
+    std::mutex m_injectMutex;
+    std::deque<detail::PoolTask *> m_injected;  ///< Tasks from threads that are not workers
+    std::atomic<long long> m_queued;            ///< Submitted and not yet taken
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<int> m_sleeping;
+    bool m_stop;
+
+    static int s_sharedThreads;
+    static Pinning s_sharedPinning;
+    static std::atomic<bool> s_sharedStarted;
+
+    void submit(detail::PoolTask *task);
+    detail::PoolTask *take(int self);
+    void execute(detail::PoolTask *task);
+    int selfIndex() const;
+    void workerLoop(int index);
+
+    TaskScheduler(const TaskScheduler &);
+    TaskScheduler &operator=(const TaskScheduler &);
+};
+
+/**
+ * @class TaskGroup
+ * @brief Tasks started together and waited for together.
+ */
+class TaskGroup
+{
+public:
+    explicit TaskGroup(TaskScheduler &scheduler = TaskScheduler::shared());
+
+    /** @brief Waits for tasks still running. */
+    ~TaskGroup();
+
+    /** @brief Queue fn() (copied) to run on any thread of the scheduler. */
+    template <typename F>
+    void run(const F &fn)
+    {
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        m_scheduler.submit(new detail::FnTask<F>(this, fn));
+    }
+
+    /** @brief Run queued tasks until every task of this group has finished. */
+    void wait();
+
+private:
+    friend class TaskScheduler;
+
+    TaskScheduler &m_scheduler;
+    std::atomic<long long> m_pending;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+
+    void finished();
+
+    TaskGroup(const TaskGroup &);
+    TaskGroup &operator=(const TaskGroup &);
+};
+
+template <typename F>
+void TaskScheduler::parallelFor(long long begin, long long end, long long grain, const F &body)
+{
+    grain = std::max(grain, 1LL);
+    if (end - begin <= grain || m_workers.empty())
+    {
+        if (begin < end)
+        {
+            body(begin, end);
+        }
+        return;
+    }
+    TaskGroup group(*this);
+    while (end - begin > grain)
+    {
+        long long mid = begin + (end - begin) / 2;
+        group.run([this, mid, end, grain, &body]() { parallelFor(mid, end, grain, body); });
+        end = mid;
+    }
+    body(begin, end);
+    group.wait();
+}
+
+template <typename T, typename Map, typename Combine>
+T TaskScheduler::parallelReduce(long long begin, long long end, long long grain, const T &identity,
+                                const Map &map, const Combine &combine)
+{
+    if (begin >= end)
+    {
+        return identity;
+    }
+    if (end - begin <= std::max(grain, 1LL) || m_workers.empty())
+    {
+        return map(begin, end);
+    }
+    long long mid = begin + (end - begin) / 2;
+    T right = identity;
+    TaskGroup group(*this);
+    group.run([&]() { right = parallelReduce(mid, end, grain, identity, map, combine); });
+    T left = parallelReduce(begin, mid, grain, identity, map, combine);
+    group.wait();
+    return combine(left, right);
+}
+
+// Merge sort over the halves; the merges at the top levels run on one
+// thread each, which bounds the speedup but keeps the sort stable
+template <typename It>
+void TaskScheduler::parallelStableSort(It first, It last, long long grain)
+{
+    long long n = (long long)(last - first);
+    if (n <= std::max(grain, 2LL) || m_workers.empty())
+    {
+        std::stable_sort(first, last);
+        return;
+    }
+    It mid = first + n / 2;
+    TaskGroup group(*this);
+    group.run([this, first, mid, grain]() { parallelStableSort(first, mid, grain); });
+    parallelStableSort(mid, last, grain);
+    group.wait();
+    std::inplace_merge(first, mid, last);
+}
+
+#endif
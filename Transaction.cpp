@@ -0,0 +1,104 @@
+#include "Transaction.h"
+
+Transaction::Transaction() : m_db(NULL), m_startSeq(0), m_active(false)
+{
+
+}
+
+// An abandoned transaction would otherwise count as active forever, and
+// the database would keep every write stamp for it
+Transaction::~Transaction()
+{
+    if (m_active)
+    {
+        m_db->abort(*this);
+    }
+}
+
+const Student *Transaction::findStudent(int studentId) const
+{
+    std::map<int, Write<Student> >::const_iterator it = m_students.find(studentId);
+    if (it != m_students.end())
+    {
+        return it->second.deleted ? NULL : &it->second.row;
+    }
+    return m_snapshot.findStudent(studentId);
+}
+
+const Faculty *Transaction::findFaculty(int facultyId) const
+{
+    std::map<int, Write<Faculty> >::const_iterator it = m_faculty.find(facultyId);
+    if (it != m_faculty.end())
+    {
+        return it->second.deleted ? NULL : &it->second.row;
+    }
+    return m_snapshot.findFaculty(facultyId);
+}
+
+void Transaction::putStudent(const Student &student)
+{
+    Write<Student> &w = m_students[student.getID()];
+    w.row = student;
+    w.deleted = false;
+}
+
+void Transaction::putFaculty(const Faculty &faculty)
+{
+    Write<Faculty> &w = m_faculty[faculty.getID()];
+    w.row = faculty;
+    w.deleted = false;
+}
+
+void Transaction::deleteStudent(int studentId)
+{
+    Write<Student> &w = m_students[studentId];
+    w.row = Student(studentId, "", "", "", 0.0, 0);
+    w.deleted = true;
+}
+
+void Transaction::deleteFaculty(int facultyId)
+{
+    Write<Faculty> &w = m_faculty[facultyId];
+    w.row = Faculty(facultyId, "", "", "");
+    w.deleted = true;
+}
+
+bool Transaction::changeAdvisor(int studentId, int facultyId, std::string &error)
+{
+    const Student *current = findStudent(studentId);
+    if (current == NULL)
+    {
+        error = "no student " + std::to_string(studentId);
+        return false;
+    }
+    Student student = *current;
+    if (student.getAdvisor() == facultyId)
+    {
+        return true;
+    }
+    const Faculty *oldAdvisor = findFaculty(student.getAdvisor());
+    if (oldAdvisor != NULL)
+    {
+        Faculty f = *oldAdvisor;
+        f.removeAdvisee(studentId);
+        putFaculty(f);
+    }
+    const Faculty *newAdvisor = findFaculty(facultyId);
+    if (newAdvisor != NULL)
+    {
+        Faculty f = *newAdvisor;
+        f.addAdvisee(studentId);
+        putFaculty(f);
+    }
+    student.setAdvisor(facultyId);
+    putStudent(student);
+    return true;
+}
+
+void Transaction::reset()
+{
+    m_snapshot = DBsnapshot();
+    m_students.clear();
+    m_faculty.clear();
+    m_active = false;
+}
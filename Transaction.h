@@ -0,0 +1,99 @@
+/**
+ * @file Transaction.h
+ * @brief Multi-record changes to students and faculty under snapshot
+ *        isolation: all of them become visible at once, or none do.
+ *
+ * ARCHITECTURE:
+ *   caller: db.begin(txn); txn.changeAdvisor(...); db.commit(txn, error)
+ *       |
+ *       v
+ *   Transaction (You are here)
+ *       |  reads: its own buffered writes, then the DBsnapshot pinned at
+ *       |  begin. Writes are buffered per key, last one wins
+ *       v
+ *   DBsystem::commit - under the write lock: first-committer-wins check of
+ *       every written key, then apply all writes and log them as one
+ *       WAL_TRANSACTION record
+ *
+ * ISOLATION: a transaction sees the database as of begin, whatever commits
+ * meanwhile. Commit fails (and the transaction is aborted) if any key it
+ * writes was written by anyone else after begin, whether by another
+ * transaction or by a plain single-key call such as upsertStudent. Reads
+ * are not validated, so this is snapshot isolation, not serializability.
+ *
+ * Readers that want to see multi-record changes whole read through
+ * DBsystem::snapshot() or a transaction; commits and snapshots take the
+ * same lock, so a snapshot holds all of a commit or none of it.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "DBsystem.h"
+
+/**
+ * @class Transaction
+ * @brief Buffered writes over a pinned snapshot; see DBsystem::begin/commit/abort.
+ */
+class Transaction
+{
+public:
+    Transaction();
+    /** @brief Aborts the transaction if it is still active; its database must still exist. */
+    ~Transaction();
+
+    /** @brief Between DBsystem::begin and commit/abort. */
+    bool isActive() const { return m_active; }
+
+    /** @brief The student as this transaction sees it, or NULL. */
+    const Student *findStudent(int studentId) const;
+    const Faculty *findFaculty(int facultyId) const;
+
+    /** @brief Insert or replace a whole record at commit. */
+    void putStudent(const Student &student);
+    void putFaculty(const Faculty &faculty);
+
+    void deleteStudent(int studentId);
+    void deleteFaculty(int facultyId);
+
+    /**
+     * @brief Move a student to a new advisor, updating the student and both
+     *        advisee lists together. A missing faculty member is skipped,
+     *        as in DBsystem::changeAdvisor.
+     * @return False (with @p error) if the student does not exist.
+     */
+    bool changeAdvisor(int studentId, int facultyId, std::string &error);
+
+    /** @brief Keys written so far. */
+    size_t writeCount() const { return m_students.size() + m_faculty.size(); }
+
+private:
+    friend class DBsystem;
+
+    template <typename T>
+    struct Write
+    {
+        T row;
+        bool deleted;
+    };
+
+    DBsystem *m_db;                             ///< Set by begin; the database it runs against
+    DBsnapshot m_snapshot;                      ///< The database as of begin
+    uint64_t m_startSeq;                        ///< DBsystem version sequence at begin
+    bool m_active;
+    std::map<int, Write<Student> > m_students;  ///< Applied in key order at commit
+    std::map<int, Write<Faculty> > m_faculty;
+
+    void reset();
+
+    Transaction(const Transaction &);
+    Transaction &operator=(const Transaction &);
+};
+
+#endif
@@ -23,10 +23,14 @@ private:
     TreeNode<T> *m_parent;
     TreeNode<T> *m_left;
     TreeNode<T> *m_right;
+    int m_count;       // nodes in this subtree, including this one
+    bool m_dirty;      // m_data changed since the last checkpoint
+    bool m_dirtyBelow; // this node or a descendant may be dirty
 };
 
 template <typename T>
-TreeNode<T>::TreeNode(T d) : m_data(d), m_parent(NULL), m_left(NULL), m_right(NULL) {}
+TreeNode<T>::TreeNode(T d)
+    : m_data(d), m_parent(NULL), m_left(NULL), m_right(NULL), m_count(1), m_dirty(false), m_dirtyBelow(false) {}
 
 template <typename T>
 TreeNode<T>::~TreeNode()
@@ -0,0 +1,561 @@
+#include "Validator.h"
+#include "DBsystem.h"
+#include "RecordMapper.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+    std::string trim(const std::string &s)
+    {
+        size_t b = s.find_first_not_of(" \t\r\n");
+        if (b == std::string::npos)
+        {
+            return std::string();
+        }
+        size_t e = s.find_last_not_of(" \t\r\n");
+        return s.substr(b, e - b + 1);
+    }
+
+    // Split "a,b,c" at top-level commas (a regex may contain its own)
+    std::vector<std::string> splitArgs(const std::string &s, size_t maxParts)
+    {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (parts.size() + 1 < maxParts)
+        {
+            size_t comma = s.find(',', start);
+            if (comma == std::string::npos)
+            {
+                break;
+            }
+            parts.push_back(trim(s.substr(start, comma - start)));
+            start = comma + 1;
+        }
+        parts.push_back(trim(s.substr(start)));
+        return parts;
+    }
+
+    // \w in Python's str patterns is Unicode-aware; bytes of multi-byte
+    // UTF-8 sequences are taken as word characters
+    bool isWord(unsigned char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+    }
+
+    bool isWordDotDash(unsigned char c)
+    {
+        return isWord(c) || c == '.' || c == '-';
+    }
+
+    // Set bit i of fail for every v[i] outside [lo, hi]; NaN fails
+    void rangeFailures(const double *v, size_t n, double lo, double hi, uint64_t *fail)
+    {
+        size_t i = 0;
+#ifdef __SSE2__
+        const __m128d vlo = _mm_set1_pd(lo);
+        const __m128d vhi = _mm_set1_pd(hi);
+        for (; i + 8 <= n; i += 8)
+        {
+            // Eight rows per step: four pairs, each compare yields two mask bits
+            unsigned bits = 0;
+            for (int k = 0; k < 4; ++k)
+            {
+                __m128d x = _mm_loadu_pd(v + i + 2 * k);
+                __m128d ok = _mm_and_pd(_mm_cmpge_pd(x, vlo), _mm_cmple_pd(x, vhi));
+                bits |= unsigned(_mm_movemask_pd(ok)) << (2 * k);
+            }
+            fail[i >> 6] |= uint64_t(~bits & 0xFFu) << (i & 63);
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            if (!(v[i] >= lo && v[i] <= hi))
+            {
+                fail[i >> 6] |= uint64_t(1) << (i & 63);
+            }
+        }
+    }
+
+    bool numericStudentField(int field)
+    {
+        return field == RecordMapper::S_ID || field == RecordMapper::S_GPA || field == RecordMapper::S_ADVISOR;
+    }
+
+    bool numericFacultyField(int field)
+    {
+        return field == RecordMapper::F_ID || field == RecordMapper::F_ADVISEES;
+    }
+
+    double numeric(const Student &s, int field)
+    {
+        switch (field)
+        {
+        case RecordMapper::S_ID:
+            return s.getID();
+        case RecordMapper::S_GPA:
+            return s.getGPA();
+        default:
+            return s.getAdvisor();
+        }
+    }
+
+    double numeric(const Faculty &f, int field)
+    {
+        return field == RecordMapper::F_ID ? f.getID() : f.getAdviseeCount();
+    }
+
+    std::string text(const Student &s, int field)
+    {
+        switch (field)
+        {
+        case RecordMapper::S_NAME:
+            return s.getName();
+        case RecordMapper::S_LEVEL:
+            return s.getLevel();
+        default:
+            return s.getMajor();
+        }
+    }
+
+    std::string text(const Faculty &f, int field)
+    {
+        switch (field)
+        {
+        case RecordMapper::F_NAME:
+            return f.getName();
+        case RecordMapper::F_LEVEL:
+            return f.getLevel();
+        default:
+            return f.getDepartment();
+        }
+    }
+
+    bool matches(const ValidationRule &rule, const std::string &value)
+    {
+        if (rule.kind == RULE_ONE_OF)
+        {
+            return std::find(rule.allowed.begin(), rule.allowed.end(), value) != rule.allowed.end();
+        }
+        if (rule.email)
+        {
+            return Validator::isEmail(value);
+        }
+        return std::regex_search(value, rule.regex, std::regex_constants::match_continuous);
+    }
+}
+
+const size_t ValidationReport::MAX_SAMPLES;
+
+Validator::Validator()
+{
+
+}
+
+bool Validator::isEmail(const std::string &text)
+{
+    // The domain's last '.' has to be the one before the final \w+, so the
+    // regex reduces to: local@domain, both [\w.-]+, domain = x.y with y \w+
+    size_t at = text.find('@');
+    if (at == 0 || at == std::string::npos || at + 1 >= text.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < at; ++i)
+    {
+        if (!isWordDotDash(text[i]))
+        {
+            return false;
+        }
+    }
+    size_t dot = text.rfind('.');
+    if (dot == std::string::npos || dot < at + 2 || dot + 1 == text.size())
+    {
+        return false;
+    }
+    for (size_t i = at + 1; i < dot; ++i)
+    {
+        if (!isWordDotDash(text[i]))
+        {
+            return false;
+        }
+    }
+    for (size_t i = dot + 1; i < text.size(); ++i)
+    {
+        if (!isWord(text[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Validator::addRule(const std::string &specText, std::string &error)
+{
+    ValidationRule rule;
+    rule.spec = trim(specText);
+    rule.warning = false;
+    rule.field = -1;
+    rule.capture = -1;
+    rule.min = -std::numeric_limits<double>::infinity();
+    rule.max = std::numeric_limits<double>::infinity();
+    rule.email = false;
+
+    std::string spec = rule.spec;
+    if (spec.compare(0, 5, "warn:") == 0)
+    {
+        rule.warning = true;
+        spec = trim(spec.substr(5));
+    }
+    size_t open = spec.find('(');
+    if (open == std::string::npos || spec[spec.size() - 1] != ')')
+    {
+        error = "expected kind(table.field,...): " + specText;
+        return false;
+    }
+    std::string kind = spec.substr(0, open);
+    std::string inner = spec.substr(open + 1, spec.size() - open - 2);
+    size_t maxArgs = 1;
+    if (kind == "range")
+    {
+        rule.kind = RULE_RANGE;
+        maxArgs = 3;
+    }
+    else if (kind == "required")
+    {
+        rule.kind = RULE_REQUIRED;
+    }
+    else if (kind == "pattern")
+    {
+        rule.kind = RULE_PATTERN;
+        maxArgs = 2;
+    }
+    else if (kind == "oneof")
+    {
+        rule.kind = RULE_ONE_OF;
+        maxArgs = 2;
+    }
+    else if (kind == "exists")
+    {
+        rule.kind = RULE_EXISTS;
+    }
+    else
+    {
+        error = "unknown rule '" + kind + "' (range, required, pattern, oneof, exists)";
+        return false;
+    }
+    std::vector<std::string> args = splitArgs(inner, maxArgs);
+    if (args.size() != maxArgs)
+    {
+        error = "wrong number of arguments: " + specText;
+        return false;
+    }
+
+    // table.field
+    size_t dot = args[0].find('.');
+    std::string table = args[0].substr(0, dot);
+    if (dot == std::string::npos || (table != "student" && table != "faculty"))
+    {
+        error = "rules apply to student.<field> or faculty.<field>: " + specText;
+        return false;
+    }
+    rule.student = (table == "student");
+    std::string name = args[0].substr(dot + 1);
+    int fields = rule.student ? int(RecordMapper::STUDENT_FIELDS) : int(RecordMapper::FACULTY_FIELDS);
+    for (int f = 0; f < fields; ++f)
+    {
+        const char *fieldName = rule.student ? RecordMapper::studentFieldName(RecordMapper::StudentField(f))
+                                             : RecordMapper::facultyFieldName(RecordMapper::FacultyField(f));
+        if (name == fieldName)
+        {
+            rule.field = f;
+        }
+    }
+    bool numericField = rule.field >= 0 && (rule.student ? numericStudentField(rule.field)
+                                                         : numericFacultyField(rule.field));
+
+    switch (rule.kind)
+    {
+    case RULE_RANGE:
+        if ((!args[1].empty() && !RecordMapper::parseDouble(args[1], rule.min)) ||
+            (!args[2].empty() && !RecordMapper::parseDouble(args[2], rule.max)))
+        {
+            error = "bad range bounds: " + specText;
+            return false;
+        }
+        if (rule.field >= 0 && !numericField)
+        {
+            error = name + " is not numeric: " + specText;
+            return false;
+        }
+        break;
+    case RULE_PATTERN:
+    case RULE_ONE_OF:
+        if (numericField)
+        {
+            error = name + " is numeric: " + specText;
+            return false;
+        }
+        if (rule.kind == RULE_ONE_OF)
+        {
+            size_t start = 0;
+            while (start <= args[1].size())
+            {
+                size_t bar = args[1].find('|', start);
+                if (bar == std::string::npos)
+                {
+                    bar = args[1].size();
+                }
+                rule.allowed.push_back(args[1].substr(start, bar - start));
+                start = bar + 1;
+            }
+        }
+        else if (args[1] == "email")
+        {
+            rule.email = true;
+        }
+        else
+        {
+            try
+            {
+                rule.regex = std::regex(args[1], std::regex::ECMAScript | std::regex::optimize);
+            }
+            catch (const std::regex_error &)
+            {
+                error = "bad regex: " + args[1];
+                return false;
+            }
+        }
+        break;
+    case RULE_EXISTS:
+        if (!rule.student || rule.field != RecordMapper::S_ADVISOR)
+        {
+            error = "exists() checks student.advisor against the faculty table";
+            return false;
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (rule.field < 0)
+    {
+        Captured &c = rule.student ? m_students : m_faculty;
+        rule.source = name;
+        std::vector<std::string>::iterator it = std::find(c.names.begin(), c.names.end(), name);
+        rule.capture = int(it - c.names.begin());
+        if (it == c.names.end())
+        {
+            c.names.push_back(name);
+            c.values.push_back(std::vector<std::string>());
+            c.present.push_back(std::vector<bool>());
+        }
+    }
+    m_rules.push_back(rule);
+    m_report.failures.push_back(0);
+    return true;
+}
+
+void Validator::addUniversityRules()
+{
+    static const char *specs[] = {
+        "required(student.name)",
+        "required(student.email)",
+        "pattern(student.email,email)",
+        "range(student.gpa,0,4)",
+        "oneof(student.level,FRESHMAN|SOPHOMORE|JUNIOR|SENIOR|GRADUATE)",
+        "exists(student.advisor)",
+        "required(faculty.name)",
+    };
+    std::string error;
+    for (size_t i = 0; i < sizeof(specs) / sizeof(specs[0]); ++i)
+    {
+        addRule(specs[i], error);
+    }
+}
+
+void Validator::resetReport()
+{
+    m_report = ValidationReport();
+    m_report.failures.assign(m_rules.size(), 0);
+}
+
+size_t Validator::validate(DBsystem &db, const std::vector<Student> &rows, std::vector<uint64_t> &reject)
+{
+    return run(db, rows, true, reject);
+}
+
+size_t Validator::validate(DBsystem &db, const std::vector<Faculty> &rows, std::vector<uint64_t> &reject)
+{
+    return run(db, rows, false, reject);
+}
+
+template <typename Record>
+size_t Validator::run(DBsystem &db, const std::vector<Record> &rows, bool student, std::vector<uint64_t> &reject)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    size_t n = rows.size();
+    size_t words = (n + 63) / 64;
+    reject.assign(words, 0);
+    Captured &captured = student ? m_students : m_faculty;
+    std::vector<uint64_t> fail;
+    std::vector<double> column;
+
+    for (size_t r = 0; r < m_rules.size(); ++r)
+    {
+        const ValidationRule &rule = m_rules[r];
+        if (rule.student != student)
+        {
+            continue;
+        }
+        const std::vector<std::string> *values = rule.capture >= 0 ? &captured.values[rule.capture] : NULL;
+        const std::vector<bool> *present = rule.capture >= 0 ? &captured.present[rule.capture] : NULL;
+        fail.assign(words, 0);
+
+        switch (rule.kind)
+        {
+        case RULE_RANGE:
+            // Gather a column, then compare it in bulk. A missing source value
+            // passes (it is stored as the lower bound); unparsable text is NaN
+            column.resize(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (values == NULL)
+                {
+                    column[i] = numeric(rows[i], rule.field);
+                }
+                else if (!(*present)[i] || (*values)[i].empty())
+                {
+                    column[i] = std::isinf(rule.min) ? rule.max : rule.min;
+                }
+                else if (!RecordMapper::parseDouble((*values)[i], column[i]))
+                {
+                    column[i] = NaN;
+                }
+            }
+            if (n > 0)
+            {
+                rangeFailures(&column[0], n, rule.min, rule.max, &fail[0]);
+            }
+            break;
+
+        case RULE_REQUIRED:
+            for (size_t i = 0; i < n; ++i)
+            {
+                bool ok;
+                if (values != NULL)
+                    ok = (*present)[i] && !trim((*values)[i]).empty();
+                else
+                    ok = (rule.student ? numericStudentField(rule.field) : numericFacultyField(rule.field)) ||
+                         !trim(text(rows[i], rule.field)).empty();
+                if (!ok)
+                    fail[i >> 6] |= uint64_t(1) << (i & 63);
+            }
+            break;
+
+        case RULE_PATTERN:
+        case RULE_ONE_OF:
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (values != NULL && !(*present)[i])
+                {
+                    continue;
+                }
+                if (!matches(rule, values != NULL ? (*values)[i] : text(rows[i], rule.field)))
+                {
+                    fail[i >> 6] |= uint64_t(1) << (i & 63);
+                }
+            }
+            break;
+
+        case RULE_EXISTS:
+        {
+            // Look each distinct advisor up once per batch
+            std::vector<std::pair<int, size_t> > keys;
+            keys.reserve(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                int id = int(numeric(rows[i], rule.field));
+                if (id != 0)
+                {
+                    keys.push_back(std::make_pair(id, i));
+                }
+            }
+            std::sort(keys.begin(), keys.end());
+            bool found = false;
+            for (size_t k = 0; k < keys.size(); ++k)
+            {
+                if (k == 0 || keys[k].first != keys[k - 1].first)
+                {
+                    found = db.findFaculty(keys[k].first) != NULL;
+                }
+                if (!found)
+                {
+                    size_t i = keys[k].second;
+                    fail[i >> 6] |= uint64_t(1) << (i & 63);
+                }
+            }
+            break;
+        }
+        }
+
+        long long count = 0;
+        for (size_t w = 0; w < words; ++w)
+        {
+            count += __builtin_popcountll(fail[w]);
+            if (!rule.warning)
+            {
+                reject[w] |= fail[w];
+            }
+        }
+        m_report.failures[r] += count;
+        if (rule.warning)
+        {
+            m_report.warnings += count;
+        }
+        for (size_t w = 0; w < words && count > 0 && m_report.samples.size() < ValidationReport::MAX_SAMPLES; ++w)
+        {
+            for (uint64_t bits = fail[w]; bits != 0 && m_report.samples.size() < ValidationReport::MAX_SAMPLES;
+                 bits &= bits - 1)
+            {
+                size_t i = w * 64 + size_t(__builtin_ctzll(bits));
+                ValidationFailure sample;
+                sample.rule = rule.spec;
+                sample.id = rows[i].getID();
+                if (values != NULL)
+                    sample.value = (*values)[i].substr(0, 100);
+                else if (rule.student ? numericStudentField(rule.field) : numericFacultyField(rule.field))
+                    sample.value = std::to_string(numeric(rows[i], rule.field));
+                else
+                    sample.value = text(rows[i], rule.field).substr(0, 100);
+                m_report.samples.push_back(sample);
+            }
+        }
+    }
+
+    long long rejected = 0;
+    for (size_t w = 0; w < words; ++w)
+    {
+        rejected += __builtin_popcountll(reject[w]);
+    }
+    m_report.rows += (long long)n;
+    m_report.rejected += rejected;
+
+    for (size_t f = 0; f < captured.names.size(); ++f)
+    {
+        captured.values[f].clear();
+        captured.present[f].clear();
+    }
+    m_report.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+    return n - size_t(rejected);
+}
@@ -0,0 +1,172 @@
+/**
+ * @file Validator.h
+ * @brief Declarative data-quality rules, checked a batch at a time during
+ *        bulk loads.
+ *
+ * ARCHITECTURE:
+ *   ingestJsonLines / importStudentsCsv / importFacultyCsv
+ *       |  each mapped row is buffered; capture() keeps the raw text of
+ *       |  source-only fields (email, ...) next to it
+ *       v
+ *   Validator (You are here)
+ *       |  per rule, one pass over a column of the batch that sets a bit
+ *       |  per failing row: ranges compare two doubles per SSE2 op,
+ *       |  "exists" looks each distinct id up once
+ *       |  error rules OR into the reject bitmap; warnings are only counted
+ *       v
+ *   DBsystem::upsertStudent / upsertFaculty - only rows whose bit is clear
+ *
+ * RULES (--validate):
+ *   range(student.gpa,0,4)          numeric in [min, max]
+ *   required(student.name)          present and not blank
+ *   pattern(student.email,email)    "email" = ^[\w.-]+@[\w.-]+\.\w+$ (built in),
+ *   pattern(student.id_text,^STU)   anything else is an ECMAScript regex that
+ *                                   must match at the start (Python re.match)
+ *   oneof(student.level,A|B|C)      one of the listed values
+ *   exists(student.advisor)         advisor is 0 (none) or in the faculty table
+ *   warn:<rule>                     count failures without rejecting the row
+ *
+ * The field is a record field of RecordMapper (student: id, name, level,
+ * major, gpa, advisor; faculty: id, name, level, department) or, failing
+ * that, a field of the raw input - the records have no email, so the email
+ * rule reads the source "email" as it streams past. As in
+ * quality/validators.py, only "required" fails on a missing value.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include <stdint.h>
+#include <regex>
+#include <string>
+#include <vector>
+#include "Student.h"
+#include "Faculty.h"
+
+class DBsystem;
+
+enum RuleKind
+{
+    RULE_RANGE,
+    RULE_REQUIRED,
+    RULE_PATTERN,
+    RULE_ONE_OF,
+    RULE_EXISTS
+};
+
+/** @brief One parsed rule. */
+struct ValidationRule
+{
+    std::string spec;                   ///< As written; names the rule in reports
+    RuleKind kind;
+    bool warning;                       ///< Counted, never rejects
+    bool student;                       ///< Table: students, else faculty
+    int field;                          ///< RecordMapper field, -1 for a source field
+    int capture;                        ///< Source field: index into the captured columns
+    std::string source;                 ///< Source field name
+    double min;
+    double max;
+    std::vector<std::string> allowed;   ///< oneof
+    bool email;                         ///< pattern: the built-in email matcher
+    std::regex regex;                   ///< pattern: anything else
+};
+
+/** @brief A failing row kept as an example. */
+struct ValidationFailure
+{
+    std::string rule;
+    int id;
+    std::string value;
+};
+
+/** @brief Counters since the last resetReport. */
+struct ValidationReport
+{
+    static const size_t MAX_SAMPLES = 20;
+
+    long long rows;                         ///< Rows checked
+    long long rejected;                     ///< Rows that failed an error rule
+    long long warnings;                     ///< Warning-rule failures
+    std::vector<long long> failures;        ///< Per rule, in rule order
+    std::vector<ValidationFailure> samples; ///< First MAX_SAMPLES failures
+    double seconds;                         ///< Time spent validating
+
+    ValidationReport() : rows(0), rejected(0), warnings(0), seconds(0.0) {}
+};
+
+/**
+ * @class Validator
+ * @brief Rule set plus the source columns captured for the current batch.
+ */
+class Validator
+{
+public:
+    Validator();
+
+    /** @brief Parse and add one rule (syntax above). */
+    bool addRule(const std::string &spec, std::string &error);
+
+    /**
+     * @brief The rules of create_university_validator that apply to these
+     *        records: required names and email, email pattern, gpa in [0, 4],
+     *        academic level, plus advisors that must exist.
+     */
+    void addUniversityRules();
+
+    bool empty() const { return m_rules.empty(); }
+    const std::vector<ValidationRule> &rules() const { return m_rules; }
+
+    /**
+     * @brief Keep the source-only fields of the row just buffered. Call once
+     *        per buffered row, in batch order.
+     */
+    template <typename Source>
+    void capture(bool student, const Source &src)
+    {
+        Captured &c = student ? m_students : m_faculty;
+        for (size_t f = 0; f < c.names.size(); ++f)
+        {
+            const std::string *v = src.find(c.names[f]);
+            c.present[f].push_back(v != NULL);
+            c.values[f].push_back(v != NULL ? *v : std::string());
+        }
+    }
+
+    /**
+     * @brief Check a buffered batch and clear its captured columns.
+     * @param reject Resized to the batch; bit i set when row i failed an error rule.
+     * @return Rows that passed.
+     */
+    size_t validate(DBsystem &db, const std::vector<Student> &rows, std::vector<uint64_t> &reject);
+    size_t validate(DBsystem &db, const std::vector<Faculty> &rows, std::vector<uint64_t> &reject);
+
+    const ValidationReport &report() const { return m_report; }
+    void resetReport();
+
+    /** @brief Whether bit @p row of a reject bitmap is set. */
+    static bool isSet(const std::vector<uint64_t> &bits, size_t row) { return (bits[row >> 6] >> (row & 63)) & 1; }
+
+    /** @brief ^[\w.-]+@[\w.-]+\.\w+ matched at the start and end of @p text. */
+    static bool isEmail(const std::string &text);
+
+private:
+    struct Captured
+    {
+        std::vector<std::string> names;
+        std::vector<std::vector<std::string> > values;
+        std::vector<std::vector<bool> > present;
+    };
+
+    std::vector<ValidationRule> m_rules;
+    Captured m_students;
+    Captured m_faculty;
+    ValidationReport m_report;
+
+    template <typename Record>
+    size_t run(DBsystem &db, const std::vector<Record> &rows, bool student, std::vector<uint64_t> &reject);
+};
+
+#endif
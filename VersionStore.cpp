@@ -0,0 +1,130 @@
+#include "VersionStore.h"
+#include <algorithm>
+
+namespace
+{
+    bool startsAfter(int64_t timestamp, const VersionSpan &span)
+    {
+        return timestamp < span.from;
+    }
+}
+
+VersionStore::VersionStore() : m_versions(0)
+{
+
+}
+
+int32_t VersionStore::store(const Student &record)
+{
+    // Closed versions are never rewritten; a freed key's records stay until
+    // clear() so the indices in other chains remain valid
+    m_records.push_back(record);
+    return int32_t(m_records.size() - 1);
+}
+
+void VersionStore::open(int id, int64_t from)
+{
+    std::vector<VersionSpan> &chain = m_chains[id];
+    if (!chain.empty() && chain.back().to == VERSION_OPEN)
+    {
+        // Already current: an insert of a key that exists is an update
+        return;
+    }
+    // A key deleted and added again resumes no earlier than it was retired
+    VersionSpan span = {chain.empty() ? from : std::max(from, chain.back().to), VERSION_OPEN, -1};
+    chain.push_back(span);
+    ++m_versions;
+}
+
+void VersionStore::close(int id, const Student &previous, int64_t at)
+{
+    std::vector<VersionSpan> &chain = m_chains[id];
+    if (chain.empty() || chain.back().to != VERSION_OPEN)
+    {
+        VersionSpan first = {chain.empty() ? VERSION_START : chain.back().to, VERSION_OPEN, -1};
+        chain.push_back(first);
+        ++m_versions;
+    }
+    VersionSpan &current = chain.back();
+    current.to = at;
+    current.record = store(previous);
+    VersionSpan next = {at, VERSION_OPEN, -1};
+    chain.push_back(next);
+    ++m_versions;
+}
+
+void VersionStore::retire(int id, const Student &last, int64_t at)
+{
+    std::vector<VersionSpan> &chain = m_chains[id];
+    if (chain.empty() || chain.back().to != VERSION_OPEN)
+    {
+        VersionSpan first = {chain.empty() ? VERSION_START : chain.back().to, VERSION_OPEN, -1};
+        chain.push_back(first);
+        ++m_versions;
+    }
+    chain.back().to = at;
+    chain.back().record = store(last);
+}
+
+void VersionStore::erase(int id)
+{
+    std::unordered_map<int, std::vector<VersionSpan> >::iterator it = m_chains.find(id);
+    if (it != m_chains.end())
+    {
+        m_versions -= it->second.size();
+        m_chains.erase(it);
+    }
+}
+
+const VersionSpan *VersionStore::find(int id, int64_t timestamp, bool &known) const
+{
+    std::unordered_map<int, std::vector<VersionSpan> >::const_iterator it = m_chains.find(id);
+    known = it != m_chains.end();
+    if (!known)
+    {
+        return NULL;
+    }
+    const std::vector<VersionSpan> &chain = it->second;
+    const VersionSpan *span = &chain.back();
+    if (timestamp < span->from)
+    {
+        // Not the newest version: last span starting at or before the time
+        std::vector<VersionSpan>::const_iterator after =
+            std::upper_bound(chain.begin(), chain.end(), timestamp, startsAfter);
+        if (after == chain.begin())
+        {
+            return NULL;
+        }
+        span = &*(after - 1);
+    }
+    return timestamp < span->to ? span : NULL;
+}
+
+int64_t VersionStore::currentFrom(int id) const
+{
+    std::unordered_map<int, std::vector<VersionSpan> >::const_iterator it = m_chains.find(id);
+    if (it == m_chains.end() || it->second.back().to != VERSION_OPEN)
+    {
+        return VERSION_START;
+    }
+    return it->second.back().from;
+}
+
+const std::vector<VersionSpan> *VersionStore::chain(int id) const
+{
+    std::unordered_map<int, std::vector<VersionSpan> >::const_iterator it = m_chains.find(id);
+    return it == m_chains.end() ? NULL : &it->second;
+}
+
+void VersionStore::clear()
+{
+    m_chains.clear();
+    m_records.clear();
+    m_versions = 0;
+}
+
+bool VersionStore::sameVersion(const Student &a, const Student &b)
+{
+    return a.getGPA() == b.getGPA() && a.getAdvisor() == b.getAdvisor() && a.getName() == b.getName() &&
+           a.getLevel() == b.getLevel() && a.getMajor() == b.getMajor();
+}
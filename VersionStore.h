@@ -0,0 +1,118 @@
+/**
+ * @file VersionStore.h
+ * @brief Slowly Changing Dimension Type 2 history for student records:
+ *        every version of a key with its effective_from / effective_to.
+ *
+ * ARCHITECTURE:
+ *   DBsystem::closeAndInsertStudents (bulk loads with --scd2)
+ *       |  changed row: the current record is copied here and its span is
+ *       |  closed at the load's effective time; the tree gets the new one
+ *       v
+ *   VersionStore (You are here)
+ *       |  per key one contiguous array of 24-byte spans sorted by
+ *       |  effective_from; closed versions point into a record deque, the
+ *       |  open (current) span points back at the tree
+ *       v
+ *   DBsystem::findStudentAsOf - newest span checked first, then a binary
+ *       search over the chain
+ *
+ * The current version stays in the student tree, so findStudent never
+ * touches this store and costs what it did before history existed. Keys
+ * that were never written under --scd2 have no chain; their one version
+ * is effective forever. As in SCD2Loader (etl/loaders.py), a load that
+ * changes no tracked field (name, level, major, gpa, advisor) adds no
+ * version. History is kept in memory only, like courses and enrollments.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef VERSION_STORE_H
+#define VERSION_STORE_H
+
+#include <stdint.h>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include "Student.h"
+
+/** @brief effective_to of the current version. */
+const int64_t VERSION_OPEN = INT64_MAX;
+/** @brief effective_from of a version that existed before history began. */
+const int64_t VERSION_START = INT64_MIN;
+
+/** @brief One version of a key: effective over [from, to). */
+struct VersionSpan
+{
+    int64_t from;
+    int64_t to;             ///< VERSION_OPEN while current
+    int32_t record;         ///< Closed versions: index of the stored record; -1 = the tree's
+};
+
+/** @brief Outcome of a close-and-insert batch. */
+struct VersionCounts
+{
+    long long inserted;     ///< New keys
+    long long updated;      ///< Current version closed, new one opened
+    long long unchanged;    ///< No tracked field differed
+
+    VersionCounts() : inserted(0), updated(0), unchanged(0) {}
+};
+
+/**
+ * @class VersionStore
+ * @brief Version chains of one table, keyed by id.
+ */
+class VersionStore
+{
+public:
+    VersionStore();
+
+    /** @brief Start a current version of @p id at @p from (a new key). */
+    void open(int id, int64_t from);
+
+    /**
+     * @brief Close the current version of @p id at @p at, keeping
+     *        @p previous as its record, and open the next one from @p at.
+     *        A key without a chain gets [VERSION_START, at) first.
+     */
+    void close(int id, const Student &previous, int64_t at);
+
+    /** @brief Close the current version at @p at without opening another (delete). */
+    void retire(int id, const Student &last, int64_t at);
+
+    /** @brief Forget every version of @p id. */
+    void erase(int id);
+
+    /**
+     * @brief The span of @p id effective at @p timestamp.
+     * @param known Set to whether @p id has a chain at all.
+     * @return NULL when no version covers the time.
+     */
+    const VersionSpan *find(int id, int64_t timestamp, bool &known) const;
+
+    /** @brief effective_from of the current version; VERSION_START without a chain. */
+    int64_t currentFrom(int id) const;
+
+    /** @brief Record of a closed span. */
+    const Student &record(const VersionSpan &span) const { return m_records[size_t(span.record)]; }
+
+    /** @brief Spans of @p id, oldest first; NULL without a chain. */
+    const std::vector<VersionSpan> *chain(int id) const;
+
+    size_t keys() const { return m_chains.size(); }
+    size_t versions() const { return m_versions; }
+    void clear();
+
+    /** @brief Tracked fields equal: loading @p b over @p a makes no version. */
+    static bool sameVersion(const Student &a, const Student &b);
+
+private:
+    std::unordered_map<int, std::vector<VersionSpan> > m_chains;
+    std::deque<Student> m_records;      ///< Closed versions; stable addresses
+    size_t m_versions;
+
+    int32_t store(const Student &record);
+};
+
+#endif
@@ -0,0 +1,355 @@
+#include "WindowAggregator.h"
+#include "RecordMapper.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace
+{
+    const int64_t NEVER = std::numeric_limits<int64_t>::min();
+    const int64_t FOREVER = std::numeric_limits<int64_t>::max();
+
+    inline int64_t floorDiv(int64_t a, int64_t b)
+    {
+        int64_t q = a / b;
+        return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+    }
+
+    int64_t gcd(int64_t a, int64_t b)
+    {
+        while (b != 0)
+        {
+            int64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // Days since 1970-01-01 of a proleptic Gregorian date
+    int64_t daysFromCivil(int64_t y, int64_t m, int64_t d)
+    {
+        y -= m <= 2;
+        int64_t era = floorDiv(y, 400);
+        int64_t yoe = y - era * 400;
+        int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+
+    void civilFromDays(int64_t z, int64_t &y, int64_t &m, int64_t &d)
+    {
+        z += 719468;
+        int64_t era = floorDiv(z, 146097);
+        int64_t doe = z - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        d = doy - (153 * mp + 2) / 5 + 1;
+        m = mp < 10 ? mp + 3 : mp - 9;
+        y = yoe + era * 400 + (m <= 2);
+    }
+
+    bool digits(const std::string &s, size_t at, size_t n, int64_t &out)
+    {
+        if (at + n > s.size())
+        {
+            return false;
+        }
+        out = 0;
+        for (size_t i = at; i < at + n; ++i)
+        {
+            if (s[i] < '0' || s[i] > '9')
+            {
+                return false;
+            }
+            out = out * 10 + (s[i] - '0');
+        }
+        return true;
+    }
+}
+
+bool parseTimestamp(const std::string &text, int64_t &millis)
+{
+    int64_t y, mo, d, h, mi, s;
+    if (text.size() == 10 && text[4] == '-' && text[7] == '-')
+    {
+        // A bare date is its midnight
+        if (!digits(text, 0, 4, y) || !digits(text, 5, 2, mo) || !digits(text, 8, 2, d))
+        {
+            return false;
+        }
+        millis = daysFromCivil(y, mo, d) * 86400000;
+        return true;
+    }
+    if (text.size() >= 19 && text[4] == '-' && text[7] == '-' && (text[10] == 'T' || text[10] == ' ') &&
+        text[13] == ':' && text[16] == ':')
+    {
+        if (!digits(text, 0, 4, y) || !digits(text, 5, 2, mo) || !digits(text, 8, 2, d) ||
+            !digits(text, 11, 2, h) || !digits(text, 14, 2, mi) || !digits(text, 17, 2, s))
+        {
+            return false;
+        }
+        int64_t ms = 0;
+        if (text.size() > 20 && text[19] == '.')
+        {
+            // Fraction of any length; keep milliseconds
+            int64_t scale = 100;
+            for (size_t i = 20; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i, scale /= 10)
+            {
+                ms += (text[i] - '0') * scale;
+            }
+        }
+        millis = ((daysFromCivil(y, mo, d) * 24 + h) * 60 + mi) * 60000 + s * 1000 + ms;
+        return true;
+    }
+
+    double seconds;
+    if (!RecordMapper::parseDouble(text, seconds))
+    {
+        return false;
+    }
+    millis = int64_t(std::floor(seconds * 1000.0));
+    return true;
+}
+
+std::string formatTimestamp(int64_t millis)
+{
+    int64_t days = floorDiv(millis, 86400000);
+    int64_t ms = millis - days * 86400000;
+    int64_t y, m, d;
+    civilFromDays(days, y, m, d);
+    char buf[160];      // Room for any int64_t the compiler can imagine per field
+    std::snprintf(buf, sizeof(buf), "%04lld-%02lld-%02lldT%02lld:%02lld:%02lld.%03lld", (long long)y, (long long)m,
+                  (long long)d, (long long)(ms / 3600000), (long long)(ms / 60000 % 60), (long long)(ms / 1000 % 60),
+                  (long long)(ms % 1000));
+    return buf;
+}
+
+// ---------------------------------------------------------------------------
+// PaneQueue
+// ---------------------------------------------------------------------------
+
+WindowAggregator::PaneQueue::PaneQueue()
+{
+    m_backAgg.count = 0;
+}
+
+void WindowAggregator::PaneQueue::push(const Pane &pane)
+{
+    m_backAgg = m_back.empty() ? pane.agg : combine(m_backAgg, pane.agg);
+    m_back.push_back(pane);
+}
+
+void WindowAggregator::PaneQueue::pop()
+{
+    if (m_front.empty())
+    {
+        // Newest first, so the oldest pane ends on top carrying the
+        // aggregate of everything that was on the back stack
+        for (size_t i = m_back.size(); i-- > 0;)
+        {
+            Entry e;
+            e.pane = m_back[i];
+            e.suffix = m_front.empty() ? m_back[i].agg : combine(m_back[i].agg, m_front.back().suffix);
+            m_front.push_back(e);
+        }
+        m_back.clear();
+        m_backAgg.count = 0;
+    }
+    m_front.pop_back();
+}
+
+WindowAggregator::Agg WindowAggregator::PaneQueue::aggregate() const
+{
+    if (m_front.empty())
+        return m_backAgg;
+    if (m_back.empty())
+        return m_front.back().suffix;
+    return combine(m_front.back().suffix, m_backAgg);
+}
+
+// ---------------------------------------------------------------------------
+// WindowAggregator
+// ---------------------------------------------------------------------------
+
+WindowAggregator::WindowAggregator(const WindowSpec &spec)
+    : m_spec(spec), m_pane(gcd(spec.size, spec.slide)), m_maxTime(NEVER), m_watermark(NEVER),
+      m_finalPanes(NEVER), m_events(0), m_late(0)
+{
+
+}
+
+WindowAggregator::Agg WindowAggregator::combine(const Agg &a, const Agg &b)
+{
+    Agg c;
+    c.count = a.count + b.count;
+    c.sum = a.sum + b.sum;
+    c.min = std::min(a.min, b.min);
+    c.max = std::max(a.max, b.max);
+    return c;
+}
+
+uint32_t WindowAggregator::keyId(const std::string &key)
+{
+    std::unordered_map<std::string, uint32_t>::iterator it = m_keyIds.find(key);
+    if (it != m_keyIds.end())
+    {
+        return it->second;
+    }
+    uint32_t id = uint32_t(m_keys.size());
+    m_keyIds[key] = id;
+    m_keys.push_back(KeyState());
+    m_keys.back().name = key;
+    m_keys.back().nextWindow = NEVER;
+    m_isActive.push_back(false);
+    return id;
+}
+
+// First window (in slides) that covers pane p
+int64_t WindowAggregator::firstWindowOf(int64_t pane) const
+{
+    return floorDiv(pane - m_spec.size / m_pane, m_spec.slide / m_pane) + 1;
+}
+
+bool WindowAggregator::add(uint32_t key, int64_t timestamp, double value)
+{
+    ++m_events;
+    int64_t index = floorDiv(timestamp, m_pane);
+    if (index < m_finalPanes)
+    {
+        ++m_late;
+        return false;
+    }
+
+    // Panes are kept in order; in-order events hit the last one
+    std::deque<Pane> &open = m_keys[key].open;
+    std::deque<Pane>::iterator it = open.end();
+    while (it != open.begin() && (it - 1)->index > index)
+    {
+        --it;
+    }
+    if (it != open.begin() && (it - 1)->index == index)
+    {
+        Agg &a = (it - 1)->agg;
+        ++a.count;
+        a.sum += value;
+        a.min = std::min(a.min, value);
+        a.max = std::max(a.max, value);
+    }
+    else
+    {
+        Pane p;
+        p.index = index;
+        p.agg.count = 1;
+        p.agg.sum = value;
+        p.agg.min = value;
+        p.agg.max = value;
+        open.insert(it, p);
+    }
+
+    if (!m_isActive[key])
+    {
+        m_isActive[key] = true;
+        m_active.push_back(key);
+    }
+
+    if (timestamp > m_maxTime)
+    {
+        m_maxTime = timestamp;
+        int64_t watermark = timestamp - m_spec.lateness;
+        if (floorDiv(watermark, m_pane) > m_finalPanes)
+            advance(watermark);
+        else
+            m_watermark = watermark;
+    }
+    return true;
+}
+
+void WindowAggregator::flush()
+{
+    advance(FOREVER);
+}
+
+// Everything before the watermark's pane is final: emit each active key's
+// closed windows and drop keys that have nothing left
+void WindowAggregator::advance(int64_t watermark)
+{
+    m_watermark = watermark;
+    m_finalPanes = watermark == FOREVER ? FOREVER : floorDiv(watermark, m_pane);
+    for (size_t i = 0; i < m_active.size();)
+    {
+        uint32_t key = m_active[i];
+        if (emit(key))
+        {
+            ++i;
+            continue;
+        }
+        m_isActive[key] = false;
+        m_active[i] = m_active.back();
+        m_active.pop_back();
+    }
+}
+
+// @return True while the key still has open or queued panes
+bool WindowAggregator::emit(uint32_t key)
+{
+    KeyState &k = m_keys[key];
+    int64_t panesPerSlide = m_spec.slide / m_pane;
+    int64_t panesPerWindow = m_spec.size / m_pane;
+
+    while (true)
+    {
+        // Skip windows that cannot hold anything
+        if (!k.window.empty())
+        {
+            k.nextWindow = std::max(k.nextWindow, firstWindowOf(k.window.oldest()));
+        }
+        else if (!k.open.empty() && k.open.front().index < m_finalPanes)
+        {
+            k.nextWindow = std::max(k.nextWindow, firstWindowOf(k.open.front().index));
+        }
+        else
+        {
+            break;
+        }
+
+        int64_t startPane = k.nextWindow * panesPerSlide;
+        int64_t endPane = startPane + panesPerWindow;
+        if (endPane > m_finalPanes)
+        {
+            break;
+        }
+        while (!k.open.empty() && k.open.front().index < endPane)
+        {
+            k.window.push(k.open.front());
+            k.open.pop_front();
+        }
+        while (!k.window.empty() && k.window.oldest() < startPane)
+        {
+            k.window.pop();
+        }
+        if (!k.window.empty())
+        {
+            Agg a = k.window.aggregate();
+            WindowResult r;
+            r.key = key;
+            r.start = startPane * m_pane;
+            r.end = endPane * m_pane;
+            r.count = a.count;
+            r.sum = a.sum;
+            r.min = a.min;
+            r.max = a.max;
+            m_results.push_back(r);
+        }
+        ++k.nextWindow;
+    }
+    return !k.open.empty() || !k.window.empty();
+}
+
+void WindowAggregator::drain(std::vector<WindowResult> &out)
+{
+    out.insert(out.end(), m_results.begin(), m_results.end());
+    m_results.clear();
+}
@@ -0,0 +1,161 @@
+/**
+ * @file WindowAggregator.h
+ * @brief Tumbling and sliding event-time windows per key, with watermarks.
+ *
+ * ARCHITECTURE:
+ *   events (key, timestamp, value) - e.g. tech/metrics.json per server_id
+ *       |
+ *       v
+ *   WindowAggregator (You are here)
+ *       |  time is cut into panes of gcd(size, slide); an event updates
+ *       |  one pane of its key (count, sum, min, max)
+ *       |  watermark = newest timestamp - lateness; panes that end at or
+ *       |  before it are final and move into the key's two-stack queue
+ *       |  a window = the panes in [start, start + size): push the newer
+ *       |  panes, pop the older ones, read the queue's aggregate
+ *       v
+ *   WindowResult (key, start, end, count, sum, avg, min, max)
+ *
+ * TWO-STACK QUEUE:
+ *   pushes go on the back stack, which keeps one running aggregate; pops
+ *   come off the front stack, where every entry stores the aggregate of
+ *   itself and all newer front entries. When the front runs dry the back is
+ *   moved over, each element once, so push, pop and query are O(1)
+ *   amortized for min/max as well as sum/count, with no subtract drift.
+ *
+ * Windows are emitted in start order per key, only when they hold events.
+ * An event whose pane is already final (older than the watermark) is
+ * dropped and counted as late. Tumbling windows are sliding windows whose
+ * slide equals their size.
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef WINDOW_AGGREGATOR_H
+#define WINDOW_AGGREGATOR_H
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** @brief Window shape; all times in milliseconds. */
+struct WindowSpec
+{
+    int64_t size;
+    int64_t slide;          ///< == size for tumbling windows
+    int64_t lateness;       ///< How far behind the newest event a timestamp may be
+
+    WindowSpec() : size(60000), slide(60000), lateness(0) {}
+};
+
+/** @brief One closed window of one key. */
+struct WindowResult
+{
+    uint32_t key;           ///< WindowAggregator::keyName(key)
+    int64_t start;
+    int64_t end;
+    long long count;
+    double sum;
+    double min;
+    double max;
+
+    double avg() const { return count > 0 ? sum / count : 0.0; }
+};
+
+class WindowAggregator
+{
+public:
+    /** @brief @p spec must have size and slide > 0 and lateness >= 0. */
+    explicit WindowAggregator(const WindowSpec &spec);
+
+    /** @brief Id of @p key, assigned on first use. */
+    uint32_t keyId(const std::string &key);
+    const std::string &keyName(uint32_t key) const { return m_keys[key].name; }
+
+    /** @brief Add one event. @return False if it arrived after its pane closed (late). */
+    bool add(uint32_t key, int64_t timestamp, double value);
+
+    /** @brief Close every remaining window, as if the watermark reached infinity. */
+    void flush();
+
+    /** @brief Move the windows closed so far into @p out (appended). */
+    void drain(std::vector<WindowResult> &out);
+
+    int64_t watermark() const { return m_watermark; }
+    long long events() const { return m_events; }
+    long long late() const { return m_late; }
+
+private:
+    struct Agg
+    {
+        long long count;
+        double sum;
+        double min;
+        double max;
+    };
+
+    struct Pane
+    {
+        int64_t index;      ///< Pane start / pane length
+        Agg agg;
+    };
+
+    // FIFO of final panes with O(1) amortized aggregate (see above)
+    class PaneQueue
+    {
+    public:
+        PaneQueue();
+        bool empty() const { return m_front.empty() && m_back.empty(); }
+        int64_t oldest() const { return m_front.empty() ? m_back.front().index : m_front.back().pane.index; }
+        void push(const Pane &pane);
+        void pop();
+        Agg aggregate() const;
+
+    private:
+        struct Entry
+        {
+            Pane pane;
+            Agg suffix;     ///< This pane combined with every newer front entry
+        };
+        std::vector<Entry> m_front;     ///< Oldest at the back
+        std::vector<Pane> m_back;       ///< Newest at the back
+        Agg m_backAgg;
+    };
+
+    struct KeyState
+    {
+        std::string name;
+        std::deque<Pane> open;  ///< Not yet final, by index; late events may still land here
+        PaneQueue window;       ///< Final panes of the window being emitted
+        int64_t nextWindow;     ///< Index (start / slide) of the next window to consider
+    };
+
+    WindowSpec m_spec;
+    int64_t m_pane;                         ///< Pane length
+    std::vector<KeyState> m_keys;
+    std::unordered_map<std::string, uint32_t> m_keyIds;
+    std::vector<uint32_t> m_active;         ///< Keys with open or queued panes
+    std::vector<bool> m_isActive;
+    int64_t m_maxTime;
+    int64_t m_watermark;
+    int64_t m_finalPanes;                   ///< Panes with index below this are final
+    long long m_events;
+    long long m_late;
+    std::vector<WindowResult> m_results;
+
+    static Agg combine(const Agg &a, const Agg &b);
+    int64_t firstWindowOf(int64_t pane) const;
+    void advance(int64_t watermark);
+    bool emit(uint32_t key);
+};
+
+/** @brief Parse "2025-12-29T05:42:11.197696" or "2025-12-29" (UTC) or epoch seconds into epoch milliseconds. */
+bool parseTimestamp(const std::string &text, int64_t &millis);
+
+/** @brief Epoch milliseconds as "2025-12-29T05:42:11.197" (UTC). */
+std::string formatTimestamp(int64_t millis);
+
+#endif
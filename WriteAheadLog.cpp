@@ -0,0 +1,728 @@
+#include "WriteAheadLog.h"
+#include "DBsystem.h"
+#include "Snapshot.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t WAL_HEADER_SIZE = 9; // u32 length, u32 checksum, u8 type
+static const uint32_t WAL_MAX_PAYLOAD = 1 << 24;
+
+static uint32_t recordChecksum(const char *typeAndPayload, size_t len)
+{
+    SnapshotChecksum sum;
+    sum.update(typeAndPayload, len);
+    return uint32_t(sum.finish());
+}
+
+static bool writeFully(int fd, const std::string &bytes)
+{
+    size_t done = 0;
+    while (done < bytes.size())
+    {
+        ssize_t n = ::write(fd, bytes.data() + done, bytes.size() - done);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        done += size_t(n);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// WalRecord
+// ---------------------------------------------------------------------------
+
+WalRecord::WalRecord(WalRecordType type)
+{
+    m_bytes.reserve(64);
+    m_bytes.assign(WAL_HEADER_SIZE - 1, '\0');
+    m_bytes += char(type);
+}
+
+WalRecord &WalRecord::putInt(long long value)
+{
+    unsigned long long v = (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63);
+    while (v >= 0x80)
+    {
+        m_bytes += char(v | 0x80);
+        v >>= 7;
+    }
+    m_bytes += char(v);
+    return *this;
+}
+
+WalRecord &WalRecord::putDouble(double value)
+{
+    char raw[sizeof(double)];
+    std::memcpy(raw, &value, sizeof(raw));
+    m_bytes.append(raw, sizeof(raw));
+    return *this;
+}
+
+WalRecord &WalRecord::putString(const std::string &value)
+{
+    putInt((long long)value.size());
+    m_bytes += value;
+    return *this;
+}
+
+WalRecord &WalRecord::putStudent(const Student &s)
+{
+    putInt(s.getID()).putString(s.getName()).putString(s.getLevel()).putString(s.getMajor());
+    putDouble(s.getGPA()).putInt(s.getAdvisor());
+    return *this;
+}
+
+WalRecord &WalRecord::putFaculty(const Faculty &f)
+{
+    putInt(f.getID()).putString(f.getName()).putString(f.getLevel()).putString(f.getDepartment());
+    putInt(f.getAdviseeCount());
+    for (int i = 0; i < f.getAdviseeCount(); ++i)
+    {
+        putInt(f.getAdvisee(i));
+    }
+    return *this;
+}
+
+const std::string &WalRecord::bytes()
+{
+    uint32_t length = uint32_t(m_bytes.size() - WAL_HEADER_SIZE);
+    uint32_t sum = recordChecksum(&m_bytes[WAL_HEADER_SIZE - 1], length + 1);
+    std::memcpy(&m_bytes[0], &length, 4);
+    std::memcpy(&m_bytes[4], &sum, 4);
+    return m_bytes;
+}
+
+// ---------------------------------------------------------------------------
+// WriteAheadLog
+// ---------------------------------------------------------------------------
+
+WriteAheadLog::WriteAheadLog()
+    : m_fd(-1), m_retiredFd(-1), m_policy(SYNC_EVERY_OP), m_windowMicros(1000), m_maxBatchBytes(1 << 20), m_appended(0),
+      m_durable(0), m_segmentStart(0), m_flushing(false), m_stop(false), m_ioError(false) {}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    close();
+}
+
+bool WriteAheadLog::parsePolicy(const std::string &name, SyncPolicy &policy)
+{
+    if (name == "every")
+        policy = SYNC_EVERY_OP;
+    else if (name == "group")
+        policy = SYNC_GROUP;
+    else if (name == "async")
+        policy = SYNC_ASYNC;
+    else
+        return false;
+    return true;
+}
+
+bool WriteAheadLog::open(const std::string &path, SyncPolicy policy, std::string &error, int windowMicros,
+                         size_t maxBatchBytes)
+{
+    close();
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (m_fd < 0)
+    {
+        error = "cannot open log " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0)
+    {
+        error = "cannot stat log " + path + ": " + std::strerror(errno);
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_path = path;
+    m_policy = policy;
+    m_windowMicros = windowMicros > 0 ? windowMicros : 1;
+    m_maxBatchBytes = maxBatchBytes;
+    m_appended = uint64_t(st.st_size);
+    m_durable = m_appended;
+    m_segmentStart = 0;
+    m_pending.clear();
+    m_flushing = false;
+    m_stop = false;
+    m_ioError = false;
+    if (m_policy != SYNC_EVERY_OP)
+    {
+        m_flusher = std::thread(&WriteAheadLog::flusherLoop, this);
+    }
+    return true;
+}
+
+void WriteAheadLog::close()
+{
+    if (m_fd < 0)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stop = true;
+    }
+    m_flushCv.notify_all();
+    if (m_flusher.joinable())
+    {
+        m_flusher.join();
+    }
+    sync();
+    if (m_retiredFd >= 0)
+    {
+        ::close(m_retiredFd); // only left behind by a write error
+        m_retiredFd = -1;
+    }
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+uint64_t WriteAheadLog::append(const std::string &record)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    bool wasEmpty = m_pending.empty();
+    m_pending += record;
+    m_appended += record.size();
+    if (m_policy != SYNC_EVERY_OP && (wasEmpty || m_pending.size() >= m_maxBatchBytes))
+    {
+        m_flushCv.notify_one();
+    }
+    return m_appended;
+}
+
+// Called with the lock held and no flush in progress. Writes the pending
+// batch without the lock so writers can keep appending the next batch.
+bool WriteAheadLog::flushLocked(std::unique_lock<std::mutex> &lock)
+{
+    if (m_pending.empty() && m_retiredFd < 0)
+    {
+        return !m_ioError;
+    }
+    m_writing.swap(m_pending);
+    m_pending.clear();
+    std::string retiring;
+    retiring.swap(m_retiring);
+    int retiredFd = m_retiredFd;
+    m_retiredFd = -1;
+    int fd = m_fd;
+    uint64_t end = m_appended;
+    m_flushing = true;
+    lock.unlock();
+
+    // The rest of a rotated-out file first, so durability stays in LSN order
+    bool ok = true;
+    if (retiredFd >= 0)
+    {
+        ok = writeFully(retiredFd, retiring) && ::fdatasync(retiredFd) == 0;
+        ::close(retiredFd);
+    }
+    if (!m_writing.empty())
+    {
+        ok = ok && writeFully(fd, m_writing) && ::fdatasync(fd) == 0;
+    }
+
+    lock.lock();
+    m_flushing = false;
+    if (ok)
+    {
+        m_durable = end;
+    }
+    else
+    {
+        m_ioError = true;
+    }
+    m_durableCv.notify_all();
+    return ok;
+}
+
+bool WriteAheadLog::waitDurable(uint64_t lsn)
+{
+    if (m_policy == SYNC_ASYNC || lsn == 0)
+    {
+        return !failed();
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_durable < lsn && !m_ioError)
+    {
+        if (m_policy == SYNC_EVERY_OP && !m_flushing)
+        {
+            // Become the leader: everything appended so far rides along
+            flushLocked(lock);
+        }
+        else
+        {
+            m_durableCv.wait(lock);
+        }
+    }
+    return m_durable >= lsn;
+}
+
+bool WriteAheadLog::sync()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while ((m_durable < m_appended || m_retiredFd >= 0) && !m_ioError)
+    {
+        if (!m_flushing)
+            flushLocked(lock);
+        else
+            m_durableCv.wait(lock);
+    }
+    return !m_ioError;
+}
+
+// Only swaps the descriptor: the old file's unwritten tail goes out with
+// the next flush, so the caller is not held up by an fsync
+bool WriteAheadLog::rotate(const std::string &path, std::string &error)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        error = "cannot open log " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size != 0)
+    {
+        error = "log segment " + path + " already has data";
+        ::close(fd);
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // One retired file at a time; callers sync() after each rotation
+    while (m_retiredFd >= 0 && !m_ioError)
+    {
+        if (!m_flushing)
+            flushLocked(lock);
+        else
+            m_durableCv.wait(lock);
+    }
+    if (m_ioError)
+    {
+        ::close(fd);
+        error = "log " + m_path + " has a write error";
+        return false;
+    }
+    m_retiring.swap(m_pending);
+    m_pending.clear();
+    m_retiredFd = m_fd;
+    m_fd = fd;
+    m_path = path;
+    m_segmentStart = m_appended;
+    m_flushCv.notify_one();
+    return true;
+}
+
+uint64_t WriteAheadLog::segmentBytes()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_appended - m_segmentStart;
+}
+
+uint64_t WriteAheadLog::appendedLsn()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_appended;
+}
+
+uint64_t WriteAheadLog::durableLsn()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_durable;
+}
+
+bool WriteAheadLog::failed()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_ioError;
+}
+
+// Group/async flusher: once records arrive, wait out the window (or until
+// the batch is full), then write and sync everything in one go
+void WriteAheadLog::flusherLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        while (!m_stop && m_pending.empty() && m_retiredFd < 0)
+        {
+            m_flushCv.wait(lock);
+        }
+        if (m_stop)
+        {
+            break;
+        }
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::microseconds(m_windowMicros);
+        while (!m_stop && m_pending.size() < m_maxBatchBytes)
+        {
+            if (m_flushCv.wait_until(lock, deadline) == std::cv_status::timeout)
+            {
+                break;
+            }
+        }
+        while (m_flushing)
+        {
+            m_durableCv.wait(lock);
+        }
+        flushLocked(lock);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Replay
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    struct PayloadReader
+    {
+        const char *p;
+        const char *end;
+        bool ok;
+
+        long long getInt()
+        {
+            unsigned long long v = 0;
+            int shift = 0;
+            while (ok)
+            {
+                if (p == end || shift > 63)
+                {
+                    ok = false;
+                    break;
+                }
+                unsigned char c = static_cast<unsigned char>(*p++);
+                v |= static_cast<unsigned long long>(c & 0x7F) << shift;
+                if ((c & 0x80) == 0)
+                {
+                    break;
+                }
+                shift += 7;
+            }
+            return static_cast<long long>(v >> 1) ^ -static_cast<long long>(v & 1);
+        }
+
+        double getDouble()
+        {
+            double d = 0.0;
+            if (end - p < (long)sizeof(double))
+            {
+                ok = false;
+                return d;
+            }
+            std::memcpy(&d, p, sizeof(d));
+            p += sizeof(d);
+            return d;
+        }
+
+        std::string getString()
+        {
+            long long n = getInt();
+            if (!ok || n < 0 || n > end - p)
+            {
+                ok = false;
+                return std::string();
+            }
+            std::string s(p, size_t(n));
+            p += n;
+            return s;
+        }
+
+        Student getStudent()
+        {
+            int id = int(getInt());
+            std::string name = getString();
+            std::string level = getString();
+            std::string major = getString();
+            double gpa = getDouble();
+            int advisor = int(getInt());
+            return Student(id, name, level, major, gpa, advisor);
+        }
+
+        Faculty getFaculty()
+        {
+            int id = int(getInt());
+            std::string name = getString();
+            std::string level = getString();
+            std::string department = getString();
+            Faculty f(id, name, level, department);
+            long long count = getInt();
+            for (long long i = 0; i < count && ok; ++i)
+            {
+                f.addAdvisee(int(getInt()));
+            }
+            return f;
+        }
+    };
+
+    bool applyRecord(DBsystem &db, int type, PayloadReader &in);
+
+    // Decodes every write before applying any
+    bool applyTransaction(DBsystem &db, PayloadReader &in)
+    {
+        struct Op
+        {
+            int type;
+            int id;
+            Student student;
+            Faculty faculty;
+        };
+        std::vector<Op> ops;
+        long long count = in.getInt();
+        for (long long i = 0; i < count && in.ok; ++i)
+        {
+            Op op;
+            op.type = int(in.getInt());
+            if (op.type == WAL_UPSERT_STUDENT)
+                op.student = in.getStudent();
+            else if (op.type == WAL_PUT_FACULTY)
+                op.faculty = in.getFaculty();
+            else if (op.type == WAL_DELETE_STUDENT || op.type == WAL_DELETE_FACULTY)
+                op.id = int(in.getInt());
+            else
+                return false;
+            ops.push_back(op);
+        }
+        if (!in.ok)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < ops.size(); ++i)
+        {
+            const Op &op = ops[i];
+            if (op.type == WAL_UPSERT_STUDENT)
+            {
+                db.upsertStudent(op.student);
+            }
+            else if (op.type == WAL_DELETE_STUDENT)
+            {
+                db.deleteStudent(op.id);
+            }
+            else if (op.type == WAL_DELETE_FACULTY)
+            {
+                db.deleteFaculty(op.id);
+            }
+            else
+            {
+                db.deleteFaculty(op.faculty.getID());
+                db.addFaculty(op.faculty);
+            }
+        }
+        return true;
+    }
+
+    bool applyRecord(DBsystem &db, int type, PayloadReader &in)
+    {
+        switch (type)
+        {
+        case WAL_ADD_STUDENT:
+        {
+            Student s = in.getStudent();
+            if (in.ok)
+                db.addStudent(s);
+            break;
+        }
+        case WAL_UPSERT_STUDENT:
+        {
+            Student s = in.getStudent();
+            if (in.ok)
+                db.upsertStudent(s);
+            break;
+        }
+        case WAL_DELETE_STUDENT:
+        {
+            int id = int(in.getInt());
+            if (in.ok)
+                db.deleteStudent(id);
+            break;
+        }
+        case WAL_ADD_FACULTY:
+        {
+            Faculty f = in.getFaculty();
+            if (in.ok)
+                db.addFaculty(f);
+            break;
+        }
+        case WAL_UPSERT_FACULTY:
+        {
+            Faculty f = in.getFaculty();
+            if (in.ok)
+                db.upsertFaculty(f);
+            break;
+        }
+        case WAL_DELETE_FACULTY:
+        {
+            int id = int(in.getInt());
+            if (in.ok)
+                db.deleteFaculty(id);
+            break;
+        }
+        case WAL_CHANGE_ADVISOR:
+        case WAL_REMOVE_ADVISEE:
+        {
+            int studentId = int(in.getInt());
+            int facultyId = int(in.getInt());
+            if (!in.ok)
+                break;
+            if (type == WAL_CHANGE_ADVISOR)
+                db.changeAdvisor(studentId, facultyId);
+            else
+                db.removeAdvisee(studentId, facultyId);
+            break;
+        }
+        case WAL_CLEAR:
+            db.clear();
+            break;
+        case WAL_PUT_FACULTY:
+        {
+            Faculty f = in.getFaculty();
+            if (!in.ok)
+                break;
+            db.deleteFaculty(f.getID());
+            db.addFaculty(f);
+            break;
+        }
+        case WAL_TRANSACTION:
+            return applyTransaction(db, in);
+        default:
+            return false;
+        }
+        return in.ok;
+    }
+
+    enum RecordRead
+    {
+        RECORD_OK,
+        RECORD_END,             ///< End of file, short read or impossible length: a torn write
+        RECORD_BAD_CHECKSUM
+    };
+
+    // Reads the record at the file position into record (type byte, then
+    // payload)
+    RecordRead readRecord(std::FILE *in, std::vector<char> &record)
+    {
+        char header[WAL_HEADER_SIZE];
+        if (std::fread(header, 1, WAL_HEADER_SIZE, in) != WAL_HEADER_SIZE)
+        {
+            return RECORD_END;
+        }
+        uint32_t length, sum;
+        std::memcpy(&length, header, 4);
+        std::memcpy(&sum, header + 4, 4);
+        if (length > WAL_MAX_PAYLOAD)
+        {
+            return RECORD_END;
+        }
+        record.resize(length + 1);
+        record[0] = header[8];
+        if (length > 0 && std::fread(&record[1], 1, length, in) != length)
+        {
+            return RECORD_END;
+        }
+        return recordChecksum(&record[0], record.size()) == sum ? RECORD_OK : RECORD_BAD_CHECKSUM;
+    }
+}
+
+bool WriteAheadLog::replay(const std::string &path, DBsystem &db, ReplayStats &stats, std::string &error,
+                           uint64_t skipThrough)
+{
+    std::FILE *in = std::fopen(path.c_str(), "rb");
+    if (in == NULL)
+    {
+        if (errno == ENOENT)
+        {
+            return true; // nothing logged yet
+        }
+        error = "cannot read log " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    std::setvbuf(in, NULL, _IOFBF, 1 << 20);
+
+    std::vector<char> record;
+    long long good = 0;
+    while (true)
+    {
+        RecordRead read = readRecord(in, record);
+        if (read == RECORD_END)
+        {
+            break;
+        }
+        if (read == RECORD_BAD_CHECKSUM)
+        {
+            // A torn write is the last thing in the file. A verified record
+            // after this one means the damage is in the middle, and cutting
+            // the file here would throw that record away.
+            std::vector<char> next;
+            if (readRecord(in, next) == RECORD_OK)
+            {
+                std::fclose(in);
+                error = "log " + path + " is corrupt at byte " + std::to_string(good) +
+                        ": a record fails its checksum and valid records follow it";
+                return false;
+            }
+            break;
+        }
+        long long end = good + (long long)(WAL_HEADER_SIZE + record.size() - 1);
+        if (uint64_t(end) <= skipThrough)
+        {
+            good = end;
+            ++stats.skipped;
+            continue;
+        }
+        if (uint64_t(good) < skipThrough)
+        {
+            break; // straddles the snapshot's offset: reported below
+        }
+        PayloadReader reader = {&record[1], &record[0] + record.size(), true};
+        if (!applyRecord(db, static_cast<unsigned char>(record[0]), reader))
+        {
+            // Verified but not understood: the records after it are just
+            // as durable, so the file stays as it is
+            std::fclose(in);
+            error = "log " + path + " has a record of type " +
+                    std::to_string(static_cast<unsigned char>(record[0])) + " at byte " + std::to_string(good) +
+                    " that cannot be applied";
+            return false;
+        }
+        good = end;
+        ++stats.records;
+    }
+
+    std::fseek(in, 0, SEEK_END);
+    long long size = std::ftell(in);
+    std::fclose(in);
+
+    // A fresh log started after the save is fine; any other log that does
+    // not reach the snapshot's offset was written for a different snapshot
+    if (size > 0 && uint64_t(good) < skipThrough)
+    {
+        error = "log " + path + " does not belong to the opened snapshot (it ends at byte " +
+                std::to_string(good) + ", the snapshot holds " + std::to_string(skipThrough) + ")";
+        return false;
+    }
+
+    stats.bytes = good;
+    stats.truncatedBytes = size - good;
+    if (size > good && ::truncate(path.c_str(), good) != 0)
+    {
+        error = "cannot truncate torn log tail: " + std::string(std::strerror(errno));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,206 @@
+/**
+ * @file WriteAheadLog.h
+ * @brief Append-only redo log for DBsystem mutations with group commit.
+ *
+ * ARCHITECTURE:
+ *   DBsystem mutation (add/delete/upsert/changeAdvisor ...)
+ *       |  applies in memory, then appends an encoded record
+ *       v
+ *   WriteAheadLog (You are here) - buffers records, fdatasync per policy
+ *       |
+ *       v
+ *   log file  --replay()-->  DBsystem on the next start
+ *
+ * RECORD FORMAT:
+ *   u32 payload length | u32 checksum of type+payload | u8 type | payload
+ *   Integers are zigzag varints, doubles are 8 raw bytes, strings are a
+ *   varint length followed by the bytes.
+ *
+ * The same record format is used for checkpoint deltas (see Checkpoint.h),
+ * which add WAL_PUT_FACULTY to replace a faculty record with its advisees.
+ * A committed transaction (Transaction.h) is one WAL_TRANSACTION record
+ * holding all of its writes, so recovery replays it whole or not at all.
+ *
+ * SYNC POLICIES:
+ *   SYNC_EVERY_OP - a writer syncs before returning; writers that arrive
+ *                   while a sync is running share the next one
+ *   SYNC_GROUP    - a flusher thread syncs once per time window, or as soon
+ *                   as the batch reaches its size cap; writers wait for it
+ *   SYNC_ASYNC    - the flusher syncs each window; writers never wait
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "Student.h"
+#include "Faculty.h"
+
+class DBsystem;
+
+enum SyncPolicy
+{
+    SYNC_EVERY_OP,
+    SYNC_GROUP,
+    SYNC_ASYNC
+};
+
+enum WalRecordType
+{
+    WAL_ADD_STUDENT = 1,
+    WAL_UPSERT_STUDENT = 2,
+    WAL_DELETE_STUDENT = 3,
+    WAL_ADD_FACULTY = 4,
+    WAL_UPSERT_FACULTY = 5,
+    WAL_DELETE_FACULTY = 6,
+    WAL_CHANGE_ADVISOR = 7,
+    WAL_REMOVE_ADVISEE = 8,
+    WAL_CLEAR = 9,
+    WAL_PUT_FACULTY = 10,
+    WAL_TRANSACTION = 11        ///< Committed transaction: count, then (type, payload) per write
+};
+
+/** @brief Counters reported by WriteAheadLog::replay. */
+struct ReplayStats
+{
+    long long records;          ///< Records applied
+    long long skipped;          ///< Records already in the snapshot
+    long long bytes;            ///< Valid bytes read
+    long long truncatedBytes;   ///< Torn/corrupt tail dropped
+
+    ReplayStats() : records(0), skipped(0), bytes(0), truncatedBytes(0) {}
+};
+
+/**
+ * @class WalRecord
+ * @brief Builds one encoded log record.
+ */
+class WalRecord
+{
+public:
+    explicit WalRecord(WalRecordType type);
+
+    WalRecord &putInt(long long value);
+    WalRecord &putDouble(double value);
+    WalRecord &putString(const std::string &value);
+    WalRecord &putStudent(const Student &s);
+    WalRecord &putFaculty(const Faculty &f);
+
+    /** @brief Finished record bytes (header filled in). */
+    const std::string &bytes();
+
+private:
+    std::string m_bytes;
+};
+
+class WriteAheadLog
+{
+public:
+    WriteAheadLog();
+    ~WriteAheadLog();
+
+    /**
+     * @brief Open (or create) @p path for appending.
+     * @param policy When appended records are made durable.
+     * @param windowMicros Group/async flush window.
+     * @param maxBatchBytes Group commit flushes early once this much is pending.
+     * @param error Set on failure.
+     */
+    bool open(const std::string &path, SyncPolicy policy, std::string &error,
+              int windowMicros = 1000, size_t maxBatchBytes = 1 << 20);
+
+    /** @brief Flush, sync and close. */
+    void close();
+
+    /** @brief Queue a record. Thread-safe. @return Its log sequence number (end offset). */
+    uint64_t append(const std::string &record);
+
+    /**
+     * @brief Block until @p lsn is on disk, as the policy requires.
+     * @return False if a write or sync failed first; under SYNC_ASYNC, if
+     *         any has failed so far.
+     */
+    bool waitDurable(uint64_t lsn);
+
+    /** @brief Write and sync everything appended so far. */
+    bool sync();
+
+    /**
+     * @brief Continue appending to @p path. Records appended so far still go
+     *        to the current file, which the next flush or sync() makes
+     *        durable and closes; rotate itself does not wait for the disk.
+     *        LSNs keep increasing.
+     */
+    bool rotate(const std::string &path, std::string &error);
+
+    bool isOpen() const { return m_fd >= 0; }
+    SyncPolicy policy() const { return m_policy; }
+    const std::string &path() const { return m_path; }
+
+    /** @brief Bytes appended since open (including replayed history), across rotations. */
+    uint64_t appendedLsn();
+
+    /** @brief Bytes in the current file. */
+    uint64_t segmentBytes();
+
+    /** @brief Bytes known to be durable. */
+    uint64_t durableLsn();
+
+    /** @brief A write or sync has failed; nothing appended since will become durable. */
+    bool failed();
+
+    /**
+     * @brief Apply every valid record in @p path to @p db. A torn tail (a
+     *        short or impossibly long last record, or a last record that
+     *        fails its checksum) is cut off so later appends start at a
+     *        record boundary.
+     * @param skipThrough Records ending at or before this offset are already
+     *        in @p db (its snapshot's logOffset) and are only counted.
+     * @return False, leaving the file as it is, if it exists but cannot be
+     *         read, if a record that fails its checksum is followed by a
+     *         valid one, if a valid record cannot be applied, or if the file
+     *         is not empty and has no record boundary at @p skipThrough.
+     */
+    static bool replay(const std::string &path, DBsystem &db, ReplayStats &stats, std::string &error,
+                       uint64_t skipThrough = 0);
+
+    /** @brief Parse a policy name ("every", "group", "async"). */
+    static bool parsePolicy(const std::string &name, SyncPolicy &policy);
+
+private:
+    int m_fd;
+    int m_retiredFd;                       ///< File rotated out whose tail is not yet synced, or -1
+    std::string m_path;
+    SyncPolicy m_policy;
+    int m_windowMicros;
+    size_t m_maxBatchBytes;
+
+    std::mutex m_mutex;
+    std::condition_variable m_durableCv;   ///< Signalled when m_durable advances
+    std::condition_variable m_flushCv;     ///< Wakes the flusher thread
+    std::string m_pending;                 ///< Appended but not yet written
+    std::string m_writing;                 ///< Batch owned by the current flush
+    std::string m_retiring;                ///< Pending bytes bound for m_retiredFd
+    uint64_t m_appended;
+    uint64_t m_durable;
+    uint64_t m_segmentStart;               ///< m_appended when the current file was started
+    bool m_flushing;
+    bool m_stop;
+    bool m_ioError;
+    std::thread m_flusher;
+
+    bool flushLocked(std::unique_lock<std::mutex> &lock);
+    void flusherLoop();
+
+    WriteAheadLog(const WriteAheadLog &);
+    WriteAheadLog &operator=(const WriteAheadLog &);
+};
+
+#endif
@@ -0,0 +1,1172 @@
+/**
+ * @file bench.cpp
+ * @brief Benchmarks for the concurrent parts of the University Database
+ *        System. Each one checks its own results and prints a ✓ or ✗ line.
+ *
+ * Usage:
+ *   bench --threads 4 --broker-bench 20000000   produce/consume through the in-process
+ *                                          message broker (SPSC and MPMC partitions)
+ *   bench --threads 32 --olc-bench 1000000  95% lookups / 5% writes on 1, 2, 4 ... 32
+ *                                          threads: ConcurrentBST vs one locked LazyBST
+ *   bench --threads 8 --skiplist-bench 1000000   ingest threads upsert while a scanner
+ *                                          checks ordered scans: skip list vs locked tree
+ *   bench --mvcc-bench 100000               reports walk pinned snapshots (PersistentBST)
+ *                                          while a writer keeps editing students
+ *   bench --threads 4 --txn-bench 2000      advisor moves as snapshot-isolated transactions;
+ *                                          every snapshot must show whole moves only
+ *   bench --threads 64 --async-bench 200000 durable writes from 1 and 64 threads vs
+ *                                          1000 coroutines on one thread (AsyncDB)
+ *   bench --io-bench 2000000                durable export, save and cold read back through
+ *                                          io_uring and through plain read/write
+ *   bench --pool 8 --pin --pool-bench 2000000   stable sort, reduce and snapshot build on
+ *                                          one thread and on the work-stealing pool
+ *   bench --shards 4 --shard-bench 1000000  batch upserts, lookups and an aggregate on
+ *                                          a thread-per-shard store (hash and range)
+ *   bench --threads 4 --pipeline 64 --loadgen unix:/tmp/udb.sock 2000000
+ *                                          pipelined 90/10 FIND/ADD load against a
+ *                                          running main --serve
+ *
+ * Benchmarks run in command-line order, each with the options given before
+ * it; the first one that fails ends the run with exit status 1.
+ *
+ * Build: make bench
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#include "AsyncDB.h"
+#include "ConcurrentBST.h"
+#include "CsvIO.h"
+#include "DBServer.h"
+#include "DBsystem.h"
+#include "IoRing.h"
+#include "JsonLines.h"
+#include "LazyBST.h"
+#include "MessageBroker.h"
+#include "OutputBuffer.h"
+#include "PersistentBST.h"
+#include "ShardedDBsystem.h"
+#include "Student.h"
+#include "TableExport.h"
+#include "TaskScheduler.h"
+#include "Transaction.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// ANSI color codes
+const string RESET = "\033[0m";
+const string RED = "\033[31m";
+const string GREEN = "\033[32m";
+
+// --threads 0 means one per core
+int threadsOrCores(int threads) {
+    return threads > 0 ? threads : int(max(1u, thread::hardware_concurrency()));
+}
+
+// Push `messages` events through one topic: in SPSC mode one producer and
+// one consumer thread per partition, in MPMC mode all of them on one
+// partition. The consumers check that every event arrives once, in order
+// per producer.
+bool benchBroker(PartitionMode mode, int threads, long long messages) {
+    typedef chrono::steady_clock Clock;
+    const size_t BATCH = 256;
+    MessageBroker<StreamEvent> broker;
+    int partitions = (mode == PARTITION_SPSC) ? threads : 1;
+    int topic = broker.createTopic("bench", partitions, 1 << 16, mode);
+    int group = broker.joinGroup(topic, "bench");
+    long long perProducer = messages / threads;
+    atomic<long long> consumed(0);
+    atomic<long long> bad(0);
+
+    Clock::time_point start = Clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(thread([&, t] {
+            StreamEvent batch[BATCH];
+            int partition = (mode == PARTITION_SPSC) ? t : 0;
+            for (long long i = 0; i < perProducer;) {
+                size_t n = 0;
+                for (; n < BATCH && i + (long long)n < perProducer; ++n) {
+                    batch[n].timestamp = i + (long long)n;
+                    batch[n].key = uint32_t(t);
+                    batch[n].flags = 0;
+                    batch[n].value = 1.0;
+                }
+                for (size_t sent = 0; sent < n;) {
+                    size_t k = broker.produce(topic, partition, batch + sent, n - sent);
+                    if (k == 0) {
+                        this_thread::yield();
+                    }
+                    sent += k;
+                }
+                i += (long long)n;
+            }
+        }));
+        workers.push_back(thread([&, t] {
+            StreamEvent batch[BATCH];
+            int partition = (mode == PARTITION_SPSC) ? t : 0;
+            long long goal = (mode == PARTITION_SPSC) ? perProducer : perProducer * threads;
+            vector<long long> next(threads, 0);
+            long long mine = 0;
+            while ((mode == PARTITION_SPSC ? mine : consumed.load(memory_order_relaxed)) < goal) {
+                size_t n = broker.consume(topic, group, partition, batch, BATCH);
+                if (n == 0) {
+                    this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    // MPMC consumers share the stream, so only SPSC sees every timestamp
+                    long long& expect = next[batch[i].key];
+                    if (mode == PARTITION_SPSC ? batch[i].timestamp != expect : batch[i].timestamp < expect) {
+                        bad.fetch_add(1, memory_order_relaxed);
+                    }
+                    expect = batch[i].timestamp + 1;
+                }
+                mine += (long long)n;
+                consumed.fetch_add((long long)n, memory_order_relaxed);
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    long long total = perProducer * threads;
+    bool ok = consumed.load() == total && bad.load() == 0 && broker.lag(topic, group) == 0;
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << (mode == PARTITION_SPSC ? "SPSC" : "MPMC") << ": "
+         << total << " events" << RESET << " (" << threads << " producers, " << threads << " consumers, "
+         << partitions << (partitions == 1 ? " partition" : " partitions") << ", " << bad.load()
+         << " out of order) in " << fixed << setprecision(3) << seconds << " s, " << setprecision(1)
+         << total / seconds / 1e6 << " M events/s\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// Load `count` students with scattered ids into a sharded store in one
+// batch, look every one up in one scatter-gather call and 100k of them one
+// at a time, then average GPA by major across the shards. Checks that each
+// step sees every student exactly once.
+bool benchShards(ShardRouting routing, int shards, long long count) {
+    typedef chrono::steady_clock Clock;
+    static const char* MAJORS[] = {"CS", "Math", "Physics", "History", "Biology", "Music"};
+    vector<Student> rows;
+    vector<int> ids;
+    rows.reserve(size_t(count));
+    ids.reserve(size_t(count));
+    for (long long i = 0; i < count; ++i) {
+        int id = int((uint32_t(i) * 2654435761u) & 0x7fffffff);
+        rows.push_back(Student(id, "Student", "Senior", MAJORS[i % 6], double(i % 41) / 10.0, 0));
+        ids.push_back(id);
+    }
+
+    ShardOptions options;
+    options.shards = shards;
+    options.routing = routing;
+    if (routing == SHARD_BY_RANGE) {
+        // Equal-count ranges from the sorted ids, like DBsystem::studentSplitKeys
+        vector<int> sorted(ids);
+        sort(sorted.begin(), sorted.end());
+        int parts = shards > 0 ? shards : int(max(1u, thread::hardware_concurrency()));
+        for (int p = 1; p < parts && !sorted.empty(); ++p) {
+            options.studentSplits.push_back(sorted[sorted.size() * size_t(p) / size_t(parts)]);
+        }
+    }
+    ShardedDBsystem store(options);
+
+    Clock::time_point start = Clock::now();
+    UpsertCounts loaded = store.upsertStudents(rows);
+    double loadSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<Student> out;
+    vector<char> found;
+    start = Clock::now();
+    size_t hits = store.findStudents(ids, out, found);
+    double batchSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    long long singles = min(count, 100000LL);
+    long long singleHits = 0;
+    Student one;
+    start = Clock::now();
+    for (long long i = 0; i < singles; ++i) {
+        singleHits += store.findStudent(ids[size_t(i)], one) ? 1 : 0;
+    }
+    double singleSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<ShardGroupStats> groups;
+    string error;
+    start = Clock::now();
+    store.studentGpaBy("major", groups, error);
+    double aggSeconds = chrono::duration<double>(Clock::now() - start).count();
+    long long grouped = 0;
+    for (size_t g = 0; g < groups.size(); ++g) {
+        grouped += groups[g].count;
+    }
+
+    long long total = store.studentCount();
+    bool ok = loaded.inserted == total && hits == size_t(count) && singleHits == singles && grouped == total;
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << (routing == SHARD_BY_HASH ? "hash" : "range") << ": "
+         << total << " students on " << store.shards() << (store.shards() == 1 ? " shard" : " shards") << RESET
+         << fixed << setprecision(3) << " - load " << loadSeconds << " s, batch lookup " << batchSeconds
+         << " s, " << setprecision(1) << singles / singleSeconds / 1e3 << "k single lookups/s, "
+         << setprecision(3) << "gpa by major " << aggSeconds << " s (" << groups.size() << " groups)\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// 95% lookups, 5% writes (half upserts, half removes) over `keys` ids on
+// `threads` threads, against ConcurrentBST and against one LazyBST behind a
+// mutex. Both passes run the same per-thread operation streams; afterwards
+// both trees must be in order with as many elements as they count.
+bool benchConcurrentTree(int threads, long long keys) {
+    typedef chrono::steady_clock Clock;
+    const long long OPS = 400000;
+    long long space = max(2 * keys, 2LL);
+    ConcurrentBST<Student> olc;
+    LazyBST<Student> locked;
+    mutex lock;
+    for (long long i = 0; i < keys; ++i) {
+        Student s(int((uint32_t(i * 2) * 2654435761u) % uint32_t(space)), "Student", "Senior", "CS", 3.0, 0);
+        if (olc.upsert(s)) {
+            locked.insert(s, false);
+        }
+    }
+
+    double seconds[2];
+    long long hits[2] = {0, 0};
+    for (int pass = 0; pass < 2; ++pass) {
+        atomic<long long> found(0);
+        Clock::time_point start = Clock::now();
+        vector<thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.push_back(thread([&, t, pass] {
+                uint64_t x = 88172645463325252ULL + uint64_t(t) * 0x9E3779B97F4A7C15ULL;
+                long long mine = 0;
+                Student out;
+                Student key;
+                for (long long i = 0; i < OPS / threads; ++i) {
+                    x ^= x << 13;
+                    x ^= x >> 7;
+                    x ^= x << 17;
+                    key.setID(int((x >> 8) % uint64_t(space)));
+                    int op = int(x % 40);   // 0: remove, 1: upsert, else lookup
+                    if (pass == 0) {
+                        if (op == 0) {
+                            olc.remove(key);
+                        } else if (op == 1) {
+                            olc.upsert(key);
+                        } else {
+                            mine += olc.find(key, out) ? 1 : 0;
+                        }
+                    } else {
+                        lock_guard<mutex> guard(lock);
+                        if (op == 0) {
+                            locked.remove(key);
+                        } else if (op == 1) {
+                            if (locked.search(key) == NULL) {
+                                locked.insert(key, false);
+                            }
+                        } else {
+                            // Copied out under the lock, as find does
+                            Student* s = locked.search(key);
+                            if (s != NULL) {
+                                out = *s;
+                                ++mine;
+                            }
+                        }
+                    }
+                }
+                found.fetch_add(mine);
+            }));
+        }
+        for (size_t i = 0; i < workers.size(); ++i) {
+            workers[i].join();
+        }
+        seconds[pass] = chrono::duration<double>(Clock::now() - start).count();
+        hits[pass] = found.load();
+    }
+
+    struct Check {
+        long long n;
+        int last;
+        bool ordered;
+        void operator()(const Student& s) {
+            ordered = ordered && (n == 0 || s.getID() > last);
+            last = s.getID();
+            ++n;
+        }
+    };
+    Check a = {0, 0, true};
+    Check b = {0, 0, true};
+    olc.visitInOrder(a);
+    locked.visitInOrder(b);
+    bool ok = a.ordered && b.ordered && a.n == olc.size() && b.n == locked.size();
+    long long ops = OPS / threads * threads;
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << threads << (threads == 1 ? " thread: " : " threads: ")
+         << RESET << fixed << setprecision(2) << "OLC " << ops / seconds[0] / 1e6 << " M ops/s, locked "
+         << ops / seconds[1] / 1e6 << " M ops/s (" << a.n << " / " << b.n << " keys, "
+         << hits[0] << " / " << hits[1] << " hits)\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// `rows` enrollments (odd ids, in scrambled order) upserted by `threads`
+// ingest threads into an enrollment table of `rows` even ids. With the
+// skip list index a scanner thread keeps running full and range scans
+// meanwhile, each of which must come out in order and hold every even id;
+// the tree pass (writers behind the write mutex, no scans: LazyBST cannot
+// be read during writes) is the baseline.
+bool benchSkipList(int threads, long long rows) {
+    typedef chrono::steady_clock Clock;
+    struct Ids {
+        static int at(long long i, int odd) {
+            return int((uint32_t(i) * 2654435761u) & 0x3FFFFFFFu) * 2 + odd;
+        }
+    };
+    struct Scan {
+        long long n;
+        long long evens;
+        int last;
+        bool ordered;
+        void operator()(const Enrollment& e) {
+            ordered = ordered && (n == 0 || e.getID() > last);
+            evens += (e.getID() % 2 == 0) ? 1 : 0;
+            last = e.getID();
+            ++n;
+        }
+    };
+
+    double seconds[2];
+    long long scans = 0;
+    long long rangeRows = 0;
+    bool consistent = true;
+    bool counted = true;
+    for (int pass = 0; pass < 2; ++pass) {
+        DBsystem db;
+        string error;
+        db.setTableIndex("enrollments", pass == 0 ? INDEX_SKIPLIST : INDEX_TREE, error);
+        for (long long i = 0; i < rows; ++i) {
+            db.upsertEnrollment(Enrollment(Ids::at(i, 0), 1, 1, "ENROLLED", "", 0.0));
+        }
+        atomic<bool> done(false);
+        thread scanner;
+        if (pass == 0) {
+            scanner = thread([&] {
+                // Every even id below the median of the scrambled ids
+                int hi = 1 << 30;
+                long long below = 0;
+                for (long long i = 0; i < rows; ++i) {
+                    below += Ids::at(i, 0) < hi ? 1 : 0;
+                }
+                while (!done.load(memory_order_acquire)) {
+                    Scan all = {0, 0, 0, true};
+                    db.forEachEnrollment(all);
+                    Scan range = {0, 0, 0, true};
+                    db.forEachEnrollmentInRange(NULL, &hi, range);
+                    consistent = consistent && all.ordered && all.evens == rows && range.ordered &&
+                                 range.evens == below && (range.n == 0 || range.last < hi);
+                    rangeRows += range.n;
+                    ++scans;
+                }
+            });
+        }
+        Clock::time_point start = Clock::now();
+        vector<thread> writers;
+        for (int t = 0; t < threads; ++t) {
+            writers.push_back(thread([&, t] {
+                for (long long i = t; i < rows; i += threads) {
+                    db.upsertEnrollment(Enrollment(Ids::at(i, 1), 1, 1, "ENROLLED", "", 0.0));
+                }
+            }));
+        }
+        for (size_t i = 0; i < writers.size(); ++i) {
+            writers[i].join();
+        }
+        seconds[pass] = chrono::duration<double>(Clock::now() - start).count();
+        done.store(true, memory_order_release);
+        if (scanner.joinable()) {
+            scanner.join();
+        }
+        Scan final = {0, 0, 0, true};
+        db.forEachEnrollment(final);
+        counted = counted && final.ordered && final.n == 2 * rows && db.enrollmentCount() == 2 * rows;
+    }
+
+    bool ok = consistent && counted;
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << threads << (threads == 1 ? " ingest thread: " : " ingest threads: ")
+         << RESET << fixed << setprecision(2) << "skip list " << rows / seconds[0] / 1e6 << " M rows/s with "
+         << scans << " concurrent scans (" << rangeRows << " rows by range)" << (consistent ? "" : " INCONSISTENT")
+         << ", locked tree " << rows / seconds[1] / 1e6 << " M rows/s\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// A writer thread keeps updating, adding and deleting students while a
+// report thread takes snapshots and walks each one twice: both walks must
+// agree with each other and with the version's size, in key order. The
+// live tree could not be walked at all while the writer runs.
+bool benchSnapshots(long long students) {
+    typedef chrono::steady_clock Clock;
+    DBsystem db;
+    vector<Student> batch;
+    for (long long i = 0; i < students; ++i) {
+        batch.push_back(Student(int(i * 2), "Student", "Senior", "CS", 2.0, 0));
+    }
+    db.upsertStudents(batch);
+
+    struct Walk {
+        long long n;
+        double gpa;
+        int last;
+        bool ordered;
+        void operator()(const Student& s) {
+            ordered = ordered && (n == 0 || s.getID() > last);
+            gpa += s.getGPA();
+            last = s.getID();
+            ++n;
+        }
+    };
+
+    atomic<bool> done(false);
+    atomic<long long> writes(0);
+    thread writer([&] {
+        uint64_t x = 88172645463325252ULL;
+        while (!done.load(memory_order_acquire)) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            int id = int((x >> 8) % uint64_t(2 * students));
+            if (x % 8 == 0) {
+                db.deleteStudent(id);
+            } else {
+                db.upsertStudent(Student(id, "Student", "Senior", "CS", double(x % 400) / 100.0, 0));
+            }
+            writes.fetch_add(1, memory_order_relaxed);
+        }
+    });
+
+    long long snapshots = 0;
+    long long rows = 0;
+    double snapshotMs = 0;
+    bool ok = true;
+    Clock::time_point start = Clock::now();
+    while (chrono::duration<double>(Clock::now() - start).count() < 2.0 || snapshots < 3) {
+        Clock::time_point before = Clock::now();
+        DBsnapshot view = db.snapshot();
+        snapshotMs += chrono::duration<double, milli>(Clock::now() - before).count();
+        Walk first = {0, 0.0, 0, true};
+        Walk second = {0, 0.0, 0, true};
+        view.students.visitInOrder(first);
+        view.students.visitInOrder(second);
+        ok = ok && first.ordered && first.n == view.students.size() && second.n == first.n &&
+             second.gpa == first.gpa;
+        rows += first.n + second.n;
+        ++snapshots;
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    done.store(true, memory_order_release);
+    writer.join();
+
+    DBsnapshot last = db.snapshot();
+    ok = ok && last.students.size() == db.studentCount();
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << snapshots << " snapshots" << RESET << fixed
+         << setprecision(2) << " (" << snapshotMs / double(snapshots) << " ms each) walked at "
+         << rows / seconds / 1e6 << " M rows/s beside " << writes.load() / seconds / 1e6
+         << " M writes/s; every walk consistent: " << (ok ? "yes" : "NO") << "\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// Every student's advisor lists them, and no advisee list holds anyone else
+bool advisorsConsistent(const DBsnapshot& view) {
+    struct Check {
+        const DBsnapshot* view;
+        long long advised;
+        bool ok;
+        void operator()(const Student& s) {
+            if (s.getAdvisor() == 0) {
+                return;
+            }
+            ++advised;
+            const Faculty* f = view->findFaculty(s.getAdvisor());
+            bool listed = false;
+            for (int i = 0; f != NULL && i < f->getAdviseeCount() && !listed; ++i) {
+                listed = f->getAdvisee(i) == s.getID();
+            }
+            ok = ok && listed;
+        }
+    };
+    struct Count {
+        long long advisees;
+        void operator()(const Faculty& f) { advisees += f.getAdviseeCount(); }
+    };
+    Check check = {&view, 0, true};
+    view.students.visitInOrder(check);
+    Count count = {0};
+    view.faculty.visitInOrder(count);
+    return check.ok && count.advisees == check.advised;
+}
+
+// `threads` threads move random students to random advisors, each move one
+// transaction over the student and both advisee lists, while one more
+// thread makes the same moves with plain DBsystem::changeAdvisor calls (so
+// some commits must lose) and a reader checks the invariant in every snapshot.
+bool benchTransactions(int threads, long long students) {
+    typedef chrono::steady_clock Clock;
+    const long long MOVES = 20000;
+    DBsystem db;
+    int faculty = int(max(2LL, students / 20));
+    for (int f = 1; f <= faculty; ++f) {
+        db.addFaculty(Faculty(f, "Faculty", "Professor", "CS"));
+    }
+    for (long long i = 1; i <= students; ++i) {
+        int advisor = int(i % faculty) + 1;
+        db.addStudent(Student(int(i), "Student", "Senior", "CS", 3.0, 0));
+        db.changeAdvisor(int(i), advisor);
+    }
+
+    atomic<bool> done(false);
+    atomic<long long> commits(0);
+    atomic<long long> conflicts(0);
+    atomic<long long> plain(0);
+    long long checked = 0;
+    bool consistent = true;
+    thread reader([&] {
+        while (!done.load(memory_order_acquire)) {
+            consistent = advisorsConsistent(db.snapshot()) && consistent;
+            ++checked;
+        }
+    });
+    thread writer([&] {
+        uint64_t x = 0x2545F4914F6CDD1DULL;
+        while (!done.load(memory_order_acquire)) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            db.changeAdvisor(int(x % uint64_t(students)) + 1, int((x >> 32) % uint64_t(faculty)) + 1);
+            plain.fetch_add(1, memory_order_relaxed);
+        }
+    });
+
+    Clock::time_point start = Clock::now();
+    vector<thread> movers;
+    for (int t = 0; t < threads; ++t) {
+        movers.push_back(thread([&, t] {
+            uint64_t x = 88172645463325252ULL + uint64_t(t) * 0x9E3779B97F4A7C15ULL;
+            Transaction txn;
+            string error;
+            for (long long i = 0; i < MOVES / threads; ++i) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                db.begin(txn);
+                if (!txn.changeAdvisor(int(x % uint64_t(students)) + 1, int((x >> 32) % uint64_t(faculty)) + 1, error)) {
+                    db.abort(txn);
+                    continue;
+                }
+                if (db.commit(txn, error)) {
+                    commits.fetch_add(1, memory_order_relaxed);
+                } else {
+                    conflicts.fetch_add(1, memory_order_relaxed);
+                }
+            }
+        }));
+    }
+    for (size_t i = 0; i < movers.size(); ++i) {
+        movers[i].join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    done.store(true, memory_order_release);
+    reader.join();
+    writer.join();
+
+    bool ok = consistent && advisorsConsistent(db.snapshot()) && commits.load() > 0;
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << threads << (threads == 1 ? " thread: " : " threads: ")
+         << RESET << fixed << setprecision(2) << commits.load() / seconds / 1e3 << " K commits/s, "
+         << conflicts.load() << " write conflicts, " << plain.load() << " plain moves beside; "
+         << checked << " snapshots checked, advisor lists " << (consistent ? "always consistent" : "TORN") << "\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// Writes a whole request batch to a blocking socket
+bool sendAll(int fd, const string& bytes) {
+    for (size_t pos = 0; pos < bytes.size();) {
+        ssize_t n = send(fd, bytes.data() + pos, bytes.size() - pos, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        pos += size_t(n);
+    }
+    return true;
+}
+
+// Reads until `count` replies have arrived; counts error and nil replies
+bool readReplies(int fd, string& buffer, int count, long long& errors, long long& misses) {
+    buffer.clear();
+    size_t pos = 0;
+    char chunk[65536];
+    while (count > 0) {
+        long used = DBServer::replyLength(buffer.data() + pos, buffer.size() - pos);
+        if (used < 0) {
+            return false;
+        }
+        if (used > 0) {
+            char type = buffer[pos];
+            errors += type == '-';
+            misses += type == '$';  // A found record is an array
+            pos += size_t(used);
+            --count;
+            continue;
+        }
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, size_t(n));
+    }
+    return true;
+}
+
+void appendCommand(string& out, const char* const* args, int n) {
+    out += '*';
+    out += to_string(n);
+    out += "\r\n";
+    for (int i = 0; i < n; ++i) {
+        size_t len = strlen(args[i]);
+        out += '$';
+        out += to_string(len);
+        out += "\r\n";
+        out.append(args[i], len);
+        out += "\r\n";
+    }
+}
+
+// Load generator for --serve: preloads KEYS students with pipelined ADDs,
+// then `connections` clients each keep `depth` requests in flight (write a
+// batch, read all its replies, repeat), 90% FIND / 10% ADD over the keys.
+bool runLoadgen(const string& address, int connections, int depth, long long ops) {
+    typedef chrono::steady_clock Clock;
+    const int KEYS = 100000;
+    string error;
+    int fd = DBServer::connectTo(address, error);
+    if (fd < 0) {
+        cerr << RED << "✗ Cannot connect: " << error << RESET << "\n";
+        return false;
+    }
+    bool ok = true;
+    long long errors = 0;
+    long long misses = 0;
+    string request;
+    string reply;
+    for (int first = 1; first <= KEYS && ok; first += 1000) {
+        request.clear();
+        int n = min(1000, KEYS - first + 1);
+        for (int k = first; k < first + n; ++k) {
+            string id = to_string((long long)k * 48271 % KEYS + 1);  // Scrambled: sorted keys unbalance the tree
+            const char* args[] = {"ADD", "STUDENT", id.c_str(), "Student", "Senior", "CS", "3.5", "1"};
+            appendCommand(request, args, 8);
+        }
+        ok = sendAll(fd, request) && readReplies(fd, reply, n, errors, misses);
+    }
+    close(fd);
+    if (!ok || errors > 0) {
+        cerr << RED << "✗ Preload failed" << RESET << "\n";
+        return false;
+    }
+
+    long long perClient = max(1LL, ops / connections);
+    atomic<long long> done(0);
+    atomic<long long> failed(0);
+    atomic<long long> errorCount(0);
+    atomic<long long> missCount(0);
+    Clock::time_point start = Clock::now();
+    vector<thread> clients;
+    for (int c = 0; c < connections; ++c) {
+        clients.push_back(thread([&, c] {
+            string err;
+            int sock = DBServer::connectTo(address, err);
+            if (sock < 0) {
+                failed.fetch_add(1);
+                return;
+            }
+            uint64_t x = 88172645463325252ULL + uint64_t(c) * 0x9E3779B97F4A7C15ULL;
+            string req;
+            string rep;
+            long long errs = 0;
+            long long miss = 0;
+            long long sent = 0;
+            while (sent < perClient) {
+                int n = int(min<long long>(depth, perClient - sent));
+                req.clear();
+                for (int i = 0; i < n; ++i) {
+                    x ^= x << 13;
+                    x ^= x >> 7;
+                    x ^= x << 17;
+                    string id = to_string(x % KEYS + 1);
+                    if (x % 10 == 0) {
+                        const char* args[] = {"ADD", "STUDENT", id.c_str(), "Student", "Junior", "Math", "3.7", "2"};
+                        appendCommand(req, args, 8);
+                    } else {
+                        const char* args[] = {"FIND", "STUDENT", id.c_str()};
+                        appendCommand(req, args, 3);
+                    }
+                }
+                if (!sendAll(sock, req) || !readReplies(sock, rep, n, errs, miss)) {
+                    failed.fetch_add(1);
+                    break;
+                }
+                sent += n;
+            }
+            close(sock);
+            done.fetch_add(sent);
+            errorCount.fetch_add(errs);
+            missCount.fetch_add(miss);
+        }));
+    }
+    for (size_t i = 0; i < clients.size(); ++i) {
+        clients[i].join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    ok = failed.load() == 0 && errorCount.load() == 0 && missCount.load() == 0;
+    long long batches = (perClient + depth - 1) / depth * connections;
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << connections
+         << (connections == 1 ? " connection" : " connections") << ", pipeline " << depth << ": " << RESET << fixed
+         << setprecision(2) << done.load() / seconds / 1e3 << " K ops/s (90% FIND / 10% ADD), "
+         << seconds * 1e6 * connections / batches << " us per batch round trip";
+    if (!ok) {
+        cerr << "; " << failed.load() << " connections failed, " << errorCount.load() << " error replies, "
+             << missCount.load() << " missing keys";
+    }
+    cerr << "\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// One coroutine client: `count` lookup-then-upsert requests on random keys
+CoTask<void> asyncClient(AsyncDB& adb, uint64_t x, long long count, int keys, long long& done) {
+    for (long long i = 0; i < count; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        int id = int(x % uint64_t(keys)) + 1;
+        optional<Student> s = co_await adb.findStudent(id);
+        Student row = s ? *s : Student(id, "Student", "Senior", "CS", 0.0, 0);
+        row.setGPA(double(x % 400) / 100.0);
+        co_await adb.upsertStudent(row);
+        ++done;
+    }
+}
+
+// Scans the whole table alongside the clients; each pass must be in id order
+CoTask<void> asyncScanner(AsyncDB& adb, const long long& done, long long total, long long& scans, bool& ordered) {
+    struct Ordered {
+        int last;
+        bool ok;
+        void operator()(const Student& s) {
+            ok = ok && s.getID() > last;
+            last = s.getID();
+        }
+    };
+    do {
+        Ordered check = {0, true};
+        co_await adb.scanStudents(0, numeric_limits<int>::max(), check);
+        ordered = ordered && check.ok;
+        ++scans;
+    } while (done < total);
+}
+
+// Lookup-then-upsert requests against a group-commit log: synchronous calls
+// on one thread and on `threads` threads (each write waits for its flush),
+// then coroutines on one thread with IN_FLIGHT requests outstanding, whose
+// writes share flushes. A scanner coroutine walks snapshots meanwhile.
+bool benchAsync(int threads, long long requests) {
+    typedef chrono::steady_clock Clock;
+    const int KEYS = 10000;
+    const int IN_FLIGHT = 1000;
+    char path[] = "/tmp/udb-async-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        cerr << RED << "✗ Cannot create a log file" << RESET << "\n";
+        return false;
+    }
+    close(fd);
+
+    double rates[3];
+    long long scans = 0;
+    bool ordered = true;
+    bool ok = true;
+    for (int mode = 0; mode < 3 && ok; ++mode) {
+        DBsystem db;
+        for (int i = 0; i < KEYS; ++i) {
+            int id = int((long long)i * 7919 % KEYS) + 1;  // Scrambled: sorted keys unbalance the tree
+            db.addStudent(Student(id, "Student", "Senior", "CS", 3.0, 0));
+        }
+        string error;
+        unlink(path);
+        if (!db.attachLog(path, SYNC_GROUP, error)) {
+            cerr << RED << "✗ " << error << RESET << "\n";
+            return false;
+        }
+        // The synchronous runs wait a whole flush per write per thread, so they get fewer requests
+        int workers = mode == 0 ? 1 : mode == 1 ? max(1, threads) : IN_FLIGHT;
+        long long count = mode == 2 ? requests : min(requests, 2000LL * workers);
+        long long done = 0;
+        Clock::time_point start = Clock::now();
+        if (mode < 2) {
+            vector<thread> pool;
+            atomic<long long> finished(0);
+            for (int t = 0; t < workers; ++t) {
+                pool.push_back(thread([&, t] {
+                    uint64_t x = 88172645463325252ULL + uint64_t(t) * 0x9E3779B97F4A7C15ULL;
+                    for (long long i = 0; i < count / workers; ++i) {
+                        x ^= x << 13;
+                        x ^= x >> 7;
+                        x ^= x << 17;
+                        int id = int(x % uint64_t(KEYS)) + 1;
+                        Student* s = db.findStudent(id);
+                        Student row = s != NULL ? *s : Student(id, "Student", "Senior", "CS", 0.0, 0);
+                        row.setGPA(double(x % 400) / 100.0);
+                        db.upsertStudent(row);
+                        finished.fetch_add(1, memory_order_relaxed);
+                    }
+                }));
+            }
+            for (size_t t = 0; t < pool.size(); ++t) {
+                pool[t].join();
+            }
+            done = finished.load();
+        } else {
+            CoScheduler scheduler;
+            AsyncDB adb(db, scheduler);
+            for (int c = 0; c < workers; ++c) {
+                scheduler.spawn(asyncClient(adb, 88172645463325252ULL + uint64_t(c) * 0x9E3779B97F4A7C15ULL,
+                                            count / workers, KEYS, done));
+            }
+            scheduler.spawn(asyncScanner(adb, done, count / workers * workers, scans, ordered));
+            scheduler.run();
+        }
+        rates[mode] = done / chrono::duration<double>(Clock::now() - start).count();
+        ok = db.log()->durableLsn() == db.log()->appendedLsn() && db.studentCount() == KEYS;
+        db.detachLog();
+    }
+    unlink(path);
+
+    ok = ok && ordered && scans > 0;
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << "lookup + durable upsert: " << RESET << fixed << setprecision(2)
+         << "1 thread " << rates[0] / 1e3 << " K/s, " << threads << (threads == 1 ? " thread " : " threads ")
+         << rates[1] / 1e3 << " K/s, " << IN_FLIGHT << " coroutines on 1 thread " << rates[2] / 1e3 << " K/s ("
+         << scans << " snapshot scans alongside" << (ordered ? "" : ", OUT OF ORDER") << ")\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// Durable JSON Lines export, a snapshot save and a cold read of the export,
+// through io_uring and through plain read/write calls. The backends take
+// turns for two rounds (the first pass on a fresh file is slower on some
+// disks) and the faster time of each counts.
+bool benchIo(long long students) {
+    typedef chrono::steady_clock Clock;
+    char exportPath[] = "/tmp/udb-io-XXXXXX";
+    int fd = mkstemp(exportPath);
+    if (fd < 0) {
+        cerr << RED << "✗ Cannot create a bench file" << RESET << "\n";
+        return false;
+    }
+    close(fd);
+    string savePath = string(exportPath) + ".udb";
+
+    DBsystem db;
+    vector<Student> batch;
+    for (long long i = 0; i < students; ++i) {
+        batch.push_back(Student(int(i + 1), "Student " + to_string(i), "Senior", "Computer Science",
+                                double(i % 400) / 100.0, 0));
+    }
+    db.upsertStudents(batch);
+    vector<CsvColumn> columns = defaultStudentColumns();
+
+    bool ok = true;
+    long long bytes = 0;
+    long long saveBytes = 0;
+    double best[2][3];  // [uring, read/write][export, save, read] seconds
+    for (int r = 0; r < 2 * 2 && ok; ++r) {
+        int m = r % 2;
+        IoRing::setEnabled(m == 0);
+
+        Clock::time_point start = Clock::now();
+        fd = open(exportPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        long long rows = 0;
+        {
+            OutputBuffer out(fd);
+            rows = exportStudents(db, out, columns, EXPORT_JSON);
+            ok = out.sync() && ok;
+            bytes = out.bytesWritten();
+        }
+        close(fd);
+        double exportSec = chrono::duration<double>(Clock::now() - start).count();
+
+        string error;
+        start = Clock::now();
+        ok = db.save(savePath, error) && ok;
+        double saveSec = chrono::duration<double>(Clock::now() - start).count();
+        struct stat st;
+        saveBytes = stat(savePath.c_str(), &st) == 0 ? (long long)st.st_size : 0;
+
+        // Out of the page cache, so the read hits the device. Objects are
+        // split but not loaded: re-inserting sorted ids would time the tree.
+        fd = open(exportPath, O_RDONLY);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+        start = Clock::now();
+        long long objects = 0;
+        FILE* in = fopen(exportPath, "rb");
+        if (in != NULL) {
+            JsonLinesReader reader(in);
+            const char* begin;
+            const char* end;
+            while (reader.nextRaw(begin, end)) {
+                ++objects;
+            }
+            fclose(in);
+        }
+        double readSec = chrono::duration<double>(Clock::now() - start).count();
+        ok = ok && rows == students && objects == students;
+
+        double times[3] = {exportSec, saveSec, readSec};
+        for (int k = 0; k < 3; ++k) {
+            best[m][k] = r < 2 ? times[k] : min(best[m][k], times[k]);
+        }
+    }
+    IoRing::setEnabled(true);
+    unlink(exportPath);
+    unlink(savePath.c_str());
+
+    IoRing probe;
+    const char* names[] = {probe.kernel() ? "io_uring" : "io_uring fallback", "read/write"};
+    for (int m = 0; m < 2; ++m) {
+        cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << names[m] << ": " << RESET << fixed << setprecision(1)
+             << "export+fsync " << bytes / 1048576.0 / best[m][0] << " MiB/s, save "
+             << saveBytes / 1048576.0 / best[m][1] << " MiB/s, cold read " << bytes / 1048576.0 / best[m][2]
+             << " MiB/s\n";
+    }
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+// Stable sort and a reduction over the same students on a one-thread
+// scheduler and on the shared pool, which must agree row for row, then a
+// snapshot build from the sorted rows on the pool.
+bool benchPool(long long students) {
+    typedef chrono::steady_clock Clock;
+    TaskScheduler serial(1);
+    TaskScheduler& pool = TaskScheduler::shared();
+    TaskScheduler* schedulers[2] = {&serial, &pool};
+
+    // Ids repeat, and names record arrival order, so stability is checked too
+    vector<Student> rows;
+    rows.reserve(size_t(students));
+    uint64_t x = 88172645463325252ULL;
+    for (long long i = 0; i < students; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        rows.push_back(Student(int(x % uint64_t(students)) + 1, "Student " + to_string(i), "Senior",
+                               "Computer Science", double(i % 400) / 100.0, 0));
+    }
+
+    vector<Student> sorted[2];
+    long long sums[2] = {0, 0};
+    double sortSec[2];
+    double reduceSec[2];
+    for (int m = 0; m < 2; ++m) {
+        sorted[m] = rows;
+        Clock::time_point start = Clock::now();
+        schedulers[m]->parallelStableSort(sorted[m].begin(), sorted[m].end());
+        sortSec[m] = chrono::duration<double>(Clock::now() - start).count();
+
+        const vector<Student>& v = sorted[m];
+        start = Clock::now();
+        sums[m] = schedulers[m]->parallelReduce(
+            0, (long long)v.size(), 1 << 14, 0LL,
+            [&v](long long lo, long long hi) {
+                long long sum = 0;
+                for (long long i = lo; i < hi; ++i) {
+                    sum += llround(v[size_t(i)].getGPA() * 100) + (long long)v[size_t(i)].getName().size();
+                }
+                return sum;
+            },
+            [](long long a, long long b) { return a + b; });
+        reduceSec[m] = chrono::duration<double>(Clock::now() - start).count();
+    }
+    bool same = sums[0] == sums[1];
+    for (size_t i = 0; same && i < sorted[0].size(); ++i) {
+        same = sorted[0][i].getID() == sorted[1][i].getID() && sorted[0][i].getName() == sorted[1][i].getName();
+    }
+
+    // Last row of each id, as upsertStudents keeps
+    vector<Student>& unique = sorted[1];
+    size_t kept = 0;
+    for (size_t i = 0; i < unique.size(); ++i) {
+        if (i + 1 == unique.size() || unique[i + 1].getID() != unique[i].getID()) {
+            unique[kept++] = unique[i];
+        }
+    }
+    unique.resize(kept);
+    Clock::time_point start = Clock::now();
+    PersistentBST<Student> version = PersistentBST<Student>::build(unique.data(), (long long)unique.size());
+    double buildSec = chrono::duration<double>(Clock::now() - start).count();
+    long long visited = 0;
+    bool ordered = true;
+    int last = 0;
+    auto visit = [&](const Student& s) {
+        ordered = ordered && s.getID() > last;
+        last = s.getID();
+        ++visited;
+    };
+    version.visitInOrder(visit);
+
+    bool ok = same && ordered && visited == (long long)unique.size() && version.size() == visited;
+    int threads = pool.concurrency();
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << "stable sort: " << RESET << fixed << setprecision(2)
+         << "1 thread " << students / 1e6 / sortSec[0] << " M rows/s, " << threads
+         << (threads == 1 ? " thread " : " threads ") << students / 1e6 / sortSec[1] << " M rows/s"
+         << (same ? "" : ", RESULTS DIFFER") << "\n";
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << "reduce: " << RESET << "1 thread "
+         << students / 1e6 / reduceSec[0] << " M rows/s, " << threads << (threads == 1 ? " thread " : " threads ")
+         << students / 1e6 / reduceSec[1] << " M rows/s\n";
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << "snapshot build: " << RESET << visited << " students, "
+         << visited / 1e6 / buildSec << " M rows/s on " << threads << (threads == 1 ? " thread" : " threads")
+         << (ordered ? "" : ", OUT OF ORDER") << "\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+void printUsage(const char* prog) {
+    cerr << "Usage: " << prog << " [options] <benchmark>...\n"
+         << "  --threads <n>                        threads for the benchmarks that follow (0 = all cores)\n"
+         << "  --shards <n>                         shards for --shard-bench (0 = one per core)\n"
+         << "  --pipeline <n>                       requests in flight per --loadgen connection (default 32)\n"
+         << "  --pool <threads>                     size of the shared task pool (default one per core)\n"
+         << "  --pin                                pin pool workers to cores 1, 2, ...\n"
+         << "  --broker-bench <events>              message broker throughput on --threads partitions\n"
+         << "  --olc-bench <keys>                   concurrent tree 95/5 read/write mix up to --threads\n"
+         << "  --skiplist-bench <rows>              concurrent ingest with scans, skip list vs locked tree\n"
+         << "  --mvcc-bench <students>              snapshot reports walked while a writer edits\n"
+         << "  --txn-bench <students>               advisor moves as transactions on --threads threads\n"
+         << "  --async-bench <requests>             durable writes: sync threads vs coroutines on one thread\n"
+         << "  --io-bench <students>                export, save and cold read: io_uring vs read/write\n"
+         << "  --pool-bench <students>              stable sort, reduce and snapshot build: 1 thread vs pool\n"
+         << "  --shard-bench <students>             sharded store throughput on --shards shards\n"
+         << "  --loadgen <address> <ops>            --threads connections against main --serve\n";
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = 1;
+    int shards = 0;
+    int depth = 32;
+    int poolThreads = 0;
+    bool pinPool = false;
+    bool ran = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool ok = true;
+        if ((arg == "--threads" || arg == "--shards") && i + 1 < argc) {
+            int n = atoi(argv[++i]);
+            if (n < 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            (arg == "--threads" ? threads : shards) = n;
+            continue;
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+            if (depth < 1) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            continue;
+        } else if ((arg == "--pool" && i + 1 < argc) || arg == "--pin") {
+            if (arg == "--pool") {
+                poolThreads = atoi(argv[++i]);
+                if (poolThreads < 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+            } else {
+                pinPool = true;
+            }
+            TaskScheduler::configureShared(poolThreads, pinPool ? TaskScheduler::PIN_CORES : TaskScheduler::PIN_NONE);
+            continue;
+        } else if (arg == "--broker-bench" && i + 1 < argc) {
+            long long messages = atoll(argv[++i]);
+            bool spsc = benchBroker(PARTITION_SPSC, threadsOrCores(threads), messages);
+            bool mpmc = benchBroker(PARTITION_MPMC, threadsOrCores(threads), messages);
+            ok = spsc && mpmc;
+        } else if (arg == "--olc-bench" && i + 1 < argc) {
+            long long keys = atoll(argv[++i]);
+            int most = threadsOrCores(threads);
+            for (int t = 1; t <= most; t = (t * 2 > most && t < most) ? most : t * 2) {
+                ok = benchConcurrentTree(t, keys) && ok;
+            }
+        } else if (arg == "--skiplist-bench" && i + 1 < argc) {
+            long long rows = atoll(argv[++i]);
+            int most = threadsOrCores(threads);
+            for (int t = 1; t <= most; t = (t * 2 > most && t < most) ? most : t * 2) {
+                ok = benchSkipList(t, rows) && ok;
+            }
+        } else if (arg == "--mvcc-bench" && i + 1 < argc) {
+            ok = benchSnapshots(atoll(argv[++i]));
+        } else if (arg == "--txn-bench" && i + 1 < argc) {
+            ok = benchTransactions(threadsOrCores(threads), atoll(argv[++i]));
+        } else if (arg == "--async-bench" && i + 1 < argc) {
+            ok = benchAsync(threads, atoll(argv[++i]));
+        } else if (arg == "--io-bench" && i + 1 < argc) {
+            ok = benchIo(atoll(argv[++i]));
+        } else if (arg == "--pool-bench" && i + 1 < argc) {
+            ok = benchPool(atoll(argv[++i]));
+        } else if (arg == "--shard-bench" && i + 1 < argc) {
+            long long students = atoll(argv[++i]);
+            bool hash = benchShards(SHARD_BY_HASH, shards, students);
+            bool range = benchShards(SHARD_BY_RANGE, shards, students);
+            ok = hash && range;
+        } else if (arg == "--loadgen" && i + 2 < argc) {
+            string address = argv[++i];
+            ok = runLoadgen(address, max(1, threads), depth, atoll(argv[++i]));
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+        ran = true;
+        if (!ok) {
+            return 1;
+        }
+    }
+    if (!ran) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
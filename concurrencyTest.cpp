@@ -0,0 +1,1039 @@
+/**
+ * @file concurrencyTest.cpp
+ * @brief Tests for the concurrent parts of the University Database System.
+ *        Each test races threads on one structure, then checks what must
+ *        hold whatever the interleaving was. The wal and checkpoint tests
+ *        damage or interrupt the durable files instead and check what
+ *        recovery makes of them.
+ *
+ * Usage:
+ *   concurrencyTest                        run every test
+ *   concurrencyTest olc                    run the tests whose name starts with "olc"
+ *
+ * A failed check prints its file, line and condition; the run goes on and
+ * exits with status 1 if any check failed.
+ *
+ * Build and run: make test (make SANITIZE=thread test under ThreadSanitizer)
+ *
+ * @author Julian Carbajal
+ * @date Spring 2024
+ */
+
+#include "Checkpoint.h"
+#include "ConcurrentBST.h"
+#include "DBsystem.h"
+#include "EpochManager.h"
+#include "SkipList.h"
+#include "Student.h"
+#include "Transaction.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// ANSI color codes
+const string RESET = "\033[0m";
+const string RED = "\033[31m";
+const string GREEN = "\033[32m";
+
+atomic<int> g_failures(0);
+
+// Checks may run on any thread
+#define CHECK(cond)                                                                              \
+    do {                                                                                         \
+        if (!(cond)) {                                                                           \
+            g_failures.fetch_add(1);                                                             \
+            cerr << RED << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << RESET << "\n"; \
+        }                                                                                        \
+    } while (0)
+
+const int THREADS = 4;
+
+// Scatters consecutive i over [0, 2^30) so that threads working on nearby
+// ranges meet all over the tree instead of at one edge
+int scrambled(long long i) {
+    return int((uint32_t(i) * 2654435761u) & 0x3fffffff);
+}
+
+// Runs body(t) on THREADS threads at once
+template <typename F>
+void race(const F& body) {
+    vector<thread> workers;
+    for (int t = 0; t < THREADS; ++t) {
+        workers.push_back(thread([&body, t] { body(t); }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+// Counts the elements of an in-order walk and whether they rose strictly
+struct OrderCheck {
+    long long n;
+    int last;
+    bool ordered;
+
+    OrderCheck() : n(0), last(0), ordered(true) {}
+
+    template <typename Row>
+    void operator()(const Row& r) {
+        ordered = ordered && (n == 0 || r.getID() > last);
+        last = r.getID();
+        ++n;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// ConcurrentBST (optimistic lock coupling)
+// ---------------------------------------------------------------------------
+
+// Threads insert disjoint keys that interleave through the whole tree
+void olcDisjointInserts() {
+    const long long PER_THREAD = 20000;
+    ConcurrentBST<Student> tree;
+    atomic<long long> inserted(0);
+    race([&](int t) {
+        for (long long i = t; i < PER_THREAD * THREADS; i += THREADS) {
+            inserted += tree.insert(Student(scrambled(i), "Student", "Senior", "CS", 3.0, 0)) ? 1 : 0;
+        }
+    });
+
+    CHECK(inserted.load() == PER_THREAD * THREADS);
+    CHECK(tree.size() == PER_THREAD * THREADS);
+    Student out;
+    long long found = 0;
+    for (long long i = 0; i < PER_THREAD * THREADS; ++i) {
+        Student key;
+        key.setID(scrambled(i));
+        found += tree.find(key, out) && out.getID() == key.getID() ? 1 : 0;
+    }
+    CHECK(found == PER_THREAD * THREADS);
+    OrderCheck walk;
+    tree.visitInOrder(walk);
+    CHECK(walk.ordered);
+    CHECK(walk.n == tree.size());
+}
+
+// Each thread inserts and removes its own keys, which sit among the other
+// threads' keys, so removes with two children take successors another
+// thread is changing. Every return value is known in advance.
+void olcInsertRemoveRace() {
+    const long long PER_THREAD = 5000;
+    const int ROUNDS = 4;
+    ConcurrentBST<Student> tree;
+    race([&](int t) {
+        for (int round = 0; round < ROUNDS; ++round) {
+            long long wrong = 0;
+            for (long long i = t; i < PER_THREAD * THREADS; i += THREADS) {
+                wrong += tree.insert(Student(scrambled(i), "Student", "Senior", "CS", 3.0, 0)) ? 0 : 1;
+            }
+            // The last round keeps every other key
+            for (long long i = t; i < PER_THREAD * THREADS; i += THREADS) {
+                if (round + 1 < ROUNDS || (i / THREADS) % 2 == 1) {
+                    Student key;
+                    key.setID(scrambled(i));
+                    wrong += tree.remove(key) ? 0 : 1;
+                }
+            }
+            CHECK(wrong == 0);
+        }
+    });
+
+    CHECK(tree.size() == PER_THREAD * THREADS / 2);
+    long long right = 0;
+    for (long long i = 0; i < PER_THREAD * THREADS; ++i) {
+        Student key;
+        key.setID(scrambled(i));
+        right += tree.contains(key) == ((i / THREADS) % 2 == 0) ? 1 : 0;
+    }
+    CHECK(right == PER_THREAD * THREADS);
+    OrderCheck walk;
+    tree.visitInOrder(walk);
+    CHECK(walk.ordered);
+    CHECK(walk.n == tree.size());
+}
+
+// Every thread upserts the same keys, marking each record with its thread
+// in both the name and the GPA, while readers check that every copy they
+// take comes from a single upsert
+void olcUpsertRace() {
+    const int KEYS = 2000;
+    const int ROUNDS = 20;
+    ConcurrentBST<Student> tree;
+    atomic<bool> done(false);
+    atomic<long long> torn(0);
+    thread reader([&] {
+        Student out;
+        while (!done.load()) {
+            for (int k = 0; k < KEYS; ++k) {
+                Student key;
+                key.setID(scrambled(k));
+                if (tree.find(key, out) && out.getName() != "T" + to_string(int(out.getGPA()))) {
+                    ++torn;
+                }
+            }
+        }
+    });
+    race([&](int t) {
+        for (int round = 0; round < ROUNDS; ++round) {
+            for (int k = 0; k < KEYS; ++k) {
+                tree.upsert(Student(scrambled(k), "T" + to_string(t), "Senior", "CS", double(t), 0));
+            }
+        }
+    });
+    done.store(true);
+    reader.join();
+
+    CHECK(torn.load() == 0);
+    CHECK(tree.size() == KEYS);
+    long long valid = 0;
+    for (int k = 0; k < KEYS; ++k) {
+        Student key;
+        Student out;
+        key.setID(scrambled(k));
+        valid += tree.find(key, out) && out.getGPA() >= 0 && out.getGPA() < THREADS ? 1 : 0;
+    }
+    CHECK(valid == KEYS);
+}
+
+// Upserts and removes on the same few keys from every thread: whatever
+// wins, the size counter must match the elements a walk finds
+void olcUpsertRemoveRace() {
+    const int KEYS = 64;
+    const long long OPS = 100000;
+    ConcurrentBST<Student> tree;
+    atomic<long long> added(0);
+    atomic<long long> removed(0);
+    race([&](int t) {
+        uint64_t x = 88172645463325252ULL + uint64_t(t) * 0x9E3779B97F4A7C15ULL;
+        for (long long i = 0; i < OPS; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            Student s(int(x % KEYS), "Student", "Senior", "CS", double(t), 0);
+            if (x % 2 == 0) {
+                added += tree.upsert(s) ? 1 : 0;
+            } else {
+                removed += tree.remove(s) ? 1 : 0;
+            }
+        }
+    });
+
+    OrderCheck walk;
+    tree.visitInOrder(walk);
+    CHECK(walk.ordered);
+    CHECK(walk.n == tree.size());
+    CHECK(added.load() - removed.load() == tree.size());
+}
+
+// ---------------------------------------------------------------------------
+// EpochManager
+// ---------------------------------------------------------------------------
+
+// Retired objects are not freed but marked dead and kept, so a reader that
+// still reaches one after it was "freed" sees the mark instead of garbage
+struct Tracked {
+    static const int ALIVE = 0x600dcafe;
+    static const int DEAD = 0x0dead000;
+
+    atomic<int> state;
+    long long value;
+
+    explicit Tracked(long long v) : state(ALIVE), value(v) {}
+};
+
+mutex g_graveyardMutex;
+vector<Tracked*> g_graveyard;
+atomic<long long> g_freed(0);
+
+void bury(void* ptr) {
+    Tracked* t = static_cast<Tracked*>(ptr);
+    t->state.store(Tracked::DEAD);
+    g_freed.fetch_add(1);
+    lock_guard<mutex> guard(g_graveyardMutex);
+    g_graveyard.push_back(t);
+}
+
+void emptyGraveyard() {
+    lock_guard<mutex> guard(g_graveyardMutex);
+    for (size_t i = 0; i < g_graveyard.size(); ++i) {
+        delete g_graveyard[i];
+    }
+    g_graveyard.clear();
+    g_freed.store(0);
+}
+
+// Nothing retired while a reader is inside a guard is freed before it
+// leaves, however often the retiring thread collects; all of it is once
+// the reader is gone
+void epochHeldByReader() {
+    const int RETIRED = 1000;
+    EpochManager epochs(1);
+    atomic<bool> inside(false);
+    atomic<bool> release(false);
+    thread reader([&] {
+        EpochGuard guard(epochs);
+        inside.store(true);
+        while (!release.load()) {
+            this_thread::yield();
+        }
+    });
+    while (!inside.load()) {
+        this_thread::yield();
+    }
+
+    for (int i = 0; i < RETIRED; ++i) {
+        epochs.retire(new Tracked(i), &bury);
+    }
+    for (int i = 0; i < 10; ++i) {
+        epochs.collect();
+    }
+    CHECK(g_freed.load() == 0);
+    CHECK(epochs.pending() == size_t(RETIRED));
+
+    release.store(true);
+    reader.join();
+    for (int i = 0; i < 3; ++i) {
+        epochs.collect();
+    }
+    CHECK(g_freed.load() == RETIRED);
+    CHECK(epochs.pending() == 0);
+    emptyGraveyard();
+}
+
+// Threads keep swapping a shared object for a new one and retiring the old
+// one, while every thread reads whatever the pointer holds inside a guard.
+// No read may find a freed object, and everything retired is freed by the
+// time the manager is gone.
+void epochSwapRace() {
+    const long long OPS = 200000;
+    atomic<long long> created(1);
+    atomic<long long> deadReads(0);
+    {
+        EpochManager epochs;
+        atomic<Tracked*> shared(new Tracked(0));
+        race([&](int t) {
+            for (long long i = 0; i < OPS; ++i) {
+                EpochGuard guard(epochs);
+                Tracked* seen = shared.load();
+                if (seen->state.load() != Tracked::ALIVE) {
+                    ++deadReads;
+                }
+                if (i % 8 == t % 8) {
+                    Tracked* old = shared.exchange(new Tracked(i));
+                    ++created;
+                    epochs.retire(old, &bury);
+                }
+            }
+        });
+        CHECK(deadReads.load() == 0);
+        CHECK(g_freed.load() + (long long)epochs.pending() == created.load() - 1);
+        bury(shared.load());
+    }
+    CHECK(g_freed.load() == created.load());
+    emptyGraveyard();
+}
+
+// ---------------------------------------------------------------------------
+// SkipList
+// ---------------------------------------------------------------------------
+
+// One thread removes every key while another upserts every key, both in
+// the same order, so most pairs meet on one node. An upsert that reports
+// a new key must have landed after the remove and left the key there; one
+// that reports a replacement came first, and the remove took the key.
+void skipListUpsertVersusRemove() {
+    const int KEYS = 20000;
+    const int ROUNDS = 10;
+    long long wrong = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        SkipList<Student> list;
+        for (int k = 0; k < KEYS; ++k) {
+            list.insert(Student(k, "old", "Senior", "CS", 0.0, 0));
+        }
+        vector<char> landed(KEYS, 0);
+        atomic<int> ready(0);
+        thread remover([&] {
+            ready.fetch_add(1);
+            while (ready.load() < 2) {
+            }
+            for (int k = 0; k < KEYS; ++k) {
+                Student key;
+                key.setID(k);
+                list.remove(key);
+            }
+        });
+        thread upserter([&] {
+            ready.fetch_add(1);
+            while (ready.load() < 2) {
+            }
+            for (int k = 0; k < KEYS; ++k) {
+                landed[size_t(k)] = list.upsert(Student(k, "new", "Senior", "CS", 1.0, 0)) ? 1 : 0;
+            }
+        });
+        remover.join();
+        upserter.join();
+
+        long long inserts = 0;
+        for (int k = 0; k < KEYS; ++k) {
+            Student key;
+            Student out;
+            key.setID(k);
+            bool present = list.find(key, out);
+            wrong += present != (landed[size_t(k)] != 0) || (present && out.getName() != "new") ? 1 : 0;
+            inserts += landed[size_t(k)];
+        }
+        OrderCheck walk;
+        list.visitInOrder(walk);
+        CHECK(walk.ordered);
+        CHECK(walk.n == list.size());
+        CHECK(list.size() == inserts);
+    }
+    CHECK(wrong == 0);
+}
+
+// Random upserts and removes on a few shared keys from every thread, with
+// a reader checking each copy it takes: the size counter must follow the
+// reported inserts and removes, and the list must stay in order
+void skipListUpsertRemoveRace() {
+    const int KEYS = 64;
+    const long long OPS = 100000;
+    SkipList<Student> list;
+    atomic<long long> added(0);
+    atomic<long long> removed(0);
+    atomic<long long> torn(0);
+    atomic<bool> done(false);
+    thread reader([&] {
+        Student out;
+        while (!done.load()) {
+            for (int k = 0; k < KEYS; ++k) {
+                Student key;
+                key.setID(k);
+                if (list.find(key, out) && out.getName() != "T" + to_string(int(out.getGPA()))) {
+                    ++torn;
+                }
+            }
+        }
+    });
+    race([&](int t) {
+        uint64_t x = 88172645463325252ULL + uint64_t(t) * 0x9E3779B97F4A7C15ULL;
+        for (long long i = 0; i < OPS; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            Student s(int(x % KEYS), "T" + to_string(t), "Senior", "CS", double(t), 0);
+            if (x % 2 == 0) {
+                added += list.upsert(s) ? 1 : 0;
+            } else {
+                removed += list.remove(s) ? 1 : 0;
+            }
+        }
+    });
+    done.store(true);
+    reader.join();
+
+    CHECK(torn.load() == 0);
+    OrderCheck walk;
+    list.visitInOrder(walk);
+    CHECK(walk.ordered);
+    CHECK(walk.n == list.size());
+    CHECK(added.load() - removed.load() == list.size());
+}
+
+// ---------------------------------------------------------------------------
+// Snapshots (DBsystem::snapshot over PersistentBST versions)
+// ---------------------------------------------------------------------------
+
+// Student `id` as written in round `round`: the name repeats the GPA, so a
+// record read whole has both from the same write
+Student roundStudent(int id, int round) {
+    return Student(id, "R" + to_string(round), "Senior", "CS", double(round), 0);
+}
+
+// Walks a snapshot taken while one writer updates every student in id
+// order, round after round: it must hold one moment of that, so ids up to
+// some point show round r + 1 and the rest round r
+struct RoundCheck {
+    long long n;
+    int first;
+    int last;
+    bool whole;
+    bool falling;
+
+    RoundCheck() : n(0), first(-1), last(-1), whole(true), falling(true) {}
+
+    void operator()(const Student& s) {
+        int round = int(s.getGPA());
+        whole = whole && s.getName() == "R" + to_string(round);
+        falling = falling && (n == 0 || round <= last);
+        first = n == 0 ? round : first;
+        last = round;
+        ++n;
+    }
+
+    bool oneMoment() const { return whole && falling && first - last <= 1; }
+};
+
+void snapshotIsolation() {
+    const int STUDENTS = 5000;
+    const int ROUNDS = 20;
+    DBsystem db;
+    for (int id = 1; id <= STUDENTS; ++id) {
+        db.addStudent(roundStudent(id, 0));
+    }
+    DBsnapshot before = db.snapshot();
+
+    atomic<bool> done(false);
+    thread writer([&] {
+        for (int round = 1; round <= ROUNDS; ++round) {
+            for (int id = 1; id <= STUDENTS; ++id) {
+                db.upsertStudent(roundStudent(id, round));
+            }
+        }
+        done.store(true);
+    });
+    long long views = 0;
+    long long torn = 0;
+    long long changed = 0;
+    while (!done.load()) {
+        DBsnapshot view = db.snapshot();
+        RoundCheck a;
+        view.students.visitInOrder(a);
+        this_thread::yield();
+        // The same version again, later: nothing the writer did since shows
+        RoundCheck b;
+        view.students.visitInOrder(b);
+        torn += a.oneMoment() && a.n == STUDENTS && view.students.size() == STUDENTS ? 0 : 1;
+        changed += b.n == a.n && b.first == a.first && b.last == a.last && b.oneMoment() ? 0 : 1;
+        ++views;
+    }
+    writer.join();
+
+    CHECK(views > 0);
+    CHECK(torn == 0);
+    CHECK(changed == 0);
+    RoundCheck old;
+    before.students.visitInOrder(old);
+    CHECK(old.n == STUDENTS && old.first == 0 && old.last == 0 && old.whole);
+    RoundCheck now;
+    db.snapshot().students.visitInOrder(now);
+    CHECK(now.n == STUDENTS && now.first == ROUNDS && now.last == ROUNDS && now.whole);
+}
+
+// Deletes and inserts after a snapshot do not show in it
+void snapshotKeepsDeleted() {
+    const int STUDENTS = 2000;
+    DBsystem db;
+    for (int id = 1; id <= STUDENTS; ++id) {
+        db.addStudent(roundStudent(id, 0));
+    }
+    DBsnapshot before = db.snapshot();
+    race([&](int t) {
+        for (int id = 1 + t; id <= STUDENTS; id += THREADS) {
+            if (id % 2 == 0) {
+                db.deleteStudent(id);
+            } else {
+                db.upsertStudent(roundStudent(id + STUDENTS, 1));
+            }
+        }
+    });
+    DBsnapshot after = db.snapshot();
+
+    long long kept = 0;
+    long long hidden = 0;
+    for (int id = 1; id <= 2 * STUDENTS; ++id) {
+        const Student* s = before.findStudent(id);
+        kept += (id <= STUDENTS) == (s != NULL && s->getGPA() == 0.0) ? 1 : 0;
+        const Student* t = after.findStudent(id);
+        bool expected = id <= STUDENTS ? id % 2 == 1 : (id - STUDENTS) % 2 == 1;
+        hidden += expected == (t != NULL) ? 1 : 0;
+    }
+    CHECK(kept == 2 * STUDENTS);
+    CHECK(hidden == 2 * STUDENTS);
+    CHECK(before.students.size() == STUDENTS);
+    CHECK(after.students.size() == STUDENTS);
+}
+
+// ---------------------------------------------------------------------------
+// Transactions
+// ---------------------------------------------------------------------------
+
+// Of two transactions writing one key, the first to commit wins and the
+// other is aborted; so is one whose key a plain write changed after begin
+void txnFirstCommitterWins() {
+    DBsystem db;
+    db.addStudent(roundStudent(1, 0));
+    db.addStudent(roundStudent(2, 0));
+    string error;
+
+    Transaction first;
+    Transaction second;
+    db.begin(first);
+    db.begin(second);
+    first.putStudent(roundStudent(1, 1));
+    second.putStudent(roundStudent(1, 2));
+    second.putStudent(roundStudent(2, 2));
+    CHECK(db.commit(first, error));
+    CHECK(!db.commit(second, error));
+    CHECK(error.find("write conflict") != string::npos);
+    CHECK(!second.isActive());
+    CHECK(db.findStudent(1)->getGPA() == 1.0);
+    CHECK(db.findStudent(2)->getGPA() == 0.0);  // Nothing of the loser is applied
+
+    Transaction a;
+    Transaction b;
+    db.begin(a);
+    db.begin(b);
+    a.putStudent(roundStudent(1, 3));
+    b.putStudent(roundStudent(2, 3));
+    CHECK(db.commit(b, error));
+    CHECK(db.commit(a, error));  // Disjoint keys: both commit
+
+    Transaction late;
+    db.begin(late);
+    db.upsertStudent(roundStudent(2, 4));
+    late.putStudent(roundStudent(2, 5));
+    CHECK(!db.commit(late, error));
+    CHECK(db.findStudent(2)->getGPA() == 4.0);
+}
+
+// Threads add one to the same student's GPA in transactions, retrying
+// each conflict: no increment is lost, and every one committed once
+void txnCounterRace() {
+    const int INCREMENTS = 500;
+    DBsystem db;
+    db.addStudent(roundStudent(1, 0));
+    race([&](int) {
+        string error;
+        for (int i = 0; i < INCREMENTS; ++i) {
+            while (true) {
+                Transaction txn;
+                db.begin(txn);
+                Student s = *txn.findStudent(1);
+                s.setGPA(s.getGPA() + 1);
+                txn.putStudent(s);
+                if (db.commit(txn, error)) {
+                    break;
+                }
+            }
+        }
+    });
+    CHECK(db.findStudent(1)->getGPA() == double(THREADS * INCREMENTS));
+}
+
+// Each advisor lists exactly the students that name them
+bool advisorsAgree(DBsystem& db, int students, const int* faculty, int facultyCount) {
+    set<int> listed;
+    for (int f = 0; f < facultyCount; ++f) {
+        const Faculty* advisor = db.findFaculty(faculty[f]);
+        if (advisor == NULL) {
+            return false;
+        }
+        for (int i = 0; i < advisor->getAdviseeCount(); ++i) {
+            const Student* s = db.findStudent(advisor->getAdvisee(i));
+            if (s == NULL || s->getAdvisor() != faculty[f] || !listed.insert(s->getID()).second) {
+                return false;
+            }
+        }
+    }
+    return listed.size() == size_t(students);
+}
+
+// Threads move students between advisors in transactions under a log;
+// replaying the log into a fresh database gives back the same students,
+// the same advisee lists and one record per commit
+void txnLogReplay() {
+    const int STUDENTS = 60;
+    const int MOVES = 150;
+    const int FACULTY[] = {100, 101, 102};
+    char path[] = "/tmp/udb-txn-test-XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+    unlink(path);
+
+    string error;
+    atomic<long long> commits(0);
+    vector<int> advisors(STUDENTS + 1, 0);
+    {
+        DBsystem db;
+        CHECK(db.attachLog(path, SYNC_GROUP, error));
+        for (int f = 0; f < 3; ++f) {
+            db.addFaculty(Faculty(FACULTY[f], "Advisor", "Professor", "CS"));
+        }
+        for (int id = 1; id <= STUDENTS; ++id) {
+            db.addStudent(Student(id, "Student", "Senior", "CS", 3.0, 0));
+        }
+        race([&](int t) {
+            uint64_t x = 88172645463325252ULL + uint64_t(t) * 0x9E3779B97F4A7C15ULL;
+            string err;
+            // Every student gets an advisor first, then moves at random
+            for (int i = 0; i < MOVES; ++i) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                int id = i < STUDENTS / THREADS ? 1 + t + i * THREADS : int(x % STUDENTS) + 1;
+                int to = FACULTY[x % 3];
+                while (true) {
+                    Transaction txn;
+                    db.begin(txn);
+                    if (!txn.changeAdvisor(id, to, err)) {
+                        db.abort(txn);
+                        break;
+                    }
+                    bool wrote = txn.writeCount() > 0;
+                    if (db.commit(txn, err)) {
+                        commits += wrote ? 1 : 0;
+                        break;
+                    }
+                }
+            }
+        });
+        CHECK(advisorsAgree(db, STUDENTS, FACULTY, 3));
+        for (int id = 1; id <= STUDENTS; ++id) {
+            advisors[size_t(id)] = db.findStudent(id)->getAdvisor();
+        }
+        db.detachLog();
+    }
+
+    DBsystem replayed;
+    ReplayStats stats;
+    CHECK(replayed.attachLog(path, SYNC_GROUP, error, &stats));
+    CHECK(stats.records == 3 + STUDENTS + commits.load());
+    CHECK(stats.truncatedBytes == 0);
+    CHECK(replayed.studentCount() == STUDENTS);
+    long long same = 0;
+    for (int id = 1; id <= STUDENTS; ++id) {
+        const Student* s = replayed.findStudent(id);
+        same += s != NULL && s->getAdvisor() == advisors[size_t(id)] ? 1 : 0;
+    }
+    CHECK(same == STUDENTS);
+    CHECK(advisorsAgree(replayed, STUDENTS, FACULTY, 3));
+    replayed.detachLog();
+    unlink(path);
+}
+
+// ---------------------------------------------------------------------------
+// Durability: torn and damaged logs, checkpoints
+// ---------------------------------------------------------------------------
+
+// A path under /tmp that does not exist yet
+string tempPath(const char* tag) {
+    string pattern = string("/tmp/udb-") + tag + "-XXXXXX";
+    vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        return "";
+    }
+    close(fd);
+    unlink(&path[0]);
+    return &path[0];
+}
+
+void removeDir(const string& dir) {
+    if (DIR* d = opendir(dir.c_str())) {
+        while (struct dirent* e = readdir(d)) {
+            string name = e->d_name;
+            if (name != "." && name != "..") {
+                unlink((dir + "/" + name).c_str());
+            }
+        }
+        closedir(d);
+    }
+    rmdir(dir.c_str());
+}
+
+long long fileBytes(const string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long long)st.st_size : -1;
+}
+
+void flipByte(const string& path, uint64_t offset) {
+    FILE* f = fopen(path.c_str(), "r+b");
+    CHECK(f != NULL);
+    if (f == NULL) {
+        return;
+    }
+    fseek(f, long(offset), SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, long(offset), SEEK_SET);
+    fputc(c ^ 0xFF, f);
+    fclose(f);
+}
+
+// Logs students 1..count to a new log at path, noting where each record ends
+void logStudents(const string& path, int count, vector<uint64_t>& ends) {
+    string error;
+    DBsystem db;
+    CHECK(db.attachLog(path, SYNC_EVERY_OP, error));
+    if (db.log() == NULL) {
+        return;
+    }
+    for (int id = 1; id <= count; ++id) {
+        db.addStudent(Student(id, "Student", "Senior", "CS", 3.0, 0));
+        ends.push_back(db.log()->appendedLsn());
+    }
+}
+
+// A last record cut short, or one that fails its checksum, is a write the
+// crash interrupted: it is cut off and every record before it replays
+void walTornTail() {
+    const int STUDENTS = 20;
+    string path = tempPath("wal");
+    vector<uint64_t> ends;
+    logStudents(path, STUDENTS, ends);
+    CHECK(ends.size() == size_t(STUDENTS));
+    if (ends.size() != size_t(STUDENTS)) {
+        unlink(path.c_str());
+        return;
+    }
+    long long lastRecord = (long long)(ends[STUDENTS - 1] - ends[STUDENTS - 2]);
+    string error;
+
+    CHECK(truncate(path.c_str(), off_t(ends[STUDENTS - 1] - 3)) == 0);
+    {
+        DBsystem db;
+        ReplayStats stats;
+        CHECK(db.attachLog(path, SYNC_EVERY_OP, error, &stats));
+        CHECK(stats.records == STUDENTS - 1);
+        CHECK(stats.truncatedBytes == lastRecord - 3);
+        CHECK(fileBytes(path) == (long long)ends[STUDENTS - 2]);
+        CHECK(db.studentCount() == STUDENTS - 1);
+        // Appends start again at the cut
+        db.addStudent(Student(STUDENTS, "Student", "Senior", "CS", 3.0, 0));
+    }
+    CHECK(fileBytes(path) == (long long)ends[STUDENTS - 1]);
+
+    flipByte(path, ends[STUDENTS - 1] - 1);
+    {
+        DBsystem db;
+        ReplayStats stats;
+        CHECK(db.attachLog(path, SYNC_EVERY_OP, error, &stats));
+        CHECK(stats.records == STUDENTS - 1);
+        CHECK(stats.truncatedBytes == lastRecord);
+        CHECK(fileBytes(path) == (long long)ends[STUDENTS - 2]);
+        CHECK(db.studentCount() == STUDENTS - 1);
+    }
+    unlink(path.c_str());
+}
+
+// Damage with a valid record after it, or a valid record replay cannot
+// apply, is not a torn write: replay fails and leaves the file alone
+void walCorruptMiddle() {
+    const int STUDENTS = 20;
+    string path = tempPath("wal");
+    vector<uint64_t> ends;
+    logStudents(path, STUDENTS, ends);
+    CHECK(ends.size() == size_t(STUDENTS));
+    if (ends.size() != size_t(STUDENTS)) {
+        unlink(path.c_str());
+        return;
+    }
+    string error;
+
+    flipByte(path, ends[STUDENTS / 2] - 1);
+    {
+        DBsystem db;
+        CHECK(!db.attachLog(path, SYNC_EVERY_OP, error));
+        CHECK(!error.empty());
+        CHECK(db.log() == NULL);
+        CHECK(fileBytes(path) == (long long)ends[STUDENTS - 1]);
+    }
+    flipByte(path, ends[STUDENTS / 2] - 1);
+
+    // A well-formed record of a type this build does not know
+    string unknown = WalRecord(static_cast<WalRecordType>(0x7F)).bytes();
+    FILE* f = fopen(path.c_str(), "ab");
+    CHECK(f != NULL);
+    if (f != NULL) {
+        fwrite(unknown.data(), 1, unknown.size(), f);
+        fclose(f);
+    }
+    error.clear();
+    {
+        DBsystem db;
+        CHECK(!db.attachLog(path, SYNC_EVERY_OP, error));
+        CHECK(!error.empty());
+        CHECK(fileBytes(path) == (long long)(ends[STUDENTS - 1] + unknown.size()));
+    }
+    unlink(path.c_str());
+}
+
+// Checkpoints only when the test asks for one
+CheckpointPolicy manualCheckpoints(int maxDeltas) {
+    CheckpointPolicy policy;
+    policy.logBytes = uint64_t(1) << 40;
+    policy.intervalMillis = 1 << 30;
+    policy.maxDeltas = maxDeltas;
+    policy.sync = SYNC_EVERY_OP;
+    return policy;
+}
+
+const int ADVISORS[] = {100, 101, 102};
+
+// Students first..last, each advised by one of ADVISORS: every student is
+// logged as an add and an advisor move
+void addAdvised(DBsystem& db, int first, int last) {
+    for (int f = 0; f < 3; ++f) {
+        if (db.findFaculty(ADVISORS[f]) == NULL) {
+            db.addFaculty(Faculty(ADVISORS[f], "Advisor", "Professor", "CS"));
+        }
+    }
+    for (int id = first; id <= last; ++id) {
+        db.addStudent(Student(id, "Student", "Senior", "CS", 3.0, 0));
+        db.changeAdvisor(id, ADVISORS[id % 3]);
+    }
+}
+
+// Recovery applies the delta, then replays only the log written after it
+void checkpointReplayAfterDelta() {
+    string dir = tempPath("ckpt");
+    CheckpointPolicy policy = manualCheckpoints(8);
+    string error;
+    {
+        DBsystem db;
+        CHECK(db.openDurable(dir, policy, error));
+        addAdvised(db, 1, 30);
+        CHECK(db.checkpoint(error));
+        addAdvised(db, 31, 40);
+        for (int id = 1; id <= 10; ++id) {
+            db.changeAdvisor(id, ADVISORS[(id + 1) % 3]);
+        }
+    }
+    DBsystem db;
+    RecoveryStats stats;
+    CHECK(db.openDurable(dir, policy, error, &stats));
+    CHECK(!stats.base);
+    CHECK(stats.deltas == 1);
+    CHECK(stats.logRecords == 2 * 10 + 10);
+    CHECK(db.studentCount() == 40);
+    CHECK(advisorsAgree(db, 40, ADVISORS, 3));
+    const Student* moved = db.findStudent(4);
+    CHECK(moved != NULL && moved->getAdvisor() == ADVISORS[5 % 3]);
+    db.closeDurable();
+    db.detachLog();
+    removeDir(dir);
+}
+
+// Deltas past maxDeltas fold into a new base that recovery maps instead
+void checkpointCompaction() {
+    string dir = tempPath("ckpt");
+    CheckpointPolicy policy = manualCheckpoints(2);
+    string error;
+    {
+        DBsystem db;
+        CHECK(db.openDurable(dir, policy, error));
+        addAdvised(db, 1, 20);
+        CHECK(db.checkpoint(error));
+        addAdvised(db, 21, 30);
+        db.deleteStudent(1);
+        db.removeAdvisee(1, ADVISORS[1]);
+        CHECK(db.checkpoint(error));
+    }
+    DBsystem db;
+    RecoveryStats stats;
+    CHECK(db.openDurable(dir, policy, error, &stats));
+    CHECK(stats.base);
+    CHECK(stats.deltas == 0);
+    CHECK(stats.logRecords == 0);
+    CHECK(db.studentCount() == 29);
+    CHECK(db.findStudent(1) == NULL);
+    CHECK(advisorsAgree(db, 29, ADVISORS, 3));
+    db.closeDurable();
+    db.detachLog();
+    removeDir(dir);
+}
+
+// A delta that failed to write is written by the next checkpoint, which
+// must also retire the log segment its records came from: recovery would
+// otherwise replay that segment on top of the delta
+void checkpointRetry() {
+    string dir = tempPath("ckpt");
+    CheckpointPolicy policy = manualCheckpoints(8);
+    string error;
+    {
+        DBsystem db;
+        CHECK(db.openDurable(dir, policy, error));
+        addAdvised(db, 1, 30);
+        // The log starts in wal-000001; the checkpoint rotates to
+        // wal-000002 and writes delta-000003 through a temporary file,
+        // which a directory of that name makes impossible
+        string blocker = dir + "/delta-000003.udd.tmp";
+        CHECK(mkdir(blocker.c_str(), 0755) == 0);
+        CHECK(!db.checkpoint(error));
+        rmdir(blocker.c_str());
+        // Nothing changed since, so this only retries the delta
+        CHECK(db.checkpoint(error));
+    }
+    DBsystem db;
+    RecoveryStats stats;
+    CHECK(db.openDurable(dir, policy, error, &stats));
+    CHECK(stats.deltas == 1);
+    CHECK(stats.logRecords == 0);
+    CHECK(db.studentCount() == 30);
+    CHECK(advisorsAgree(db, 30, ADVISORS, 3));
+    db.closeDurable();
+    db.detachLog();
+    removeDir(dir);
+}
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+const TestCase TESTS[] = {
+    {"olcDisjointInserts", olcDisjointInserts},
+    {"olcInsertRemoveRace", olcInsertRemoveRace},
+    {"olcUpsertRace", olcUpsertRace},
+    {"olcUpsertRemoveRace", olcUpsertRemoveRace},
+    {"epochHeldByReader", epochHeldByReader},
+    {"epochSwapRace", epochSwapRace},
+    {"skipListUpsertVersusRemove", skipListUpsertVersusRemove},
+    {"skipListUpsertRemoveRace", skipListUpsertRemoveRace},
+    {"snapshotIsolation", snapshotIsolation},
+    {"snapshotKeepsDeleted", snapshotKeepsDeleted},
+    {"txnFirstCommitterWins", txnFirstCommitterWins},
+    {"txnCounterRace", txnCounterRace},
+    {"txnLogReplay", txnLogReplay},
+    {"walTornTail", walTornTail},
+    {"walCorruptMiddle", walCorruptMiddle},
+    {"checkpointReplayAfterDelta", checkpointReplayAfterDelta},
+    {"checkpointCompaction", checkpointCompaction},
+    {"checkpointRetry", checkpointRetry},
+};
+
+int main(int argc, char* argv[])
+{
+    string prefix = argc > 1 ? argv[1] : "";
+    int ran = 0;
+    for (size_t i = 0; i < sizeof(TESTS) / sizeof(TESTS[0]); ++i) {
+        if (string(TESTS[i].name).compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+        int before = g_failures.load();
+        TESTS[i].run();
+        bool ok = g_failures.load() == before;
+        cerr << (ok ? GREEN : RED) << (ok ? "✓ " : "✗ ") << TESTS[i].name << RESET << "\n";
+        ++ran;
+    }
+    if (ran == 0) {
+        cerr << RED << "✗ No test starts with " << prefix << RESET << "\n";
+        return 1;
+    }
+    return g_failures.load() == 0 ? 0 : 1;
+}
@@ -1,15 +1,91 @@
 /**
  * @file main.cpp
  * @brief Interactive University Database System
+ *
+ * Usage:
+ *   main                                   interactive menu
+ *   main --ingest <file|->                 stream JSON Lines (or a JSON array) into
+ *        [--map student.name=full_name]    the database, then open the menu
+ *   main --import-csv students <file|->    load a CSV table
+ *   main --export-csv faculty <file|->     write a CSV table, optionally with
+ *        [--columns id,name=full_name]     selected/renamed columns
+ *   main --export students <file|->        write a table as CSV, JSON Lines or
+ *        [--format csv|json|fixed]         fixed-width text
+ *        [--threads 8] [--shards 16]       ... in parallel by key range, as one
+ *                                          file or as file.part-NNNN shards
+ *   main --open db.udb [--verify]          map a binary snapshot; records are
+ *                                          paged in as they are first used
+ *   main --ingest - --save db.udb          build a snapshot from a stream
+ *   main --open db.udb --wal db.wal        replay what the snapshot lacks of the log,
+ *        [--sync every|group|async]        then log every change made afterwards
+ *   main --data-dir db/ [--checkpoint]     recover from a data directory and keep it
+ *                                          durable with background checkpoints
+ *   main --ingest courses.json --ingest enrollments.json --ingest students.json
+ *        --join --transcript STU30649997   hash-join enrollments to courses and
+ *                                          students; print one student's transcript
+ *   main --group-by server_id              group-by aggregation over a JSON file or
+ *        --metric avg_cpu=avg(cpu_usage_pct)  a table (students, faculty, courses,
+ *        --having avg_cpu>50               enrollments), written like --export
+ *        --aggregate metrics.json -
+ *   main --group-by server_id              tumbling or sliding event-time windows
+ *        --value cpu_usage_pct             (count/sum/avg/min/max per key), closed
+ *        --window-size 300 --slide 60      as the watermark passes them
+ *        [--lateness 30] --window metrics.json -
+ *   main --validate university             check rules inline while loading; rows that
+ *        --validate 'range(student.gpa,0,4)'   break an error rule are rejected
+ *        --ingest students.json
+ *   main --scd2 2025-01-01 --ingest students.json   SCD Type-2 history: each load closes the
+ *        --scd2 2025-06-01 --ingest students.json   versions it changes; look one up
+ *        --as-of 2025-03-15 STU30649997      as of any time
+ *   main --threads 8 --profile transactions.json -   one pass per column: type, nulls,
+ *                                          distinct count, mean/std, quantiles and
+ *                                          top values from mergeable sketches
+ *   main --index enrollments=skiplist       lock-free skip list index for a memory-only
+ *        --ingest enrollments.json          table (courses, enrollments)
+ *   main --wal db.wal --serve unix:/tmp/udb.sock   serve find/add/delete/scan (RESP, so
+ *                                          redis-cli works) over a Unix socket or
+ *                                          loopback TCP port until Ctrl-C
+ *
+ * Actions run in command-line order. When stdin or stdout carries data
+ * (a "-" path or any export) the program reports and exits instead of
+ * opening the menu.
+ *
+ * Benchmarks of the concurrent parts are a separate program, bench.cpp.
+ *
+ * Build: make (leaves build/main and build/bench)
+ *
  * @author Julian Carbajal
  * @date Spring 2024
  */
 
 #include "DBsystem.h"
+#include "Checkpoint.h"
+#include "DBServer.h"
+#include "IoRing.h"
+#include "Aggregator.h"
+#include "CsvIO.h"
+#include "HashJoin.h"
+#include "JsonLines.h"
+#include "OutputBuffer.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include "TableExport.h"
+#include "RecordMapper.h"
+#include "Validator.h"
+#include "WindowAggregator.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <iomanip>
 #include <limits>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -53,6 +129,7 @@ void displayMainMenu() {
     cout << "╠══════════════════════════════════════════════════════════════╣\n";
     cout << "║ 11. Load Sample Data     12. Clear Database                  ║\n";
     cout << "║ 13. Database Statistics  14. Exit                            ║\n";
+    cout << "║ 15. Save Snapshot        16. Open Snapshot                   ║\n";
     cout << "╚══════════════════════════════════════════════════════════════╝\n";
     cout << "Enter choice: ";
 }
@@ -112,8 +189,11 @@ void addStudentInteractive(DBsystem& db) {
     cout << "Enter Advisor ID: ";
     cin >> advisorId;
     
-    db.addStudent(Student(id, name, level, major, gpa, advisorId));
-    cout << GREEN << "✓ Student added successfully!" << RESET << "\n";
+    if (db.addStudent(Student(id, name, level, major, gpa, advisorId))) {
+        cout << GREEN << "✓ Student added successfully!" << RESET << "\n";
+    } else {
+        cout << RED << "✗ A student with ID " << id << " already exists." << RESET << "\n";
+    }
 }
 
 void addFacultyInteractive(DBsystem& db) {
@@ -135,8 +215,11 @@ void addFacultyInteractive(DBsystem& db) {
     cout << "Enter Department: ";
     getline(cin, department);
     
-    db.addFaculty(Faculty(id, name, level, department));
-    cout << GREEN << "✓ Faculty added successfully!" << RESET << "\n";
+    if (db.addFaculty(Faculty(id, name, level, department))) {
+        cout << GREEN << "✓ Faculty added successfully!" << RESET << "\n";
+    } else {
+        cout << RED << "✗ A faculty member with ID " << id << " already exists." << RESET << "\n";
+    }
 }
 
 void findStudentInteractive(DBsystem& db) {
@@ -221,18 +304,915 @@ void deleteFacultyInteractive(DBsystem& db) {
     }
 }
 
+void saveSnapshotInteractive(DBsystem& db) {
+    string path, error;
+    cout << "\nEnter snapshot file to write: ";
+    cin >> path;
+    if (db.save(path, error)) {
+        cout << GREEN << "✓ Saved " << db.studentCount() << " students and " << db.facultyCount()
+             << " faculty to " << path << RESET << "\n";
+    } else {
+        cout << RED << "✗ Save failed: " << error << RESET << "\n";
+    }
+}
+
+void openSnapshotInteractive(DBsystem& db) {
+    string path, error;
+    cout << "\nEnter snapshot file to open: ";
+    cin >> path;
+    if (db.open(path, error)) {
+        cout << GREEN << "✓ Opened " << path << " (" << db.studentCount() << " students, "
+             << db.facultyCount() << " faculty)" << RESET << "\n";
+    } else {
+        cout << RED << "✗ Open failed: " << error << RESET << "\n";
+    }
+}
+
 void displayStatistics(DBsystem& db) {
     cout << "\n" << BOLD << "═══════════════ DATABASE STATISTICS ═══════════════" << RESET << "\n";
     cout << "┌──────────────────────────────────────────┐\n";
-    cout << "│ " << CYAN << "Students in Database:" << RESET << " (see display)\n";
-    cout << "│ " << YELLOW << "Faculty in Database:" << RESET << "  (see display)\n";
+    cout << "│ " << CYAN << "Students in Database:" << RESET << " " << db.studentCount() << "\n";
+    cout << "│ " << YELLOW << "Faculty in Database:" << RESET << "  " << db.facultyCount() << "\n";
     cout << "└──────────────────────────────────────────┘\n";
 }
 
-int main()
+void reportLoad(const IngestStats& stats, const string& path) {
+    cerr << GREEN << "✓ Loaded " << stats.rows << " rows from " << path << RESET
+         << " (" << stats.inserted << " inserted, " << stats.updated << " updated, "
+         << stats.skipped << " skipped";
+    if (stats.rejected > 0) {
+        cerr << ", " << stats.rejected << " rejected";
+    }
+    if (stats.unchanged > 0) {
+        cerr << ", " << stats.unchanged << " unchanged";
+    }
+    cerr << ") in " << fixed << setprecision(3) << stats.seconds
+         << " s, " << setprecision(0) << stats.rowsPerSecond() << " rows/s\n";
+    cerr.unsetf(ios::floatfield);
+}
+
+void reportValidation(Validator& validator) {
+    const ValidationReport& report = validator.report();
+    cerr << (report.rejected == 0 ? GREEN : YELLOW) << "  Validated " << report.rows << " rows: "
+         << report.rejected << " rejected, " << report.warnings << " warnings" << RESET << " (" << fixed
+         << setprecision(3) << report.seconds * 1000.0 << " ms)\n";
+    cerr.unsetf(ios::floatfield);
+    const vector<ValidationRule>& rules = validator.rules();
+    for (size_t r = 0; r < rules.size(); ++r) {
+        if (report.failures[r] > 0) {
+            cerr << "    " << left << setw(44) << rules[r].spec << right << setw(8) << report.failures[r]
+                 << (rules[r].warning ? " warnings\n" : " failures\n");
+        }
+    }
+    for (size_t i = 0; i < report.samples.size() && i < 5; ++i) {
+        const ValidationFailure& f = report.samples[i];
+        cerr << DIM << "    e.g. " << f.id << " " << f.rule << ": '" << f.value << "'" << RESET << "\n";
+    }
+    validator.resetReport();
+}
+
+void reportJoin(const char* name, const JoinStats& stats, long long unmatched) {
+    cerr << GREEN << "✓ " << name << ": " << stats.matches << " matches" << RESET << " (build "
+         << stats.buildRows << " x probe " << stats.probeRows << ", " << stats.partitions
+         << (stats.partitions == 1 ? " partition, " : " partitions, ") << unmatched << " enrollments unmatched) in "
+         << fixed << setprecision(3) << stats.seconds * 1000.0 << " ms\n";
+    cerr.unsetf(ios::floatfield);
+}
+
+void printTranscript(const Transcript& t) {
+    cout << BOLD << "Transcript: " << t.student.getID();
+    if (t.known) {
+        cout << " " << t.student.getName() << " (" << t.student.getLevel() << ", " << t.student.getMajor() << ")";
+    }
+    cout << RESET << "\n";
+    cout << left << setw(10) << "Enrollment" << " " << setw(8) << "Course" << " " << setw(40) << "Title" << " "
+         << right << setw(7) << "Credits" << " " << left << setw(10) << "Status" << " " << setw(5) << "Grade"
+         << " " << right << setw(6) << "Points" << "\n";
+    for (size_t i = 0; i < t.lines.size(); ++i) {
+        const TranscriptLine& line = t.lines[i];
+        const Enrollment& e = line.enrollment;
+        cout << left << setw(10) << e.getID() << " " << setw(8) << line.code << " " << setw(40)
+             << line.title.substr(0, 40) << " " << right << setw(7) << line.credits << " " << left << setw(10)
+             << e.getStatus() << " " << setw(5) << e.getGrade() << " " << right << setw(6);
+        if (e.isGraded()) {
+            cout << fixed << setprecision(2) << e.getGradePoints();
+            cout.unsetf(ios::floatfield);
+        } else {
+            cout << "";
+        }
+        cout << "\n";
+    }
+    cout << left << "Credits attempted: " << t.creditsAttempted << ", earned: " << t.creditsEarned
+         << ", GPA: " << fixed << setprecision(2) << t.gpa() << " over " << t.gradedCredits << " graded credits\n";
+    cout.unsetf(ios::floatfield);
+}
+
+// One step of a batch run, executed in command-line order
+struct CliAction {
+    string kind;   // "ingest", "import-csv", "export", "open", "save", "verify", "wal",
+                   // "data-dir", "checkpoint", "join", "transcript", "aggregate", "window",
+                   // "profile", "index", "scd2", "as-of" or "serve"
+    string table;  // "students" or "faculty" for the import/export actions; the
+                   // table or JSON file read by "aggregate" and "profile", the JSON
+                   // file for "window"; "courses" or "enrollments" for "index"
+    string path;   // file name, or "-" for stdin/stdout; student id for "transcript" and
+                   // "as-of"; "now" for an "scd2" that takes the time when it runs;
+                   // "tree" or "skiplist" for "index"; address for "serve"
+    vector<CsvColumn> columns;
+    ExportFormat format;  // for "export"
+    int threads;          // for "export"; > 1 exports by key range in parallel. Workers
+                          // for "profile"
+    int shards;           // for "export"; > 0 leaves part files
+    SyncPolicy sync;      // for "wal" and "data-dir"
+    AggQuery query;       // for "aggregate"; groupBy[0] is the key of "window"
+    WindowSpec window;    // for "window"
+    string value;         // for "window": the field aggregated
+    string time;          // for "window": the event-time field
+    int64_t at;           // for "scd2" (VERSION_START turns history off) and "as-of"
+
+    CliAction() : format(EXPORT_CSV), threads(1), shards(0), sync(SYNC_GROUP), at(0) {}
+};
+
+bool runAggregate(DBsystem& db, const CliAction& action, char delimiter) {
+    const AggQuery& query = action.query;
+    AggTable table(query);
+    string error;
+    const string& source = action.table;
+    if (source == "students" || source == "faculty" || source == "courses" || source == "enrollments") {
+        table.loadTable(db, source, error);
+    } else {
+        FILE* in = (source == "-") ? stdin : fopen(source.c_str(), "rb");
+        if (!in) {
+            cerr << RED << "✗ Cannot open " << source << RESET << "\n";
+            return false;
+        }
+        table.loadJson(in);
+        if (in != stdin) {
+            fclose(in);
+        }
+    }
+
+    AggResult result;
+    AggStats stats;
+    if (!aggregate(table, query, AggOptions(), result, &stats, error)) {
+        cerr << RED << "✗ Aggregation failed: " << error << RESET << "\n";
+        return false;
+    }
+
+    int fd = (action.path == "-") ? 1 : open(action.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << RED << "✗ Cannot create " << action.path << RESET << "\n";
+        return false;
+    }
+    bool ok;
+    {
+        vector<CsvColumn> columns;
+        for (size_t k = 0; k < result.keyNames.size(); ++k) {
+            CsvColumn c = {int(k), result.keyNames[k], 24};
+            columns.push_back(c);
+        }
+        for (size_t m = 0; m < result.metricNames.size(); ++m) {
+            CsvColumn c = {int(columns.size()), result.metricNames[m], 14};
+            columns.push_back(c);
+        }
+        OutputBuffer out(fd);
+        TableWriter writer(out, action.format, columns, false, delimiter);
+        writer.header();
+        size_t keys = result.keyNames.size();
+        size_t metrics = result.metricNames.size();
+        for (size_t r = 0; r < result.rows(); ++r) {
+            for (size_t k = 0; k < keys; ++k) {
+                writer.field(result.keys[r * keys + k]);
+            }
+            for (size_t m = 0; m < metrics; ++m) {
+                double v = result.values[r * metrics + m];
+                AggFunction f = query.metrics[m].function;
+                if (v != v && action.format != EXPORT_JSON) {
+                    writer.field(string());
+                } else if (f == AGG_COUNT || f == AGG_COUNT_DISTINCT) {
+                    writer.field((long long)v);
+                } else {
+                    writer.field(v);
+                }
+            }
+            writer.endRow();
+        }
+        ok = out.ok();
+    }
+    if (fd != 1) {
+        close(fd);
+    }
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ Aggregated " : "✗ Failed aggregating ") << stats.rows << " rows into "
+         << result.rows() << " of " << stats.groups << " groups" << RESET << " (" << stats.partitions
+         << (stats.partitions == 1 ? " partition) in " : " partitions) in ") << fixed << setprecision(3)
+         << stats.seconds * 1000.0 << " ms\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+bool runWindow(const CliAction& action, char delimiter) {
+    FILE* in = (action.table == "-") ? stdin : fopen(action.table.c_str(), "rb");
+    if (!in) {
+        cerr << RED << "✗ Cannot open " << action.table << RESET << "\n";
+        return false;
+    }
+    int fd = (action.path == "-") ? 1 : open(action.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << RED << "✗ Cannot create " << action.path << RESET << "\n";
+        if (in != stdin) {
+            fclose(in);
+        }
+        return false;
+    }
+
+    typedef chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    const string key = action.query.groupBy.empty() ? string() : action.query.groupBy[0];
+    static const char* names[] = {"key", "window_start", "window_end", "count", "sum", "avg", "min", "max"};
+    static const int widths[] = {24, 23, 23, 8, 14, 14, 14, 14};
+    vector<CsvColumn> columns;
+    for (int c = 0; c < 8; ++c) {
+        CsvColumn column = {c, names[c], widths[c]};
+        columns.push_back(column);
+    }
+    if (!key.empty()) {
+        columns[0].header = key;
+    }
+
+    WindowAggregator windows(action.window);
+    JsonLinesReader reader(in);
+    JsonObject obj;
+    vector<WindowResult> closed;
+    long long skipped = 0;
+    long long emitted = 0;
+    bool ok;
+    {
+        OutputBuffer out(fd);
+        TableWriter writer(out, action.format, columns, false, delimiter);
+        writer.header();
+        bool more = true;
+        while (more) {
+            more = reader.next(obj);
+            if (more) {
+                const string* k = key.empty() ? NULL : obj.find(key);
+                const string* t = obj.find(action.time);
+                const string* v = obj.find(action.value);
+                int64_t millis;
+                double value;
+                if (t == NULL || v == NULL || !parseTimestamp(*t, millis) || !RecordMapper::parseDouble(*v, value)) {
+                    ++skipped;
+                    continue;
+                }
+                windows.add(windows.keyId(k ? *k : string()), millis, value);
+            } else {
+                windows.flush();
+            }
+            windows.drain(closed);
+            for (size_t i = 0; i < closed.size(); ++i) {
+                const WindowResult& w = closed[i];
+                writer.field(windows.keyName(w.key));
+                writer.field(formatTimestamp(w.start));
+                writer.field(formatTimestamp(w.end));
+                writer.field(w.count);
+                writer.field(w.sum);
+                writer.field(w.avg());
+                writer.field(w.min);
+                writer.field(w.max);
+                writer.endRow();
+            }
+            emitted += (long long)closed.size();
+            closed.clear();
+        }
+        ok = out.ok();
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    if (fd != 1) {
+        close(fd);
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ Windowed " : "✗ Failed windowing ") << windows.events() << " events into "
+         << emitted << " windows" << RESET << " (" << windows.late() << " late, " << skipped << " skipped) in "
+         << fixed << setprecision(3) << seconds << " s\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+bool runProfile(DBsystem& db, const CliAction& action, char delimiter) {
+    Profile profile;
+    ProfileStats stats;
+    string error;
+    const string& source = action.table;
+    if (source == "students" || source == "faculty" || source == "courses" || source == "enrollments") {
+        profileTable(db, source, profile, error, &stats);
+    } else {
+        FILE* in = (source == "-") ? stdin : fopen(source.c_str(), "rb");
+        if (!in) {
+            cerr << RED << "✗ Cannot open " << source << RESET << "\n";
+            return false;
+        }
+        ProfileOptions options;
+        options.threads = action.threads;
+        profileJson(in, options, profile, &stats);
+        if (in != stdin) {
+            fclose(in);
+        }
+    }
+
+    int fd = (action.path == "-") ? 1 : open(action.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << RED << "✗ Cannot create " << action.path << RESET << "\n";
+        return false;
+    }
+    bool ok;
+    {
+        OutputBuffer out(fd);
+        writeProfile(profile, out, action.format, delimiter);
+        ok = out.ok();
+    }
+    if (fd != 1) {
+        close(fd);
+    }
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ Profiled " : "✗ Failed profiling ") << stats.rows << " rows, "
+         << profile.columns().size() << " columns" << RESET << " (" << stats.threads
+         << (stats.threads == 1 ? " thread" : " threads");
+    if (stats.malformed > 0) {
+        cerr << ", " << stats.malformed << " malformed";
+    }
+    cerr << ") in " << fixed << setprecision(3) << stats.seconds << " s\n";
+    cerr.unsetf(ios::floatfield);
+    return ok;
+}
+
+DBServer* g_server = NULL;  // for the signal handler
+
+void stopServer(int) {
+    if (g_server != NULL) {
+        g_server->stop();
+    }
+}
+
+// Serves the database until SIGINT or SIGTERM
+bool runServer(DBsystem& db, const string& address) {
+    DBServer server(db);
+    string error;
+    if (!server.listen(address, error)) {
+        cerr << RED << "✗ Cannot serve: " << error << RESET << "\n";
+        return false;
+    }
+    g_server = &server;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopServer;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    cerr << GREEN << "✓ Serving on " << address << RESET << " (Ctrl-C to stop)\n";
+    bool ok = server.run(error);
+    g_server = NULL;
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    const ServerStats& stats = server.stats();
+    cerr << (ok ? GREEN : RED) << (ok ? "✓ Stopped: " : "✗ Server failed: ") << RESET << (ok ? "" : error + "; ")
+         << stats.requests << " requests in " << stats.reads << " read batches from " << stats.connections
+         << " connections\n";
+    return ok;
+}
+
+bool runAction(DBsystem& db, const CliAction& action, const RecordMapper& mapper, char delimiter,
+               Validator& validator) {
+    bool faculty = action.table == "faculty";
+
+    if (action.kind == "open" || action.kind == "save") {
+        string error;
+        typedef chrono::steady_clock Clock;
+        Clock::time_point start = Clock::now();
+        bool ok = (action.kind == "open") ? db.open(action.path, error) : db.save(action.path, error);
+        double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+        if (!ok) {
+            cerr << RED << "✗ " << action.kind << " failed: " << error << RESET << "\n";
+            return false;
+        }
+        cerr << GREEN << "✓ " << (action.kind == "open" ? "Opened " : "Saved ") << action.path << RESET
+             << " (" << db.studentCount() << " students, " << db.facultyCount() << " faculty) in "
+             << fixed << setprecision(2) << ms << " ms\n";
+        cerr.unsetf(ios::floatfield);
+        return true;
+    }
+
+    if (action.kind == "wal") {
+        string error;
+        ReplayStats stats;
+        if (!db.attachLog(action.path, action.sync, error, &stats)) {
+            cerr << RED << "✗ Cannot use log: " << error << RESET << "\n";
+            return false;
+        }
+        cerr << GREEN << "✓ Replayed " << stats.records << " log records from " << action.path << RESET;
+        if (stats.skipped > 0) {
+            cerr << " (" << stats.skipped << " already in the snapshot)";
+        }
+        if (stats.truncatedBytes > 0) {
+            cerr << YELLOW << " (dropped " << stats.truncatedBytes << " bytes of torn tail)" << RESET;
+        }
+        cerr << "\n";
+        return true;
+    }
+
+    if (action.kind == "data-dir") {
+        string error;
+        RecoveryStats stats;
+        CheckpointPolicy policy;
+        policy.sync = action.sync;
+        if (!db.openDurable(action.path, policy, error, &stats)) {
+            cerr << RED << "✗ Recovery failed: " << error << RESET << "\n";
+            return false;
+        }
+        cerr << GREEN << "✓ Recovered " << action.path << RESET << " (" << (stats.base ? "base + " : "")
+             << stats.deltas << " deltas, " << stats.deltaRecords << " records; " << stats.segments
+             << " log segments, " << stats.logRecords << " records) in " << fixed << setprecision(3)
+             << stats.seconds << " s\n";
+        cerr.unsetf(ios::floatfield);
+        return true;
+    }
+
+    if (action.kind == "checkpoint") {
+        string error;
+        if (!db.checkpoint(error)) {
+            cerr << RED << "✗ Checkpoint failed: " << error << RESET << "\n";
+            return false;
+        }
+        cerr << GREEN << "✓ Checkpoint written" << RESET << "\n";
+        return true;
+    }
+
+    if (action.kind == "verify") {
+        bool ok = db.verifySnapshot();
+        cerr << (ok ? GREEN + "✓ Snapshot checksum OK" : RED + "✗ Snapshot checksum mismatch") << RESET << "\n";
+        return ok;
+    }
+
+    if (action.kind == "join" || action.kind == "transcript") {
+        TranscriptIndex index;
+        index.build(db);
+        if (action.kind == "join") {
+            reportJoin("enrollments x courses", index.courseJoin(), index.unmatchedCourses());
+            reportJoin("enrollments x students", index.studentJoin(), index.unmatchedStudents());
+            return true;
+        }
+        int id;
+        Transcript transcript;
+        if (!RecordMapper::parseId(action.path, id, mapper.studentPrefix()) || !index.lookup(db, id, transcript)) {
+            cerr << RED << "✗ No student or enrollments for " << action.path << RESET << "\n";
+            return false;
+        }
+        printTranscript(transcript);
+        return true;
+    }
+
+    if (action.kind == "scd2") {
+        int64_t at = action.at;
+        if (action.path == "now") {
+            at = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        }
+        db.setStudentVersionTime(at);
+        if (db.studentsVersioned()) {
+            cerr << GREEN << "✓ Keeping student history" << RESET << " (changes take effect at "
+                 << formatTimestamp(at) << ")\n";
+        }
+        return true;
+    }
+
+    if (action.kind == "as-of") {
+        int id;
+        VersionSpan span;
+        const Student* student = RecordMapper::parseId(action.path, id, mapper.studentPrefix())
+                                     ? db.findStudentAsOf(id, action.at, &span)
+                                     : NULL;
+        if (student == NULL) {
+            cerr << RED << "✗ No version of student " << action.path << " at " << formatTimestamp(action.at) << RESET
+                 << "\n";
+            return false;
+        }
+        const vector<VersionSpan>* chain = db.studentHistory().chain(id);
+        cout << BOLD << *student << RESET << "\n  effective "
+             << (span.from == VERSION_START ? string("from the start") : "from " + formatTimestamp(span.from))
+             << (span.to == VERSION_OPEN ? string(", current") : " to " + formatTimestamp(span.to)) << " ("
+             << (chain != NULL ? chain->size() : 1) << (chain != NULL && chain->size() > 1 ? " versions)\n" : " version)\n");
+        return true;
+    }
+
+    if (action.kind == "aggregate") {
+        return runAggregate(db, action, delimiter);
+    }
+
+    if (action.kind == "window") {
+        return runWindow(action, delimiter);
+    }
+
+    if (action.kind == "profile") {
+        return runProfile(db, action, delimiter);
+    }
+
+    if (action.kind == "serve") {
+        return runServer(db, action.path);
+    }
+
+    if (action.kind == "index") {
+        string error;
+        if (!db.setTableIndex(action.table, action.path == "skiplist" ? INDEX_SKIPLIST : INDEX_TREE, error)) {
+            cerr << RED << "✗ " << error << RESET << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    if (action.kind == "export" && (action.threads != 1 || action.shards > 0)) {
+        ParallelExportOptions options;
+        options.threads = action.threads;
+        options.shards = action.shards;
+        options.delimiter = delimiter;
+        ParallelExportStats stats;
+        string error;
+        bool ok = exportTableParallel(db, faculty, action.path, action.columns, action.format, options, stats, error);
+        if (!ok) {
+            cerr << RED << "✗ Failed exporting " << action.table << ": " << error << RESET << "\n";
+            return false;
+        }
+        cerr << GREEN << "✓ Exported " << stats.rows << " " << action.table << " to " << action.path << RESET
+             << " (" << stats.parts << (action.shards > 0 ? " shards, " : " ranges, ") << stats.threads
+             << " threads, " << fixed << setprecision(1) << stats.bytes / 1048576.0 / stats.seconds << " MiB/s)\n";
+        cerr.unsetf(ios::floatfield);
+        return true;
+    }
+
+    if (action.kind == "export") {
+        int fd = (action.path == "-") ? 1 : open(action.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            cerr << RED << "✗ Cannot create " << action.path << RESET << "\n";
+            return false;
+        }
+        long long rows;
+        bool ok;
+        {
+            OutputBuffer out(fd);
+            rows = faculty ? exportFaculty(db, out, action.columns, action.format, delimiter)
+                           : exportStudents(db, out, action.columns, action.format, delimiter);
+            ok = out.ok();
+        }
+        if (fd != 1) {
+            close(fd);
+        }
+        cerr << (ok ? GREEN : RED) << (ok ? "✓ Exported " : "✗ Failed exporting ") << rows << " "
+             << action.table << " to " << action.path << RESET << "\n";
+        return ok;
+    }
+
+    FILE* in = (action.path == "-") ? stdin : fopen(action.path.c_str(), "rb");
+    if (!in) {
+        cerr << RED << "✗ Cannot open " << action.path << RESET << "\n";
+        return false;
+    }
+    IngestStats stats;
+    Validator* rules = validator.empty() ? NULL : &validator;
+    if (action.kind == "ingest") {
+        stats = ingestJsonLines(db, in, mapper, 8192, rules);
+    } else {
+        stats = faculty ? importFacultyCsv(db, in, mapper, delimiter, rules)
+                        : importStudentsCsv(db, in, mapper, delimiter, rules);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    reportLoad(stats, action.path);
+    if (rules != NULL) {
+        reportValidation(validator);
+    }
+    if (db.logFailed()) {
+        cerr << RED << "✗ The log has a write error: " << action.path << " is not durable" << RESET << "\n";
+        return false;
+    }
+    return true;
+}
+
+void printUsage(const char* prog) {
+    cerr << "Usage: " << prog << " [options]\n"
+         << "  --ingest <file|->                    load JSON Lines / JSON array\n"
+         << "  --import-csv <students|faculty> <file|->\n"
+         << "  --export-csv <students|faculty> <file|->\n"
+         << "  --export <students|faculty> <file|->\n"
+         << "  --format <csv|json|fixed>            format for the next --export (default csv)\n"
+         << "  --threads <n>                        export by key range on n threads (0 = all cores)\n"
+         << "  --shards <n>                         next export leaves n part files\n"
+         << "  --columns <id,name=full_name:40,...> columns (and fixed widths) for the next export\n"
+         << "  --delimiter <c>                      CSV field separator (default ,)\n"
+         << "  --map <table.field=source>           remap an input field\n"
+         << "  --validate <rule|university>         reject loaded rows that break a rule, e.g.\n"
+         << "                                       range(student.gpa,0,4), required(student.name),\n"
+         << "                                       pattern(student.email,email), exists(student.advisor),\n"
+         << "                                       oneof(student.level,A|B), warn:<rule>\n"
+         << "  --open <file>                        map a snapshot (records load on first use)\n"
+         << "  --verify                             checksum the opened snapshot\n"
+         << "  --save <file>                        write a snapshot\n"
+         << "  --wal <file>                         replay, then log all changes to file\n"
+         << "  --sync <every|group|async>           durability for the next --wal/--data-dir (default group)\n"
+         << "  --data-dir <dir>                     recover, then log and checkpoint into dir\n"
+         << "  --checkpoint                         checkpoint the data directory now\n"
+         << "  --join                               join enrollments to courses and students, report\n"
+         << "  --transcript <student id>            print a student's courses, credits and GPA\n"
+         << "  --aggregate <table|file> <file|->    group-by aggregation, written like --export\n"
+         << "  --group-by <field,...>               grouping for the next --aggregate\n"
+         << "  --metric <name=func(field)>          sum avg count min max count_distinct first last std\n"
+         << "  --having <metric op value>           keep groups where e.g. avg_gpa>=3.5\n"
+         << "  --window <file|-> <file|->           windowed count/sum/avg/min/max per --group-by key\n"
+         << "  --value <field> [--time <field>]     field to aggregate, event time (default timestamp)\n"
+         << "  --window-size <s> [--slide <s>]      window length and step in seconds (tumbling if equal)\n"
+         << "  --lateness <s>                       accept events this far behind the newest one\n"
+         << "  --profile <table|file> <file|->      column profile (--threads workers), written like --export\n"
+         << "  --scd2 <time|now|off>                keep student history: later loads close changed\n"
+         << "                                       versions at that time (ISO UTC or epoch seconds)\n"
+         << "  --as-of <time> <student id>          print the student version effective at a time\n"
+         << "  --index <table=tree|skiplist>        index for courses or enrollments (before loading them)\n"
+         << "  --io <uring|sync>                    file I/O for loads, exports and saves (default uring)\n"
+         << "  --pool <threads>                     size of the shared task pool for parallel exports,\n"
+         << "                                       profiles, joins and loads (default one per core)\n"
+         << "  --pin                                pin pool workers to cores 1, 2, ...\n"
+         << "  --serve <unix:/path|tcp:[host:]port> serve find/add/delete/scan until Ctrl-C\n";
+}
+
+int main(int argc, char* argv[])
 {
     DBsystem db;
     int choice;
+    RecordMapper mapper;
+    Validator validator;
+    vector<CliAction> actions;
+    string columnSpec;
+    ExportFormat format = EXPORT_CSV;
+    int threads = 1;
+    int shards = 0;
+    int poolThreads = 0;
+    bool pinPool = false;
+    char delimiter = ',';
+    SyncPolicy sync = SYNC_GROUP;
+    AggQuery query;
+    WindowSpec window;
+    string windowValue;
+    string windowTime = "timestamp";
+    bool batch = false;  // stdin or stdout carries data, so no menu afterwards
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--ingest" && i + 1 < argc) {
+            CliAction a;
+            a.kind = "ingest";
+            a.path = argv[++i];
+            batch = batch || a.path == "-";
+            actions.push_back(a);
+        } else if ((arg == "--import-csv" || arg == "--export-csv" || arg == "--export") && i + 2 < argc) {
+            CliAction a;
+            a.kind = (arg == "--import-csv") ? "import-csv" : "export";
+            a.format = (arg == "--export") ? format : EXPORT_CSV;
+            a.threads = threads;
+            a.shards = shards;
+            a.table = argv[++i];
+            a.path = argv[++i];
+            bool faculty = a.table == "faculty";
+            if (!faculty && a.table != "students") {
+                printUsage(argv[0]);
+                return 1;
+            }
+            if (a.kind == "export") {
+                a.columns = faculty ? defaultFacultyColumns() : defaultStudentColumns();
+                if (!columnSpec.empty() && !parseCsvColumns(columnSpec, faculty, a.columns)) {
+                    cerr << RED << "✗ Bad column list: " << columnSpec << RESET << "\n";
+                    return 1;
+                }
+                columnSpec.clear();
+                format = EXPORT_CSV;
+                shards = 0;
+                batch = true;
+            } else {
+                batch = batch || a.path == "-";
+            }
+            actions.push_back(a);
+        } else if ((arg == "--open" || arg == "--save") && i + 1 < argc) {
+            CliAction a;
+            a.kind = arg.substr(2);
+            a.path = argv[++i];
+            actions.push_back(a);
+        } else if ((arg == "--wal" || arg == "--data-dir") && i + 1 < argc) {
+            CliAction a;
+            a.kind = arg.substr(2);
+            a.path = argv[++i];
+            a.sync = sync;
+            actions.push_back(a);
+        } else if (arg == "--sync" && i + 1 < argc) {
+            if (!WriteAheadLog::parsePolicy(argv[++i], sync)) {
+                cerr << RED << "✗ Unknown sync policy: " << argv[i] << RESET << "\n";
+                return 1;
+            }
+        } else if (arg == "--verify" || arg == "--checkpoint" || arg == "--join") {
+            CliAction a;
+            a.kind = arg.substr(2);
+            actions.push_back(a);
+        } else if (arg == "--io" && i + 1 < argc) {
+            string io = argv[++i];
+            if (io != "uring" && io != "sync") {
+                cerr << RED << "✗ Unknown I/O backend: " << io << RESET << "\n";
+                return 1;
+            }
+            IoRing::setEnabled(io == "uring");
+        } else if ((arg == "--pool" && i + 1 < argc) || arg == "--pin") {
+            if (arg == "--pool") {
+                poolThreads = atoi(argv[++i]);
+                if (poolThreads < 0) {
+                    printUsage(argv[0]);
+                    return 1;
+                }
+            } else {
+                pinPool = true;
+            }
+            TaskScheduler::configureShared(poolThreads, pinPool ? TaskScheduler::PIN_CORES : TaskScheduler::PIN_NONE);
+        } else if (arg == "--serve" && i + 1 < argc) {
+            CliAction a;
+            a.kind = "serve";
+            a.path = argv[++i];
+            batch = true;
+            actions.push_back(a);
+        } else if (arg == "--index" && i + 1 < argc) {
+            // Takes effect in command-line order, so it goes before the loads
+            CliAction a;
+            a.kind = "index";
+            string spec = argv[++i];
+            size_t eq = spec.find('=');
+            a.table = spec.substr(0, eq);
+            a.path = eq == string::npos ? "" : spec.substr(eq + 1);
+            if (a.path != "tree" && a.path != "skiplist") {
+                cerr << RED << "✗ Bad --index (table=tree|skiplist): " << spec << RESET << "\n";
+                return 1;
+            }
+            actions.push_back(a);
+        } else if (arg == "--aggregate" && i + 2 < argc) {
+            CliAction a;
+            a.kind = "aggregate";
+            a.table = argv[++i];
+            a.path = argv[++i];
+            a.format = format;
+            if (query.metrics.empty()) {
+                AggMetric count = {"count", AGG_COUNT, ""};
+                query.metrics.push_back(count);
+            }
+            a.query = query;
+            query = AggQuery();
+            format = EXPORT_CSV;
+            batch = true;
+            actions.push_back(a);
+        } else if (arg == "--profile" && i + 2 < argc) {
+            CliAction a;
+            a.kind = "profile";
+            a.table = argv[++i];
+            a.path = argv[++i];
+            a.format = format;
+            a.threads = threads;
+            format = EXPORT_CSV;
+            batch = true;
+            actions.push_back(a);
+        } else if (arg == "--window" && i + 2 < argc) {
+            CliAction a;
+            a.kind = "window";
+            a.table = argv[++i];
+            a.path = argv[++i];
+            a.format = format;
+            a.query = query;
+            a.window = window;
+            a.value = windowValue;
+            a.time = windowTime;
+            if (a.value.empty()) {
+                cerr << RED << "✗ --window needs --value <field>" << RESET << "\n";
+                return 1;
+            }
+            query = AggQuery();
+            format = EXPORT_CSV;
+            batch = true;
+            actions.push_back(a);
+        } else if ((arg == "--window-size" || arg == "--slide" || arg == "--lateness") && i + 1 < argc) {
+            double seconds;
+            if (!RecordMapper::parseDouble(argv[++i], seconds) || seconds < 0 ||
+                (seconds * 1000.0 < 1.0 && arg != "--lateness")) {
+                cerr << RED << "✗ Bad " << arg << ": " << argv[i] << RESET << "\n";
+                return 1;
+            }
+            int64_t millis = int64_t(seconds * 1000.0);
+            if (arg == "--window-size") {
+                // A new size resets the slide to tumbling unless --slide follows
+                window.size = millis;
+                window.slide = millis;
+            } else if (arg == "--slide") {
+                window.slide = millis;
+            } else {
+                window.lateness = millis;
+            }
+        } else if ((arg == "--value" || arg == "--time") && i + 1 < argc) {
+            (arg == "--value" ? windowValue : windowTime) = argv[++i];
+        } else if (arg == "--group-by" && i + 1 < argc) {
+            string list = argv[++i];
+            query.groupBy.clear();
+            for (size_t start = 0; start < list.size();) {
+                size_t comma = list.find(',', start);
+                if (comma == string::npos) {
+                    comma = list.size();
+                }
+                if (comma > start) {
+                    query.groupBy.push_back(list.substr(start, comma - start));
+                }
+                start = comma + 1;
+            }
+        } else if (arg == "--metric" && i + 1 < argc) {
+            AggMetric metric;
+            if (!parseAggMetric(argv[++i], metric)) {
+                cerr << RED << "✗ Bad metric: " << argv[i] << RESET << "\n";
+                return 1;
+            }
+            query.metrics.push_back(metric);
+        } else if (arg == "--having" && i + 1 < argc) {
+            HavingClause clause;
+            if (!parseHaving(argv[++i], clause)) {
+                cerr << RED << "✗ Bad HAVING filter: " << argv[i] << RESET << "\n";
+                return 1;
+            }
+            query.having.push_back(clause);
+        } else if (arg == "--scd2" && i + 1 < argc) {
+            // Takes effect in command-line order, so loads can be given different times
+            CliAction a;
+            a.kind = "scd2";
+            a.path = argv[++i];
+            if (a.path == "off") {
+                a.at = VERSION_START;
+            } else if (a.path != "now" && !parseTimestamp(a.path, a.at)) {
+                cerr << RED << "✗ Bad --scd2 time: " << a.path << RESET << "\n";
+                return 1;
+            }
+            actions.push_back(a);
+        } else if (arg == "--as-of" && i + 2 < argc) {
+            CliAction a;
+            a.kind = "as-of";
+            if (!parseTimestamp(argv[++i], a.at)) {
+                cerr << RED << "✗ Bad --as-of time: " << argv[i] << RESET << "\n";
+                return 1;
+            }
+            a.path = argv[++i];
+            batch = true;
+            actions.push_back(a);
+        } else if (arg == "--transcript" && i + 1 < argc) {
+            CliAction a;
+            a.kind = "transcript";
+            a.path = argv[++i];
+            batch = true;
+            actions.push_back(a);
+        } else if ((arg == "--threads" || arg == "--shards") && i + 1 < argc) {
+            int n = atoi(argv[++i]);
+            if (n < 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            (arg == "--threads" ? threads : shards) = n;
+        } else if (arg == "--format" && i + 1 < argc) {
+            if (!parseExportFormat(argv[++i], format)) {
+                cerr << RED << "✗ Unknown export format: " << argv[i] << RESET << "\n";
+                return 1;
+            }
+        } else if (arg == "--columns" && i + 1 < argc) {
+            columnSpec = argv[++i];
+        } else if (arg == "--delimiter" && i + 1 < argc && strlen(argv[i + 1]) == 1) {
+            delimiter = argv[++i][0];
+        } else if (arg == "--validate" && i + 1 < argc) {
+            string error;
+            if (string(argv[++i]) == "university") {
+                validator.addUniversityRules();
+            } else if (!validator.addRule(argv[i], error)) {
+                cerr << RED << "✗ Bad rule: " << error << RESET << "\n";
+                return 1;
+            }
+        } else if (arg == "--map" && i + 1 < argc) {
+            if (!mapper.parseMapping(argv[++i])) {
+                cerr << RED << "✗ Bad mapping: " << argv[i] << RESET << "\n";
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < actions.size(); ++i) {
+        if (!runAction(db, actions[i], mapper, delimiter, validator)) {
+            return 1;
+        }
+    }
+    if (batch) {
+        cerr << "Students: " << db.studentCount() << ", Faculty: " << db.facultyCount() << "\n";
+        return 0;
+    }
     
     clearScreen();
     displayBanner();
@@ -241,6 +1221,9 @@ int main()
         displayMainMenu();
         
         if (!(cin >> choice)) {
+            if (cin.eof()) {
+                return 0;  // input closed (scripted run)
+            }
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
             cout << RED << "Invalid input. Please enter a number." << RESET << "\n";
@@ -262,7 +1245,7 @@ int main()
                 db.displayAllStudents();
                 break;
             case 5:
-                cout << "\n" << CYAN << "Total Students: " << RESET << "(display all to see)\n";
+                cout << "\n" << CYAN << "Total Students: " << RESET << db.studentCount() << "\n";
                 break;
             case 6:
                 addFacultyInteractive(db);
@@ -278,7 +1261,7 @@ int main()
                 db.displayAllFaculty();
                 break;
             case 10:
-                cout << "\n" << YELLOW << "Total Faculty: " << RESET << "(display all to see)\n";
+                cout << "\n" << YELLOW << "Total Faculty: " << RESET << db.facultyCount() << "\n";
                 break;
             case 11:
                 loadSampleData(db);
@@ -288,7 +1271,7 @@ int main()
                 char confirm;
                 cin >> confirm;
                 if (confirm == 'y' || confirm == 'Y') {
-                    db = DBsystem();  // Reset database
+                    db.clear();  // Reset database
                     cout << GREEN << "✓ Database cleared." << RESET << "\n";
                 }
                 break;
@@ -298,6 +1281,12 @@ int main()
             case 14:
                 cout << "\n" << GREEN << "Goodbye! Database session ended." << RESET << "\n\n";
                 return 0;
+            case 15:
+                saveSnapshotInteractive(db);
+                break;
+            case 16:
+                openSnapshotInteractive(db);
+                break;
             default:
                 cout << RED << "Invalid choice. Please try again." << RESET << "\n";
         }